@@ -47,6 +47,9 @@ public struct Com_Google_Companionprotos_VersionExchange {
 
   public var maxSupportedSecurityVersion: Int32 = 0
 
+  /// Bit set of optional secure channel features the device supports.
+  public var supportedChannelCapabilities: UInt32 = 0
+
   public var unknownFields = SwiftProtobuf.UnknownStorage()
 
   public init() {}
@@ -63,6 +66,7 @@ extension Com_Google_Companionprotos_VersionExchange: SwiftProtobuf.Message, Swi
     2: .standard(proto: "max_supported_messaging_version"),
     3: .standard(proto: "min_supported_security_version"),
     4: .standard(proto: "max_supported_security_version"),
+    5: .standard(proto: "supported_channel_capabilities"),
   ]
 
   public mutating func decodeMessage<D: SwiftProtobuf.Decoder>(decoder: inout D) throws {
@@ -75,6 +79,7 @@ extension Com_Google_Companionprotos_VersionExchange: SwiftProtobuf.Message, Swi
       case 2: try { try decoder.decodeSingularInt32Field(value: &self.maxSupportedMessagingVersion) }()
       case 3: try { try decoder.decodeSingularInt32Field(value: &self.minSupportedSecurityVersion) }()
       case 4: try { try decoder.decodeSingularInt32Field(value: &self.maxSupportedSecurityVersion) }()
+      case 5: try { try decoder.decodeSingularUInt32Field(value: &self.supportedChannelCapabilities) }()
       default: break
       }
     }
@@ -93,6 +98,9 @@ extension Com_Google_Companionprotos_VersionExchange: SwiftProtobuf.Message, Swi
     if self.maxSupportedSecurityVersion != 0 {
       try visitor.visitSingularInt32Field(value: self.maxSupportedSecurityVersion, fieldNumber: 4)
     }
+    if self.supportedChannelCapabilities != 0 {
+      try visitor.visitSingularUInt32Field(value: self.supportedChannelCapabilities, fieldNumber: 5)
+    }
     try unknownFields.traverse(visitor: &visitor)
   }
 
@@ -101,6 +109,7 @@ extension Com_Google_Companionprotos_VersionExchange: SwiftProtobuf.Message, Swi
     if lhs.maxSupportedMessagingVersion != rhs.maxSupportedMessagingVersion {return false}
     if lhs.minSupportedSecurityVersion != rhs.minSupportedSecurityVersion {return false}
     if lhs.maxSupportedSecurityVersion != rhs.maxSupportedSecurityVersion {return false}
+    if lhs.supportedChannelCapabilities != rhs.supportedChannelCapabilities {return false}
     if lhs.unknownFields != rhs.unknownFields {return false}
     return true
   }
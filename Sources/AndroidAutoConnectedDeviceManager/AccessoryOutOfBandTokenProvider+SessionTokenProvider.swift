@@ -26,12 +26,21 @@
 
   extension AccessoryOutOfBandTokenProvider {
     /// Token provider for a given EASession.
+    ///
+    /// The accessory sends its token some time after the session opens. Requests made before then
+    /// wait for the token rather than resolving without one, so a request made ahead of time (e.g.
+    /// when an association scan starts) is answered as soon as the token arrives.
     class SessionTokenProvider: NSObject {
       private static let log = Logger(for: SessionTokenProvider.self)
       private let session: EASession
       private var reader: StreamReader!
+
+      private let lock = NSLock()
       private var token: OutOfBandToken?
 
+      /// Requests waiting for the accessory to send a token.
+      private var pendingCompletions: [(OutOfBandToken?) -> Void] = []
+
       var accessory: EAAccessory? { session.accessory }
       var isConnected: Bool { accessory?.isConnected ?? false }
 
@@ -52,7 +61,7 @@
 
         self.reader = StreamReader(stream: inputStream) { [weak self] token in
           Self.log("Stream reader parsed token.")
-          self?.token = token
+          self?.receive(token)
         }
         accessory.delegate = self
 
@@ -76,7 +85,18 @@
         reader.invalidate()
         // Close the output stream for proper cleanup even though we never directly open it.
         session.outputStream?.close()
-        token = nil
+        reset()
+      }
+
+      /// Stores the token and resolves the requests waiting for it.
+      private func receive(_ token: OutOfBandToken) {
+        lock.lock()
+        self.token = token
+        let completions = pendingCompletions
+        pendingCompletions = []
+        lock.unlock()
+
+        completions.forEach { $0(token) }
       }
     }
   }
@@ -84,12 +104,44 @@
   // MARK: - OutOfBandTokenProvider Conformance
 
   extension AccessoryOutOfBandTokenProvider.SessionTokenProvider: OutOfBandTokenProvider {
+    /// Removes the token and resolves the requests waiting for one without it.
     func reset() {
+      lock.lock()
       token = nil
+      lock.unlock()
+
+      cancelPendingRequests()
     }
 
+    /// Resolves the requests waiting for the accessory without a token.
+    ///
+    /// A token that arrives later is kept for the next request.
+    func cancelPendingRequests() {
+      lock.lock()
+      let completions = pendingCompletions
+      pendingCompletions = []
+      lock.unlock()
+
+      if !completions.isEmpty {
+        Self.log("Cancelling \(completions.count) pending token requests.")
+      }
+      completions.forEach { $0(nil) }
+    }
+
+    /// Resolves the request with the token, or once the accessory has sent one.
+    ///
+    /// - Parameter completion: The handler to call when the request is resolved.
     func requestToken(completion: @escaping (OutOfBandToken?) -> Void) {
-      Self.log("Requested token available: \(token != nil)")
+      lock.lock()
+      guard let token = token else {
+        pendingCompletions.append(completion)
+        lock.unlock()
+        Self.log("Waiting for the accessory to send a token.")
+        return
+      }
+      lock.unlock()
+
+      Self.log("Requested token available.")
       completion(token)
     }
   }
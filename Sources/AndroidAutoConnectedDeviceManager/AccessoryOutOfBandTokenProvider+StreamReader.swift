@@ -30,8 +30,14 @@ import Foundation
       /// The input stream from which to read the tokens.
       private let stream: InputStream
 
-      /// Buffer which processes the input stream data to construct the token.
-      private var buffer: Buffer<Int32> = .empty
+      /// The most bytes a serialized token may have.
+      private static let maxTokenSize = 4_096
+
+      /// Accumulates the bytes of the token being read from the stream.
+      private let buffer = ByteRingBuffer(capacity: maxTokenSize)
+
+      /// Whether the token being read has overflowed `buffer` and must be discarded.
+      private var isDiscardingToken = false
 
       /// Handler which receives the tokens read from the stream.
       private var handler: (OutOfBandToken) -> Void
@@ -80,22 +86,56 @@ import Foundation
 
         guard isOpen, stream.hasBytesAvailable else { return }
 
+        while isOpen, stream.hasBytesAvailable {
+          guard buffer.read(from: stream) >= 0 else {
+            let description = stream.streamError?.localizedDescription ?? "Unknown"
+            Self.log.error("Error reading from the stream: \(description)")
+            reset()
+            return
+          }
+
+          if buffer.isFull, stream.hasBytesAvailable {
+            Self.log.error("Token exceeds \(Self.maxTokenSize) bytes. Discarding it.")
+            buffer.removeAll()
+            isDiscardingToken = true
+          }
+        }
+
+        // A token is written in one burst, so it is complete once the stream has been drained.
+        guard !isDiscardingToken else {
+          reset()
+          return
+        }
+
+        if let token = parseToken() {
+          handler(token)
+        }
+      }
+
+      /// Parses the buffered bytes as a token in place and clears the buffer.
+      private func parseToken() -> OutOfBandToken? {
+        guard !buffer.isEmpty else { return nil }
+        defer { buffer.removeAll() }
+
+        Self.log("Parsing token of \(buffer.count) bytes.")
         do {
-          while isOpen, stream.hasBytesAvailable {
-            try buffer.read(from: stream)
-            if let token = buffer.token {
-              buffer = .empty
-              handler(token)
-            }
+          return try buffer.withContiguousBytes(count: buffer.count) { bytes in
+            let data = Data(
+              bytesNoCopy: UnsafeMutableRawPointer(mutating: bytes.baseAddress!),
+              count: bytes.count,
+              deallocator: .none)
+            return try OutOfBandAssociationToken(serializedData: data)
           }
         } catch {
-          Self.log.error("Error reading the token from the stream: \(error.localizedDescription)")
+          Self.log.error("Error parsing the token from the stream: \(error.localizedDescription)")
+          return nil
         }
       }
 
       /// Reset the buffer to start processing new tokens.
       func reset() {
-        buffer.reset()
+        buffer.removeAll()
+        isDiscardingToken = false
       }
     }
   }
@@ -120,78 +160,4 @@ import Foundation
     }
   }
 
-  // MARK: - StreamReader Buffer
-
-  extension AccessoryOutOfBandTokenProvider.StreamReader {
-    /// Buffer which processes input stream data to parse tokens.
-    private enum Buffer<SizeType: FixedWidthInteger> {
-      private static var log: Logger { Logger(for: Buffer<SizeType>.self) }
-
-      /// Size (bytes) of the buffer for reading data from the stream in chunks.
-      private static var bufferSize: Int { 1_024 }
-
-      /// The buffer is empty awaiting data to process.
-      case empty
-
-      /// Current message under construction assembled from the stream data.
-      case message([UInt8])
-
-      /// A parsed token from a complete message.
-      case token(OutOfBandToken)
-
-      /// A token (if any) read from the stream.
-      var token: OutOfBandToken? {
-        if case let .token(token) = self {
-          return token
-        } else {
-          return nil
-        }
-      }
-
-      /// Reset the buffer to empty, clearing its token.
-      mutating func reset() {
-        self = .empty
-      }
-
-      /// Process the input stream building a message to construct a token.
-      ///
-      /// - Parameter stream: The stream from which to read the message.
-      /// - Throws: An error if the token cannot be parsed or another stream error is encountered.
-      mutating func read(from stream: InputStream) throws {
-        switch self {
-        case .empty, .token(_):
-          try readMessage(from: stream, pending: [])
-        case let .message(pending):
-          try readMessage(from: stream, pending: pending)
-        }
-      }
-
-      private mutating func readMessage(
-        from stream: InputStream,
-        pending: [UInt8]
-      ) throws {
-        Self.log("Read message pending: \(pending.count)")
-        let maxLength = Self.bufferSize
-        Self.log("Read message maxLength: \(maxLength)")
-        var buffer: [UInt8] = Array(repeating: 0, count: maxLength)
-        let readCount = stream.read(&buffer, maxLength: buffer.count)
-        guard readCount > 0 else { return }
-
-        Self.log("Read message readCount: \(readCount)")
-        let message = pending + Array(buffer[0..<readCount])
-        Self.log("Read message current message length: \(message.count)")
-
-        if stream.hasBytesAvailable {
-          Self.log("Waiting for more data.")
-          self = .message(message)
-        } else {
-          Self.log("Parsing token.")
-          let messageData = Data(message)
-          let token = try OutOfBandAssociationToken(serializedData: messageData)
-          self = .token(token)
-        }
-      }
-    }
-  }
-
 #endif  // ExternalAccessory
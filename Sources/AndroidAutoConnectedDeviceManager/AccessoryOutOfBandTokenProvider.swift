@@ -76,6 +76,10 @@
       source.requestToken(completion: completion)
     }
 
+    func cancelPendingRequests() {
+      source.cancelPendingRequests()
+    }
+
     func reset() {
       source.reset()
     }
@@ -21,6 +21,11 @@ struct AnyOutOfBandTokenProvider: OutOfBandTokenProvider {
   /// Source provider whose type is erased.
   let source: OutOfBandTokenProvider
 
+  /// The name of the source provider, so that metrics are attributed to it.
+  var providerName: String {
+    source.providerName
+  }
+
   /// Prepare the provider for a possible upcoming token request.
   func prepareForRequests() {
     source.prepareForRequests()
@@ -38,6 +43,11 @@ struct AnyOutOfBandTokenProvider: OutOfBandTokenProvider {
     source.requestToken(completion: completion)
   }
 
+  /// Cancels the pending requests of the source provider.
+  func cancelPendingRequests() {
+    source.cancelPendingRequests()
+  }
+
   /// Resets this provider.
   func reset() {
     source.reset()
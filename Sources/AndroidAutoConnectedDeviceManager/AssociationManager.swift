@@ -172,6 +172,9 @@ class AssociationManager: NSObject {
 
   private var messageHelper: AssociationMessageHelper?
 
+  /// The secure channel capabilities the car listed during the version exchange.
+  private var channelCapabilities: SecureChannelCapabilities = []
+
   /// Whether any devices been been previously associated.
   var isAssociated: Bool {
     return associatedCarsManager.count > 0
@@ -310,6 +313,7 @@ class AssociationManager: NSObject {
     carToAssociate = nil
     carId = nil
     messageHelper = nil
+    channelCapabilities = []
   }
 
   /// Checks if the given peripheral has an association characteristic for registering an escrow
@@ -533,6 +537,9 @@ extension AssociationManager: SecureBLEChannelDelegate {
     _ secureBLEChannel: SecureBLEChannel,
     establishedUsing messageStream: MessageStream
   ) {
+    // Must happen before any encrypted message is exchanged, which is the switch point both
+    // sides agree on.
+    secureBLEChannel.negotiateCapabilities(channelCapabilities)
     messageHelper?.onEncryptionEstablished()
   }
 
@@ -585,6 +592,22 @@ extension AssociationManager: BLEVersionResolverDelegate {
     didResolveStreamVersionTo streamVersion: MessageStreamVersion,
     securityVersionTo securityVersion: MessageSecurityVersion,
     for peripheral: BLEPeripheral
+  ) {
+    self.bleVersionResolver(
+      bleVersionResolver,
+      didResolveStreamVersionTo: streamVersion,
+      securityVersionTo: securityVersion,
+      channelCapabilities: 0,
+      for: peripheral
+    )
+  }
+
+  func bleVersionResolver(
+    _ bleVersionResolver: BLEVersionResolver,
+    didResolveStreamVersionTo streamVersion: MessageStreamVersion,
+    securityVersionTo securityVersion: MessageSecurityVersion,
+    channelCapabilities: UInt32,
+    for peripheral: BLEPeripheral
   ) {
     // This shouldn't happen because the version exchange happens after characteristics are
     // discovered.
@@ -604,6 +627,7 @@ extension AssociationManager: BLEVersionResolverDelegate {
       allowsCompression: isMessageCompressionAllowed
     )
     self.messageStream = messageStream
+    self.channelCapabilities = SecureChannelCapabilities(rawValue: channelCapabilities)
     messageStream.delegate = self
 
     let associator = AssociatorProxy(self)
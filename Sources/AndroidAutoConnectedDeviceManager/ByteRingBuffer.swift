@@ -0,0 +1,144 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+import Foundation
+
+/// A fixed-capacity circular buffer of bytes that is filled directly from an `InputStream`.
+///
+/// Bytes are read into the free space of the buffer and consumed from its front without
+/// allocating, so a reader can accumulate and parse messages in place.
+final class ByteRingBuffer {
+  /// The most bytes the buffer can hold.
+  let capacity: Int
+
+  private let storage: UnsafeMutableRawBufferPointer
+
+  /// The offset in `storage` of the first unconsumed byte.
+  private var head = 0
+
+  /// The number of unconsumed bytes.
+  private(set) var count = 0
+
+  var isEmpty: Bool { count == 0 }
+  var isFull: Bool { count == capacity }
+
+  /// Creates an empty buffer.
+  ///
+  /// - Parameter capacity: The most bytes the buffer can hold. Must be positive.
+  init(capacity: Int) {
+    precondition(capacity > 0, "The capacity of a ring buffer must be positive.")
+
+    self.capacity = capacity
+    storage = UnsafeMutableRawBufferPointer.allocate(
+      byteCount: capacity, alignment: MemoryLayout<UInt8>.alignment)
+  }
+
+  deinit {
+    storage.deallocate()
+  }
+
+  /// Returns the unconsumed byte at the given offset from the front of the buffer.
+  subscript(offset: Int) -> UInt8 {
+    precondition(offset >= 0 && offset < count, "Offset \(offset) is out of bounds")
+    return storage[(head + offset) % capacity]
+  }
+
+  /// Reads as many bytes as fit into the free space of the buffer.
+  ///
+  /// The free space may wrap around the end of the storage, in which case the stream is read
+  /// twice.
+  ///
+  /// - Parameter stream: An open stream.
+  /// - Returns: The number of bytes read, `0` if the buffer is full or the stream is at its end,
+  ///   or a negative value if the stream encountered an error.
+  @discardableResult
+  func read(from stream: InputStream) -> Int {
+    var totalReadCount = 0
+
+    while !isFull {
+      let tail = (head + count) % capacity
+      let freeCount = tail >= head ? capacity - tail : head - tail
+      let pointer = storage.baseAddress!.advanced(by: tail).assumingMemoryBound(to: UInt8.self)
+
+      let readCount = stream.read(pointer, maxLength: freeCount)
+      guard readCount > 0 else {
+        return totalReadCount > 0 ? totalReadCount : readCount
+      }
+
+      count += readCount
+      totalReadCount += readCount
+
+      // Only continue into the wrapped space if the stream filled the region at the end.
+      guard readCount == freeCount, stream.hasBytesAvailable else { break }
+    }
+
+    return totalReadCount
+  }
+
+  /// Calls the given closure with the first `byteCount` unconsumed bytes as one contiguous region.
+  ///
+  /// If the bytes wrap around the end of the storage, the contents are first rotated in place so
+  /// that they start at the beginning of the storage.
+  ///
+  /// - Parameters:
+  ///   - byteCount: The number of bytes to expose. Must not exceed `count`.
+  ///   - body: A closure that must not let the pointer escape.
+  func withContiguousBytes<Result>(
+    count byteCount: Int,
+    _ body: (UnsafeRawBufferPointer) throws -> Result
+  ) rethrows -> Result {
+    precondition(byteCount >= 0 && byteCount <= count, "Not enough bytes in the buffer")
+
+    if head + byteCount > capacity {
+      linearize()
+    }
+
+    return try body(UnsafeRawBufferPointer(rebasing: storage[head..<(head + byteCount)]))
+  }
+
+  /// Discards the given number of bytes from the front of the buffer.
+  func consume(_ byteCount: Int) {
+    precondition(byteCount >= 0 && byteCount <= count, "Cannot consume more bytes than held")
+
+    count -= byteCount
+    head = count == 0 ? 0 : (head + byteCount) % capacity
+  }
+
+  /// Discards all bytes in the buffer.
+  func removeAll() {
+    head = 0
+    count = 0
+  }
+
+  /// Rotates the storage so that the unconsumed bytes start at offset zero.
+  private func linearize() {
+    guard head != 0 else { return }
+
+    // Rotating by three reversals needs no scratch space.
+    reverse(0..<head)
+    reverse(head..<capacity)
+    reverse(0..<capacity)
+    head = 0
+  }
+
+  private func reverse(_ range: Range<Int>) {
+    var lower = range.lowerBound
+    var upper = range.upperBound - 1
+    while lower < upper {
+      storage.swapAt(lower, upper)
+      lower += 1
+      upper -= 1
+    }
+  }
+}
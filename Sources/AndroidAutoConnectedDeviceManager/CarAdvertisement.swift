@@ -0,0 +1,55 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+import CoreBluetooth
+import Foundation
+
+/// Typed view of the advertisement of a discovered car.
+///
+/// CoreBluetooth reports advertisements as a `[String: Any]` dictionary. This extracts the fields
+/// needed for name resolution and reconnection once per discovery so that they are not cast again
+/// along the way. The service data is referenced rather than copied.
+struct CarAdvertisement {
+  /// The advertised service UUIDs or `nil` if the advertisement has none.
+  let serviceUUIDs: [CBUUID]?
+
+  /// The advertised local name.
+  let localName: String?
+
+  /// Service data for the association data UUID.
+  let associationData: Data?
+
+  /// Service data for the reconnection data UUID.
+  let reconnectionData: Data?
+
+  /// Parse the advertisement data reported by CoreBluetooth.
+  ///
+  /// - Parameters:
+  ///   - advertisementData: The advertisement data associated with the peripheral discovery.
+  ///   - uuidConfig: A configuration for common UUIDs.
+  init(_ advertisementData: [String: Any], uuidConfig: UUIDConfig) {
+    serviceUUIDs = (advertisementData[CBAdvertisementDataServiceUUIDsKey] as? NSArray)?
+      .compactMap { $0 as? CBUUID }
+    localName = advertisementData[CBAdvertisementDataLocalNameKey] as? String
+
+    let serviceData = advertisementData[CBAdvertisementDataServiceDataKey] as? NSDictionary
+    associationData = serviceData?[uuidConfig.associationDataUUID] as? Data
+    reconnectionData = serviceData?[uuidConfig.reconnectionDataUUID] as? Data
+  }
+
+  /// Returns `true` if the advertisement includes the specified service UUID.
+  func advertisesService(_ uuid: CBUUID) -> Bool {
+    serviceUUIDs?.contains(uuid) ?? false
+  }
+}
@@ -78,41 +78,87 @@ struct CarAuthenticatorImpl: CarAuthenticator {
   /// Size of the hash in bytes (SHA256)
   private static let hashSize = Int(CC_SHA256_DIGEST_LENGTH)
 
-  /// Processes the advertisement data.
-  enum Advertisement {
+  /// The truncated HMAC and padded salt of a reconnection advertisement.
+  ///
+  /// The advertised data is 11 bytes in total length. The first three bytes is the truncated
+  /// HMAC and the remaining eight bytes are the salt. The actual salt used to compute the HMAC
+  /// was zero padded with eight additional bytes.
+  ///
+  /// Both parts are held inline so that matching an advertisement against each associated car
+  /// does not allocate.
+  struct Advertisement {
     enum PartitionError: Error {
       case invalidLength
     }
 
     /// Total length of the advertisement data in bytes.
-    private static let totalLength = 11
+    static let totalLength = 11
 
     /// Length of the truncated HMAC in bytes.
     private static let truncatedHMACLength = 3
 
-    /// Length of the zero padding to append to the advertised salt.
-    private static let saltZeroPaddingLength = 8
+    /// The truncated HMAC bytes, big endian in the low 24 bits.
+    private let truncatedHMAC: UInt32
+
+    /// The advertised salt followed by its zero padding, in memory order.
+    private let paddedSalt: (salt: UInt64, zeroPadding: UInt64)
+
+    /// The truncated HMAC as data.
+    var truncatedHMACData: Data {
+      Data([
+        UInt8(truncatingIfNeeded: truncatedHMAC >> 16),
+        UInt8(truncatingIfNeeded: truncatedHMAC >> 8),
+        UInt8(truncatingIfNeeded: truncatedHMAC),
+      ])
+    }
+
+    /// The padded salt as data.
+    var paddedSaltData: Data {
+      withUnsafePaddedSalt { Data($0) }
+    }
 
     /// Partition the advertised data into the truncated HMAC and padded salt.
     ///
-    /// The advertised data is 11 bytes in total length. The first three bytes is the truncated
-    /// HMAC and the remaining eight bytes are the salt. The actual salt used to compute the HMAC
-    /// was zero padded with eight additional bytes.
-    ///
     /// - Parameter advertisement: The advertisement data.
-    /// - Returns: A tuple of the truncated HMAC and padded salt.
     /// - Throws: An error if the advertisement cannot be partitioned as expected.
-    static func partition(advertisement: Data) throws -> (truncatedHMAC: Data, paddedSalt: Data) {
-      guard advertisement.count == totalLength else {
+    init(_ advertisement: Data) throws {
+      guard advertisement.count == Self.totalLength else {
         throw PartitionError.invalidLength
       }
 
-      let truncatedHMAC = advertisement[0..<truncatedHMACLength]
-      let salt = advertisement[truncatedHMACLength...]
-      let paddedSaltBytes = Array(salt) + Array(repeating: 0, count: saltZeroPaddingLength)
-      let paddedSalt = Data(bytes: paddedSaltBytes, count: paddedSaltBytes.count)
+      var truncatedHMAC: UInt32 = 0
+      var salt: UInt64 = 0
+      advertisement.withUnsafeBytes { bytes in
+        for byte in bytes[0..<Self.truncatedHMACLength] {
+          truncatedHMAC = truncatedHMAC << 8 | UInt32(byte)
+        }
+        withUnsafeMutableBytes(of: &salt) {
+          $0.copyMemory(
+            from: UnsafeRawBufferPointer(rebasing: bytes[Self.truncatedHMACLength...]))
+        }
+      }
+
+      self.truncatedHMAC = truncatedHMAC
+      paddedSalt = (salt: salt, zeroPadding: 0)
+    }
 
-      return (truncatedHMAC: truncatedHMAC, paddedSalt: paddedSalt)
+    /// Calls the closure with the bytes of the padded salt.
+    func withUnsafePaddedSalt<Result>(
+      _ body: (UnsafeRawBufferPointer) throws -> Result
+    ) rethrows -> Result {
+      var paddedSalt = self.paddedSalt
+      return try withUnsafeBytes(of: &paddedSalt, body)
+    }
+
+    /// Returns `true` if the truncated form of the specified HMAC is the advertised one.
+    ///
+    /// - Parameter hmac: This is expected to be a valid HMAC.
+    func isTruncation(of hmac: Data) -> Bool {
+      guard hmac.count >= Self.truncatedHMACLength else { return false }
+      let hmacPrefix = hmac.prefix(Self.truncatedHMACLength).reduce(UInt32(0)) {
+        $0 << 8 | UInt32($1)
+      }
+      return hmacPrefix == truncatedHMAC
     }
 
     /// Truncate the specified HMAC according to the advertisement rules.
@@ -201,21 +247,30 @@ struct CarAuthenticatorImpl: CarAuthenticator {
     matchingData advertisementData: Data
   ) -> CarAdvertisementMatch? {
     // If we can't partition the advertisement as expected then we don't have a match.
-    guard
-      let (advertisedTruncatedHMAC, paddedSalt) =
-        try? Advertisement.partition(advertisement: advertisementData)
-    else {
+    guard let advertisement = try? Advertisement(advertisementData) else {
       return nil
     }
+    return first(among: cars, matching: advertisement)
+  }
 
+  /// Find a car whose associated key generates the advertised truncated HMAC for the advertised
+  /// salt.
+  ///
+  /// - Parameters:
+  ///   - cars: The set of cars among which to test for a match.
+  ///   - advertisement: The parsed advertisement.
+  /// - Returns: The matching car plus full HMAC or `nil` if none matches.
+  static func first(
+    among cars: Set<Car>,
+    matching advertisement: Advertisement
+  ) -> CarAdvertisementMatch? {
     // Find a car whose key autenticates the advertised truncated HMAC for the advertised salt.
     for car in cars {
       guard let authenticator = try? CarAuthenticatorImpl(carId: car.id) else {
         continue
       }
-      let hmac = authenticator.computeHMAC(data: paddedSalt)
-      let truncatedHMAC = Advertisement.truncateHMAC(hmac: hmac)
-      if truncatedHMAC == advertisedTruncatedHMAC {
+      let hmac = advertisement.withUnsafePaddedSalt { authenticator.computeHMAC(bytes: $0) }
+      if advertisement.isTruncation(of: hmac) {
         return (car: car, hmac: hmac)
       }
     }
@@ -244,17 +299,26 @@ struct CarAuthenticatorImpl: CarAuthenticator {
   /// - Parameter data: The data to hash.
   /// - Returns: The 256 bit SHA authentication code.
   func computeHMAC(data: Data) -> Data {
-    let dataBytes = [UInt8](data)
-    var mac: [UInt8] = Array.init(repeating: 0, count: Self.hashSize)
-    CCHmac(
-      CCHmacAlgorithm(kCCHmacAlgSHA256),
-      key,
-      key.count,
-      dataBytes,
-      dataBytes.count,
-      &mac
-    )
-    return Data(bytes: mac, count: mac.count)
+    data.withUnsafeBytes { computeHMAC(bytes: $0) }
+  }
+
+  /// Compute the authentication code for the specified bytes using the authenticator's key.
+  ///
+  /// - Parameter bytes: The bytes to hash.
+  /// - Returns: The 256 bit SHA authentication code.
+  func computeHMAC(bytes: UnsafeRawBufferPointer) -> Data {
+    var mac = Data(count: Self.hashSize)
+    mac.withUnsafeMutableBytes { macBytes in
+      CCHmac(
+        CCHmacAlgorithm(kCCHmacAlgSHA256),
+        key,
+        key.count,
+        bytes.baseAddress,
+        bytes.count,
+        macBytes.baseAddress
+      )
+    }
+    return mac
   }
 
   /// Save to the keychain, the key for the specified car.
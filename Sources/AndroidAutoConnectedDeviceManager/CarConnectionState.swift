@@ -0,0 +1,262 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+import Foundation
+
+/// The connection state of a single car and the transitions between its phases.
+///
+/// Everything the managers track about a car while connecting to it lives here: the connection
+/// retry timer, the device id it reported, its reconnection helper, the car pending a secure
+/// channel and the timeout on that channel. The state is confined to the queue that CoreBluetooth
+/// and the managers' delegates are serviced on, which is also where its timers fire, so it needs
+/// no locking. Callers must only use it on that queue.
+final class CarConnectionState {
+  /// The phases a car moves through while a secure channel is being established.
+  enum Phase: Equatable {
+    /// Nothing is in flight for the car.
+    case idle
+
+    /// A connection has been requested; `attempt` is the number of retries made since.
+    case connecting(attempt: Int)
+
+    /// The car is connected but has no secure channel.
+    case connected
+
+    /// A secure channel is being set up.
+    case securing
+
+    /// A secure channel has been established.
+    case secured
+  }
+
+  /// What to do when a connection retry timer fires.
+  enum RetryDecision: Equatable {
+    /// The car is no longer connecting, so there is nothing to retry.
+    case notConnecting
+
+    /// The retry limit has been reached and the attempt should be torn down.
+    case exhausted
+
+    /// Connection should be requested again; `attempt` is the number of retries made so far.
+    case retry(attempt: Int)
+  }
+
+  /// The identifier of the peripheral backing the car.
+  let identifier: UUID
+
+  /// The queue that this state is confined to and that its timers fire on.
+  private let queue: DispatchQueue
+
+  /// The current phase of the car.
+  private(set) var phase = Phase.idle
+
+  /// The device id the car has reported, which differs from the peripheral identifier.
+  var deviceId: String?
+
+  /// The helper for the reconnection handshake with the car.
+  var reconnectionHelper: ReconnectionHelper?
+
+  /// The car waiting for a secure channel to be set up.
+  private(set) var pendingCar: PendingCar?
+
+  /// Incremented whenever a retry timer is armed or cancelled so stale timers can be ignored.
+  private var retryGeneration = 0
+  private var retryWorkItem: DispatchWorkItem?
+
+  /// Incremented whenever a timeout is armed or cancelled so stale timeouts can be ignored.
+  private var timeoutGeneration = 0
+  private var timeoutWorkItem: DispatchWorkItem?
+
+  /// Creates the state for the car backed by the peripheral with the given identifier.
+  ///
+  /// - Parameters:
+  ///   - identifier: The identifier of the peripheral.
+  ///   - queue: The queue that the state is used on and that timer handlers are invoked on.
+  init(identifier: UUID, queue: DispatchQueue) {
+    self.identifier = identifier
+    self.queue = queue
+  }
+
+  /// `true` if no phase is in flight and nothing is held for the car.
+  var isIdle: Bool {
+    return phase == .idle && deviceId == nil && reconnectionHelper == nil && pendingCar == nil
+  }
+
+  /// Removes and returns the device id of the car.
+  func takeDeviceId() -> String? {
+    defer { deviceId = nil }
+    return deviceId
+  }
+
+  // MARK: - Connection
+
+  /// Moves the car to `.connecting` and arms the first retry timer.
+  ///
+  /// Any retry timer that was already armed is cancelled.
+  ///
+  /// - Parameters:
+  ///   - delay: The time to wait for a connection before `handler` is invoked.
+  ///   - handler: Invoked if the car is still connecting after `delay`.
+  func beginConnecting(retryAfter delay: DispatchTimeInterval, handler: @escaping () -> Void) {
+    phase = .connecting(attempt: 0)
+    armRetry(after: delay, handler: handler)
+  }
+
+  /// Decides what to do now that a retry timer has fired.
+  ///
+  /// - Parameter limit: The maximum number of retries.
+  func retryDecision(limit: Int) -> RetryDecision {
+    guard case .connecting(let attempt) = phase else { return .notConnecting }
+    return attempt < limit ? .retry(attempt: attempt) : .exhausted
+  }
+
+  /// Records a retry of the connection and arms the timer for the next one.
+  ///
+  /// Does nothing if the car is no longer connecting.
+  ///
+  /// - Parameters:
+  ///   - delay: The time to wait for a connection before `handler` is invoked.
+  ///   - handler: Invoked if the car is still connecting after `delay`.
+  func recordRetry(retryAfter delay: DispatchTimeInterval, handler: @escaping () -> Void) {
+    guard case .connecting(let attempt) = phase else { return }
+    phase = .connecting(attempt: attempt + 1)
+    armRetry(after: delay, handler: handler)
+  }
+
+  /// Cancels any pending connection retry and moves the car to the given phase.
+  ///
+  /// - Parameter phase: `.connected` if the car connected, otherwise `.idle`.
+  func endConnecting(in phase: Phase) {
+    cancelRetry()
+    self.phase = phase
+  }
+
+  // MARK: - Secure channel
+
+  /// Moves the car to `.securing` with the given pending car and arms the reconnection timeout.
+  ///
+  /// - Parameters:
+  ///   - pendingCar: The car waiting for its secure channel.
+  ///   - timeout: The time allowed for the secure channel to be set up.
+  ///   - handler: Invoked if the timeout has not been cancelled in time.
+  func beginSecuring(
+    _ pendingCar: PendingCar,
+    timeout: DispatchTimeInterval,
+    handler: @escaping () -> Void
+  ) {
+    self.pendingCar = pendingCar
+    phase = .securing
+    armTimeout(after: timeout, handler: handler)
+  }
+
+  /// Removes the pending car once its handshake has completed, successfully or not.
+  func clearPendingCar() {
+    pendingCar = nil
+  }
+
+  /// Cancels the reconnection timeout if one is armed.
+  func cancelTimeout() {
+    timeoutGeneration &+= 1
+    timeoutWorkItem?.cancel()
+    timeoutWorkItem = nil
+  }
+
+  /// Ends the secure channel setup, releasing the reconnection helper.
+  ///
+  /// - Parameter succeeded: Whether the secure channel was established.
+  func endSecuring(succeeded: Bool) {
+    cancelTimeout()
+    reconnectionHelper = nil
+    phase = succeeded ? .secured : .idle
+  }
+
+  // MARK: - Timers
+
+  /// Arms a retry timer, replacing any existing one.
+  private func armRetry(after delay: DispatchTimeInterval, handler: @escaping () -> Void) {
+    cancelRetry()
+    let generation = retryGeneration
+    let workItem = DispatchWorkItem { [weak self] in
+      guard let self = self, self.retryGeneration == generation else { return }
+      self.retryWorkItem = nil
+      handler()
+    }
+    retryWorkItem = workItem
+    queue.asyncAfter(deadline: .now() + delay, execute: workItem)
+  }
+
+  /// Cancels the retry timer.
+  private func cancelRetry() {
+    retryGeneration &+= 1
+    retryWorkItem?.cancel()
+    retryWorkItem = nil
+  }
+
+  /// Arms the reconnection timeout, replacing any existing one.
+  private func armTimeout(after delay: DispatchTimeInterval, handler: @escaping () -> Void) {
+    cancelTimeout()
+    let generation = timeoutGeneration
+    let workItem = DispatchWorkItem { [weak self] in
+      guard let self = self, self.timeoutGeneration == generation else { return }
+      // Claim the timeout so that it fires at most once.
+      self.cancelTimeout()
+      handler()
+    }
+    timeoutWorkItem = workItem
+    queue.asyncAfter(deadline: .now() + delay, execute: workItem)
+  }
+}
+
+/// The `CarConnectionState` of every car that is being connected to, keyed by peripheral
+/// identifier.
+///
+/// Like the states it holds, the registry is confined to a single queue.
+final class CarConnectionStateRegistry {
+  private let queue: DispatchQueue
+  private var states: [UUID: CarConnectionState] = [:]
+
+  /// Creates an empty registry.
+  ///
+  /// - Parameter queue: The queue that the registry and its states are used on.
+  init(queue: DispatchQueue = .main) {
+    self.queue = queue
+  }
+
+  /// All states currently registered.
+  var allStates: [CarConnectionState] {
+    return Array(states.values)
+  }
+
+  /// Returns the state for the given peripheral, creating it if necessary.
+  func state(for identifier: UUID) -> CarConnectionState {
+    if let state = states[identifier] {
+      return state
+    }
+    let state = CarConnectionState(identifier: identifier, queue: queue)
+    states[identifier] = state
+    return state
+  }
+
+  /// Returns the state for the given peripheral if one has been registered.
+  func existingState(for identifier: UUID) -> CarConnectionState? {
+    return states[identifier]
+  }
+
+  /// Drops the state for the given peripheral if it no longer holds anything.
+  func removeStateIfIdle(for identifier: UUID) {
+    if states[identifier]?.isIdle == true {
+      states[identifier] = nil
+    }
+  }
+}
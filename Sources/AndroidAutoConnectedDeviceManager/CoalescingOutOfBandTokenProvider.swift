@@ -15,10 +15,79 @@
 import AndroidAutoLogger
 import Foundation
 
+/// Time-to-token statistics for one kind of out of band token provider.
+struct OutOfBandTokenProviderMetrics: Equatable {
+  /// The number of requests made to providers of this kind.
+  var requestCount = 0
+
+  /// The number of requests to which a provider of this kind responded with a token.
+  var tokenCount = 0
+
+  /// The number of requests that were resolved by a token from a provider of this kind.
+  var winCount = 0
+
+  /// The number of requests to providers of this kind that were cancelled because another
+  /// provider responded first or the deadline passed.
+  var cancelledCount = 0
+
+  /// Seconds from the most recent request until a provider of this kind responded with a token.
+  var lastTimeToToken: TimeInterval?
+
+  /// The largest time to token observed.
+  var maxTimeToToken: TimeInterval = 0
+
+  /// The sum of all times to token.
+  var totalTimeToToken: TimeInterval = 0
+
+  /// The mean time to token of the requests that received a token.
+  var averageTimeToToken: TimeInterval? {
+    return tokenCount > 0 ? totalTimeToToken / TimeInterval(tokenCount) : nil
+  }
+}
+
+/// Records the time to token of the providers of a `CoalescingOutOfBandTokenProvider`.
+///
+/// Responses can arrive on any thread, so all access is synchronized.
+final class OutOfBandTokenMetrics {
+  private let lock = NSLock()
+  private var providerMetrics: [String: OutOfBandTokenProviderMetrics] = [:]
+  private var storedTimeoutCount = 0
+
+  /// The number of requests that were resolved without a token because the deadline passed.
+  var timeoutCount: Int {
+    lock.lock()
+    defer { lock.unlock() }
+    return storedTimeoutCount
+  }
+
+  /// Returns the metrics of the providers with the given name.
+  func metrics(forProviderNamed name: String) -> OutOfBandTokenProviderMetrics {
+    lock.lock()
+    defer { lock.unlock() }
+    return providerMetrics[name] ?? OutOfBandTokenProviderMetrics()
+  }
+
+  fileprivate func update(
+    providerNamed name: String,
+    _ update: (inout OutOfBandTokenProviderMetrics) -> Void
+  ) {
+    lock.lock()
+    defer { lock.unlock() }
+    update(&providerMetrics[name, default: OutOfBandTokenProviderMetrics()])
+  }
+
+  fileprivate func recordTimeout() {
+    lock.lock()
+    defer { lock.unlock() }
+    storedTimeoutCount += 1
+  }
+}
+
 /// Coalesces multiple out of band token providers into a single provider.
 ///
-/// Forwards token events from its providers to its token handler and maintains the most recently
-/// posted token.
+/// Requests are fanned out to all providers at once. The first token to arrive resolves the
+/// request and the requests still pending with the other providers are cancelled. If no provider
+/// responds with a token before the `deadline`, the request resolves without one.
 @available(watchOS 6.0, *)
 struct CoalescingOutOfBandTokenProvider<Provider: OutOfBandTokenProvider> {
   private static var log: Logger { Logger(for: CoalescingOutOfBandTokenProvider<Provider>.self) }
@@ -26,6 +95,15 @@ struct CoalescingOutOfBandTokenProvider<Provider: OutOfBandTokenProvider> {
   /// The child providers.
   private(set) var providers: [Provider]
 
+  /// How long a request may wait for a token, or `nil` to wait for every provider to respond.
+  var deadline: DispatchTimeInterval?
+
+  /// The queue on which a request that reaches its deadline is resolved.
+  var deadlineQueue = DispatchQueue.main
+
+  /// Time-to-token statistics for each kind of child provider.
+  let metrics = OutOfBandTokenMetrics()
+
   /// Initializes this provider with child providers.
   ///
   /// - Parameter providers: The child providers to which to forward requests.
@@ -72,7 +150,8 @@ extension CoalescingOutOfBandTokenProvider: OutOfBandTokenProvider {
   /// Request a token and call the completion handler when it's been resolved.
   ///
   /// The request is tied to the current child providers at the time the request was made since each
-  /// such provider will be responsible for responding to the request.
+  /// such provider will be responsible for responding to the request. The completion handler is
+  /// called exactly once, with the first token any provider responds with or `nil` if none do.
   ///
   /// - Parameter completion: The handler to call once the request is complete.
   func requestToken(completion: @escaping (OutOfBandToken?) -> Void) {
@@ -85,30 +164,146 @@ extension CoalescingOutOfBandTokenProvider: OutOfBandTokenProvider {
       return
     }
 
-    // As soon as token is discovered, call completion and be done.
-    var discoveredToken = false
-    var pending = providers.count
-    for provider in providers {
+    let request = CoalescedTokenRequest(providerCount: providers.count, completion: completion)
+    let metrics = self.metrics
+
+    if let deadline = deadline {
+      deadlineQueue.asyncAfter(deadline: .now() + deadline) {
+        guard let resolution = request.expire() else { return }
+
+        Self.log.error("No out of band token received before the deadline.")
+        metrics.recordTimeout()
+        Self.finish(resolution, providers: providers, metrics: metrics)
+      }
+    }
+
+    for (index, provider) in providers.enumerated() {
+      // A provider may respond synchronously, in which case the rest need not be asked.
+      guard !request.isResolved else { break }
+
+      let name = provider.providerName
+      let startTime = DispatchTime.now()
+      metrics.update(providerNamed: name) { $0.requestCount += 1 }
+
       provider.requestToken { token in
-        guard !discoveredToken else { return }
-        pending -= 1
-        guard let token = token else {
-          // No token, so check if this is the last pending provider.
-          guard pending == 0 else { return }
-          // Last pending provider, so we need to call the completion handler.
-          completion(nil)
-          return
+        if token != nil {
+          let timeToToken = startTime.secondsUntilNow
+          metrics.update(providerNamed: name) {
+            $0.tokenCount += 1
+            $0.lastTimeToToken = timeToToken
+            $0.maxTimeToToken = max($0.maxTimeToToken, timeToToken)
+            $0.totalTimeToToken += timeToToken
+          }
+        }
+
+        guard let resolution = request.resolve(providerAt: index, token: token) else { return }
+
+        if token != nil {
+          metrics.update(providerNamed: name) { $0.winCount += 1 }
         }
-        completion(token)
-        discoveredToken = true
+        Self.finish(resolution, providers: providers, metrics: metrics)
       }
     }
   }
 
+  /// Cancels the pending requests of all child providers.
+  func cancelPendingRequests() {
+    providers.forEach { $0.cancelPendingRequests() }
+  }
+
   /// Resets this provider.
   ///
   /// Removes any cached token and resolves any pending completion handlers.
   func reset() {
     providers.forEach { $0.reset() }
   }
+
+  /// Calls the completion of a resolved request and cancels the providers that have not
+  /// responded to it.
+  private static func finish(
+    _ resolution: CoalescedTokenRequest.Resolution,
+    providers: [Provider],
+    metrics: OutOfBandTokenMetrics
+  ) {
+    resolution.completion(resolution.token)
+
+    for index in resolution.pendingProviderIndices {
+      let provider = providers[index]
+      metrics.update(providerNamed: provider.providerName) { $0.cancelledCount += 1 }
+      provider.cancelPendingRequests()
+    }
+  }
+}
+
+/// The state of a single request that has been fanned out to several providers.
+///
+/// Providers may respond on any thread, so the state is guarded by a lock and exactly one response
+/// or the deadline resolves the request.
+private final class CoalescedTokenRequest {
+  /// What remains to be done once a request has been resolved.
+  struct Resolution {
+    let completion: (OutOfBandToken?) -> Void
+    let token: OutOfBandToken?
+
+    /// The providers that had not responded when the request was resolved.
+    let pendingProviderIndices: [Int]
+  }
+
+  private let lock = NSLock()
+  private var completion: ((OutOfBandToken?) -> Void)?
+  private var hasResponded: [Bool]
+
+  init(providerCount: Int, completion: @escaping (OutOfBandToken?) -> Void) {
+    self.completion = completion
+    hasResponded = Array(repeating: false, count: providerCount)
+  }
+
+  var isResolved: Bool {
+    lock.lock()
+    defer { lock.unlock() }
+    return completion == nil
+  }
+
+  /// Records the response of a provider.
+  ///
+  /// - Returns: The resolution if this response resolves the request, otherwise `nil`.
+  func resolve(providerAt index: Int, token: OutOfBandToken?) -> Resolution? {
+    lock.lock()
+    defer { lock.unlock() }
+
+    hasResponded[index] = true
+    guard token != nil || !hasResponded.contains(false) else { return nil }
+
+    return takeResolution(token: token)
+  }
+
+  /// Resolves the request without a token because the deadline has passed.
+  ///
+  /// - Returns: The resolution or `nil` if the request had already been resolved.
+  func expire() -> Resolution? {
+    lock.lock()
+    defer { lock.unlock() }
+
+    return takeResolution(token: nil)
+  }
+
+  /// Must be called with the lock held.
+  private func takeResolution(token: OutOfBandToken?) -> Resolution? {
+    guard let completion = completion else { return nil }
+    self.completion = nil
+
+    let pendingProviderIndices = hasResponded.indices.filter { !hasResponded[$0] }
+    return Resolution(
+      completion: completion,
+      token: token,
+      pendingProviderIndices: pendingProviderIndices)
+  }
+}
+
+extension DispatchTime {
+  /// The number of seconds that have elapsed since this time.
+  fileprivate var secondsUntilNow: TimeInterval {
+    let nanoseconds = DispatchTime.now().uptimeNanoseconds - uptimeNanoseconds
+    return TimeInterval(nanoseconds) / TimeInterval(NSEC_PER_SEC)
+  }
 }
@@ -138,6 +138,12 @@ class CommunicationManager: NSObject {
   /// Overlay key for the message compression enablement pending support for it.
   static let messageCompressionAllowedKey = "MessageCompressionAllowed"
 
+  /// Overlay key for publishing secure channels before their configuration has completed.
+  static let speculativeUnlockAllowedKey = "SpeculativeUnlockAllowed"
+
+  /// Overlay key for offering the compact binary message stream framing to cars.
+  static let compactFramingAllowedKey = "CompactFramingAllowed"
+
   private let connectionHandle: ConnectionHandle
   private let uuidConfig: UUIDConfig
   private let associatedCarsManager: AssociatedCarsManager
@@ -146,22 +152,31 @@ class CommunicationManager: NSObject {
   private let bleVersionResolver: BLEVersionResolver
   private let reconnectionHandlerFactory: ReconnectionHandlerFactory
 
-  /// Maps identifiers for peripherals to a `DispatchWorkItem` keeping track that should be called
-  /// if a reconnection attempt has timed out.
-  private var reconnectionTimeouts: [UUID: DispatchWorkItem] = [:]
+  /// The last confirmed user role of each car, which decides whether its channel can be published
+  /// before configuration.
+  private let userRoleCache: UserRoleCache
+
+  /// The connection state of each car, which holds its reconnection helper, pending car and
+  /// reconnection timeout.
+  private let carStates: CarConnectionStateRegistry
 
   /// Whether compression is allowed.
   let isMessageCompressionAllowed: Bool
 
+  /// Whether a secure channel for a car with a known user role can be published as soon as
+  /// encryption is established, with its configuration completing in parallel.
+  ///
+  /// This allows features such as unlock to queue their messages ahead of the user role query.
+  let isSpeculativeUnlockAllowed: Bool
+
   /// The cars waiting for a secure channel to be set up.
-  var pendingCars: [PendingCar] = []
+  var pendingCars: [PendingCar] {
+    return carStates.allStates.compactMap { $0.pendingCar }
+  }
 
   /// Handlers that are currently in the middle of encryption setup.
   var reconnectingHandlers: [ReconnectionHandler] = []
 
-  /// `ReconnectionHelper` keyed by peripheral id.
-  var reconnectionHelpers: [UUID: ReconnectionHelper] = [:]
-
   var timeoutDuration = CommunicationManager.defaultReconnectionTimeoutDuration
 
   weak var delegate: CommunicationManagerDelegate?
@@ -178,6 +193,9 @@ class CommunicationManager: NSObject {
   ///   - secureBLEChannelFactory: A factory that can create new secure BLE channels.
   ///   - bleVersionResolver: The version of the message stream to use.
   ///   - reconnectionHandlerFactory: A factory that can create new `SecuredCarChannelInternal`s.
+  ///   - userRoleCache: The cache of confirmed user roles, shared with the connection manager.
+  ///   - carStates: The connection state of each car, which may be shared with the connection
+  ///       manager.
   init(
     overlay: Overlay,
     connectionHandle: ConnectionHandle,
@@ -186,7 +204,9 @@ class CommunicationManager: NSObject {
     secureSessionManager: SecureSessionManager,
     secureBLEChannelFactory: SecureBLEChannelFactory,
     bleVersionResolver: BLEVersionResolver,
-    reconnectionHandlerFactory: ReconnectionHandlerFactory
+    reconnectionHandlerFactory: ReconnectionHandlerFactory,
+    userRoleCache: UserRoleCache,
+    carStates: CarConnectionStateRegistry = CarConnectionStateRegistry()
   ) {
     self.connectionHandle = connectionHandle
     self.uuidConfig = uuidConfig
@@ -195,8 +215,11 @@ class CommunicationManager: NSObject {
     self.secureBLEChannelFactory = secureBLEChannelFactory
     self.bleVersionResolver = bleVersionResolver
     self.reconnectionHandlerFactory = reconnectionHandlerFactory
+    self.userRoleCache = userRoleCache
+    self.carStates = carStates
 
     isMessageCompressionAllowed = overlay.isMessageCompressionAllowed
+    isSpeculativeUnlockAllowed = overlay.isSpeculativeUnlockAllowed
   }
 
   /// Add a helper to handle the reconnection handshake details.
@@ -206,11 +229,42 @@ class CommunicationManager: NSObject {
   ///
   /// - Parameter helper: The helper to handle reconnection handshake.
   func addReconnectionHelper(_ helper: ReconnectionHelper) {
-    reconnectionHelpers[helper.peripheral.identifier] = helper
+    carStates.state(for: helper.peripheral.identifier).reconnectionHelper = helper
+
+    // The car is known from its advertisement, so its channel can be prepared while connecting.
+    if let carId = helper.carId {
+      prewarmSecureChannel(for: carId)
+    }
+  }
+
+  /// Prepares the secure channel for the given associated car.
+  ///
+  /// This runs in the discovery callback, so the saved session is read from the keychain by the
+  /// factory off the main thread.
+  private func prewarmSecureChannel(for carId: String) {
+    guard associatedCarsManager.identifiers.contains(carId) else { return }
+
+    let secureSessionManager = self.secureSessionManager
+    secureBLEChannelFactory.prewarmChannel(for: carId) {
+      secureSessionManager.secureSession(for: carId)
+    }
+  }
+
+  /// Discards the secure channel prepared for the given car.
+  ///
+  /// - Parameter carId: The car that is no longer associated.
+  func evictPrewarmedChannel(for carId: String) {
+    secureBLEChannelFactory.evictPrewarmedChannel(for: carId)
+  }
+
+  /// Discards the secure channels prepared for all cars.
+  func evictAllPrewarmedChannels() {
+    secureBLEChannelFactory.evictAllPrewarmedChannels()
   }
 
   private func reconnectionHelper(for peripheral: BLEPeripheral) throws -> ReconnectionHelper {
-    guard let helper = reconnectionHelpers[peripheral.identifier] else {
+    guard let helper = carStates.existingState(for: peripheral.identifier)?.reconnectionHelper
+    else {
       throw CommunicationManagerError.missingReconnectionHelper(peripheral.identifier)
     }
 
@@ -229,39 +283,35 @@ class CommunicationManager: NSObject {
 
     let helper = try reconnectionHelper(for: peripheral)
     if id != nil {
-      let secureSession = try fetchSecureSession(for: peripheral, id: id!)
-      pendingCar = PendingCar(car: peripheral, id: id!, secureSession: secureSession)
+      try checkAssociation(of: peripheral, id: id!)
+      pendingCar = PendingCar(car: peripheral, id: id!)
+
+      // The channel was already prewarmed if the car was identified by its advertisement.
+      if helper.carId != id {
+        prewarmSecureChannel(for: id!)
+      }
     } else {
       pendingCar = PendingCar(car: peripheral)
     }
     serviceUUIDToDiscover = helper.discoveryUUID(from: uuidConfig)
 
-    pendingCars.append(pendingCar)
-
     peripheral.delegate = self
 
-    scheduleReconnectionTimeout(for: peripheral)
-    peripheral.discoverServices([serviceUUIDToDiscover])
-  }
-
-  private func scheduleReconnectionTimeout(for peripheral: BLEPeripheral) {
-    let notifyReconnectionError = DispatchWorkItem { [weak self] in
+    let carState = carStates.state(for: peripheral.identifier)
+    carState.beginSecuring(pendingCar, timeout: timeoutDuration) { [weak self] in
       Self.log.error(
         "Reconnection attempt timed out for car \(peripheral.logName). Notifying delegate.")
 
       self?.notifyDelegateOfError(.failedEncryptionEstablishment, connecting: peripheral)
     }
-    reconnectionTimeouts[peripheral.identifier] = notifyReconnectionError
-
-    DispatchQueue.main.asyncAfter(
-      deadline: .now() + timeoutDuration,
-      execute: notifyReconnectionError
-    )
+    peripheral.discoverServices([serviceUUIDToDiscover])
   }
 
-  /// Returns a saved secure session for the given car or throws an error if the car is
-  /// unassociated.
-  private func fetchSecureSession(for car: BLEPeripheral, id: String) throws -> Data {
+  /// Throws an error if the given car is unassociated.
+  ///
+  /// The saved secure session is not read here. It is loaded off the main thread by the prewarm
+  /// and checked when encryption is established.
+  private func checkAssociation(of car: BLEPeripheral, id: String) throws {
     // Check if the peripheral matches the identifier of a previous association.
     guard associatedCarsManager.identifiers.contains(id) else {
       Self.log(
@@ -272,13 +322,6 @@ class CommunicationManager: NSObject {
       )
       throw CommunicationManagerError.notAssociated
     }
-
-    guard let secureSession = secureSessionManager.secureSession(for: id) else {
-      Self.log("No secure session found for car (id: \(id), name: \(car.logName)")
-      throw CommunicationManagerError.noSavedEncryption
-    }
-
-    return secureSession
   }
 
   /// Attempts to resolve the version of the BLE message stream to use.
@@ -356,12 +399,18 @@ class CommunicationManager: NSObject {
   }
 
   private func firstPendingCar(with peripheral: BLEPeripheral) -> PendingCar? {
-    return pendingCars.first(where: { $0.car === peripheral })
+    guard let pendingCar = carStates.existingState(for: peripheral.identifier)?.pendingCar,
+      pendingCar.car === peripheral
+    else {
+      return nil
+    }
+    return pendingCar
   }
 
-  /// Removes all any cars in the `pendingCars` array that hold the given peripheral.
+  /// Removes the car pending a secure channel with the given peripheral.
   private func removePendingCars(with peripheral: BLEPeripheral) {
-    pendingCars.removeAll(where: { $0.car === peripheral })
+    guard firstPendingCar(with: peripheral) != nil else { return }
+    carStates.existingState(for: peripheral.identifier)?.clearPendingCar()
   }
 
   private func notifyDelegateOfError(
@@ -373,7 +422,7 @@ class CommunicationManager: NSObject {
   }
 
   private func cleanTimeouts(for peripheral: BLEPeripheral) {
-    reconnectionTimeouts.removeValue(forKey: peripheral.identifier)?.cancel()
+    carStates.existingState(for: peripheral.identifier)?.cancelTimeout()
   }
 
   /// Returns a log-friendly name for the given `BLEPeripehral`.
@@ -540,6 +589,22 @@ extension CommunicationManager: BLEVersionResolverDelegate {
     didResolveStreamVersionTo streamVersion: MessageStreamVersion,
     securityVersionTo securityVersion: MessageSecurityVersion,
     for peripheral: BLEPeripheral
+  ) {
+    self.bleVersionResolver(
+      bleVersionResolver,
+      didResolveStreamVersionTo: streamVersion,
+      securityVersionTo: securityVersion,
+      channelCapabilities: 0,
+      for: peripheral
+    )
+  }
+
+  func bleVersionResolver(
+    _ bleVersionResolver: BLEVersionResolver,
+    didResolveStreamVersionTo streamVersion: MessageStreamVersion,
+    securityVersionTo securityVersion: MessageSecurityVersion,
+    channelCapabilities: UInt32,
+    for peripheral: BLEPeripheral
   ) {
     // This shouldn't happen because this case should have been vetted for when characteristics are
     // discovered.
@@ -570,10 +635,11 @@ extension CommunicationManager: BLEVersionResolverDelegate {
     )
 
     pendingCar.messageStream = messageStream
+    pendingCar.channelCapabilities = SecureChannelCapabilities(rawValue: channelCapabilities)
 
     messageStream.delegate = self
 
-    guard let helper = reconnectionHelpers[peripheral.identifier] else {
+    guard let helper = try? reconnectionHelper(for: peripheral) else {
       notifyDelegateOfError(.unknown, connecting: peripheral)
       return
     }
@@ -616,7 +682,7 @@ extension CommunicationManager: MessageStreamDelegate {
 
     let peripheral = messageStream.peripheral
 
-    guard let helper = reconnectionHelpers[peripheral.identifier] else {
+    guard let helper = try? reconnectionHelper(for: peripheral) else {
       notifyDelegateOfError(.unknown, connecting: peripheral)
       return
     }
@@ -654,7 +720,11 @@ extension CommunicationManager: MessageStreamDelegate {
     }
 
     do {
-      try establishEncryption(messageStream: messageStream, carId: carId)
+      try establishEncryption(
+        messageStream: messageStream,
+        carId: carId,
+        channelCapabilities: firstPendingCar(with: peripheral)?.channelCapabilities ?? []
+      )
     } catch CommunicationManagerError.noSavedEncryption {
       notifyDelegateOfError(.noSavedEncryption, connecting: peripheral)
     } catch SecureBLEChannelError.invalidSavedSession {
@@ -675,9 +745,18 @@ extension CommunicationManager: MessageStreamDelegate {
   ///   - Parameters:
   ///   - messageStream: The stream used to establish the secure channel.
   ///   - carId: Car identifier.
+  ///   - channelCapabilities: The secure channel capabilities the car listed.
   /// - Throws: An error it fails to establish a secure channel.
-  private func establishEncryption(messageStream: MessageStream, carId: String) throws {
-    var reconnectionHandler = try makeChannel(messageStream: messageStream, carId: carId)
+  private func establishEncryption(
+    messageStream: MessageStream,
+    carId: String,
+    channelCapabilities: SecureChannelCapabilities
+  ) throws {
+    var reconnectionHandler = try makeChannel(
+      messageStream: messageStream,
+      carId: carId,
+      channelCapabilities: channelCapabilities
+    )
     reconnectingHandlers.append(reconnectionHandler)
 
     guard let messageStream = messageStream as? BLEMessageStream else {
@@ -701,7 +780,8 @@ extension CommunicationManager: MessageStreamDelegate {
   /// - Throws: An error if the secure session is missing.
   private func makeChannel(
     messageStream: MessageStream,
-    carId: String
+    carId: String,
+    channelCapabilities: SecureChannelCapabilities
   ) throws -> ReconnectionHandler {
     guard let messageStream = messageStream as? BLEMessageStream else {
       fatalError("messageStream: \(messageStream) must be a BLEMessageStream.")
@@ -724,7 +804,8 @@ extension CommunicationManager: MessageStreamDelegate {
       connectionHandle: connectionHandle,
       secureSession: secureSession,
       messageStream: messageStream,
-      secureBLEChannel: secureBLEChannelFactory.makeChannel(),
+      secureBLEChannel: secureBLEChannelFactory.makeChannel(for: carId),
+      channelCapabilities: channelCapabilities,
       secureSessionManager: secureSessionManager
     )
   }
@@ -773,6 +854,25 @@ extension CommunicationManager: ReconnectionHandlerDelegate {
       return
     }
 
+    let car = securedCarChannel.car
+    let knownUserRole = isSpeculativeUnlockAllowed ? userRoleCache.userRole(for: car.id) : nil
+    let isSpeculative = knownUserRole != nil
+
+    // Publishing the channel first lets features queue messages, such as unlock credentials,
+    // before the configuration sends its own. The channel assumes the cached role so that
+    // observers never see it without one. The reconnection timeout stays in place until the
+    // configuration completes.
+    if let knownUserRole = knownUserRole {
+      Self.log(
+        """
+        Publishing secure channel for car \(car.logName) before configuration. Known user role: \
+        \(knownUserRole)
+        """
+      )
+      securedCarChannel.updateUserRole(knownUserRole)
+      delegate?.communicationManager(self, didEstablishSecureChannel: securedCarChannel)
+    }
+
     helper.configureSecureChannel(
       securedCarChannel,
       using: connectionHandle
@@ -780,20 +880,65 @@ extension CommunicationManager: ReconnectionHandlerDelegate {
       guard let self = self else { return }
 
       guard success else {
-        self.delegate?.communicationManager(
-          self,
-          didEncounterError: .configureSecureChannelFailed,
-          whenReconnecting: reconnectionHandler.peripheral)
+        self.handleConfigurationFailure(
+          of: securedCarChannel,
+          from: reconnectionHandler,
+          wasPublished: isSpeculative
+        )
         return
       }
 
       self.cleanTimeouts(for: reconnectionHandler.peripheral)
 
-      self.delegate?.communicationManager(self, didEstablishSecureChannel: securedCarChannel)
+      if let knownUserRole = knownUserRole, let userRole = securedCarChannel.userRole,
+        userRole != knownUserRole
+      {
+        Self.log.error(
+          """
+          Car \(car.logName) was published with user role \(knownUserRole) but reported \
+          \(userRole).
+          """
+        )
+      }
+
+      if !isSpeculative {
+        self.delegate?.communicationManager(self, didEstablishSecureChannel: securedCarChannel)
+      }
       self.reconnectingHandlers.removeAll(where: { $0.car == securedCarChannel.car })
 
-      self.reconnectionHelpers[reconnectionHandler.peripheral.identifier] = nil
+      let peripheralID = reconnectionHandler.peripheral.identifier
+      self.carStates.existingState(for: peripheralID)?.endSecuring(succeeded: true)
+    }
+  }
+
+  /// Abandons a secure channel whose configuration failed.
+  ///
+  /// The delegate disconnects the car in response to the error. For a channel that was already
+  /// published, that disconnection removes it and notifies the observers that were handed it.
+  private func handleConfigurationFailure(
+    of securedCarChannel: SecuredConnectedDeviceChannel,
+    from reconnectionHandler: ReconnectionHandler,
+    wasPublished: Bool
+  ) {
+    let car = securedCarChannel.car
+
+    if wasPublished {
+      Self.log.error(
+        """
+        Configuration failed for published secure channel of car \(car.logName). Tearing it \
+        down.
+        """
+      )
+      // The cached role may be what the car rejected, so the next connection must confirm it
+      // before publishing again.
+      userRoleCache.clearUserRole(for: car.id)
     }
+
+    reconnectingHandlers.removeAll(where: { $0.car == car })
+    notifyDelegateOfError(.configureSecureChannelFailed, connecting: reconnectionHandler.peripheral)
+
+    let peripheralID = reconnectionHandler.peripheral.identifier
+    carStates.existingState(for: peripheralID)?.endSecuring(succeeded: false)
   }
 
   func reconnectionHandler(
@@ -806,7 +951,8 @@ extension CommunicationManager: ReconnectionHandlerDelegate {
       connecting: reconnectionHandler.peripheral
     )
     reconnectingHandlers.removeAll(where: { $0.car == reconnectionHandler.car })
-    reconnectionHelpers[reconnectionHandler.peripheral.identifier] = nil
+    let peripheralID = reconnectionHandler.peripheral.identifier
+    carStates.existingState(for: peripheralID)?.endSecuring(succeeded: false)
   }
 }
 
@@ -818,4 +964,16 @@ extension Overlay {
     // Allow for message compression unless the overlay vetoes it.
     self[CommunicationManager.messageCompressionAllowedKey] as? Bool ?? true
   }
+
+  /// Indicates whether secure channels can be published before they are configured.
+  var isSpeculativeUnlockAllowed: Bool {
+    // Speculative publishing is opt-in.
+    self[CommunicationManager.speculativeUnlockAllowedKey] as? Bool ?? false
+  }
+
+  /// Indicates whether the compact binary message stream framing can be offered to cars.
+  var isCompactFramingAllowed: Bool {
+    // Compact framing is opt-in, since cars only support it if they implement it.
+    self[CommunicationManager.compactFramingAllowedKey] as? Bool ?? false
+  }
 }
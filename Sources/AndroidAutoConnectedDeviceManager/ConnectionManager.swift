@@ -129,6 +129,11 @@ private enum ConnectionManagerSignposts {
   static let reconnectionDuration = SignpostDuration("Reconnection Duration")
   static let reconnectionCompletion = SignpostMarker("Reconnection Completion")
   static let reconnectionFailure = SignpostMarker("Reconnection Failure")
+
+  /// Spans from the discovery of an associated car's advertisement to its secure channel being
+  /// published to features, which is when unlock credentials are sent.
+  static let advertisementToSecureChannelDuration = SignpostDuration(
+    "Advertisement To Secure Channel Duration")
 }
 
 extension BuildNumber {
@@ -136,15 +141,6 @@ extension BuildNumber {
   fileprivate static let sdkVersion = BuildNumber(major: 2, minor: 0, patch: 1)
 }
 
-/// Holds all the necessary information to try a reconnection for a `Peripheral`.
-private struct ConnectionRetryState {
-  /// The block of code that will attempt a connection retry.
-  let retryHandler: DispatchWorkItem
-
-  /// The number of times that a connection has been retried for a given `Peripheral`.
-  var retryCount = 0
-}
-
 /// A `ConnectionManager` that utilizes Core Bluetooth for establishing and maintaining connections
 /// with a remote vehicle.
 ///
@@ -191,12 +187,6 @@ public class CoreBluetoothConnectionManager: ConnectionManager<CBCentralManager>
   /// reached, the connection attempt is torn down and a re-scan is initiated.
   private static let maxConnectionRetryCount = retryTimeIntervals.count
 
-  /// A mapping of `Peripheral` identifiers to the current state of connection retry.
-  ///
-  /// Any peripherals that are attempting connection will be in this map and they will be removed
-  /// upon connection.
-  private var connectionRetryStates: [UUID: ConnectionRetryState] = [:]
-
   private let centralManagerWrapper: CoreBluetoothCentralManagerWrapper
 
   public override init() {
@@ -211,29 +201,28 @@ public class CoreBluetoothConnectionManager: ConnectionManager<CBCentralManager>
 
   /// Connects to the given `peripheral` and schedules retry events if necessary.
   override func connect(with peripheral: Peripheral) {
-    resetConnectionRetryState(for: peripheral)
+    let carState = carStates.state(for: peripheral.identifier)
 
     centralManager.connect(peripheral, options: nil)
 
     // After a connection call has been made, schedule a retry to call `connect` again if we do
     // not receive a `didConnect` callback.
-    let retryHandler = DispatchWorkItem { [weak self] in
+    carState.beginConnecting(retryAfter: Self.retryTimeIntervals[0]) { [weak self] in
       self?.handleConnectionRetry(with: peripheral)
     }
-
-    let retryState = ConnectionRetryState(retryHandler: retryHandler)
-    connectionRetryStates[peripheral.identifier] = retryState
-
-    DispatchQueue.main.asyncAfter(
-      deadline: .now() + Self.retryTimeIntervals[retryState.retryCount],
-      execute: retryHandler
-    )
   }
 
   /// Attempts a connect with the given peripheral and schedules a handler to retry the connection
   /// after a certain amount of time has passed.
   private func handleConnectionRetry(with peripheral: Peripheral) {
-    guard var retryState = connectionRetryStates[peripheral.identifier] else {
+    // A car whose state has already been dropped is not connecting, so do not register it again.
+    let carState = carStates.existingState(for: peripheral.identifier)
+    let retryCount: Int
+
+    switch carState?.retryDecision(limit: Self.maxConnectionRetryCount) ?? .notConnecting {
+    case .retry(let attempt):
+      retryCount = attempt
+    case .notConnecting:
       log(
         """
         Attempt to handle connection retry for car (\(peripheral.logName)), \
@@ -242,9 +231,7 @@ public class CoreBluetoothConnectionManager: ConnectionManager<CBCentralManager>
       )
       disconnect(peripheral)
       return
-    }
-
-    guard retryState.retryCount < Self.maxConnectionRetryCount else {
+    case .exhausted:
       log(
         """
         Attempted to retry connection with car (\(peripheral.logName)), \
@@ -264,22 +251,17 @@ public class CoreBluetoothConnectionManager: ConnectionManager<CBCentralManager>
         """
       )
 
-      resetConnectionRetryState(for: peripheral)
+      resetConnectionRetryState(for: peripheral, phase: .connected)
       return
     }
 
-    log(
-      "Retrying connection with car (\(peripheral.logName)). Attempt \(retryState.retryCount + 1)")
+    log("Retrying connection with car (\(peripheral.logName)). Attempt \(retryCount + 1)")
 
     centralManager.connect(peripheral, options: nil)
 
-    DispatchQueue.main.asyncAfter(
-      deadline: .now() + Self.retryTimeIntervals[retryState.retryCount],
-      execute: retryState.retryHandler
-    )
-
-    retryState.retryCount += 1
-    connectionRetryStates[peripheral.identifier] = retryState
+    carState?.recordRetry(retryAfter: Self.retryTimeIntervals[retryCount]) { [weak self] in
+      self?.handleConnectionRetry(with: peripheral)
+    }
   }
 
   override fileprivate func resolveError(_ error: NSError) -> Error {
@@ -299,7 +281,7 @@ public class CoreBluetoothConnectionManager: ConnectionManager<CBCentralManager>
       "Connected car (\(peripheral.logName))",
       metadata: ["car": peripheral.logName, "connected": true]
     )
-    resetConnectionRetryState(for: peripheral)
+    resetConnectionRetryState(for: peripheral, phase: .connected)
   }
 
   override func onPeripheralConnectionFailed(_ peripheral: Peripheral, error: NSError) {
@@ -315,8 +297,12 @@ public class CoreBluetoothConnectionManager: ConnectionManager<CBCentralManager>
     resetConnectionRetryState(for: peripheral)
   }
 
-  private func resetConnectionRetryState(for peripheral: Peripheral) {
-    connectionRetryStates.removeValue(forKey: peripheral.identifier)?.retryHandler.cancel()
+  /// Cancels any pending connection retry and moves the car to the given phase.
+  private func resetConnectionRetryState(
+    for peripheral: Peripheral,
+    phase: CarConnectionState.Phase = .idle
+  ) {
+    carStates.existingState(for: peripheral.identifier)?.endConnecting(in: phase)
   }
 
   override func peripheral(from channel: SecuredCarChannel) -> Peripheral? {
@@ -357,7 +343,7 @@ public class CoreBluetoothConnectionManager: ConnectionManager<CBCentralManager>
     do {
       try communicationManager.setUpSecureChannel(
         with: CBPeripheralWrapper(peripheral: peripheral),
-        id: peripheralDeviceIds[peripheral.identifier]
+        id: carStates.existingState(for: peripheral.identifier)?.deviceId
       )
     } catch CommunicationManagerError.notAssociated {
       log.error(
@@ -440,19 +426,27 @@ where CentralManager: SomeCentralManager {
   /// Actions to perform sequentially once the power state has been determined.
   private var pendingPowerStateActions: [(RadioState) -> Void] = []
 
-  /// Maps `Peripheral`s by their identifier to its associated device ID.
+  /// The connection state of each car, keyed by the identifier of its `Peripheral`.
   ///
-  /// The device ID is different than the `identifier` in the `Peripheral`. During association and
-  /// reconnection, the device ID will be sent by the peripheral to this phone.
-  ///
-  /// Depending on the version of communication, the device ID will either be part of the
-  /// advertisement data of the peripheral or sent after connection.
-  fileprivate var peripheralDeviceIds: [UUID: String] = [:]
+  /// Each car's state, including the device ID it reported, is confined to the main queue, which
+  /// CoreBluetooth is serviced on, and is shared with the `CommunicationManager`. The device ID is
+  /// different than the `identifier` in the `Peripheral`. Depending on the version of
+  /// communication, it will either be part of the advertisement data of the peripheral or sent
+  /// after connection.
+  fileprivate let carStates = CarConnectionStateRegistry()
 
   /// Central out of band association token provider which wraps others.
+  ///
+  /// The token is prefetched when an association scan starts so that it is ready by the time the
+  /// handshake reaches verification.
   private lazy var centralOutOfBandAssociationTokenProvider:
-    CoalescingOutOfBandTokenProvider<AnyOutOfBandTokenProvider> =
-      makeCentralOutOfBandTokenProvider()
+    PrefetchingOutOfBandTokenProvider<CoalescingOutOfBandTokenProvider<AnyOutOfBandTokenProvider>> =
+      PrefetchingOutOfBandTokenProvider(makeCentralOutOfBandTokenProvider())
+
+  /// How much association time prefetching the out of band token has saved.
+  var outOfBandTokenPrefetchMetrics: OutOfBandTokenPrefetchMetrics {
+    centralOutOfBandAssociationTokenProvider.metrics
+  }
 
   /// Out of band association token provider which is externally populated.
   private let externalAssociationTokenProvider = PassiveOutOfBandTokenProvider()
@@ -463,7 +457,12 @@ where CentralManager: SomeCentralManager {
   public var state: RadioState = CBManagerState.unknown
 
   public fileprivate(set) var securedChannels: [SecuredCarChannel] = []
-  let secureSessionManager: SecureSessionManager = KeychainSecureSessionManager()
+
+  /// Sessions refreshed on reconnection are persisted to the keychain in the background so that a
+  /// newly secured channel is not held back by keychain I/O.
+  let secureSessionManager: SecureSessionManager = DeferredSecureSessionManager(
+    storage: KeychainSecureSessionManager())
+  let userRoleCache: UserRoleCache = UserDefaultsUserRoleCache()
 
   fileprivate var systemFeatureManager: SystemFeatureManager!
 
@@ -497,6 +496,7 @@ where CentralManager: SomeCentralManager {
     self.associatedCarsManager = associatedCarsManager
     let bleVersionResolver = BLEVersionResolverImpl()
     let secureBLEChannelFactory = UKey2ChannelFactory()
+    bleVersionResolver.channelCapabilities = secureBLEChannelFactory.supportedCapabilities.rawValue
 
     uuidConfig = UUIDConfig(plistLoader: plistLoader)
     defaultAssociationConfig = AssociationConfig(associationUUID: uuidConfig.associationUUID)
@@ -509,6 +509,7 @@ where CentralManager: SomeCentralManager {
 
     let connectionHandleProxy = ConnectionHandleProxy(connectionManager: self)
     let overlay = plistLoader.loadOverlayValues()
+    bleVersionResolver.isCompactFramingAllowed = overlay.isCompactFramingAllowed
     systemFeatureManager = SystemFeatureManager(connectedCarManager: self)
 
     associationManager = AssociationManager(
@@ -530,7 +531,9 @@ where CentralManager: SomeCentralManager {
       secureSessionManager: secureSessionManager,
       secureBLEChannelFactory: secureBLEChannelFactory,
       bleVersionResolver: bleVersionResolver,
-      reconnectionHandlerFactory: self
+      reconnectionHandlerFactory: self,
+      userRoleCache: userRoleCache,
+      carStates: carStates
     )
 
     state = centralManager.state
@@ -617,6 +620,9 @@ where CentralManager: SomeCentralManager {
       return
     }
 
+    // Acquire the out of band token while scanning rather than once verification needs it.
+    centralOutOfBandAssociationTokenProvider.prefetchToken(for: outOfBandSource)
+
     let associationUUID = associationConfig.associationUUID
     log("Starting scan for cars to associate with UUID \(associationUUID)")
 
@@ -756,6 +762,8 @@ where CentralManager: SomeCentralManager {
     }
 
     associationManager.clearAllAssociations()
+    userRoleCache.clearAllUserRoles()
+    communicationManager.evictAllPrewarmedChannels()
     disconnectAllPeripherals()
   }
 
@@ -768,6 +776,8 @@ where CentralManager: SomeCentralManager {
     disconnect(car)
 
     associationManager.clearAssociation(for: car)
+    userRoleCache.clearUserRole(for: car.id)
+    communicationManager.evictPrewarmedChannel(for: car.id)
 
     observations.dissociation.values.forEach { observation in
       observation(self, car)
@@ -801,6 +811,8 @@ where CentralManager: SomeCentralManager {
     -> CoalescingOutOfBandTokenProvider<AnyOutOfBandTokenProvider>
   {
     CoalescingOutOfBandTokenProvider {
+      // Association waits on the token, so do not let a slow provider hold it up indefinitely.
+      $0.deadline = .seconds(5)
       $0.register(wrapping: externalAssociationTokenProvider)
       let accessoryOutOfBandTokenProviderFactory = AccessoryOutOfBandTokenProviderFactory()
       guard
@@ -935,15 +947,57 @@ where CentralManager: SomeCentralManager {
   }
 
   /// Request the user role (driver/passenger) for the specified channel.
+  ///
+  /// If a user role is cached for the channel's car, the channel is configured with it immediately
+  /// and the car is queried in the background to confirm it.
   func requestConfiguration(
     for channel: SecuredConnectedDeviceChannel,
     completion: @escaping () -> Void
   ) {
+    let carId = channel.car.id
+
+    if let cachedUserRole = userRoleCache.userRole(for: carId) {
+      log("Configuring channel: \(channel) with cached user role: \(cachedUserRole)")
+      channel.updateUserRole(cachedUserRole)
+      completion()
+      confirmUserRole(cachedUserRole, of: channel)
+      return
+    }
+
     log("Requesting configuration of channel: \(channel)")
     channel.configure(using: systemFeatureManager) { [weak self] channel in
       defer { completion() }
       guard let self = self else { return }
       self.log("Secure channel configuration complete.")
+
+      if let userRole = channel.userRole {
+        self.userRoleCache.storeUserRole(userRole, for: carId)
+      }
+    }
+  }
+
+  /// Queries the car for the user role and updates the channel if it differs from the cached one.
+  private func confirmUserRole(
+    _ cachedUserRole: UserRole,
+    of channel: SecuredConnectedDeviceChannel
+  ) {
+    let carId = channel.car.id
+
+    systemFeatureManager.requestUserRole(with: channel) { [weak self] userRole in
+      guard let self = self else { return }
+
+      guard let userRole = userRole else {
+        self.log.error("Unable to confirm cached user role for car \(carId). Clearing it.")
+        self.userRoleCache.clearUserRole(for: carId)
+        return
+      }
+
+      self.userRoleCache.storeUserRole(userRole, for: carId)
+
+      if userRole != cachedUserRole {
+        self.log("User role for car \(carId) changed from \(cachedUserRole) to \(userRole).")
+        channel.updateUserRole(userRole)
+      }
     }
   }
 }
@@ -1056,8 +1110,8 @@ extension ConnectionManager: CommunicationManagerDelegate {
     establishingEncryptionWith car: Car,
     peripheral: BLEPeripheral
   ) {
-    // Ensure that the list of peripherals to device ids is up to date.
-    peripheralDeviceIds[peripheral.identifier] = car.id
+    // Ensure that the device id of the car is up to date.
+    carStates.state(for: peripheral.identifier).deviceId = car.id
 
     observations.connected.values.forEach { observation in
       observation(self, car)
@@ -1068,6 +1122,9 @@ extension ConnectionManager: CommunicationManagerDelegate {
     _ communicationManager: CommunicationManager,
     didEstablishSecureChannel securedCarChannel: SecuredConnectedDeviceChannel
   ) {
+    signpostMetrics.postIfAvailable(
+      ConnectionManagerSignposts.advertisementToSecureChannelDuration.end)
+
     self.securedChannels.append(securedCarChannel)
     self.registerServiceObserver(on: securedCarChannel)
 
@@ -1083,6 +1140,8 @@ extension ConnectionManager: CommunicationManagerDelegate {
   ) {
     signpostMetrics.postIfAvailable(ConnectionManagerSignposts.reconnectionFailure)
     signpostMetrics.postIfAvailable(ConnectionManagerSignposts.reconnectionDuration.end)
+    signpostMetrics.postIfAvailable(
+      ConnectionManagerSignposts.advertisementToSecureChannelDuration.end)
     log.error(
       "Encountered error during reconnection. Disconnecting peripheral: \(peripheral.logName).")
 
@@ -1117,8 +1176,8 @@ extension ConnectionManager: AssociationManagerDelegate {
     self.associationDelegate?.connectionManager(
       self, didCompleteAssociationWithCar: car)
 
-    // Ensure that the list of peripherals to device ids is up to date.
-    self.peripheralDeviceIds[peripheral.identifier] = car.id
+    // Ensure that the device id of the car is up to date.
+    self.carStates.state(for: peripheral.identifier).deviceId = car.id
 
     self.observations.securedChannel.values.forEach { observation in
       observation(self, securedCarChannel)
@@ -1166,6 +1225,7 @@ extension ConnectionManager: ReconnectionHandlerFactory {
     secureSession: Data,
     messageStream: BLEMessageStream,
     secureBLEChannel: SecureBLEChannel,
+    channelCapabilities: SecureChannelCapabilities,
     secureSessionManager: SecureSessionManager
   ) -> ReconnectionHandler {
     return ReconnectionHandlerImpl(
@@ -1174,6 +1234,7 @@ extension ConnectionManager: ReconnectionHandlerFactory {
       secureSession: secureSession,
       messageStream: messageStream,
       secureBLEChannel: secureBLEChannel,
+      channelCapabilities: channelCapabilities,
       secureSessionManager: secureSessionManager)
   }
 }
@@ -1203,6 +1264,7 @@ extension ConnectionManager: CentralManagerDelegate {
       for peripheral in discoveredPeripherals {
         handleDisconnection(of: peripheral, error: nil)
       }
+      communicationManager.evictAllPrewarmedChannels()
     case .poweredOn:
       log(
         "CoreBluetooth BLE hardware is powered on and ready",
@@ -1286,7 +1348,8 @@ extension ConnectionManager: CentralManagerDelegate {
 
     guard shouldConnect(to: peripheral) else { return }
 
-    let advertisedName = resolveName(from: advertisementData)
+    let advertisement = CarAdvertisement(advertisementData, uuidConfig: uuidConfig)
+    let advertisedName = resolveName(from: advertisement)
     log(
       """
       Discovered device (\(peripheral.logName): \(peripheral.identifier.uuidString)). \
@@ -1306,7 +1369,7 @@ extension ConnectionManager: CentralManagerDelegate {
     }
 
     discoveredPeripherals.insert(peripheral)
-    attemptReconnection(with: peripheral, advertisementData: advertisementData)
+    attemptReconnection(with: peripheral, advertisement: advertisement)
   }
 
   private func handleDiscoveryForAssociation(of peripheral: Peripheral, advertisedName: String?) {
@@ -1333,20 +1396,17 @@ extension ConnectionManager: CentralManagerDelegate {
     associationDelegate?.connectionManager(self, didDiscover: peripheral, advertisedName: fullName)
   }
 
-  private func resolveName(from advertisementData: [String: Any]) -> String? {
+  private func resolveName(from advertisement: CarAdvertisement) -> String? {
     // The advertised name can come from two sources. In newer versions, the name is stored in the
     // scan response and retrievable by the `associationDataUUID`. Otherwise, it's the standard
     // advertised name.
-    guard
-      let dataContents = advertisementData[CBAdvertisementDataServiceDataKey] as? NSDictionary,
-      let rawData = dataContents[uuidConfig.associationDataUUID] as? Data
-    else {
+    guard let rawData = advertisement.associationData else {
       log("Retrieving default advertised name from advertisement data.")
 
       // iOS will cache the name of the discovered peripheral if it is paired via Bluetooth. This
       // means `peripheral.name` might not be up to date. As a result, manually read the advertised
       // name to use as a backup name.
-      return advertisementData[CBAdvertisementDataLocalNameKey] as? String
+      return advertisement.localName
     }
 
     if rawData.count == advertisementLengthForUTF8Conversion {
@@ -1410,20 +1470,22 @@ extension ConnectionManager: CentralManagerDelegate {
     return true
   }
 
-  private func attemptReconnection(with peripheral: Peripheral, advertisementData: [String: Any]) {
+  private func attemptReconnection(with peripheral: Peripheral, advertisement: CarAdvertisement) {
     signpostMetrics.postIfAvailable(ConnectionManagerSignposts.reconnectionDuration.begin)
+    signpostMetrics.postIfAvailable(
+      ConnectionManagerSignposts.advertisementToSecureChannelDuration.begin)
     do {
       let reconnectionHelper = try reconnectionHelperFactory.makeHelper(
         peripheral: peripheral,
-        advertisementData: advertisementData,
+        advertisement: advertisement,
         associatedCars: associatedCars,
         uuidConfig: uuidConfig,
         authenticator: CarAuthenticatorImpl.self
       )
 
-      // The peripheral to device id mapping is needed for security version 2.
+      // The device id of the car is needed for security version 2.
       if let carId = reconnectionHelper.carId {
-        peripheralDeviceIds[peripheral.identifier] = carId
+        carStates.state(for: peripheral.identifier).deviceId = carId
       }
 
       communicationManager.addReconnectionHelper(reconnectionHelper)
@@ -1530,7 +1592,11 @@ extension ConnectionManager: CentralManagerDelegate {
       scanForAssociatedCarsAfterDelay()
     }
 
-    guard let id = peripheralDeviceIds.removeValue(forKey: peripheral.identifier) else {
+    defer {
+      carStates.removeStateIfIdle(for: peripheral.identifier)
+    }
+
+    guard let id = carStates.existingState(for: peripheral.identifier)?.takeDeviceId() else {
       log(
         "Device disconnected, but no device id, meaning device ids have not been exchanged yet.")
       return
@@ -1538,6 +1604,9 @@ extension ConnectionManager: CentralManagerDelegate {
 
     // Remove any secured channels that contain the given car that just disconnected as they should
     // now be invalid.
+    for channel in securedChannels where channel.car.id == id {
+      (channel as? SecuredConnectedDeviceChannel)?.handleDisconnection()
+    }
     securedChannels = securedChannels.filter { $0.car.id != id }
 
     // Only notify observers if the device is associated.
@@ -14,51 +14,239 @@
 
 import Foundation
 
+/// Lookup tables for the byte-oriented codecs in this file.
+private enum DataCodingTables {
+  /// Decoded value marking a byte that is not part of the alphabet.
+  static let invalid: UInt8 = 0xFF
+
+  /// Decoded value marking base64 padding.
+  static let padding: UInt8 = 0xFE
+
+  /// Decoded value marking whitespace, which is skipped when decoding base64.
+  static let whitespace: UInt8 = 0xFD
+
+  /// The two uppercase hex digits for each byte value, in byte order.
+  static let hexDigitPairs: [UInt8] = {
+    let digits = Array("0123456789ABCDEF".utf8)
+    var pairs: [UInt8] = []
+    pairs.reserveCapacity(512)
+    for byte in 0..<256 {
+      pairs.append(digits[byte >> 4])
+      pairs.append(digits[byte & 0x0F])
+    }
+    return pairs
+  }()
+
+  /// The value of each hex digit in either case, indexed by its UTF-8 code unit.
+  static let hexValues: [UInt8] = {
+    var values = [UInt8](repeating: invalid, count: 256)
+    for (value, digit) in "0123456789ABCDEF".utf8.enumerated() {
+      values[Int(digit)] = UInt8(value)
+    }
+    for (value, digit) in "abcdef".utf8.enumerated() {
+      values[Int(digit)] = UInt8(value + 10)
+    }
+    return values
+  }()
+
+  /// The URL-safe base64 alphabet (RFC 4648 section 5).
+  static let base64URLAlphabet = Array(
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_".utf8)
+
+  /// The value of each base64 digit, indexed by its UTF-8 code unit.
+  ///
+  /// Both the URL-safe and the standard alphabets are accepted.
+  static let base64Values: [UInt8] = {
+    var values = [UInt8](repeating: invalid, count: 256)
+    for (value, digit) in base64URLAlphabet.enumerated() {
+      values[Int(digit)] = UInt8(value)
+    }
+    values[Int(UInt8(ascii: "+"))] = 62
+    values[Int(UInt8(ascii: "/"))] = 63
+    values[Int(UInt8(ascii: "="))] = padding
+    for space in " \t\r\n".utf8 {
+      values[Int(space)] = whitespace
+    }
+    return values
+  }()
+}
+
 /// Data transformations.
 extension Data {
   /// Returns a hexadecimal representation of the `Data` contents.
+  ///
+  /// Each byte is represented by two uppercase hex digits.
   var hex: String {
-    self.map {
-      // Each byte is represented by two hex digits.
-      var digitPair = String($0, radix: 16, uppercase: true)
-      if digitPair.count == 1 {
-        digitPair = "0" + digitPair
+    let utf8: [UInt8] = DataCodingTables.hexDigitPairs.withUnsafeBufferPointer { pairs in
+      [UInt8](unsafeUninitializedCapacity: count * 2) { buffer, initializedCount in
+        withUnsafeBytes { (bytes: UnsafeRawBufferPointer) in
+          var index = 0
+          for byte in bytes {
+            let pairIndex = Int(byte) * 2
+            buffer[index] = pairs[pairIndex]
+            buffer[index + 1] = pairs[pairIndex + 1]
+            index += 2
+          }
+          initializedCount = index
+        }
       }
-      return digitPair
-    }.joined()
+    }
+    return String(decoding: utf8, as: UTF8.self)
   }
 
   /// Initializes from a hexadecimal string.
   ///
-  /// The string must contain only a series of valid hexadecimal digits such as "2AF8".
+  /// The string must contain only a series of valid hexadecimal digits such as "2AF8". An odd
+  /// number of digits is treated as if it had a leading zero.
   ///
   /// - Parameter hex: The hexadecimal string.
   /// - Returns: Returns `nil` if the string is not valid hexadecimal.
   init?(hex rawHex: String) {
-    if rawHex.isEmpty { return nil }
+    var hex = rawHex
+    let bytes: [UInt8]? = hex.withUTF8 { digits in
+      guard !digits.isEmpty else { return nil }
 
-    // Make sure we have an even number of hex characters (one pair per byte).
-    let hex: String
-    if rawHex.count.isMultiple(of: 2) {
-      hex = rawHex
+      return DataCodingTables.hexValues.withUnsafeBufferPointer { values in
+        var bytes: [UInt8] = []
+        bytes.reserveCapacity((digits.count + 1) / 2)
+
+        var index = 0
+        if !digits.count.isMultiple(of: 2) {
+          // A leading digit on its own forms the low half of the first byte.
+          let low = values[Int(digits[0])]
+          guard low != DataCodingTables.invalid else { return nil }
+          bytes.append(low)
+          index = 1
+        }
+
+        while index < digits.count {
+          let high = values[Int(digits[index])]
+          let low = values[Int(digits[index + 1])]
+          guard high != DataCodingTables.invalid, low != DataCodingTables.invalid else {
+            return nil
+          }
+          bytes.append(high << 4 | low)
+          index += 2
+        }
+        return bytes
+      }
+    }
+
+    guard let decodedBytes = bytes else { return nil }
+    self.init(decodedBytes)
+  }
+
+  /// Returns the URL-safe base64 encoding (RFC 4648 section 5) of the `Data` contents.
+  ///
+  /// - Parameter padded: `true` to pad the encoding with "=" to a multiple of four characters.
+  /// - Returns: The encoded string.
+  func base64URLEncodedString(padded: Bool = false) -> String {
+    let fullGroupCount = count / 3
+    let remainderCount = count % 3
+    let encodedCount: Int
+    if remainderCount == 0 || padded {
+      encodedCount = (fullGroupCount + (remainderCount == 0 ? 0 : 1)) * 4
     } else {
-      hex = "0" + rawHex
+      encodedCount = fullGroupCount * 4 + remainderCount + 1
     }
 
-    // Each byte consists of a pair of hex characters.
-    var data = Data(capacity: hex.count / 2)
+    let utf8: [UInt8] = DataCodingTables.base64URLAlphabet.withUnsafeBufferPointer { alphabet in
+      [UInt8](unsafeUninitializedCapacity: encodedCount) { buffer, initializedCount in
+        withUnsafeBytes { (bytes: UnsafeRawBufferPointer) in
+          var input = 0
+          var output = 0
+          for _ in 0..<fullGroupCount {
+            let group = UInt32(bytes[input]) << 16 | UInt32(bytes[input + 1]) << 8
+              | UInt32(bytes[input + 2])
+            buffer[output] = alphabet[Int(group >> 18)]
+            buffer[output + 1] = alphabet[Int(group >> 12 & 0x3F)]
+            buffer[output + 2] = alphabet[Int(group >> 6 & 0x3F)]
+            buffer[output + 3] = alphabet[Int(group & 0x3F)]
+            input += 3
+            output += 4
+          }
 
-    var currentIndex = hex.startIndex
-    while currentIndex != hex.endIndex {
-      // Process two characters at a time.
-      let nextIndex = hex.index(currentIndex, offsetBy: 2)
-      let bytes = hex[currentIndex..<nextIndex]
+          if remainderCount > 0 {
+            var group = UInt32(bytes[input]) << 16
+            if remainderCount == 2 {
+              group |= UInt32(bytes[input + 1]) << 8
+            }
+            buffer[output] = alphabet[Int(group >> 18)]
+            buffer[output + 1] = alphabet[Int(group >> 12 & 0x3F)]
+            output += 2
+            if remainderCount == 2 {
+              buffer[output] = alphabet[Int(group >> 6 & 0x3F)]
+              output += 1
+            }
+            while padded && output < encodedCount {
+              buffer[output] = UInt8(ascii: "=")
+              output += 1
+            }
+          }
+          initializedCount = output
+        }
+      }
+    }
+    return String(decoding: utf8, as: UTF8.self)
+  }
+
+  /// Initializes from a base64 string in either the URL-safe or the standard alphabet.
+  ///
+  /// Padding is optional and whitespace is skipped.
+  ///
+  /// - Parameter base64: The base64 encoded string.
+  /// - Returns: Returns `nil` if the string contains other characters or has a dangling digit.
+  init?(base64URLEncoded base64: String) {
+    var base64 = base64
+    let bytes: [UInt8]? = base64.withUTF8 { digits in
+      DataCodingTables.base64Values.withUnsafeBufferPointer { values in
+        var bytes: [UInt8] = []
+        bytes.reserveCapacity(digits.count / 4 * 3 + 2)
 
-      guard let hexValue = UInt8(bytes, radix: 16) else { return nil }
-      data.append(hexValue)
-      currentIndex = nextIndex
+        var group: UInt32 = 0
+        var groupDigitCount = 0
+        var isPadded = false
+        for digit in digits {
+          let value = values[Int(digit)]
+          switch value {
+          case DataCodingTables.whitespace:
+            continue
+          case DataCodingTables.padding:
+            isPadded = true
+          case DataCodingTables.invalid:
+            return nil
+          default:
+            // Digits may not follow padding.
+            guard !isPadded else { return nil }
+            group = group << 6 | UInt32(value)
+            groupDigitCount += 1
+            if groupDigitCount == 4 {
+              bytes.append(UInt8(truncatingIfNeeded: group >> 16))
+              bytes.append(UInt8(truncatingIfNeeded: group >> 8))
+              bytes.append(UInt8(truncatingIfNeeded: group))
+              group = 0
+              groupDigitCount = 0
+            }
+          }
+        }
+
+        switch groupDigitCount {
+        case 0:
+          break
+        case 2:
+          bytes.append(UInt8(truncatingIfNeeded: group >> 4))
+        case 3:
+          bytes.append(UInt8(truncatingIfNeeded: group >> 10))
+          bytes.append(UInt8(truncatingIfNeeded: group >> 2))
+        default:
+          // A single digit carries fewer than eight bits.
+          return nil
+        }
+        return bytes
+      }
     }
 
-    self = data
+    guard let decodedBytes = bytes else { return nil }
+    self.init(decodedBytes)
   }
 }
@@ -0,0 +1,350 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+import AndroidAutoLogger
+import Foundation
+
+#if canImport(UIKit)
+  import UIKit
+#endif
+
+/// A `SecureSessionManager` that persists refreshed secure sessions off the calling thread.
+///
+/// Refreshing the session of a reconnected car only records it in memory and schedules the write
+/// to the backing storage on a serial background queue, so a newly secured channel can be handed
+/// to features without waiting on the keychain. Repeated writes for the same car that arrive
+/// before the previous one has been persisted are coalesced so that only the latest session is
+/// written. Reads return the pending session, if any, so callers always observe their own writes.
+///
+/// Storing the first session of a car at association is written synchronously, so that a failure
+/// is reported to the caller rather than leaving the association in memory only.
+///
+/// Pending writes are flushed when the app enters the background or is about to terminate. A
+/// deferred write that the backing storage rejects is retried with exponential backoff.
+final class DeferredSecureSessionManager {
+  private static let log = Logger(for: DeferredSecureSessionManager.self)
+
+  /// The longest delay between retries of a failed write.
+  static let maxRetryDelay: TimeInterval = 5 * 60
+
+  /// Counters describing the writes handled by this manager.
+  struct Statistics: Equatable {
+    /// The number of sessions that have been stored or cleared.
+    var requestedWrites = 0
+
+    /// The number of requests that replaced a write which had not yet been persisted.
+    var coalescedWrites = 0
+
+    /// The number of writes that reached the backing storage successfully.
+    var completedWrites = 0
+
+    /// The number of writes that the backing storage rejected. Deferred writes are retried with
+    /// backoff and on flush.
+    var failedWrites = 0
+  }
+
+  private enum Operation {
+    case store(Data)
+    case clear
+  }
+
+  private struct PendingOperation {
+    let operation: Operation
+    let generation: Int
+  }
+
+  private let storage: SecureSessionManager
+  private let queue: DispatchQueue
+  private let notificationCenter: NotificationCenter
+  private let initialRetryDelay: TimeInterval
+
+  private let lock = NSLock()
+  private var pendingOperations: [String: PendingOperation] = [:]
+  private var scheduledIdentifiers: Set<String> = []
+
+  /// The number of consecutive failed writes of each car with a retry pending.
+  private var failedAttempts: [String: Int] = [:]
+  private var retryingIdentifiers: Set<String> = []
+  private var nextGeneration = 0
+  private var storedStatistics = Statistics()
+  private var observers: [NSObjectProtocol] = []
+
+  /// Counters describing the writes handled so far.
+  var statistics: Statistics {
+    lock.lock()
+    defer { lock.unlock() }
+    return storedStatistics
+  }
+
+  /// Whether there are sessions which have not yet been written to the backing storage.
+  var hasPendingWrites: Bool {
+    lock.lock()
+    defer { lock.unlock() }
+    return !pendingOperations.isEmpty
+  }
+
+  /// Creates a manager which persists sessions to the given storage.
+  ///
+  /// - Parameters:
+  ///   - storage: The manager that performs the actual persistence.
+  ///   - queue: The serial queue on which `storage` is written.
+  ///   - notificationCenter: The center to observe for app lifecycle notifications.
+  ///   - initialRetryDelay: Seconds before the first retry of a failed write. The delay doubles
+  ///     with each further failure, up to `maxRetryDelay`.
+  init(
+    storage: SecureSessionManager,
+    queue: DispatchQueue = DispatchQueue(
+      label: "com.google.ios.aae.secureSessionPersistence", qos: .utility),
+    notificationCenter: NotificationCenter = .default,
+    initialRetryDelay: TimeInterval = 1
+  ) {
+    self.storage = storage
+    self.queue = queue
+    self.notificationCenter = notificationCenter
+    self.initialRetryDelay = initialRetryDelay
+
+    observeAppLifecycle()
+  }
+
+  deinit {
+    for observer in observers {
+      notificationCenter.removeObserver(observer)
+    }
+  }
+
+  /// Synchronously writes all pending sessions to the backing storage.
+  ///
+  /// This must not be called from the persistence queue.
+  func flush() {
+    queue.sync {
+      persistAll()
+    }
+  }
+
+  private func observeAppLifecycle() {
+    #if os(iOS)
+      observers.append(
+        notificationCenter.addObserver(
+          forName: UIApplication.didEnterBackgroundNotification,
+          object: nil,
+          queue: nil
+        ) { [weak self] _ in
+          self?.flushInBackgroundTask()
+        })
+
+      // There is no time left to run a background task on termination, so block until written.
+      observers.append(
+        notificationCenter.addObserver(
+          forName: UIApplication.willTerminateNotification,
+          object: nil,
+          queue: nil
+        ) { [weak self] _ in
+          Self.log("App terminating; flushing pending secure sessions.")
+          self?.flush()
+        })
+    #endif
+  }
+
+  #if os(iOS)
+    /// Persists all pending sessions while holding a background task so that the app is not
+    /// suspended before the writes complete.
+    private func flushInBackgroundTask() {
+      guard hasPendingWrites else { return }
+
+      Self.log("Entering background; flushing pending secure sessions.")
+
+      let application = UIApplication.shared
+
+      // Only touched on the main thread so that the task is ended exactly once.
+      var task = UIBackgroundTaskIdentifier.invalid
+      let endTask = {
+        guard task != .invalid else { return }
+        application.endBackgroundTask(task)
+        task = .invalid
+      }
+
+      // The system terminates an app that does not end its task when time runs out. Writes that
+      // are still pending then complete when the app next runs.
+      task = application.beginBackgroundTask(withName: "FlushSecureSessions") {
+        Self.log.error("Background time expired before pending secure sessions were flushed.")
+        endTask()
+      }
+
+      queue.async {
+        self.persistAll()
+        DispatchQueue.main.async(execute: endTask)
+      }
+    }
+  #endif
+
+  /// Records the given operation as the latest for the car and schedules it to be persisted.
+  private func enqueue(_ operation: Operation, for identifier: String) {
+    lock.lock()
+    nextGeneration += 1
+    pendingOperations[identifier] = PendingOperation(
+      operation: operation, generation: nextGeneration)
+    storedStatistics.requestedWrites += 1
+
+    let isScheduled = !scheduledIdentifiers.insert(identifier).inserted
+    if isScheduled {
+      storedStatistics.coalescedWrites += 1
+    }
+    lock.unlock()
+
+    guard !isScheduled else { return }
+
+    // Capture strongly so that writes which are already accepted are not lost.
+    queue.async {
+      self.persist(identifier)
+    }
+  }
+
+  private func persistAll() {
+    lock.lock()
+    let identifiers = Array(pendingOperations.keys)
+    lock.unlock()
+
+    for identifier in identifiers {
+      persist(identifier)
+    }
+  }
+
+  /// Writes the latest pending operation for the car. Must be called on `queue`.
+  private func persist(_ identifier: String) {
+    lock.lock()
+    scheduledIdentifiers.remove(identifier)
+    let pending = pendingOperations[identifier]
+    lock.unlock()
+
+    // Already written by an earlier flush.
+    guard let pending = pending else { return }
+
+    let succeeded: Bool
+    switch pending.operation {
+    case .store(let session):
+      succeeded = storage.storeSecureSession(session, for: identifier)
+    case .clear:
+      storage.clearSecureSession(for: identifier)
+      succeeded = true
+    }
+
+    lock.lock()
+    defer { lock.unlock() }
+
+    guard succeeded else {
+      // Keep the session pending so it is still served from memory and retried.
+      storedStatistics.failedWrites += 1
+      failedAttempts[identifier, default: 0] += 1
+      Self.log.error("Unable to persist secure session for car \(identifier); will retry.")
+      scheduleRetryLocked(for: identifier)
+      return
+    }
+
+    storedStatistics.completedWrites += 1
+    failedAttempts[identifier] = nil
+
+    // A newer operation may have arrived while this one was being written.
+    if pendingOperations[identifier]?.generation == pending.generation {
+      pendingOperations[identifier] = nil
+    }
+  }
+}
+
+// MARK: - Retries
+
+extension DeferredSecureSessionManager {
+  /// Returns the seconds to wait before retrying a write that has failed the given number of
+  /// consecutive times.
+  func retryDelay(afterFailures failureCount: Int) -> TimeInterval {
+    let exponent = Double(max(failureCount - 1, 0))
+    return min(initialRetryDelay * pow(2, exponent), Self.maxRetryDelay)
+  }
+
+  /// Schedules another attempt to persist the car's pending operation unless one is already
+  /// scheduled. Must be called while holding `lock`.
+  private func scheduleRetryLocked(for identifier: String) {
+    guard retryingIdentifiers.insert(identifier).inserted else { return }
+
+    let delay = retryDelay(afterFailures: failedAttempts[identifier] ?? 1)
+    queue.asyncAfter(deadline: .now() + delay) { [weak self] in
+      guard let self = self else { return }
+
+      self.lock.lock()
+      self.retryingIdentifiers.remove(identifier)
+      self.lock.unlock()
+
+      self.persist(identifier)
+    }
+  }
+}
+
+// MARK: - SecureSessionManager
+
+extension DeferredSecureSessionManager: SecureSessionManager {
+  func secureSession(for identifier: String) -> Data? {
+    lock.lock()
+    let pending = pendingOperations[identifier]
+    lock.unlock()
+
+    switch pending?.operation {
+    case .store(let session)?:
+      return session
+    case .clear?:
+      return nil
+    case nil:
+      return storage.secureSession(for: identifier)
+    }
+  }
+
+  /// Writes the session to the backing storage before returning.
+  ///
+  /// Any deferred operation for the car is superseded. This must not be called from the
+  /// persistence queue.
+  ///
+  /// - Returns: `true` if the backing storage accepted the session.
+  func storeSecureSession(_ secureSession: Data, for identifier: String) -> Bool {
+    return queue.sync {
+      lock.lock()
+      pendingOperations[identifier] = nil
+      failedAttempts[identifier] = nil
+      storedStatistics.requestedWrites += 1
+      lock.unlock()
+
+      let succeeded = storage.storeSecureSession(secureSession, for: identifier)
+
+      lock.lock()
+      defer { lock.unlock() }
+
+      if succeeded {
+        storedStatistics.completedWrites += 1
+      } else {
+        storedStatistics.failedWrites += 1
+        Self.log.error("Unable to persist secure session for car \(identifier).")
+      }
+      return succeeded
+    }
+  }
+
+  /// Accepts the session for persistence and returns immediately.
+  ///
+  /// - Returns: Always `true`. Failures to write are logged and retried with backoff.
+  func refreshSecureSession(_ secureSession: Data, for identifier: String) -> Bool {
+    enqueue(.store(secureSession), for: identifier)
+    return true
+  }
+
+  func clearSecureSession(for identifier: String) {
+    enqueue(.clear, for: identifier)
+  }
+}
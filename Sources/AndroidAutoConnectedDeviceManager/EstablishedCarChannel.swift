@@ -19,7 +19,6 @@ import AndroidAutoLogger
 import Foundation
 @_implementationOnly import AndroidAutoCompanionProtos
 
-private typealias QueryProto = Com_Google_Companionprotos_Query
 private typealias QueryResponseProto = Com_Google_Companionprotos_QueryResponse
 
 /// A car that can be used to send encrypted messages.
@@ -29,7 +28,8 @@ class EstablishedCarChannel: NSObject, SecuredCarChannelPeripheral {
   let messageStream: MessageStream
   private let connectionHandle: ConnectionHandle
 
-  private var writeCompletionHandlers: [(Bool) -> Void] = []
+  /// Schedules the writes of all features onto `messageStream` and tracks their completion.
+  private let multiplexer = FeatureMessageMultiplexer()
   private var receivedMessageObservations: [UUID: (EstablishedCarChannel, Data) -> Void] = [:]
 
   /// Keeps track of unique recipient UUIDs that are being observed and the observations that are
@@ -41,8 +41,18 @@ class EstablishedCarChannel: NSObject, SecuredCarChannelPeripheral {
   /// Messages that were received, but had no registered observation for them.
   ///
   /// These messages are saved until an observer is registered, after which the messages are sent to
-  /// that observation in the order they are received.
-  private var missedMessagesForRecipients: [UUID: [Data]] = [:]
+  /// that observation in the order they are received. The buffer spills to disk and expires old
+  /// messages so that recipients that register late or never do not grow memory without bound.
+  private let missedMessagesForRecipients = MissedMessageBuffer<Data>(
+    encode: { $0 },
+    decode: { $0 }
+  )
+
+  /// The observation of each recipient whose missed messages are still being read from disk.
+  ///
+  /// Messages that arrive for these recipients are buffered behind the missed ones so that they are
+  /// delivered in the order they were received.
+  private var drainingMessageObservations: [UUID: UUID] = [:]
 
   /// A mapping of feature IDs to closures that should be notified when a query is received for that
   /// feature.
@@ -52,7 +62,25 @@ class EstablishedCarChannel: NSObject, SecuredCarChannelPeripheral {
   ///
   /// These queries are saved until an observer is registered, after which the queries are sent to
   /// that observation in the order they are received.
-  private var missedQueriesForRecipients: [UUID: [(Int32, UUID, Query)]] = [:]
+  private let missedQueriesForRecipients = MissedMessageBuffer<(Int32, UUID, Query)>(
+    encode: { id, sender, query in try query.toProtoData(queryID: id, sender: sender) },
+    decode: { data in
+      ReceivedQuery(serializedData: data).map { ($0.id, $0.sender, $0.query) }
+    }
+  )
+
+  /// The observation of each recipient whose missed queries are still being read from disk.
+  private var drainingQueryObservations: [UUID: UUID] = [:]
+
+  /// Statistics on the messages held for recipients without an observer.
+  var missedMessageMetrics: MissedMessageBufferMetrics {
+    return missedMessagesForRecipients.metrics
+  }
+
+  /// Statistics on the queries held for recipients without an observer.
+  var missedQueryMetrics: MissedMessageBufferMetrics {
+    return missedQueriesForRecipients.metrics
+  }
 
   /// Keep track of unique recipient UUIDs being observed to an identifier for observations
   /// that should be invoked when a query is received.
@@ -64,6 +92,9 @@ class EstablishedCarChannel: NSObject, SecuredCarChannelPeripheral {
   /// back.
   private var queryResponseHandlers: [Int32: ((QueryResponse) -> Void)] = [:]
 
+  /// Observations to notify when the user role changes.
+  private var userRoleChangeObservations: [UUID: (SecuredCarChannel, UserRole) -> Void] = [:]
+
   /// The current ID to use for queries.
   ///
   /// This value should always be non-negative and is defined as an `Int32` because it needs to be
@@ -123,17 +154,34 @@ extension EstablishedCarChannel: SecuredCarChannel {
     // Check for missed messages after the handle has been returned. This allows observers to not
     // have to worry about race conditions between registering and receiving messages.
     defer {
-      if let missedMessages = missedMessagesForRecipients[recipient] {
-        for message in missedMessages {
-          observation(self, message)
-        }
-        missedMessagesForRecipients[recipient] = nil
+      deliverMissedElements(
+        from: missedMessagesForRecipients,
+        to: recipient,
+        observationID: id,
+        trackedIn: \.drainingMessageObservations
+      ) { [weak self] message in
+        guard let self = self else { return }
+        observation(self, message)
       }
     }
 
     return ObservationHandle { [weak self] in
       self?.receivedMessageObservations.removeValue(forKey: id)
       self?.messageRecipientToObservations[recipient] = nil
+      if self?.drainingMessageObservations[recipient] == id {
+        self?.drainingMessageObservations[recipient] = nil
+      }
+    }
+  }
+
+  public func observeUserRoleChange(
+    using observation: @escaping (SecuredCarChannel, UserRole) -> Void
+  ) -> ObservationHandle {
+    let id = UUID()
+    userRoleChangeObservations[id] = observation
+
+    return ObservationHandle { [weak self] in
+      self?.userRoleChangeObservations.removeValue(forKey: id)
     }
   }
 
@@ -152,17 +200,22 @@ extension EstablishedCarChannel: SecuredCarChannel {
     // Check for missed queries after the handle has been returned. This allows observers to not
     // have to worry about race conditions between registering and receiving queries.
     defer {
-      if let missedQueries = missedQueriesForRecipients[recipient] {
-        for (id, sender, query) in missedQueries {
-          observation(id, sender, query)
-        }
-        missedQueriesForRecipients[recipient] = nil
+      deliverMissedElements(
+        from: missedQueriesForRecipients,
+        to: recipient,
+        observationID: id,
+        trackedIn: \.drainingQueryObservations
+      ) { id, sender, query in
+        observation(id, sender, query)
       }
     }
 
     return ObservationHandle { [weak self] in
       self?.receivedQueryObservations.removeValue(forKey: id)
       self?.queryRecipientToObservations[recipient] = nil
+      if self?.drainingQueryObservations[recipient] == id {
+        self?.drainingQueryObservations[recipient] = nil
+      }
     }
   }
 
@@ -176,14 +229,13 @@ extension EstablishedCarChannel: SecuredCarChannel {
     }
 
     do {
-      try messageStream.writeEncryptedMessage(
-        message,
-        params: MessageStreamParams(recipient: recipient, operationType: .clientMessage)
-      )
-
       // Ensure that there is always a completion handler for each write. This simplifies the logic
       // of notifying handlers when a write is complete because a closure can always be called.
-      writeCompletionHandlers.append(completion ?? noop)
+      try enqueueWrite(
+        message,
+        params: MessageStreamParams(recipient: recipient, operationType: .clientMessage),
+        completion: completion ?? noop
+      )
     } catch {
       Self.log.error("Attempt to write encrypted message failed: \(error.localizedDescription)")
 
@@ -201,17 +253,22 @@ extension EstablishedCarChannel: SecuredCarChannel {
     }
 
     let queryID = nextQueryID()
+
+    // Register the handler before enqueueing, since the write may complete synchronously and its
+    // failure cleanup must find the handler to remove it.
+    queryResponseHandlers[queryID] = response
     do {
-      try messageStream.writeEncryptedMessage(
+      // A query that fails to send will never receive a response, so stop waiting for one.
+      try enqueueWrite(
         try query.toProtoData(queryID: queryID, sender: recipient),
         params: MessageStreamParams(recipient: recipient, operationType: .query)
-      )
-
-      // Add a no-op completion handler to be called when the query has finished sending. This
-      // ensures all out-standing messages have completion handlers.
-      writeCompletionHandlers.append(noop)
-      queryResponseHandlers[queryID] = response
+      ) { [weak self] success in
+        if !success {
+          self?.queryResponseHandlers[queryID] = nil
+        }
+      }
     } catch {
+      queryResponseHandlers[queryID] = nil
       Self.log.error("Attempt to send query failed: \(error.localizedDescription)")
       throw SecuredCarChannelError.cannotEncryptMessage
     }
@@ -223,14 +280,11 @@ extension EstablishedCarChannel: SecuredCarChannel {
     }
 
     do {
-      try messageStream.writeEncryptedMessage(
+      try enqueueWrite(
         try queryResponse.toProtoData(),
-        params: MessageStreamParams(recipient: recipient, operationType: .queryResponse)
+        params: MessageStreamParams(recipient: recipient, operationType: .queryResponse),
+        completion: noop
       )
-
-      // Add a no-op completion handler to be called when the response has finished sending. This
-      // ensures all out-standing messages have completion handlers.
-      writeCompletionHandlers.append(noop)
     } catch {
       Self.log.error("Attempt to send query response failed: \(error.localizedDescription)")
       throw SecuredCarChannelError.cannotEncryptMessage
@@ -251,6 +305,66 @@ extension EstablishedCarChannel: SecuredCarChannel {
     return currentQueryID
   }
 
+  public func setSendPolicy(_ policy: FeatureSendPolicy, for recipient: UUID) {
+    multiplexer.setPolicy(policy, for: recipient)
+  }
+
+  public func sendStatistics(for recipient: UUID) -> FeatureSendStatistics {
+    return multiplexer.statistics(for: recipient)
+  }
+
+  /// Queues a message to be written to the stream when its recipient's turn comes.
+  ///
+  /// - Throws: An error if the message is written immediately and the stream fails to encrypt it.
+  private func enqueueWrite(
+    _ message: Data,
+    params: MessageStreamParams,
+    completion: @escaping (Bool) -> Void
+  ) throws {
+    try multiplexer.enqueue(
+      byteCount: message.count,
+      to: params.recipient,
+      write: { [messageStream] in
+        try messageStream.writeEncryptedMessage(message, params: params)
+      },
+      completion: completion
+    )
+  }
+
+  /// Hands the missed elements of a recipient to `deliver` in the order they were received.
+  ///
+  /// While spilled elements are read from disk, the recipient is listed in `drainingObservations`
+  /// and newly received elements are buffered. Those are delivered once the read completes, as
+  /// long as the observation is still registered.
+  private func deliverMissedElements<Element>(
+    from buffer: MissedMessageBuffer<Element>,
+    to recipient: UUID,
+    observationID: UUID,
+    trackedIn drainingObservations: ReferenceWritableKeyPath<EstablishedCarChannel, [UUID: UUID]>,
+    using deliver: @escaping (Element) -> Void
+  ) {
+    self[keyPath: drainingObservations][recipient] = observationID
+
+    buffer.removeAll(for: recipient) { [weak self] elements in
+      elements.forEach(deliver)
+
+      guard let self = self, self[keyPath: drainingObservations][recipient] == observationID
+      else { return }
+
+      guard buffer.containsMessages(for: recipient) else {
+        self[keyPath: drainingObservations][recipient] = nil
+        return
+      }
+
+      self.deliverMissedElements(
+        from: buffer,
+        to: recipient,
+        observationID: observationID,
+        trackedIn: drainingObservations,
+        using: deliver)
+    }
+  }
+
   /// Convenience method that performs no action.
   private func noop(_ value: Bool) {}
 }
@@ -273,6 +387,23 @@ extension EstablishedCarChannel: SecuredConnectedDeviceChannel {
       }
     }
   }
+
+  func updateUserRole(_ userRole: UserRole) {
+    let previousRole = self.userRole
+    self.userRole = userRole
+
+    guard let previous = previousRole, previous != userRole else { return }
+
+    Self.log.info("User role changed from \(previous) to \(userRole).")
+    userRoleChangeObservations.values.forEach { observation in
+      observation(self, userRole)
+    }
+  }
+
+  func handleDisconnection() {
+    // The stream will not report the outcome of writes that were queued or in flight.
+    multiplexer.cancelAll()
+  }
 }
 
 // MARK: - MessageStreamDelegate
@@ -291,17 +422,8 @@ extension EstablishedCarChannel: MessageStreamDelegate {
       """
     )
 
-    // This should not happen because a handler is always stored for every write.
-    guard !writeCompletionHandlers.isEmpty else {
-      assertionFailure("No completion handler to call after a message write failure.")
-
-      Self.log.fault(
-        "Unexpected. No completion handler able to call after a message write failure.")
-      return
-    }
-
-    let handler = writeCompletionHandlers.removeFirst()
-    handler(false)
+    // Writes complete in the order they were handed to the stream.
+    multiplexer.completeWrite(isSuccessful: false)
   }
 
   public func messageStream(
@@ -325,7 +447,9 @@ extension EstablishedCarChannel: MessageStreamDelegate {
   }
 
   private func handleClientMessage(_ message: Data, from recipient: UUID) {
-    if let observationUUID = messageRecipientToObservations[recipient] {
+    if let observationUUID = messageRecipientToObservations[recipient],
+      drainingMessageObservations[recipient] == nil
+    {
       Self.log.debug("Received client message. Passing onto feature with UUID \(recipient)")
 
       receivedMessageObservations[observationUUID]?(self, message)
@@ -335,11 +459,7 @@ extension EstablishedCarChannel: MessageStreamDelegate {
     Self.log(
       "Received client message for \(recipient), but no registered observer. Saving message.")
 
-    if missedMessagesForRecipients[recipient] == nil {
-      missedMessagesForRecipients[recipient] = []
-    }
-
-    missedMessagesForRecipients[recipient]?.append(message)
+    missedMessagesForRecipients.append(message, for: recipient)
   }
 
   private func handleQueryResponse(_ message: Data) {
@@ -362,43 +482,32 @@ extension EstablishedCarChannel: MessageStreamDelegate {
   }
 
   private func handleQuery(_ message: Data, for recipient: UUID) {
-    guard let query = try? QueryProto(serializedData: message) else {
+    guard let query = ReceivedQuery(serializedData: message) else {
       Self.log.error("Received query but unable to parse. Ignoring.")
       return
     }
 
-    if let observationID = queryRecipientToObservations[recipient] {
+    if let observationID = queryRecipientToObservations[recipient],
+      drainingQueryObservations[recipient] == nil
+    {
       // Unlikely for this unwrap to fail since the observation ID is created at the time of
       // registration.
-      receivedQueryObservations[observationID]?(query.id, query.senderUUID, query.toQuery())
+      receivedQueryObservations[observationID]?(query.id, query.sender, query.query)
       return
     }
 
     Self.log.error(
       "Received query for recipient \(recipient) but no registered observation. Saving query")
 
-    if missedQueriesForRecipients[recipient] == nil {
-      missedQueriesForRecipients[recipient] = []
-    }
-
-    missedQueriesForRecipients[recipient]?.append((query.id, query.senderUUID, query.toQuery()))
+    missedQueriesForRecipients.append((query.id, query.sender, query.query), for: recipient)
   }
 
   public func messageStreamDidWriteMessage(
     _ messageStream: MessageStream,
     to recipient: UUID
   ) {
-    // This should not happen because a handler is always stored for every write.
-    guard !writeCompletionHandlers.isEmpty else {
-      assertionFailure("No completion handler to call after a successful message write.")
-
-      Self.log.fault(
-        "Unexpected. No completion handler able to call after a successful message write.")
-      return
-    }
-
-    let handler = writeCompletionHandlers.removeFirst()
-    handler(true)
+    // Writes complete in the order they were handed to the stream.
+    multiplexer.completeWrite(isSuccessful: true)
   }
 
   public func messageStreamEncounteredUnrecoverableError(_ messageStream: MessageStream) {
@@ -409,19 +518,6 @@ extension EstablishedCarChannel: MessageStreamDelegate {
 
 // MARK: - Helper extensions
 
-extension QueryProto {
-  /// Converts this proto to its `Query` representation.
-  fileprivate func toQuery() -> Query {
-    return Query(request: self.request, parameters: self.parameters)
-  }
-
-  /// A `UUID` representation of the `sender` field.
-  fileprivate var senderUUID: UUID {
-    NSUUID(uuidBytes: [UInt8](self.sender)) as UUID
-  }
-
-}
-
 extension QueryResponseProto {
   /// Converts this proto to its `QueryResponse` representation
   fileprivate func toQueryResponse() -> QueryResponse {
@@ -0,0 +1,158 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+import AndroidAutoLogger
+import Foundation
+
+/// Where the event callbacks of a `FeatureManager` are invoked.
+public enum FeatureExecutionContext {
+  /// Callbacks are invoked synchronously on the thread that delivers the event from the car.
+  case inline
+
+  /// Callbacks are invoked in order on a serial queue owned by the feature.
+  ///
+  /// While `maxPendingMessages` or more events are waiting to be handled, newly received messages
+  /// and queries are dropped. A dropped query is answered with an unsuccessful response so the car
+  /// does not wait for it. Connection events are never dropped.
+  case serialQueue(maxPendingMessages: Int)
+}
+
+/// Statistics on the delivery of events to a feature.
+public struct FeatureInboxMetrics {
+  /// The number of events waiting to be handled by the feature.
+  public fileprivate(set) var pendingEventCount = 0
+
+  /// The largest value `pendingEventCount` has reached.
+  public fileprivate(set) var maxPendingEventCount = 0
+
+  /// The number of events that have been handed to the feature.
+  public fileprivate(set) var deliveredEventCount = 0
+
+  /// The number of messages and queries dropped because the inbox was full.
+  public fileprivate(set) var droppedEventCount = 0
+
+  /// Seconds between the most recent event being received and the feature starting to handle it.
+  public fileprivate(set) var lastDispatchLag: TimeInterval = 0
+
+  /// The largest dispatch lag observed.
+  public fileprivate(set) var maxDispatchLag: TimeInterval = 0
+}
+
+/// Delivers the events of a single feature in its configured `FeatureExecutionContext`.
+final class FeatureInbox {
+  private static let log = Logger(for: FeatureInbox.self)
+
+  /// The queue that runs the feature's callbacks or `nil` if they are run inline.
+  private let queue: DispatchQueue?
+  private let maxPendingMessages: Int
+
+  /// Guards `storedMetrics`.
+  private let lock = NSLock()
+  private var storedMetrics = FeatureInboxMetrics()
+
+  var metrics: FeatureInboxMetrics {
+    lock.lock()
+    defer { lock.unlock() }
+    return storedMetrics
+  }
+
+  /// Creates an inbox for the feature with the given identifier.
+  ///
+  /// - Parameters:
+  ///   - featureID: The identifier of the feature, used to label its queue.
+  ///   - context: Where the feature's callbacks should be invoked.
+  init(featureID: UUID, context: FeatureExecutionContext) {
+    switch context {
+    case .inline:
+      queue = nil
+      maxPendingMessages = .max
+    case .serialQueue(let maxPendingMessages):
+      queue = DispatchQueue(label: "com.google.ios.aae.FeatureManager.\(featureID.uuidString)")
+      self.maxPendingMessages = max(maxPendingMessages, 1)
+    }
+  }
+
+  /// Delivers a message or query, dropping it if the inbox is full.
+  ///
+  /// - Parameter event: The callback to invoke.
+  /// - Returns: `false` if the event was dropped.
+  @discardableResult
+  func deliverMessage(_ event: @escaping () -> Void) -> Bool {
+    return deliver(isDroppable: true, event)
+  }
+
+  /// Delivers a connection event, which is never dropped.
+  ///
+  /// - Parameter event: The callback to invoke.
+  func deliverConnectionEvent(_ event: @escaping () -> Void) {
+    deliver(isDroppable: false, event)
+  }
+
+  /// Delivers the completion of a write or query issued by the feature, which is never dropped.
+  ///
+  /// - Parameter event: The callback to invoke.
+  func deliverCompletion(_ event: @escaping () -> Void) {
+    deliver(isDroppable: false, event)
+  }
+
+  /// Blocks until all events that have been delivered so far have been handled.
+  func waitUntilIdle() {
+    queue?.sync {}
+  }
+
+  @discardableResult
+  private func deliver(isDroppable: Bool, _ event: @escaping () -> Void) -> Bool {
+    guard let queue = queue else {
+      lock.lock()
+      storedMetrics.deliveredEventCount += 1
+      lock.unlock()
+
+      event()
+      return true
+    }
+
+    lock.lock()
+    if isDroppable, storedMetrics.pendingEventCount >= maxPendingMessages {
+      storedMetrics.droppedEventCount += 1
+      lock.unlock()
+
+      Self.log.error("Inbox full with \(maxPendingMessages) pending events. Dropping message.")
+      return false
+    }
+    storedMetrics.pendingEventCount += 1
+    storedMetrics.maxPendingEventCount = max(
+      storedMetrics.maxPendingEventCount, storedMetrics.pendingEventCount)
+    lock.unlock()
+
+    let receivedTime = DispatchTime.now()
+    queue.async { [weak self] in
+      self?.recordDispatch(receivedAt: receivedTime)
+      event()
+    }
+    return true
+  }
+
+  private func recordDispatch(receivedAt receivedTime: DispatchTime) {
+    let lagNanoseconds = DispatchTime.now().uptimeNanoseconds - receivedTime.uptimeNanoseconds
+    let lag = TimeInterval(lagNanoseconds) / TimeInterval(NSEC_PER_SEC)
+
+    lock.lock()
+    defer { lock.unlock() }
+
+    storedMetrics.pendingEventCount -= 1
+    storedMetrics.deliveredEventCount += 1
+    storedMetrics.lastDispatchLag = lag
+    storedMetrics.maxDispatchLag = max(storedMetrics.maxDispatchLag, lag)
+  }
+}
@@ -12,6 +12,7 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+import AndroidAutoLogger
 @_implementationOnly import AndroidAutoSecureChannel
 import Foundation
 
@@ -33,6 +34,11 @@ public enum FeatureManagerError: Error {
 /// property is overridden, or this class will crash.
 @available(watchOS 6.0, *)
 open class FeatureManager {
+  private static let log = Logger(for: FeatureManager.self)
+
+  /// The identifier of the failed response passed to a query that could not be sent.
+  private static let unsentQueryID: Int32 = -1
+
   private let connectedCarManager: ConnectedCarManager
 
   private var secureChannelHandle: ObservationHandle?
@@ -42,6 +48,10 @@ open class FeatureManager {
 
   private var messageReceivedHandles: [String: ObservationHandle] = [:]
   private var queryReceivedHandles: [String: ObservationHandle] = [:]
+  private var userRoleChangeHandles: [String: ObservationHandle] = [:]
+
+  /// Delivers events to this feature in its `executionContext`.
+  private var inbox: FeatureInbox!
 
   /// An identifier that unique to this feature manager.
   ///
@@ -50,6 +60,34 @@ open class FeatureManager {
     fatalError("Feature ID must be supplied.")
   }
 
+  /// Where the event callbacks of this feature manager are invoked.
+  ///
+  /// By default, callbacks are invoked inline on the thread that delivers events from the car. A
+  /// feature that performs slow work, such as disk I/O, in its callbacks should override this to
+  /// return `.serialQueue(maxPendingMessages:)` so that it does not delay the delivery of events to
+  /// other features. The value is read once when this feature manager is initialized.
+  ///
+  /// The write methods of this class can be called from any context.
+  open var executionContext: FeatureExecutionContext {
+    return .inline
+  }
+
+  /// How the messages this feature sends are scheduled relative to those of other features.
+  ///
+  /// By default, every feature gets an equal share of the bandwidth to a car. An interactive
+  /// feature can override this to return a larger weight, and a feature that sends bulk data can
+  /// return a rate limit so that it does not delay the messages of other features. The value is
+  /// applied each time a secure channel is established.
+  open var sendPolicy: FeatureSendPolicy {
+    return .default
+  }
+
+  /// Statistics on the delivery of events to this feature, such as the number of pending events
+  /// and how long they waited before being handled.
+  public final var inboxMetrics: FeatureInboxMetrics {
+    return inbox.metrics
+  }
+
   /// A list of cars that have secure communication channels established.
   ///
   /// The cars in this list can be sent secure messages.
@@ -66,9 +104,12 @@ open class FeatureManager {
   /// - Parameter connectedCarManager: The manager of connecting cars.
   public init(connectedCarManager: ConnectedCarManager) {
     self.connectedCarManager = connectedCarManager
+    inbox = FeatureInbox(featureID: featureID, context: executionContext)
 
     connectHandle = connectedCarManager.observeConnection { [weak self] _, car in
-      self?.onCarConnected(car)
+      self?.inbox.deliverConnectionEvent { [weak self] in
+        self?.onCarConnected(car)
+      }
     }
 
     dissociationHandle = connectedCarManager.observeDissociation { [weak self] _, car in
@@ -91,6 +132,7 @@ open class FeatureManager {
     dissociationHandle?.cancel()
     messageReceivedHandles.values.forEach { $0.cancel() }
     queryReceivedHandles.values.forEach { $0.cancel() }
+    userRoleChangeHandles.values.forEach { $0.cancel() }
   }
 
   // MARK: - Write methods.
@@ -103,7 +145,11 @@ open class FeatureManager {
   /// invoking this method.
   ///
   /// The optional `completion` parameter will be invoked with a value of `true` if the message was
-  /// sent successfully.
+  /// sent successfully. It is invoked in this feature's `executionContext`.
+  ///
+  /// When called off the main thread, this method does not wait for the message to be handed to
+  /// the car and does not throw. Any error is instead reported by invoking `completion` with
+  /// `false`.
   ///
   /// - Parameters:
   ///   - message: The message to send.
@@ -118,11 +164,35 @@ open class FeatureManager {
     to car: Car,
     completion: ((Bool) -> Void)? = nil
   ) throws {
-    guard let channel = connectedCarManager.securedChannel(for: car) else {
-      throw FeatureManagerError.noSecureChannel
+    let inbox = self.inbox!
+    let connectedCarManager = self.connectedCarManager
+    let featureID = self.featureID
+
+    // Only touched on the main thread, by the write and by its failure handler.
+    var isCompleted = false
+    let inboxCompletion: ((Bool) -> Void)? = completion.map { completion in
+      { success in
+        isCompleted = true
+        inbox.deliverCompletion { completion(success) }
+      }
     }
 
-    try channel.writeEncryptedMessage(message, to: featureID, completion: completion)
+    try performOnTransportThread(
+      {
+        guard let channel = connectedCarManager.securedChannel(for: car) else {
+          throw FeatureManagerError.noSecureChannel
+        }
+
+        try channel.writeEncryptedMessage(message, to: featureID, completion: inboxCompletion)
+      },
+      onFailure: { error in
+        FeatureManager.log.error(
+          "Unable to send message to car \(car.logName): \(error.localizedDescription)")
+        if !isCompleted {
+          inboxCompletion?(false)
+        }
+      }
+    )
   }
 
   /// Sends a query to the given car.
@@ -139,19 +209,38 @@ open class FeatureManager {
   ///   - query: The query to send to the car.
   ///   - car: The car that will receive the query. If the car is not securely connected, this
   ///     method will throw an error
-  ///   - response: the closure that will be invoked when the car responds.
+  ///   - response: the closure that will be invoked when the car responds. It is invoked in this
+  ///     feature's `executionContext`.
   /// - Throws: An error if the given car is not set up for secure communication or an error occurs
-  ///   during the query.
+  ///   during the query. When called off the main thread, this method does not throw and instead
+  ///   invokes `response` with an unsuccessful, empty response.
   public final func sendQuery(
     _ query: Query,
     to car: Car,
     response: @escaping (QueryResponse) -> Void
   ) throws {
-    guard let channel = connectedCarManager.securedChannel(for: car) else {
-      throw FeatureManagerError.noSecureChannel
+    let inbox = self.inbox!
+    let connectedCarManager = self.connectedCarManager
+    let featureID = self.featureID
+    let inboxResponse = { (queryResponse: QueryResponse) in
+      inbox.deliverCompletion { response(queryResponse) }
     }
 
-    try channel.sendQuery(query, to: featureID, response: response)
+    try performOnTransportThread(
+      {
+        guard let channel = connectedCarManager.securedChannel(for: car) else {
+          throw FeatureManagerError.noSecureChannel
+        }
+
+        try channel.sendQuery(query, to: featureID, response: inboxResponse)
+      },
+      onFailure: { error in
+        FeatureManager.log.error(
+          "Unable to send query to car \(car.logName): \(error.localizedDescription)")
+        inboxResponse(
+          QueryResponse(id: FeatureManager.unsentQueryID, isSuccessful: false, response: Data()))
+      }
+    )
   }
 
   /// Returns `true` if secure messages can be sent to the given car.
@@ -175,6 +264,13 @@ open class FeatureManager {
   /// Once this method has been called for a car, `sendMessage(to:)` can be called for that car.
   open func onSecureChannelEstablished(for car: Car) {}
 
+  /// Invoked when the car reports a user role that differs from the one the secure channel was
+  /// established with.
+  ///
+  /// A secure channel may be established with the role that was last reported by the car, which
+  /// the car then confirms in the background. This method is only invoked if the roles differ.
+  open func onUserRoleChanged(to userRole: UserRole, for car: Car) {}
+
   /// Invoked when a car has been disassociated.
   ///
   /// When a car has disassociated, it will need to undergo the association process again before
@@ -204,20 +300,67 @@ open class FeatureManager {
 
   // MARK: - Private event methods.
 
+  /// Blocks until all events delivered to this feature so far have been handled.
+  func waitForPendingEvents() {
+    inbox.waitUntilIdle()
+  }
+
+  /// Runs the given work on the main thread, which delivers the events of the transport.
+  ///
+  /// On the main thread, the work runs immediately and its error is thrown. From any other thread,
+  /// the work is dispatched without waiting for it because the main thread may itself be waiting
+  /// for this feature's queue. An error is then passed to `onFailure` on the main thread.
+  private func performOnTransportThread(
+    _ work: @escaping () throws -> Void,
+    onFailure: @escaping (Error) -> Void
+  ) throws {
+    guard !Thread.isMainThread else {
+      try work()
+      return
+    }
+
+    DispatchQueue.main.async {
+      do {
+        try work()
+      } catch {
+        onFailure(error)
+      }
+    }
+  }
+
+  /// Returns statistics on the messages this feature has sent to the given car during its current
+  /// connection, such as the number of bytes sent and how long messages took to be written.
+  ///
+  /// - Parameter car: The car to return statistics for.
+  /// - Returns: The statistics or `nil` if the car does not have a secure channel.
+  public final func sendStatistics(for car: Car) -> FeatureSendStatistics? {
+    return connectedCarManager.securedChannel(for: car)?.sendStatistics(for: featureID)
+  }
+
   private func handleSecureChannelEstablished(_ channel: SecuredCarChannel) {
+    channel.setSendPolicy(sendPolicy, for: featureID)
     initializeMessageObserver(on: channel)
     initializeQueryObserver(on: channel)
-    onSecureChannelEstablished(for: channel.car)
+    initializeUserRoleObserver(on: channel)
+
+    let car = channel.car
+    inbox.deliverConnectionEvent { [weak self] in
+      self?.onSecureChannelEstablished(for: car)
+    }
   }
 
   private func handleDisconnectedCar(_ car: Car) {
     clearMessageHandles(for: car)
-    onCarDisconnected(car)
+    inbox.deliverConnectionEvent { [weak self] in
+      self?.onCarDisconnected(car)
+    }
   }
 
   private func handleDisassociatedCar(_ car: Car) {
     clearMessageHandles(for: car)
-    onCarDisassociated(car)
+    inbox.deliverConnectionEvent { [weak self] in
+      self?.onCarDisassociated(car)
+    }
   }
 
   private func initializeMessageObserver(on channel: SecuredCarChannel) {
@@ -225,7 +368,9 @@ open class FeatureManager {
 
     do {
       let handle = try channel.observeMessageReceived(from: featureID) { [weak self] _, message in
-        self?.onMessageReceived(message, from: channel.car)
+        self?.inbox.deliverMessage { [weak self] in
+          self?.onMessageReceived(message, from: channel.car)
+        }
       }
 
       messageReceivedHandles[channel.car.id] = handle
@@ -249,7 +394,16 @@ open class FeatureManager {
     do {
       let handle = try channel.observeQueryReceived(from: featureID) {
         [weak self] queryID, sender, query in
-        self?.handleQuery(query, queryID: queryID, sender: sender, car: channel.car)
+        guard let self = self else { return }
+
+        let isDelivered = self.inbox.deliverMessage { [weak self] in
+          self?.handleQuery(query, queryID: queryID, sender: sender, car: channel.car)
+        }
+
+        // The car waits for a response to every query, so answer a dropped one right away.
+        if !isDelivered {
+          self.rejectDroppedQuery(queryID: queryID, sender: sender, on: channel)
+        }
       }
 
       queryReceivedHandles[channel.car.id] = handle
@@ -280,18 +434,51 @@ open class FeatureManager {
     onQueryReceived(query, from: car, responseHandle: responseHandle)
   }
 
+  private func rejectDroppedQuery(queryID: Int32, sender: UUID, on channel: SecuredCarChannel) {
+    do {
+      try channel.sendQueryResponse(
+        QueryResponse(id: queryID, isSuccessful: false, response: Data()),
+        to: sender
+      )
+    } catch {
+      FeatureManager.log.error(
+        "Unable to reject query for car \(channel.car.logName): \(error.localizedDescription)")
+    }
+  }
+
   private func sendQueryResponse(
     _ queryResponse: QueryResponse, to car: Car, sender: UUID
   ) throws {
-    guard let channel = connectedCarManager.securedChannel(for: car) else {
-      throw FeatureManagerError.noSecureChannel
-    }
+    let connectedCarManager = self.connectedCarManager
+    try performOnTransportThread(
+      {
+        guard let channel = connectedCarManager.securedChannel(for: car) else {
+          throw FeatureManagerError.noSecureChannel
+        }
+
+        try channel.sendQueryResponse(queryResponse, to: sender)
+      },
+      onFailure: { error in
+        FeatureManager.log.error(
+          "Unable to send query response to car \(car.logName): \(error.localizedDescription)")
+      }
+    )
+  }
 
-    try channel.sendQueryResponse(queryResponse, to: sender)
+  private func initializeUserRoleObserver(on channel: SecuredCarChannel) {
+    userRoleChangeHandles[channel.car.id]?.cancel()
+
+    userRoleChangeHandles[channel.car.id] = channel.observeUserRoleChange {
+      [weak self] channel, userRole in
+      self?.inbox.deliverConnectionEvent { [weak self] in
+        self?.onUserRoleChanged(to: userRole, for: channel.car)
+      }
+    }
   }
 
   private func clearMessageHandles(for car: Car) {
     messageReceivedHandles.removeValue(forKey: car.id)?.cancel()
     queryReceivedHandles.removeValue(forKey: car.id)?.cancel()
+    userRoleChangeHandles.removeValue(forKey: car.id)?.cancel()
   }
 }
@@ -0,0 +1,383 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+import AndroidAutoLogger
+import Foundation
+
+/// How the messages of a feature are scheduled relative to those of other features on the same
+/// car.
+public struct FeatureSendPolicy: Equatable {
+  /// The default policy: an equal share of the bandwidth and no rate limit.
+  public static let `default` = FeatureSendPolicy()
+
+  /// The share of the bandwidth the feature receives, relative to other features that are
+  /// sending at the same time.
+  public let weight: Double
+
+  /// The most bytes per second the feature may send, or `nil` if it is not limited.
+  public let maxBytesPerSecond: Int?
+
+  /// The most bytes the feature may send at once before its rate limit applies.
+  public let burstBytes: Int
+
+  /// Creates a policy.
+  ///
+  /// - Parameters:
+  ///   - weight: The relative share of the bandwidth. Must be positive.
+  ///   - maxBytesPerSecond: The most bytes per second the feature may send.
+  ///   - burstBytes: The most bytes that may be sent at once. Defaults to one second's worth.
+  public init(weight: Double = 1, maxBytesPerSecond: Int? = nil, burstBytes: Int? = nil) {
+    precondition(weight > 0, "The weight of a feature must be positive.")
+
+    self.weight = weight
+    self.maxBytesPerSecond = maxBytesPerSecond
+    self.burstBytes = burstBytes ?? maxBytesPerSecond ?? .max
+  }
+}
+
+/// Statistics on the messages a feature has sent to a car.
+public struct FeatureSendStatistics: Equatable {
+  /// The number of messages that finished writing, successfully or not.
+  public internal(set) var messageCount = 0
+
+  /// The number of bytes in the messages that finished writing.
+  public internal(set) var byteCount = 0
+
+  /// The number of messages that failed to write.
+  public internal(set) var failedMessageCount = 0
+
+  /// The number of messages waiting to be written.
+  public internal(set) var pendingMessageCount = 0
+
+  /// The number of messages of the feature that were held back by its rate limit.
+  public internal(set) var throttledMessageCount = 0
+
+  /// Seconds from the most recent message being sent until it finished writing.
+  public internal(set) var lastLatency: TimeInterval = 0
+
+  /// The largest latency observed.
+  public internal(set) var maxLatency: TimeInterval = 0
+
+  /// The sum of the latencies of all messages.
+  public internal(set) var totalLatency: TimeInterval = 0
+
+  /// The mean latency of the messages that finished writing.
+  public var averageLatency: TimeInterval {
+    return messageCount > 0 ? totalLatency / TimeInterval(messageCount) : 0
+  }
+}
+
+/// Schedules the writes of several recipients onto a single message stream.
+///
+/// Writes are ordered by weighted fair queuing: each recipient receives bandwidth in proportion
+/// to the weight of its `FeatureSendPolicy`, so a recipient that sends continuously cannot starve
+/// the others. Recipients with a rate limit are held back until their token bucket allows the
+/// next message. Only `maxInFlightWrites` writes are handed to the stream at once so that newly
+/// queued messages can still be ordered ahead of those of busier recipients.
+///
+/// Writes complete in the order they were handed to the stream, matching the stream's delegate
+/// callbacks.
+final class FeatureMessageMultiplexer {
+  private static let log = Logger(for: FeatureMessageMultiplexer.self)
+
+  /// A write waiting for its turn or in flight.
+  private struct PendingWrite {
+    let id: Int
+    let recipient: UUID
+    let byteCount: Int
+    let write: () throws -> Void
+    let completion: (Bool) -> Void
+    let enqueueTime: TimeInterval
+
+    /// The virtual time at which this write starts and finishes under fair queuing.
+    let startTag: Double
+    let finishTag: Double
+
+    /// Whether this write has been counted as held back by its recipient's rate limit.
+    var isThrottled = false
+  }
+
+  /// Limits the rate at which a recipient can send.
+  private struct TokenBucket {
+    let bytesPerSecond: Double
+    let capacity: Double
+    var tokens: Double
+    var lastRefillTime: TimeInterval
+
+    mutating func refill(at time: TimeInterval) {
+      tokens = min(capacity, tokens + (time - lastRefillTime) * bytesPerSecond)
+      lastRefillTime = time
+    }
+
+    /// Seconds until a message of the given size may be sent.
+    ///
+    /// A message larger than the capacity may be sent once the bucket is full.
+    func delay(forByteCount byteCount: Int) -> TimeInterval {
+      let required = min(Double(byteCount), capacity)
+      return tokens >= required ? 0 : (required - tokens) / bytesPerSecond
+    }
+  }
+
+  private let maxInFlightWrites: Int
+  private let now: () -> TimeInterval
+  private let scheduleRetry: (TimeInterval, @escaping () -> Void) -> Void
+
+  private var queues: [UUID: [PendingWrite]] = [:]
+  private var inFlightWrites: [PendingWrite] = []
+
+  private var policies: [UUID: FeatureSendPolicy] = [:]
+  private var tokenBuckets: [UUID: TokenBucket] = [:]
+  private var sendStatistics: [UUID: FeatureSendStatistics] = [:]
+
+  /// The virtual time of fair queuing, which advances as writes are handed to the stream.
+  private var virtualTime: Double = 0
+  private var lastFinishTags: [UUID: Double] = [:]
+
+  private var isRetryScheduled = false
+  private var nextWriteID = 0
+
+  /// Creates a multiplexer.
+  ///
+  /// - Parameters:
+  ///   - maxInFlightWrites: The most writes handed to the stream at once.
+  ///   - now: The current time in seconds.
+  ///   - scheduleRetry: Invokes the given closure after the given number of seconds, on the
+  ///     context that writes are made from.
+  init(
+    maxInFlightWrites: Int = 2,
+    now: @escaping () -> TimeInterval = { ProcessInfo.processInfo.systemUptime },
+    scheduleRetry: @escaping (TimeInterval, @escaping () -> Void) -> Void = { delay, work in
+      DispatchQueue.main.asyncAfter(deadline: .now() + delay, execute: work)
+    }
+  ) {
+    self.maxInFlightWrites = max(maxInFlightWrites, 1)
+    self.now = now
+    self.scheduleRetry = scheduleRetry
+  }
+
+  /// Sets the policy of the given recipient, replacing any previous one.
+  func setPolicy(_ policy: FeatureSendPolicy, for recipient: UUID) {
+    policies[recipient] = policy
+
+    if let maxBytesPerSecond = policy.maxBytesPerSecond {
+      let capacity = Double(max(policy.burstBytes, 1))
+      tokenBuckets[recipient] = TokenBucket(
+        bytesPerSecond: Double(max(maxBytesPerSecond, 1)),
+        capacity: capacity,
+        tokens: capacity,
+        lastRefillTime: now())
+    } else {
+      tokenBuckets[recipient] = nil
+    }
+  }
+
+  /// Returns the statistics of the given recipient.
+  func statistics(for recipient: UUID) -> FeatureSendStatistics {
+    return sendStatistics[recipient] ?? FeatureSendStatistics()
+  }
+
+  /// Queues a write to the given recipient.
+  ///
+  /// If the write can be handed to the stream immediately and `write` throws, the error is
+  /// rethrown and `completion` is not invoked. Otherwise `completion` is invoked once the write
+  /// finishes or fails.
+  ///
+  /// - Parameters:
+  ///   - byteCount: The size of the message, used for fair queuing and rate limiting.
+  ///   - recipient: The recipient of the message.
+  ///   - write: Hands the message to the stream.
+  ///   - completion: Invoked with whether the write succeeded.
+  func enqueue(
+    byteCount: Int,
+    to recipient: UUID,
+    write: @escaping () throws -> Void,
+    completion: @escaping (Bool) -> Void
+  ) throws {
+    let weight = policies[recipient]?.weight ?? FeatureSendPolicy.default.weight
+    let startTag = max(virtualTime, lastFinishTags[recipient] ?? 0)
+    let finishTag = startTag + Double(max(byteCount, 1)) / weight
+    lastFinishTags[recipient] = finishTag
+
+    let pendingWrite = PendingWrite(
+      id: nextWriteID,
+      recipient: recipient,
+      byteCount: byteCount,
+      write: write,
+      completion: completion,
+      enqueueTime: now(),
+      startTag: startTag,
+      finishTag: finishTag)
+
+    nextWriteID += 1
+
+    queues[recipient, default: []].append(pendingWrite)
+    sendStatistics[recipient, default: FeatureSendStatistics()].pendingMessageCount += 1
+
+    try dispatchPendingWrites(rethrowingFor: pendingWrite.id)
+  }
+
+  /// Records that the oldest in-flight write has finished and hands further writes to the stream.
+  ///
+  /// - Parameter isSuccessful: Whether the write succeeded.
+  func completeWrite(isSuccessful: Bool) {
+    guard !inFlightWrites.isEmpty else {
+      assertionFailure("No in-flight write to complete.")
+      Self.log.fault("Unexpected. No in-flight write to complete.")
+      return
+    }
+
+    let write = inFlightWrites.removeFirst()
+    recordCompletion(of: write, isSuccessful: isSuccessful)
+    write.completion(isSuccessful)
+
+    try? dispatchPendingWrites()
+  }
+
+  /// Fails every queued and in-flight write, such as when the stream has been disconnected.
+  ///
+  /// Completions are invoked in the order the writes were queued.
+  func cancelAll() {
+    let writes = (inFlightWrites + queues.values.joined()).sorted { $0.id < $1.id }
+    inFlightWrites = []
+    queues = [:]
+
+    guard !writes.isEmpty else { return }
+    Self.log("Cancelling \(writes.count) pending writes.")
+
+    for write in writes {
+      recordCompletion(of: write, isSuccessful: false)
+      write.completion(false)
+    }
+  }
+
+  // MARK: - Scheduling
+
+  /// Hands writes to the stream until the in-flight limit is reached or no recipient may send.
+  ///
+  /// An error from the write with the given ID is rethrown. Errors from other writes are reported
+  /// through their completions.
+  private func dispatchPendingWrites(rethrowingFor writeID: Int? = nil) throws {
+    var rethrownError: Error?
+
+    while inFlightWrites.count < maxInFlightWrites, let write = dequeueNextEligibleWrite() {
+      virtualTime = max(virtualTime, write.startTag)
+
+      do {
+        try write.write()
+        inFlightWrites.append(write)
+      } catch {
+        if write.id == writeID {
+          sendStatistics[write.recipient]?.pendingMessageCount -= 1
+          rethrownError = error
+        } else {
+          Self.log.error("Queued write to \(write.recipient) failed: \(error.localizedDescription)")
+          recordCompletion(of: write, isSuccessful: false)
+          write.completion(false)
+        }
+      }
+    }
+
+    scheduleRetryIfThrottled()
+
+    if let error = rethrownError {
+      throw error
+    }
+  }
+
+  /// Removes and returns the eligible write with the earliest finish tag.
+  private func dequeueNextEligibleWrite() -> PendingWrite? {
+    let time = now()
+    var nextRecipient: UUID?
+    var nextFinishTag = Double.infinity
+
+    for (recipient, queue) in queues {
+      guard let head = queue.first, head.finishTag < nextFinishTag else { continue }
+      guard delayUntilEligible(head, at: time) == 0 else {
+        markHeadThrottled(for: recipient)
+        continue
+      }
+
+      nextRecipient = recipient
+      nextFinishTag = head.finishTag
+    }
+
+    guard let recipient = nextRecipient, let write = queues[recipient]?.first else { return nil }
+
+    queues[recipient]?.removeFirst()
+    if queues[recipient]?.isEmpty == true {
+      queues[recipient] = nil
+    }
+    tokenBuckets[recipient]?.tokens -= Double(write.byteCount)
+
+    return write
+  }
+
+  /// Counts the oldest queued write of the given recipient as held back by its rate limit, once
+  /// no matter how many scheduling passes it waits through.
+  private func markHeadThrottled(for recipient: UUID) {
+    guard queues[recipient]?.first?.isThrottled == false else { return }
+
+    queues[recipient]?[0].isThrottled = true
+    sendStatistics[recipient]?.throttledMessageCount += 1
+  }
+
+  /// Seconds until the given write is allowed by the rate limit of its recipient.
+  private func delayUntilEligible(_ write: PendingWrite, at time: TimeInterval) -> TimeInterval {
+    guard tokenBuckets[write.recipient] != nil else { return 0 }
+
+    tokenBuckets[write.recipient]?.refill(at: time)
+    return tokenBuckets[write.recipient]?.delay(forByteCount: write.byteCount) ?? 0
+  }
+
+  /// Schedules another dispatch for when the earliest throttled recipient may send again.
+  private func scheduleRetryIfThrottled() {
+    guard !isRetryScheduled, inFlightWrites.count < maxInFlightWrites else { return }
+
+    let time = now()
+    var earliestDelay = TimeInterval.infinity
+
+    for queue in queues.values {
+      guard let head = queue.first else { continue }
+
+      let delay = delayUntilEligible(head, at: time)
+      if delay > 0 {
+        earliestDelay = min(earliestDelay, delay)
+      }
+    }
+
+    guard earliestDelay.isFinite else { return }
+
+    isRetryScheduled = true
+    scheduleRetry(earliestDelay) { [weak self] in
+      self?.isRetryScheduled = false
+      try? self?.dispatchPendingWrites()
+    }
+  }
+
+  private func recordCompletion(of write: PendingWrite, isSuccessful: Bool) {
+    let latency = now() - write.enqueueTime
+
+    var recipientStatistics = sendStatistics[write.recipient] ?? FeatureSendStatistics()
+    recipientStatistics.pendingMessageCount -= 1
+    recipientStatistics.messageCount += 1
+    recipientStatistics.byteCount += write.byteCount
+    if !isSuccessful {
+      recipientStatistics.failedMessageCount += 1
+    }
+    recipientStatistics.lastLatency = latency
+    recipientStatistics.maxLatency = max(recipientStatistics.maxLatency, latency)
+    recipientStatistics.totalLatency += latency
+    sendStatistics[write.recipient] = recipientStatistics
+  }
+}
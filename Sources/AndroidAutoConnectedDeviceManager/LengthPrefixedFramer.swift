@@ -0,0 +1,118 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+import Foundation
+
+/// Errors that can occur while reading length-prefixed frames.
+enum LengthPrefixedFramerError: Error, Equatable {
+  /// A frame declared a negative size.
+  case invalidFrameSize(Int64)
+
+  /// A frame is larger than the buffer of the framer.
+  case frameTooLarge(Int64)
+
+  /// The stream reported an error.
+  case streamError
+}
+
+/// Splits an `InputStream` into frames, each preceded by its size as a big-endian `SizeType`.
+///
+/// Bytes are read directly into a fixed-size ring buffer and frames are handed out in place, so
+/// reading does not allocate once the framer has been created. A frame and its prefix must fit in
+/// the buffer.
+struct LengthPrefixedFramer<SizeType: FixedWidthInteger> {
+  private static var prefixSize: Int { MemoryLayout<SizeType>.size }
+
+  private let buffer: ByteRingBuffer
+
+  /// The number of bytes in the buffer.
+  var bufferedByteCount: Int { buffer.count }
+
+  /// Creates a framer.
+  ///
+  /// - Parameter capacity: The size of the buffer, which bounds the size of a frame.
+  init(capacity: Int = 4_096) {
+    precondition(capacity > Self.prefixSize, "The capacity must exceed the size prefix.")
+    buffer = ByteRingBuffer(capacity: capacity)
+  }
+
+  /// Reads the bytes available from the stream and calls `handler` with each complete frame.
+  ///
+  /// The bytes passed to `handler` are only valid for the duration of the call. Bytes of an
+  /// incomplete frame are kept until the next read.
+  ///
+  /// - Parameters:
+  ///   - stream: An open stream.
+  ///   - handler: A closure called with the contents of each frame, excluding its prefix.
+  /// - Throws: A `LengthPrefixedFramerError` if a frame is malformed or the stream fails, or an
+  ///   error thrown by `handler`. The buffer is cleared after a framing error.
+  func read(
+    from stream: InputStream,
+    handler: (UnsafeRawBufferPointer) throws -> Void
+  ) throws {
+    var madeProgress = false
+    repeat {
+      let readCount = buffer.read(from: stream)
+      guard readCount >= 0 else {
+        buffer.removeAll()
+        throw LengthPrefixedFramerError.streamError
+      }
+
+      // Draining frames frees space, so a full buffer can still make progress.
+      let frameCount = try drainFrames(handler: handler)
+      madeProgress = readCount > 0 || frameCount > 0
+    } while madeProgress && stream.hasBytesAvailable
+  }
+
+  /// Discards any partially read frame.
+  func reset() {
+    buffer.removeAll()
+  }
+
+  /// Calls `handler` with each complete frame in the buffer and returns how many there were.
+  private func drainFrames(handler: (UnsafeRawBufferPointer) throws -> Void) throws -> Int {
+    var frameCount = 0
+    while let frameSize = try nextFrameSize(),
+      buffer.count >= Self.prefixSize + frameSize
+    {
+      try buffer.withContiguousBytes(count: Self.prefixSize + frameSize) { bytes in
+        try handler(UnsafeRawBufferPointer(rebasing: bytes[Self.prefixSize...]))
+      }
+      buffer.consume(Self.prefixSize + frameSize)
+      frameCount += 1
+    }
+    return frameCount
+  }
+
+  /// Returns the size of the next frame or `nil` if its prefix has not been read yet.
+  private func nextFrameSize() throws -> Int? {
+    guard buffer.count >= Self.prefixSize else { return nil }
+
+    var size: SizeType = 0
+    for offset in 0..<Self.prefixSize {
+      size = size << 8 | SizeType(truncatingIfNeeded: buffer[offset])
+    }
+
+    guard size >= 0 else {
+      buffer.removeAll()
+      throw LengthPrefixedFramerError.invalidFrameSize(Int64(clamping: size))
+    }
+    guard size <= buffer.capacity - Self.prefixSize else {
+      buffer.removeAll()
+      throw LengthPrefixedFramerError.frameTooLarge(Int64(clamping: size))
+    }
+
+    return Int(size)
+  }
+}
@@ -0,0 +1,397 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+import AndroidAutoLogger
+import CryptoKit
+import Foundation
+
+/// Counts that describe the contents of a `MissedMessageBuffer`.
+struct MissedMessageBufferMetrics: Equatable {
+  /// The number of messages held in memory.
+  var inMemoryCount = 0
+
+  /// The number of messages currently held on disk.
+  var spilledCount = 0
+
+  /// The number of messages written to disk over the lifetime of the buffer.
+  var totalSpilledCount = 0
+
+  /// The number of messages discarded because no recipient claimed them before they expired.
+  var expiredCount = 0
+
+  /// The number of messages discarded because the buffer was full or could not be written.
+  var droppedCount = 0
+
+  /// The number of messages handed to their recipient.
+  var deliveredCount = 0
+}
+
+/// The disk storage shared by all `MissedMessageBuffer`s.
+enum MissedMessageStorage {
+  /// The directory that holds the directories of individual buffers.
+  static let parentDirectory = FileManager.default.temporaryDirectory
+    .appendingPathComponent("com.google.ios.aae.MissedMessages", isDirectory: true)
+
+  /// Runs the disk I/O of all buffers in order, off the thread that delivers messages.
+  static let queue = DispatchQueue(label: "com.google.ios.aae.MissedMessages", qos: .utility)
+
+  /// Removes the directories left behind by buffers of a previous process, which cannot be read
+  /// because their keys are gone. Evaluated once, when the first buffer is created.
+  static let sweepOnce: Void = {
+    queue.async { removeStaleDirectories(in: parentDirectory) }
+  }()
+
+  /// Removes everything in the given directory. Must be called on `queue`.
+  static func removeStaleDirectories(in parentDirectory: URL) {
+    let fileManager = FileManager.default
+    guard
+      let urls = try? fileManager.contentsOfDirectory(
+        at: parentDirectory, includingPropertiesForKeys: nil)
+    else { return }
+
+    urls.forEach { try? fileManager.removeItem(at: $0) }
+  }
+
+  /// Blocks until all disk I/O that has been scheduled so far has completed.
+  static func waitUntilIdle() {
+    queue.sync {}
+  }
+}
+
+/// Holds messages for recipients that have not registered an observer yet.
+///
+/// The first messages for each recipient are kept in memory. Once a recipient has
+/// `maxInMemoryCountPerRecipient` messages waiting, or the buffer holds `maxInMemoryCount`
+/// messages in total, further messages for that recipient are encrypted with a key that only
+/// lives in memory and written to disk until it registers. Messages older than `timeToLive` are
+/// discarded, so recipients that never register do not hold on to memory or disk space.
+///
+/// Messages are encrypted and written on `MissedMessageStorage.queue`, and read back and decrypted
+/// there too, so neither appending nor removing messages waits for the disk.
+final class MissedMessageBuffer<Element> {
+  private static var log: Logger { Logger(for: MissedMessageBuffer.self) }
+
+  /// A message held in memory along with when it was received.
+  private struct Entry {
+    let date: Date
+    let element: Element
+  }
+
+  /// The outcome of reading a single spilled message.
+  private enum SpilledRecord {
+    case element(Element)
+    case expired
+    case unreadable
+  }
+
+  /// The messages of a recipient that have been written to disk, one file per message.
+  private struct SpillQueue {
+    let directory: URL
+    var count = 0
+
+    /// When the most recent message in this queue was received.
+    var newestDate: Date
+
+    func url(forRecordAt index: Int) -> URL {
+      return directory.appendingPathComponent(String(index))
+    }
+  }
+
+  /// The number of bytes used to store the date a spilled message was received.
+  private static var dateSize: Int { MemoryLayout<UInt64>.size }
+
+  let maxInMemoryCountPerRecipient: Int
+  let maxInMemoryCount: Int
+  let maxSpilledCountPerRecipient: Int
+  let timeToLive: TimeInterval
+
+  private(set) var metrics = MissedMessageBufferMetrics()
+
+  /// The current time. Can be replaced for testing.
+  var now: () -> Date = Date.init
+
+  private let encode: (Element) throws -> Data
+  private let decode: (Data) -> Element?
+
+  /// The queue that the buffer is used on, where messages read from disk are handed back.
+  private let callbackQueue: DispatchQueue
+
+  /// The directory that holds the spilled messages of this buffer.
+  private let directory: URL
+  private let fileManager = FileManager.default
+
+  /// The key that encrypts spilled messages. It is never persisted, so spilled messages cannot be
+  /// read by anyone other than this buffer.
+  private let key = SymmetricKey(size: .bits256)
+
+  private var inMemoryEntries: [UUID: [Entry]] = [:]
+  private var spillQueues: [UUID: SpillQueue] = [:]
+
+  /// Creates an empty buffer.
+  ///
+  /// - Parameters:
+  ///   - maxInMemoryCountPerRecipient: The most messages held in memory for a single recipient.
+  ///   - maxInMemoryCount: The most messages held in memory across all recipients.
+  ///   - maxSpilledCountPerRecipient: The most messages held on disk for a single recipient.
+  ///   - timeToLive: How long a message is held before it is discarded.
+  ///   - directory: The directory to hold spilled messages in. It is deleted with the buffer.
+  ///   - callbackQueue: The serial queue the buffer is used on. Spilled messages are handed back
+  ///     on it.
+  ///   - encode: Serializes a message so that it can be spilled to disk.
+  ///   - decode: Restores a message serialized by `encode`. It is called on the storage queue.
+  init(
+    maxInMemoryCountPerRecipient: Int = 16,
+    maxInMemoryCount: Int = 128,
+    maxSpilledCountPerRecipient: Int = 256,
+    timeToLive: TimeInterval = 5 * 60,
+    directory: URL = MissedMessageStorage.parentDirectory
+      .appendingPathComponent(UUID().uuidString, isDirectory: true),
+    callbackQueue: DispatchQueue = .main,
+    encode: @escaping (Element) throws -> Data,
+    decode: @escaping (Data) -> Element?
+  ) {
+    self.maxInMemoryCountPerRecipient = maxInMemoryCountPerRecipient
+    self.maxInMemoryCount = maxInMemoryCount
+    self.maxSpilledCountPerRecipient = maxSpilledCountPerRecipient
+    self.timeToLive = timeToLive
+    self.directory = directory
+    self.callbackQueue = callbackQueue
+    self.encode = encode
+    self.decode = decode
+
+    _ = MissedMessageStorage.sweepOnce
+  }
+
+  deinit {
+    // Recipients that were drained leave their directory behind, so it is removed regardless of
+    // what is still spilled. This runs after any write that is still pending.
+    removeItem(at: directory)
+  }
+
+  /// Holds the given message until its recipient claims it.
+  func append(_ element: Element, for recipient: UUID) {
+    let date = now()
+    removeExpiredEntries(olderThan: date.addingTimeInterval(-timeToLive))
+
+    // Once a recipient has spilled, newer messages also go to disk so that order is preserved.
+    if spillQueues[recipient] == nil,
+      inMemoryEntries[recipient, default: []].count < maxInMemoryCountPerRecipient,
+      metrics.inMemoryCount < maxInMemoryCount
+    {
+      inMemoryEntries[recipient, default: []].append(Entry(date: date, element: element))
+      metrics.inMemoryCount += 1
+      return
+    }
+
+    spill(element, receivedAt: date, for: recipient)
+  }
+
+  /// Whether any messages are held for the given recipient.
+  func containsMessages(for recipient: UUID) -> Bool {
+    return inMemoryEntries[recipient] != nil || spillQueues[recipient] != nil
+  }
+
+  /// Removes the unexpired messages for the given recipient and passes them to `completion` in
+  /// the order they were received.
+  ///
+  /// If none of the messages were spilled, `completion` is invoked before this method returns.
+  /// Otherwise the spilled messages are read and decrypted on the storage queue and `completion`
+  /// is invoked later on the callback queue. Messages appended in the meantime are kept for the
+  /// next removal.
+  func removeAll(for recipient: UUID, completion: @escaping ([Element]) -> Void) {
+    let cutoff = now().addingTimeInterval(-timeToLive)
+    var elements: [Element] = []
+
+    if let entries = inMemoryEntries.removeValue(forKey: recipient) {
+      metrics.inMemoryCount -= entries.count
+
+      for entry in entries {
+        if entry.date < cutoff {
+          metrics.expiredCount += 1
+        } else {
+          elements.append(entry.element)
+        }
+      }
+    }
+
+    guard let spillQueue = spillQueues.removeValue(forKey: recipient) else {
+      metrics.deliveredCount += elements.count
+      completion(elements)
+      return
+    }
+
+    metrics.spilledCount -= spillQueue.count
+    readSpilledRecords(from: spillQueue, for: recipient, cutoff: cutoff) { [weak self] records in
+      for record in records {
+        switch record {
+        case .element(let element):
+          elements.append(element)
+        case .expired:
+          self?.metrics.expiredCount += 1
+        case .unreadable:
+          self?.metrics.droppedCount += 1
+        }
+      }
+
+      self?.metrics.deliveredCount += elements.count
+      completion(elements)
+    }
+    removeItem(at: spillQueue.directory)
+  }
+
+  // MARK: - Expiry
+
+  private func removeExpiredEntries(olderThan cutoff: Date) {
+    for (recipient, entries) in inMemoryEntries {
+      // Entries are in the order they were received, so expired ones are at the front.
+      guard let firstUnexpired = entries.firstIndex(where: { $0.date >= cutoff }) else {
+        inMemoryEntries[recipient] = nil
+        metrics.inMemoryCount -= entries.count
+        metrics.expiredCount += entries.count
+        continue
+      }
+
+      if firstUnexpired > 0 {
+        inMemoryEntries[recipient]?.removeFirst(firstUnexpired)
+        metrics.inMemoryCount -= firstUnexpired
+        metrics.expiredCount += firstUnexpired
+      }
+    }
+
+    // Individual records are only checked when read, but a queue whose newest message has
+    // expired can be deleted outright.
+    for (recipient, spillQueue) in spillQueues where spillQueue.newestDate < cutoff {
+      spillQueues[recipient] = nil
+      metrics.spilledCount -= spillQueue.count
+      metrics.expiredCount += spillQueue.count
+      removeItem(at: spillQueue.directory)
+    }
+  }
+
+  // MARK: - Disk
+
+  /// Removes the given file or directory once the writes scheduled before it have completed.
+  private func removeItem(at url: URL) {
+    MissedMessageStorage.queue.async { [fileManager] in
+      try? fileManager.removeItem(at: url)
+    }
+  }
+
+  /// Schedules the given message to be written to disk.
+  ///
+  /// The message is counted as spilled once it is scheduled. If the write then fails, the record
+  /// is missing when it is read and the message is counted as dropped at that point.
+  private func spill(_ element: Element, receivedAt date: Date, for recipient: UUID) {
+    var spillQueue: SpillQueue
+    if let existingQueue = spillQueues[recipient] {
+      spillQueue = existingQueue
+    } else {
+      spillQueue = SpillQueue(
+        directory: directory.appendingPathComponent(recipient.uuidString, isDirectory: true),
+        newestDate: date)
+    }
+
+    guard spillQueue.count < maxSpilledCountPerRecipient else {
+      Self.log.error("Too many missed messages for recipient \(recipient). Dropping message.")
+      metrics.droppedCount += 1
+      return
+    }
+
+    // The element is encoded here because it may not be safe to use from another thread.
+    var plaintext = Data(capacity: Self.dateSize)
+    withUnsafeBytes(of: date.timeIntervalSinceReferenceDate.bitPattern.bigEndian) {
+      plaintext.append(contentsOf: $0)
+    }
+    do {
+      plaintext.append(try encode(element))
+    } catch {
+      Self.log.error(
+        "Unable to encode missed message for \(recipient): \(error.localizedDescription)")
+      metrics.droppedCount += 1
+      return
+    }
+
+    let recordURL = spillQueue.url(forRecordAt: spillQueue.count)
+    MissedMessageStorage.queue.async { [key, fileManager, directory = spillQueue.directory] in
+      do {
+        // The recipient is authenticated so that records cannot be moved between recipients.
+        let sealedBox = try AES.GCM.seal(
+          plaintext, using: key, authenticating: recipient.toData())
+        guard let record = sealedBox.combined else {
+          throw MissedMessageBufferError.cannotEncrypt
+        }
+
+        try fileManager.createDirectory(at: directory, withIntermediateDirectories: true)
+        try record.write(
+          to: recordURL,
+          options: [.atomic, .completeFileProtectionUntilFirstUserAuthentication])
+      } catch {
+        Self.log.error(
+          "Unable to spill missed message for \(recipient): \(error.localizedDescription)")
+      }
+    }
+
+    spillQueue.count += 1
+    spillQueue.newestDate = date
+    spillQueues[recipient] = spillQueue
+
+    metrics.spilledCount += 1
+    metrics.totalSpilledCount += 1
+  }
+
+  /// Reads and decrypts the records of the given queue on the storage queue, after the writes
+  /// scheduled before it, and hands them to `completion` on the callback queue.
+  private func readSpilledRecords(
+    from spillQueue: SpillQueue,
+    for recipient: UUID,
+    cutoff: Date,
+    completion: @escaping ([SpilledRecord]) -> Void
+  ) {
+    MissedMessageStorage.queue.async { [key, fileManager, decode, callbackQueue] in
+      let records = (0..<spillQueue.count).map { index -> SpilledRecord in
+        guard
+          let record = fileManager.contents(atPath: spillQueue.url(forRecordAt: index).path),
+          let sealedBox = try? AES.GCM.SealedBox(combined: record),
+          let plaintext = try? AES.GCM.open(
+            sealedBox, using: key, authenticating: recipient.toData()),
+          plaintext.count >= Self.dateSize
+        else {
+          Self.log.error("Unable to read spilled message \(index) for recipient \(recipient).")
+          return .unreadable
+        }
+
+        let bitPattern = plaintext.prefix(Self.dateSize).reduce(UInt64(0)) {
+          $0 << 8 | UInt64($1)
+        }
+        let date = Date(timeIntervalSinceReferenceDate: Double(bitPattern: bitPattern))
+        guard date >= cutoff else { return .expired }
+
+        guard let element = decode(plaintext.subdata(in: Self.dateSize..<plaintext.count)) else {
+          Self.log.error("Unable to decode spilled message \(index) for recipient \(recipient).")
+          return .unreadable
+        }
+
+        return .element(element)
+      }
+
+      callbackQueue.async { completion(records) }
+    }
+  }
+}
+
+/// Errors that can occur while spilling missed messages to disk.
+enum MissedMessageBufferError: Error {
+  /// The message could not be encrypted.
+  case cannotEncrypt
+}
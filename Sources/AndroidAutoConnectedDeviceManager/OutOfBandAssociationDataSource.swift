@@ -75,14 +75,7 @@ extension OutOfBandAssociationDataSource {
         throw Error.missingOutOfBandData
       }
 
-      let oobBase64String = try toBase64(urlSafeBase64: oobComponent)
-      guard
-        let oobTokenData = Data(
-          base64Encoded: String(oobBase64String), options: .ignoreUnknownCharacters)
-      else {
-        Self.log.error("URL query out of band data could not be base64 decoded.")
-        throw Error.invalidBase64Encoding
-      }
+      let oobTokenData = try decode(urlSafeBase64: oobComponent)
       let outOfBandData = try OutOfBandAssociationData(serializedData: oobTokenData)
 
       Self.log("Parsed out of band data from URL for car: \(outOfBandData.deviceIdentifier.hex)")
@@ -90,27 +83,30 @@ extension OutOfBandAssociationDataSource {
       return outOfBandData
     }
 
-    /// Convert from URL Safe Base64 to standard Base64.
+    /// Decode URL Safe Base64, which may additionally be percent encoded.
     ///
-    /// Replace URL Safe percent encoded characters with their decoded characters.
-    /// Map URL safe Base64 characters to their counterparts:
-    ///   "_" -> "/"
-    ///   "-" -> "+"
+    /// The digits are decoded directly from the string's UTF-8 bytes in a single pass. Query
+    /// values are normally percent decoded already, so the string is only percent decoded here if
+    /// it still contains a "%".
     ///
     /// - Parameter urlSafeBase64: URL Safe Base64 encoded string.
-    /// - Returns: Standard Base64 encoded string.
-    /// - Throws: Error if the URL safe string has an invalid percent encoding.
-    static func toBase64(urlSafeBase64: String) throws -> String {
-      guard
-        let base64String =
-          urlSafeBase64.removingPercentEncoding?
-          .replacingOccurrences(of: "_", with: "/")
-          .replacingOccurrences(of: "-", with: "+")
-      else {
-        Self.log.error("Failed to decode URL Safe Base64 encoding.")
+    /// - Returns: The decoded data.
+    /// - Throws: Error if the string has an invalid percent or Base64 encoding.
+    static func decode(urlSafeBase64: String) throws -> Data {
+      var base64String = urlSafeBase64
+      if base64String.utf8.contains(UInt8(ascii: "%")) {
+        guard let percentDecoded = base64String.removingPercentEncoding else {
+          Self.log.error("Failed to decode URL Safe Base64 encoding.")
+          throw Error.invalidBase64Encoding
+        }
+        base64String = percentDecoded
+      }
+
+      guard let data = Data(base64URLEncoded: base64String) else {
+        Self.log.error("URL query out of band data could not be base64 decoded.")
         throw Error.invalidBase64Encoding
       }
-      return base64String
+      return data
     }
   }
 }
@@ -39,6 +39,11 @@ enum OutOfBandTokenError: Error {
 
 /// Source of out of band tokens.
 protocol OutOfBandTokenProvider {
+  /// A name for the kind of this provider, used to attribute metrics.
+  ///
+  /// Default implementation provided.
+  var providerName: String { get }
+
   /// Prepare for possible token request.
   ///
   /// Allocate resources if necessary in preparation for possible token requests.
@@ -61,6 +66,14 @@ protocol OutOfBandTokenProvider {
   /// - Parameter completion: The handler to call when the request is resolved.
   func requestToken(completion: @escaping (OutOfBandToken?) -> Void)
 
+  /// Cancels the pending token requests of this provider.
+  ///
+  /// Pending completion handlers are resolved without a token, but unlike `reset()` any cached
+  /// token is kept for later requests.
+  ///
+  /// Default implementation provided.
+  func cancelPendingRequests()
+
   /// Resets this provider within the current session.
   ///
   /// Removes any cached token and resolves any pending completion handlers.
@@ -70,9 +83,17 @@ protocol OutOfBandTokenProvider {
 // MARK: - OutOfBandTokenProvider Default Implementations
 
 extension OutOfBandTokenProvider {
+  /// The name of the type of this provider.
+  var providerName: String {
+    return String(describing: type(of: self))
+  }
+
   /// Prepare for possible token request.
   func prepareForRequests() {}
 
   /// Close the current request session.
   func closeForRequests() {}
+
+  /// Cancel pending requests. Providers that resolve requests synchronously have none.
+  func cancelPendingRequests() {}
 }
@@ -36,7 +36,8 @@ class PassiveOutOfBandTokenProvider {
 extension PassiveOutOfBandTokenProvider: OutOfBandTokenProvider {
   /// Request a token and call the completion handler when it's been resolved.
   ///
-  /// This provider immediately calls the completion handler with its current token if any.
+  /// This provider immediately calls the completion handler with its current token if any, so it
+  /// never has pending requests to cancel.
   ///
   /// - Parameter completion: The handler to call when the request is resolved.
   func requestToken(completion: (OutOfBandToken?) -> Void) {
@@ -14,6 +14,7 @@
 
 @_implementationOnly import AndroidAutoCoreBluetoothProtocols
 @_implementationOnly import AndroidAutoMessageStream
+@_implementationOnly import AndroidAutoSecureChannel
 import Foundation
 
 /// A car that is pending establishment of a secure channel.
@@ -30,6 +31,9 @@ class PendingCar {
   /// The characteristic on the car that can be used to write values to.
   var writeCharacteristic: BLECharacteristic?
 
+  /// The optional secure channel capabilities the car listed in the version exchange.
+  var channelCapabilities: SecureChannelCapabilities = []
+
   /// Initialize this struct with just the car that is waiting for a secure channel.
   ///
   /// - Parameter car: the peripheral that backs this `PendingCar`.
@@ -39,6 +43,18 @@ class PendingCar {
     self.secureSession = nil
   }
 
+  /// Initializes this struct with a car whose saved secure session is loaded when encryption is
+  /// established.
+  ///
+  /// - Parameters:
+  ///   - car: The car to establish a secure channel with.
+  ///   - id: The unique identifier for the car.
+  init(car: BLEPeripheral, id: String) {
+    self.id = id
+    self.car = car
+    self.secureSession = nil
+  }
+
   /// Initializes this struct with the basic signals for reestablishing a secure session.
   ///
   /// The secure session passed should be the result of a `SecureBLEChannel.saveSession()` call.
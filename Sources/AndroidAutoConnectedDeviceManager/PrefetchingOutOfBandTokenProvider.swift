@@ -0,0 +1,271 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+import AndroidAutoLogger
+import Foundation
+
+/// How much association time out of band token prefetching has saved.
+struct OutOfBandTokenPrefetchMetrics: Equatable {
+  /// The number of token requests answered by a prefetched token that had already arrived.
+  var hitCount = 0
+
+  /// The number of token requests that joined a prefetch which was still in flight.
+  var inFlightCount = 0
+
+  /// The number of token requests that had to be forwarded because no token was prefetched.
+  var missCount = 0
+
+  /// Seconds the most recent token request waited for the prefetched token.
+  var lastWaitTime: TimeInterval?
+
+  /// Seconds the most recent token request did not have to wait because the token was being
+  /// fetched while scanning, connecting and performing the handshake.
+  var lastSavedTime: TimeInterval?
+
+  /// The sum of all saved times.
+  var totalSavedTime: TimeInterval = 0
+}
+
+/// Fetches an out of band token ahead of the request for it.
+///
+/// Acquiring a token (e.g. waiting for an accessory session to send it) can take a while. Rather
+/// than waiting until the association handshake reaches verification, the token is requested when
+/// the association scan begins and cached for the scanned out of band source. The token request
+/// made at verification is then answered from the cache or joins the prefetch still in flight.
+/// How much time this saves depends on the provider and is recorded in `metrics`.
+///
+/// Responses can arrive on any thread, so all state is synchronized.
+@available(watchOS 6.0, *)
+final class PrefetchingOutOfBandTokenProvider<Provider: OutOfBandTokenProvider> {
+  private static var log: Logger { Logger(for: PrefetchingOutOfBandTokenProvider<Provider>.self) }
+
+  /// A token request that waits for the prefetch in flight.
+  private struct Waiter {
+    let requestTime: DispatchTime
+    let completion: (OutOfBandToken?) -> Void
+  }
+
+  private enum State {
+    case idle
+
+    /// A prefetch is in flight and the given requests wait for it.
+    case fetching(waiters: [Waiter])
+
+    /// The prefetch has resolved at the given time.
+    case fetched(OutOfBandToken?, resolvedTime: DispatchTime)
+  }
+
+  /// The provider which acquires the tokens.
+  let provider: Provider
+
+  private let lock = NSLock()
+  private var state = State.idle
+
+  /// The source for which the token was prefetched; `nil` for scans without one.
+  private var source: AnyObject?
+
+  /// When the current prefetch started, used to compute the time saved.
+  private var prefetchStartTime: DispatchTime?
+
+  /// Incremented with each prefetch so that a stale response is ignored.
+  private var generation = 0
+
+  private var storedMetrics = OutOfBandTokenPrefetchMetrics()
+
+  /// The association time saved by prefetching so far.
+  var metrics: OutOfBandTokenPrefetchMetrics {
+    lock.lock()
+    defer { lock.unlock() }
+    return storedMetrics
+  }
+
+  init(_ provider: Provider) {
+    self.provider = provider
+  }
+
+  /// Starts acquiring a token for an association scan of the given source.
+  ///
+  /// If a token has already been prefetched or is in flight for the same source, it is kept.
+  /// Otherwise the previous prefetch is discarded and a new one starts.
+  ///
+  /// - Parameter source: The out of band source of the scan or `nil` if there is none.
+  func prefetchToken(for source: AnyObject?) {
+    lock.lock()
+    if self.source === source, isReusable(state) {
+      lock.unlock()
+      Self.log("Reusing the out of band token prefetched for this source.")
+      return
+    }
+
+    let waiters = takeWaiters()
+    self.source = source
+    generation += 1
+    let generation = self.generation
+    prefetchStartTime = DispatchTime.now()
+    state = .fetching(waiters: [])
+    lock.unlock()
+
+    waiters.forEach { $0.completion(nil) }
+    if !waiters.isEmpty {
+      provider.cancelPendingRequests()
+    }
+
+    Self.log("Prefetching the out of band token.")
+    provider.prepareForRequests()
+    provider.requestToken { [weak self] token in
+      self?.completePrefetch(generation: generation, token: token)
+    }
+  }
+
+  /// Whether the given state holds a prefetch that can serve the next request.
+  ///
+  /// A prefetch that resolved without a token is not reused, since a source such as an accessory
+  /// may have become available since.
+  private func isReusable(_ state: State) -> Bool {
+    switch state {
+    case .idle: return false
+    case .fetching: return true
+    case .fetched(let token, _): return token != nil
+    }
+  }
+
+  private func completePrefetch(generation: Int, token: OutOfBandToken?) {
+    lock.lock()
+    guard generation == self.generation, case .fetching(let waiters) = state else {
+      lock.unlock()
+      return
+    }
+
+    let resolvedTime = DispatchTime.now()
+    state = .fetched(token, resolvedTime: resolvedTime)
+    for waiter in waiters {
+      // A waiter was spared the time the prefetch had already spent when it joined.
+      recordRequest(at: waiter.requestTime, resolvedTime: resolvedTime)
+    }
+    lock.unlock()
+
+    Self.log("Prefetched out of band token available: \(token != nil)")
+    waiters.forEach { $0.completion(token) }
+  }
+
+  /// Must be called with the lock held.
+  private func takeWaiters() -> [Waiter] {
+    guard case .fetching(let waiters) = state else { return [] }
+    state = .idle
+    return waiters
+  }
+
+  /// Records the time saved for a request made at `requestTime` and answered by a prefetch that
+  /// resolved at `resolvedTime`.
+  ///
+  /// Without the prefetch, the request would have waited for the full acquisition time.
+  ///
+  /// Must be called with the lock held.
+  private func recordRequest(at requestTime: DispatchTime, resolvedTime: DispatchTime) {
+    guard let startTime = prefetchStartTime else { return }
+
+    let waitTime =
+      resolvedTime > requestTime ? TimeInterval(seconds: requestTime, to: resolvedTime) : 0
+    let savedTime = TimeInterval(seconds: startTime, to: resolvedTime) - waitTime
+    storedMetrics.lastWaitTime = waitTime
+    storedMetrics.lastSavedTime = savedTime
+    storedMetrics.totalSavedTime += savedTime
+  }
+}
+
+// MARK: - OutOfBandTokenProvider
+
+@available(watchOS 6.0, *)
+extension PrefetchingOutOfBandTokenProvider: OutOfBandTokenProvider {
+  var providerName: String {
+    provider.providerName
+  }
+
+  func prepareForRequests() {
+    provider.prepareForRequests()
+  }
+
+  /// Discards the prefetched token, which is only valid for one association, and closes the
+  /// provider.
+  func closeForRequests() {
+    let waiters = discardPrefetch()
+    waiters.forEach { $0.completion(nil) }
+    provider.closeForRequests()
+  }
+
+  /// Answers from the prefetched token, joins the prefetch in flight, or forwards the request.
+  ///
+  /// - Parameter completion: The handler to call when the request is resolved.
+  func requestToken(completion: @escaping (OutOfBandToken?) -> Void) {
+    lock.lock()
+    switch state {
+    case .fetched(let token?, let resolvedTime):
+      storedMetrics.hitCount += 1
+      recordRequest(at: DispatchTime.now(), resolvedTime: resolvedTime)
+      let savedTime = storedMetrics.lastSavedTime ?? 0
+      lock.unlock()
+      Self.log("Using the prefetched out of band token, saving \(savedTime) seconds.")
+      completion(token)
+    case .fetching(var waiters):
+      storedMetrics.inFlightCount += 1
+      waiters.append(Waiter(requestTime: DispatchTime.now(), completion: completion))
+      state = .fetching(waiters: waiters)
+      lock.unlock()
+      Self.log("Waiting for the out of band token prefetch in flight.")
+    case .idle, .fetched(.none, _):
+      storedMetrics.missCount += 1
+      lock.unlock()
+      provider.requestToken(completion: completion)
+    }
+  }
+
+  func cancelPendingRequests() {
+    lock.lock()
+    let waiters = takeWaiters()
+    lock.unlock()
+
+    waiters.forEach { $0.completion(nil) }
+    provider.cancelPendingRequests()
+  }
+
+  /// Discards the prefetched token and resolves any request waiting for it.
+  func reset() {
+    let waiters = discardPrefetch()
+    waiters.forEach { $0.completion(nil) }
+    provider.reset()
+  }
+
+  /// Forgets the prefetch so that the next association fetches a fresh token.
+  ///
+  /// - Returns: The requests that were waiting for the prefetch and must be resolved.
+  private func discardPrefetch() -> [Waiter] {
+    lock.lock()
+    defer { lock.unlock() }
+
+    let waiters = takeWaiters()
+    state = .idle
+    source = nil
+    prefetchStartTime = nil
+    generation += 1
+    return waiters
+  }
+}
+
+extension TimeInterval {
+  /// The seconds elapsed between two dispatch times.
+  fileprivate init(seconds start: DispatchTime, to end: DispatchTime) {
+    let nanoseconds = end.uptimeNanoseconds - start.uptimeNanoseconds
+    self = TimeInterval(nanoseconds) / TimeInterval(NSEC_PER_SEC)
+  }
+}
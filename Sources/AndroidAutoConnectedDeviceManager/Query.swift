@@ -22,6 +22,11 @@ public struct Query: Equatable {
 
   /// An optional `Data` object that represents parameters that modify the query.
   public let parameters: Data?
+
+  public init(request: Data, parameters: Data?) {
+    self.request = request
+    self.parameters = parameters
+  }
 }
 
 extension Query {
@@ -31,12 +36,47 @@ extension Query {
 
     queryProto.id = queryID
     queryProto.sender = sender.toData()
-    queryProto.request = self.request
+    queryProto.request = request
 
-    if let parameters = self.parameters {
+    if let parameters = parameters {
       queryProto.parameters = parameters
     }
 
     return try queryProto.serializedData()
   }
 }
+
+/// A query received from a car.
+struct ReceivedQuery {
+  /// The identifier used to match the response to the query.
+  let id: Int32
+
+  /// The feature that sent the query.
+  let sender: UUID
+
+  /// The query, which holds on to the request and parameters decoded from the proto.
+  let query: Query
+
+  /// Parses a serialized `Com_Google_Companionprotos_Query` proto.
+  ///
+  /// - Parameter data: The serialized proto.
+  /// - Returns: `nil` if the data is not a valid proto.
+  init?(serializedData data: Data) {
+    guard let queryProto = try? Com_Google_Companionprotos_Query(serializedData: data) else {
+      return nil
+    }
+
+    id = queryProto.id
+    sender = ReceivedQuery.uuid(from: queryProto.sender)
+    query = Query(request: queryProto.request, parameters: queryProto.parameters)
+  }
+
+  /// Converts the given bytes to a `UUID`, padding them with zeros if there are fewer than 16.
+  private static func uuid(from bytes: Data) -> UUID {
+    var uuidBytes = [UInt8](repeating: 0, count: 16)
+    for (index, byte) in bytes.prefix(uuidBytes.count).enumerated() {
+      uuidBytes[index] = byte
+    }
+    return NSUUID(uuidBytes: uuidBytes) as UUID
+  }
+}
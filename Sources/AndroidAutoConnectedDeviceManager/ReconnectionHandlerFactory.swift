@@ -26,6 +26,7 @@ protocol ReconnectionHandlerFactory {
   ///   - secureSession: The data that represents a previous secure session with the car.
   ///   - messageStream: The stream that handles message sending.
   ///   - secureBLEChannel: The underlying stream that handles setup of secure communication.
+  ///   - channelCapabilities: The secure channel capabilities the car listed.
   ///   - secureSessionManager: Manager for retrieving and storing secure sessions.
   func makeHandler(
     car: Car,
@@ -33,6 +34,7 @@ protocol ReconnectionHandlerFactory {
     secureSession: Data,
     messageStream: BLEMessageStream,
     secureBLEChannel: SecureBLEChannel,
+    channelCapabilities: SecureChannelCapabilities,
     secureSessionManager: SecureSessionManager
   ) -> ReconnectionHandler
 }
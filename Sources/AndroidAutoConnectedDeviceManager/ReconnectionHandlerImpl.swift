@@ -27,6 +27,7 @@ class ReconnectionHandlerImpl: NSObject, ReconnectionHandler {
   private let connectionHandle: ConnectionHandle
   private let secureSession: Data
   private let secureBLEChannel: SecureBLEChannel
+  private let channelCapabilities: SecureChannelCapabilities
   private let secureSessionManager: SecureSessionManager
 
   /// Possible unlock states.
@@ -62,6 +63,7 @@ class ReconnectionHandlerImpl: NSObject, ReconnectionHandler {
   ///   - secureSession: The data that represents a previous secure session with the car.
   ///   - messageStream: The stream that will handle sending of messages.
   ///   - secureBLEChannel: A secure channel that can encrypt messages.
+  ///   - channelCapabilities: The secure channel capabilities the car listed.
   ///   - secureSessionManager: Manager for retrieving and storing secure sessions.
   init(
     car: Car,
@@ -69,12 +71,14 @@ class ReconnectionHandlerImpl: NSObject, ReconnectionHandler {
     secureSession: Data,
     messageStream: BLEMessageStream,
     secureBLEChannel: SecureBLEChannel,
+    channelCapabilities: SecureChannelCapabilities,
     secureSessionManager: SecureSessionManager
   ) {
     self.car = car
     self.connectionHandle = connectionHandle
     self.secureSession = secureSession
     self.secureBLEChannel = secureBLEChannel
+    self.channelCapabilities = channelCapabilities
     self.messageStream = messageStream
     self.secureSessionManager = secureSessionManager
 
@@ -117,9 +121,13 @@ extension ReconnectionHandlerImpl: SecureBLEChannelDelegate {
     _ secureBLEChannel: SecureBLEChannel,
     establishedUsing messageStream: MessageStream
   ) {
+    // Capabilities apply from the first encrypted message, so they are negotiated before the
+    // channel is handed out.
+    secureBLEChannel.negotiateCapabilities(channelCapabilities)
+
     // Update the saved secure session for this new one.
     guard let secureSession = try? secureBLEChannel.saveSession(),
-      secureSessionManager.storeSecureSession(secureSession, for: car.id)
+      secureSessionManager.refreshSecureSession(secureSession, for: car.id)
     else {
       Self.log.error("Cannot save the secure session")
 
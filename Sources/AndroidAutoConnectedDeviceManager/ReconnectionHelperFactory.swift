@@ -21,6 +21,26 @@ protocol ReconnectionHelperFactory {
   ///
   /// - Parameters:
   ///   - peripheral: The peripheral for which the reconnection is being attempted.
+  ///   - advertisement: The parsed advertisement associated with the peripheral discovery.
+  ///   - associatedCars: The cars among which we should test for a match against the advertisement.
+  ///   - uuidConfig: A configuration for common UUIDs.
+  ///   - authenticator: Authenticator to use.
+  /// - Throws: An error if either the service doesn't match what's expected or none of the
+  /// associated cars match against the advertisement.
+  static func makeHelper(
+    peripheral: AnyPeripheral,
+    advertisement: CarAdvertisement,
+    associatedCars: Set<Car>,
+    uuidConfig: UUIDConfig,
+    authenticator: CarAuthenticator.Type
+  ) throws -> ReconnectionHelper
+}
+
+extension ReconnectionHelperFactory {
+  /// Make a helper of the appropriate version depending on the raw advertisement data.
+  ///
+  /// - Parameters:
+  ///   - peripheral: The peripheral for which the reconnection is being attempted.
   ///   - advertisementData: The advertisement data associated with the peripheral discovery.
   ///   - associatedCars: The cars among which we should test for a match against the advertisement.
   ///   - uuidConfig: A configuration for common UUIDs.
@@ -33,7 +53,15 @@ protocol ReconnectionHelperFactory {
     associatedCars: Set<Car>,
     uuidConfig: UUIDConfig,
     authenticator: CarAuthenticator.Type
-  ) throws -> ReconnectionHelper
+  ) throws -> ReconnectionHelper {
+    try makeHelper(
+      peripheral: peripheral,
+      advertisement: CarAdvertisement(advertisementData, uuidConfig: uuidConfig),
+      associatedCars: associatedCars,
+      uuidConfig: uuidConfig,
+      authenticator: authenticator
+    )
+  }
 }
 
 /// Factory for making reconnection helpers based on the advertisement.
@@ -42,7 +70,7 @@ struct ReconnectionHelperFactoryImpl: ReconnectionHelperFactory {
   ///
   /// - Parameters:
   ///   - peripheral: The peripheral for which the reconnection is being attempted.
-  ///   - advertisementData: The advertisement data associated with the peripheral discovery.
+  ///   - advertisement: The parsed advertisement associated with the peripheral discovery.
   ///   - associatedCars: The cars among which we should test for a match against the advertisement.
   ///   - uuidConfig: A configuration for common UUIDs.
   ///   - authenticator: Authenticator to use.
@@ -50,24 +78,21 @@ struct ReconnectionHelperFactoryImpl: ReconnectionHelperFactory {
   /// associated cars match against the advertisement.
   static func makeHelper(
     peripheral: AnyPeripheral,
-    advertisementData: [String: Any],
+    advertisement: CarAdvertisement,
     associatedCars: Set<Car>,
     uuidConfig: UUIDConfig,
     authenticator: CarAuthenticator.Type
   ) throws -> ReconnectionHelper {
-    guard let serviceUUIDs = advertisementData[CBAdvertisementDataServiceUUIDsKey] as? NSArray
-    else {
+    guard advertisement.serviceUUIDs != nil else {
       throw CommunicationManagerError.serviceNotFound
     }
 
-    if serviceUUIDs.contains(uuidConfig.reconnectionUUID(for: .v1)) {
+    if advertisement.advertisesService(uuidConfig.reconnectionUUID(for: .v1)) {
       return ReconnectionHelperV1(peripheral: peripheral)
     }
 
     // It must be version 2, so make sure the advertisement is consistent.
-    guard let dataContents = advertisementData[CBAdvertisementDataServiceDataKey] as? NSDictionary,
-      let adData = dataContents[uuidConfig.reconnectionDataUUID] as? NSData
-    else {
+    guard let adData = advertisement.reconnectionData else {
       return ReconnectionHelperV2(
         peripheral: peripheral,
         cars: associatedCars,
@@ -79,7 +104,7 @@ struct ReconnectionHelperFactoryImpl: ReconnectionHelperFactory {
     guard
       let helper = ReconnectionHelperV2(
         peripheral: peripheral,
-        advertisementData: adData as Data,
+        advertisementData: adData,
         cars: associatedCars,
         authenticatorType: authenticator
       )
@@ -32,8 +32,25 @@ protocol SecureSessionManager {
   /// - Returns: `true` if the operation was successful.
   func storeSecureSession(_ secureSession: Data, for identifier: String) -> Bool
 
+  /// Replaces the stored secure session of a car that has reconnected.
+  ///
+  /// Implementations may persist the session asynchronously, in which case `true` indicates that
+  /// the session was accepted and is immediately visible through `secureSession(for:)`.
+  ///
+  /// - Parameters:
+  ///   - secureSession: The session to save.
+  ///   - identifier: The identifier for the car.
+  /// - Returns: `true` if the operation was successful.
+  func refreshSecureSession(_ secureSession: Data, for identifier: String) -> Bool
+
   /// Clears any stored secure sessions for the given car.
   ///
   /// - Parameter identifier: the identifier of the car.
   func clearSecureSession(for identifier: String)
 }
+
+extension SecureSessionManager {
+  func refreshSecureSession(_ secureSession: Data, for identifier: String) -> Bool {
+    return storeSecureSession(secureSession, for: identifier)
+  }
+}
@@ -85,6 +85,17 @@ public protocol SecuredCarChannel: AnyObject {
     using observation: @escaping ((Int32, UUID, Query) -> Void)
   ) throws -> ObservationHandle
 
+  /// Observe when the user's role with the car changes.
+  ///
+  /// A channel may start with a cached role that the car later reports to be different, in which
+  /// case the observation is passed the role reported by the car.
+  ///
+  /// - Parameter observation: A closure called with the new role when it changes.
+  /// - Returns: A handle that that can be used to cancel an observation
+  func observeUserRoleChange(
+    using observation: @escaping (SecuredCarChannel, UserRole) -> Void
+  ) -> ObservationHandle
+
   /// Writes an encrypted message to the recipient on the car associated with this class.
   ///
   /// Upon completion, the passed closure is passed a boolean of `true` if successful.
@@ -131,4 +142,33 @@ public protocol SecuredCarChannel: AnyObject {
   ///   - recipient: The unique identifier for a recipient that will receive the response.
   /// - Throws: An error if the query response could not be sent.
   func sendQueryResponse(_ queryResponse: QueryResponse, to recipient: UUID) throws
+
+  /// Sets how writes to the given recipient are scheduled relative to those of other recipients.
+  ///
+  /// - Parameters:
+  ///   - policy: The weight and rate limit of the recipient.
+  ///   - recipient: The unique identifier of the recipient.
+  func setSendPolicy(_ policy: FeatureSendPolicy, for recipient: UUID)
+
+  /// Returns statistics on the messages that have been written to the given recipient.
+  ///
+  /// - Parameter recipient: The unique identifier of the recipient.
+  func sendStatistics(for recipient: UUID) -> FeatureSendStatistics
+}
+
+extension SecuredCarChannel {
+  /// By default, channels keep the role they were configured with and never notify the observer.
+  public func observeUserRoleChange(
+    using observation: @escaping (SecuredCarChannel, UserRole) -> Void
+  ) -> ObservationHandle {
+    return ObservationHandle {}
+  }
+
+  /// By default, channels do not schedule writes and ignore the policy.
+  public func setSendPolicy(_ policy: FeatureSendPolicy, for recipient: UUID) {}
+
+  /// By default, channels do not record statistics.
+  public func sendStatistics(for recipient: UUID) -> FeatureSendStatistics {
+    return FeatureSendStatistics()
+  }
 }
@@ -29,4 +29,15 @@ protocol SecuredConnectedDeviceChannel: SecuredCarChannel {
     using provider: ChannelFeatureProvider,
     completion: @escaping (SecuredConnectedDeviceChannel) -> Void
   )
+
+  /// Sets the user's role with the car without querying for it.
+  ///
+  /// Observers registered through `observeUserRoleChange(using:)` are notified if this replaces a
+  /// different role.
+  ///
+  /// - Parameter userRole: The role to assume for the user.
+  func updateUserRole(_ userRole: UserRole)
+
+  /// Fails the writes still waiting on this channel because its car has disconnected.
+  func handleDisconnection()
 }
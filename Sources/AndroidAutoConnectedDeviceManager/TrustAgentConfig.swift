@@ -51,6 +51,8 @@ protocol TrustAgentConfig: AnyObject {
 /// A configuration for the trust agent whose storage is backed by `UserDefaults`.
 ///
 /// Due to the usage of `UserDefaults`, each instance of this class will utilize the same storage.
+/// Values are cached in memory once loaded and written through on change, so changes made through
+/// one instance are not seen by another instance that has already loaded them.
 @available(watchOS 6.0, *)
 class TrustAgentConfigUserDefaults: TrustAgentConfig {
   #if os(watchOS)
@@ -77,14 +79,35 @@ class TrustAgentConfigUserDefaults: TrustAgentConfig {
 
   private let storage = UserDefaultsStorage.shared
 
+  /// Guards `cachedIsPasscodeRequired` and `cachedCarConfigs`.
+  private let cacheLock = NSLock()
+
+  /// The value of `isPasscodeRequired` or `nil` if it has not been loaded yet.
+  private var cachedIsPasscodeRequired: Bool?
+
+  /// The configurations that have been loaded, keyed by car id.
+  private var cachedCarConfigs: [String: IndividualCarConfig] = [:]
+
   /// Whether a passcode is required for enrollment and unlocking.
   ///
   /// By default, this value is `true`.
   var isPasscodeRequired: Bool {
     get {
-      return storage.bool(forKey: Self.isPasscodeRequiredKey)
+      cacheLock.lock()
+      defer { cacheLock.unlock() }
+
+      if let isPasscodeRequired = cachedIsPasscodeRequired {
+        return isPasscodeRequired
+      }
+      let isPasscodeRequired = storage.bool(forKey: Self.isPasscodeRequiredKey)
+      cachedIsPasscodeRequired = isPasscodeRequired
+      return isPasscodeRequired
     }
     set {
+      cacheLock.lock()
+      defer { cacheLock.unlock() }
+
+      cachedIsPasscodeRequired = newValue
       storage.set(newValue, forKey: Self.isPasscodeRequiredKey)
     }
   }
@@ -118,7 +141,10 @@ class TrustAgentConfigUserDefaults: TrustAgentConfig {
   ///   - car: The car to config.
   ///   - isRequired: The new value of the configuration.
   func setDeviceUnlockRequired(_ isRequired: Bool, for car: Car) {
-    var savedConfig = fetchIndividualCarConfig(for: car)
+    cacheLock.lock()
+    defer { cacheLock.unlock() }
+
+    var savedConfig = loadIndividualCarConfig(for: car)
     savedConfig.isDeviceUnlockRequired = isRequired
     saveIndividualCarConfig(config: savedConfig, for: car)
   }
@@ -143,10 +169,34 @@ class TrustAgentConfigUserDefaults: TrustAgentConfig {
   }
 
   func clearConfig(for car: Car) {
+    cacheLock.lock()
+    defer { cacheLock.unlock() }
+
+    cachedCarConfigs[car.id] = nil
     storage.remove(forKey: trustedDeviceConfigurationKey(forCarId: car.id))
   }
 
   private func fetchIndividualCarConfig(for car: Car) -> IndividualCarConfig {
+    cacheLock.lock()
+    defer { cacheLock.unlock() }
+
+    return loadIndividualCarConfig(for: car)
+  }
+
+  /// Returns the cached configuration for the car, loading it from storage if needed.
+  ///
+  /// Must be called while holding `cacheLock`.
+  private func loadIndividualCarConfig(for car: Car) -> IndividualCarConfig {
+    if let cachedConfig = cachedCarConfigs[car.id] {
+      return cachedConfig
+    }
+
+    let config = readIndividualCarConfig(for: car)
+    cachedCarConfigs[car.id] = config
+    return config
+  }
+
+  private func readIndividualCarConfig(for car: Car) -> IndividualCarConfig {
     guard let savedConfig = storage.data(forKey: trustedDeviceConfigurationKey(forCarId: car.id))
     else {
       Self.log.debug(
@@ -155,6 +205,12 @@ class TrustAgentConfigUserDefaults: TrustAgentConfig {
       )
       return IndividualCarConfig()
     }
+
+    if let loadedConfig = IndividualCarConfig(serialized: savedConfig) {
+      return loadedConfig
+    }
+
+    // Configurations used to be stored as JSON. Migrate them to the current encoding.
     guard let loadedConfig = try? JSONDecoder().decode(IndividualCarConfig.self, from: savedConfig)
     else {
       Self.log.error(
@@ -163,18 +219,16 @@ class TrustAgentConfigUserDefaults: TrustAgentConfig {
       )
       return IndividualCarConfig()
     }
+    storage.set(loadedConfig.serialized, forKey: trustedDeviceConfigurationKey(forCarId: car.id))
     return loadedConfig
   }
 
+  /// Writes the given configuration through the cache to storage.
+  ///
+  /// Must be called while holding `cacheLock`.
   private func saveIndividualCarConfig(config: IndividualCarConfig, for car: Car) {
-    guard let encoded = try? JSONEncoder().encode(config) else {
-      Self.log.error(
-        "Cannot encode individual car configuration for car id. Not saving config.",
-        redacting: "car id: \(car.id)"
-      )
-      return
-    }
-    storage.set(encoded, forKey: trustedDeviceConfigurationKey(forCarId: car.id))
+    cachedCarConfigs[car.id] = config
+    storage.set(config.serialized, forKey: trustedDeviceConfigurationKey(forCarId: car.id))
   }
 
   private func trustedDeviceConfigurationKey(forCarId carId: String) -> String {
@@ -183,7 +237,36 @@ class TrustAgentConfigUserDefaults: TrustAgentConfig {
 }
 
 /// Data structure to store all car specific configuration.
+///
+/// The `Codable` conformance is only used to read configurations stored before the compact
+/// encoding of `serialized` was introduced.
 struct IndividualCarConfig: Codable {
   /// Whether user needs to unlock the phone to unlock the car.
   var isDeviceUnlockRequired = true
 }
+
+extension IndividualCarConfig {
+  /// The version of the encoding produced by `serialized`.
+  private static let serializationVersion: UInt8 = 1
+
+  /// Bits of the flags byte in the serialized form.
+  private enum Flag {
+    static let isDeviceUnlockRequired: UInt8 = 1 << 0
+  }
+
+  /// A compact encoding of this configuration: a version byte followed by a byte of flags.
+  var serialized: Data {
+    let flags = isDeviceUnlockRequired ? Flag.isDeviceUnlockRequired : 0
+    return Data([Self.serializationVersion, flags])
+  }
+
+  /// Decodes a configuration from the output of `serialized`.
+  ///
+  /// Returns `nil` if the data is not in the expected format. Unknown flags are ignored.
+  init?(serialized data: Data) {
+    guard data.count == 2, data[data.startIndex] == Self.serializationVersion else { return nil }
+
+    let flags = data[data.startIndex + 1]
+    self.init(isDeviceUnlockRequired: flags & Flag.isDeviceUnlockRequired != 0)
+  }
+}
@@ -0,0 +1,132 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+import Foundation
+
+/// Stores the last confirmed user role for each car so that a channel can be configured without
+/// waiting for the car to respond to a user role query.
+protocol UserRoleCache {
+  /// Returns the cached user role for the given car or `nil` if there is none or it has expired.
+  ///
+  /// - Parameter carId: The identifier of the car.
+  func userRole(for carId: String) -> UserRole?
+
+  /// Caches the given user role as confirmed by the car.
+  ///
+  /// - Parameters:
+  ///   - userRole: The role reported by the car.
+  ///   - carId: The identifier of the car.
+  func storeUserRole(_ userRole: UserRole, for carId: String)
+
+  /// Clears the cached user role for the given car.
+  ///
+  /// - Parameter carId: The identifier of the car.
+  func clearUserRole(for carId: String)
+
+  /// Clears the cached user roles of all cars.
+  func clearAllUserRoles()
+}
+
+/// An implementation of `UserRoleCache` that delegates to `UserDefaults`.
+class UserDefaultsUserRoleCache: UserRoleCache {
+  /// The key prefix to create an identifier for a car's user role.
+  private static let userRolePrefix = "userRole.cachedRole_"
+
+  private static let roleKey = "role"
+  private static let dateKey = "date"
+
+  /// How long a cached role stays valid by default. The role is confirmed on every connection, so
+  /// this only bounds how stale the role can be for a car that has not been connected in a while.
+  static let defaultTimeToLive: TimeInterval = 7 * 24 * 60 * 60
+
+  private let userDefaults: UserDefaults
+  private let timeToLive: TimeInterval
+
+  /// Provides the current date. Overridable for testing.
+  var now: () -> Date = Date.init
+
+  /// Creates a cache whose entries expire after the given interval.
+  ///
+  /// - Parameters:
+  ///   - userDefaults: The defaults in which to persist the roles.
+  ///   - timeToLive: How long a stored role remains valid.
+  init(
+    userDefaults: UserDefaults = .standard,
+    timeToLive: TimeInterval = UserDefaultsUserRoleCache.defaultTimeToLive
+  ) {
+    self.userDefaults = userDefaults
+    self.timeToLive = timeToLive
+  }
+
+  func userRole(for carId: String) -> UserRole? {
+    let key = Self.makeKey(for: carId)
+    guard let entry = userDefaults.dictionary(forKey: key),
+      let rawRole = entry[Self.roleKey] as? String,
+      let date = entry[Self.dateKey] as? Date
+    else {
+      return nil
+    }
+
+    guard now().timeIntervalSince(date) < timeToLive, let userRole = UserRole(rawRole: rawRole)
+    else {
+      userDefaults.removeObject(forKey: key)
+      return nil
+    }
+
+    return userRole
+  }
+
+  func storeUserRole(_ userRole: UserRole, for carId: String) {
+    userDefaults.set(
+      [Self.roleKey: userRole.rawRole, Self.dateKey: now()],
+      forKey: Self.makeKey(for: carId)
+    )
+  }
+
+  func clearUserRole(for carId: String) {
+    userDefaults.removeObject(forKey: Self.makeKey(for: carId))
+  }
+
+  func clearAllUserRoles() {
+    userDefaults.dictionaryRepresentation().keys.forEach { key in
+      if key.starts(with: Self.userRolePrefix) {
+        userDefaults.removeObject(forKey: key)
+      }
+    }
+  }
+
+  private static func makeKey(for carId: String) -> String {
+    return userRolePrefix + carId
+  }
+}
+
+// MARK: - Persistence
+
+extension UserRole {
+  /// A stable string representation of this role for persistence.
+  fileprivate var rawRole: String {
+    switch self {
+    case .driver: return "driver"
+    case .passenger: return "passenger"
+    }
+  }
+
+  fileprivate init?(rawRole: String) {
+    switch rawRole {
+    case "driver": self = .driver
+    case "passenger": self = .passenger
+    default: return nil
+    }
+  }
+}
@@ -17,11 +17,14 @@ import AndroidAutoMessageStream
 import Foundation
 
 /// Fake `BLEVersionResolver` that will always resolve to the `.passthrough` stream version
-///  and the configurable security version.
+///  and the configurable security version and channel capabilities.
 public class BLEVersionResolverFake: NSObject, BLEVersionResolver {
   // MARK: - Configuration
   public var securityVersion = MessageSecurityVersion.v1
 
+  /// The raw channel capabilities that the car reports.
+  public var channelCapabilities: UInt32 = 0
+
   // MARK: - BLEVersionResolver
 
   public weak var delegate: BLEVersionResolverDelegate?
@@ -36,6 +39,7 @@ public class BLEVersionResolverFake: NSObject, BLEVersionResolver {
       self,
       didResolveStreamVersionTo: .passthrough,
       securityVersionTo: securityVersion,
+      channelCapabilities: channelCapabilities,
       for: peripheral
     )
   }
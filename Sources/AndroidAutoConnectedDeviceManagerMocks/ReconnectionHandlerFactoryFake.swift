@@ -26,6 +26,9 @@ public class ReconnectionHandlerFactoryFake: ReconnectionHandlerFactory {
 
   public var createdChannels: [ReconnectionHandlerFake] = []
 
+  /// The channel capabilities passed with each created channel, in order.
+  public var channelCapabilities: [SecureChannelCapabilities] = []
+
   public init() {}
 
   public func makeHandler(
@@ -34,8 +37,10 @@ public class ReconnectionHandlerFactoryFake: ReconnectionHandlerFactory {
     secureSession: Data,
     messageStream: BLEMessageStream,
     secureBLEChannel: SecureBLEChannel,
+    channelCapabilities: SecureChannelCapabilities,
     secureSessionManager: SecureSessionManager
   ) -> ReconnectionHandler {
+    self.channelCapabilities.append(channelCapabilities)
     let channel = ReconnectionHandlerFake(car: car, peripheral: messageStream.peripheral)
     channel.establishEncryptionShouldFail = makeChannelEstablishEncryptionShouldFail
     createdChannels.append(channel)
@@ -44,5 +49,6 @@ public class ReconnectionHandlerFactoryFake: ReconnectionHandlerFactory {
 
   public func reset() {
     createdChannels = []
+    channelCapabilities = []
   }
 }
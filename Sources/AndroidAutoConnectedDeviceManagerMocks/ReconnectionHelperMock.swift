@@ -27,6 +27,10 @@ final public class ReconnectionHelperMock {
   public var prepareForHandshakeShouldSucceed = true
   public var configureSecureChannelShouldSucceed = true
 
+  /// Whether `configureSecureChannel` should hold on to its completion until
+  /// `completeConfiguration()` is called.
+  public var defersConfiguration = false
+
   /// The Car ID to use once the handshake is complete.
   private var pendingCarId: String
 
@@ -35,6 +39,8 @@ final public class ReconnectionHelperMock {
   public var onResolvedSecurityVersionCalled = false
   public var handleMessageCalled = false
   public var prepareForHandshakeCalled = false
+  public var configuredChannel: SecuredConnectedDeviceChannel?
+  private var pendingConfigurationCompletion: ((Bool) -> Void)?
 
   // MARK: - ReconnectionHelper Stored Properties
   public var carId: String?
@@ -46,6 +52,13 @@ final public class ReconnectionHelperMock {
     self.peripheral = peripheral
     self.pendingCarId = pendingCarId
   }
+
+  /// Completes a configuration that was deferred by `defersConfiguration`.
+  public func completeConfiguration() {
+    let completion = pendingConfigurationCompletion
+    pendingConfigurationCompletion = nil
+    completion?(configureSecureChannelShouldSucceed)
+  }
 }
 
 // MARK: - ReconnectionHelper
@@ -88,10 +101,16 @@ extension ReconnectionHelperMock: ReconnectionHelper {
   }
 
   public func configureSecureChannel(
-    _: SecuredConnectedDeviceChannel,
+    _ channel: SecuredConnectedDeviceChannel,
     using connectionHandle: ConnectionHandle,
-    completion: (Bool) -> Void
+    completion: @escaping (Bool) -> Void
   ) {
+    configuredChannel = channel
+
+    guard !defersConfiguration else {
+      pendingConfigurationCompletion = completion
+      return
+    }
     completion(configureSecureChannelShouldSucceed)
   }
 }
@@ -63,6 +63,9 @@ final public class SecureBLEChannelMock: NSObject, SecureBLEChannel {
   /// Whether a call to `saveSession` will throw an error or not.
   public var saveSessionSucceeds = true
 
+  /// The capabilities passed to each call of `negotiateCapabilities(_:)`, in order.
+  public var negotiatedCapabilities: [SecureChannelCapabilities] = []
+
   public func establish(using messageStream: MessageStream) throws {
     self.messageStream = messageStream
 
@@ -134,6 +137,10 @@ final public class SecureBLEChannelMock: NSObject, SecureBLEChannel {
     return SecureBLEChannelMock.mockSavedSession
   }
 
+  public func negotiateCapabilities(_ remoteCapabilities: SecureChannelCapabilities) {
+    negotiatedCapabilities.append(remoteCapabilities)
+  }
+
   /// Notifies any delegates on this mock that a secure session was established from a previously
   /// saved secure session.
   public func notifySavedSessionEstablished() {
@@ -162,6 +169,7 @@ final public class SecureBLEChannelMock: NSObject, SecureBLEChannel {
 
     savedSessionShouldInstantlyNotify = false
     establishWithSavedSessionCalled = false
+    negotiatedCapabilities = []
   }
 }
 
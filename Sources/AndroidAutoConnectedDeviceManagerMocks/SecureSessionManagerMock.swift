@@ -23,6 +23,9 @@ public class SecureSessionManagerMock: SecureSessionManager {
   /// The return value `storeSecureSession(_:for:)`. `true` indicates that that method succeeds.
   public var storeSecureSessionSucceeds = true
 
+  /// The number of times `storeSecureSession(_:for:)` has been called.
+  public var storeSecureSessionCallCount = 0
+
   public init() {}
 
   public func secureSession(for identifier: String) -> Data? {
@@ -30,6 +33,8 @@ public class SecureSessionManagerMock: SecureSessionManager {
   }
 
   public func storeSecureSession(_ secureSession: Data, for identifier: String) -> Bool {
+    storeSecureSessionCallCount += 1
+
     guard storeSecureSessionSucceeds else {
       return false
     }
@@ -46,5 +51,6 @@ public class SecureSessionManagerMock: SecureSessionManager {
   public func reset() {
     secureSessions = [:]
     storeSecureSessionSucceeds = true
+    storeSecureSessionCallCount = 0
   }
 }
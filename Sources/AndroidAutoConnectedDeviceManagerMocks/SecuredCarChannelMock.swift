@@ -29,11 +29,15 @@ public class SecuredCarChannelMock: SecuredCarChannelPeripheral {
   private var queryRecipientToObservations: [UUID: UUID] = [:]
 
   private var queryResponseHandlers: [Int32: ((QueryResponse) -> Void)] = [:]
+  private var userRoleChangeObservations: [UUID: (SecuredCarChannel, UserRole) -> Void] = [:]
 
   public var writtenQueries: [Query] = []
   public var writtenQueryResponses: [(queryResponse: QueryResponse, recipient: UUID)] = []
   public var writtenMessages: [Data] = []
+  public var sendPolicies: [UUID: FeatureSendPolicy] = [:]
+  public var sendStatisticsByRecipient: [UUID: FeatureSendStatistics] = [:]
   public var configureUsingFeatureProviderCalled = false
+  public var handleDisconnectionCalled = false
 
   public var car: Car
   public var userRole: UserRole?
@@ -87,6 +91,12 @@ public class SecuredCarChannelMock: SecuredCarChannelPeripheral {
     }
   }
 
+  /// Simulates the car reporting a different user role.
+  public func triggerUserRoleChange(to userRole: UserRole) {
+    self.userRole = userRole
+    userRoleChangeObservations.values.forEach { $0(self, userRole) }
+  }
+
   public func triggerQueryResponse(_ queryResponse: QueryResponse) {
     if let handler = queryResponseHandlers[queryResponse.id] {
       handler(queryResponse)
@@ -122,6 +132,25 @@ extension SecuredCarChannelMock: SecuredConnectedDeviceChannel {
     configureUsingFeatureProviderCalled = true
   }
 
+  public func updateUserRole(_ userRole: UserRole) {
+    self.userRole = userRole
+  }
+
+  public func handleDisconnection() {
+    handleDisconnectionCalled = true
+  }
+
+  public func observeUserRoleChange(
+    using observation: @escaping (SecuredCarChannel, UserRole) -> Void
+  ) -> ObservationHandle {
+    let id = UUID()
+    userRoleChangeObservations[id] = observation
+
+    return ObservationHandle { [weak self] in
+      self?.userRoleChangeObservations.removeValue(forKey: id)
+    }
+  }
+
   public func sendQuery(
     _ query: Query,
     to recipient: UUID,
@@ -145,6 +174,14 @@ extension SecuredCarChannelMock: SecuredConnectedDeviceChannel {
     writtenQueryResponses.append((queryResponse, recipient))
   }
 
+  public func setSendPolicy(_ policy: FeatureSendPolicy, for recipient: UUID) {
+    sendPolicies[recipient] = policy
+  }
+
+  public func sendStatistics(for recipient: UUID) -> FeatureSendStatistics {
+    return sendStatisticsByRecipient[recipient] ?? FeatureSendStatistics()
+  }
+
   public func observeMessageReceived(
     from recipient: UUID,
     using observation: @escaping (SecuredCarChannel, Data) -> Void
@@ -39,22 +39,63 @@ public actor LogArchiver: LoggerDelegate {
   /// Directory for the log files that are actively being written.
   static public var logDirectory: String { LogSerialWriter.logDirectory }
 
+  /// A record waiting to be persisted.
+  private struct PendingRecord {
+    let record: LogRecord
+
+    /// Sequence number of the copy of the record in the ring log, if any.
+    let sequence: UInt64?
+  }
+
   /// Records to be persisted.
-  private var records: [LogRecord] = []
+  private var records: [PendingRecord] = []
 
   /// Serially writes records to the persistent store.
   private var serialWriter: LogSerialWriter
 
+  /// Crash-safe copy of the most recent records, which covers the batching delay.
+  private let ringLog: MappedRingLog?
+
+  /// Ring log sequence number through which every record has been persisted or dropped.
+  private var settledSequence: UInt64 = 0
+
+  /// Ring log sequence numbers after `settledSequence` that have been persisted or dropped.
+  private var settledSequencesAhead: Set<UInt64> = []
+
   /// Initialize with `FileLogStoreFactory` for persistence.
   convenience init() {
-    self.init(persistentStoreFactory: FileLogStoreFactory())
+    self.init(
+      persistentStoreFactory: FileLogStoreFactory(),
+      ringLog: MappedRingLog(path: MappedRingLog.defaultPath)
+    )
   }
 
   /// Initialize using the specified persistence.
   ///
-  /// - Parameter persistentStoreFactory: Factory to use for persistence.
-  init(persistentStoreFactory: PersistentLogStoreFactory) {
-    serialWriter = LogSerialWriter(persistentStoreFactory: persistentStoreFactory)
+  /// Records left in the ring log by a previous process which did not persist them are merged
+  /// into the persistent store.
+  ///
+  /// - Parameters:
+  ///   - persistentStoreFactory: Factory to use for persistence.
+  ///   - syncPolicy: When written records are flushed to stable storage.
+  ///   - ringLog: Ring log in which to keep records until they have been persisted.
+  init(
+    persistentStoreFactory: PersistentLogStoreFactory,
+    syncPolicy: LogSerialWriter.SyncPolicy = .interval(30),
+    ringLog: MappedRingLog? = nil
+  ) {
+    serialWriter = LogSerialWriter(
+      persistentStoreFactory: persistentStoreFactory, syncPolicy: syncPolicy)
+    self.ringLog = ringLog
+
+    guard let ringLog = ringLog else { return }
+
+    // Read the ring before any new records can be appended to it.
+    settledSequence = ringLog.persistedSequence
+    let (recoveredRecords, lastSequence) = ringLog.unpersistedRecords()
+    Task {
+      await restoreRecords(recoveredRecords, through: lastSequence)
+    }
   }
 
   /// Get the existing URLs for the logs.
@@ -92,13 +133,16 @@ public actor LogArchiver: LoggerDelegate {
       guard record.level > .debug else { return }
     #endif
 
+    // Copy the record into the ring right away so it survives a crash before the batch is written.
+    let sequence = ringLog?.append(record)
+
     Task {
-      await archive(record)
+      await archive(PendingRecord(record: record, sequence: sequence))
     }
   }
 
   /// Archive the record to the persistent store.
-  private func archive(_ record: LogRecord) {
+  private func archive(_ record: PendingRecord) {
     pruneRecordsIfNeeded()
     records.append(record)
 
@@ -129,6 +173,7 @@ public actor LogArchiver: LoggerDelegate {
       pruneRecords(below: .error)
     }
     if records.count > Self.backlogLimit {
+      settle(records.prefix(Self.backlogDropCount).compactMap { $0.sequence })
       records = Array(records.dropFirst(Self.backlogDropCount))
     }
   }
@@ -139,10 +184,11 @@ public actor LogArchiver: LoggerDelegate {
   ///
   /// - Parameter level: The level below which records will be pruned.
   private func pruneRecords(below level: Logger.Level) {
-    records = records.filter { $0.level >= level }
+    settle(records.filter { $0.record.level < level }.compactMap { $0.sequence })
+    records = records.filter { $0.record.level >= level }
   }
 
-  private func nextRecordsToPersist() -> [LogRecord] {
+  private func nextRecordsToPersist() -> [PendingRecord] {
     let batchRecords = records
     records = []
     return batchRecords
@@ -155,7 +201,7 @@ public actor LogArchiver: LoggerDelegate {
     guard batchRecords.count > 0 else { return }
 
     do {
-      try await serialWriter.write(batchRecords)
+      try await serialWriter.write(batchRecords.map { $0.record })
     } catch {
       os_log(
         "Error writing records: %s",
@@ -164,55 +210,51 @@ public actor LogArchiver: LoggerDelegate {
         error.localizedDescription
       )
     }
+
+    // The records are settled even if writing failed since they will not be retried.
+    await settle(batchRecords.compactMap { $0.sequence })
   }
-}
 
-/// Serializes the writing of log records to the perisistent store.
-private actor LogSerialWriter {
-  /// Factory for making the persistent store.
-  private let persistentStoreFactory: PersistentLogStoreFactory
+  /// Persist the records recovered from the ring log, then settle everything up to the last
+  /// sequence number that was in the ring when it was read.
+  private func restoreRecords(_ recoveredRecords: [LogRecord], through lastSequence: UInt64) async {
+    if !recoveredRecords.isEmpty {
+      os_log(
+        "Restoring %d records from the ring log.",
+        log: Self.log,
+        recoveredRecords.count
+      )
+      do {
+        try await serialWriter.write(recoveredRecords)
+      } catch {
+        os_log(
+          "Error writing restored records: %s",
+          log: Self.log,
+          type: .error,
+          error.localizedDescription
+        )
+      }
+    }
 
-  /// Directory for the log files that are actively being written.
-  static var logDirectory: String {
-    #if os(iOS) || os(watchOS)
-      return NSString.path(withComponents: [
-        NSHomeDirectory(), "Documents", "Logs",
-      ])
-    #elseif os(macOS)
-      return NSString.path(withComponents: [
-        NSHomeDirectory(), "Library", "Logs", ProcessInfo.processInfo.processName,
-      ])
-    #else
-      #error("Unsupported OS for logDirectory.")
-    #endif
+    settledSequence = max(settledSequence, lastSequence)
+    advanceSettledSequence()
   }
 
-  /// Initialize using the specified persistence.
-  ///
-  /// - Parameter persistentStoreFactory: Factory to use for persistence.
-  init(persistentStoreFactory: PersistentLogStoreFactory) {
-    self.persistentStoreFactory = persistentStoreFactory
+  /// Record that the records with the specified ring log sequence numbers no longer need to be
+  /// recovered, either because they were persisted or because they were dropped.
+  private func settle(_ sequences: [UInt64]) {
+    guard ringLog != nil, !sequences.isEmpty else { return }
+
+    settledSequencesAhead.formUnion(sequences)
+    advanceSettledSequence()
   }
 
-  /// Serially write the specified batch of records.
-  ///
-  /// - Parameter records: The batch records to write to the persistent storage.
-  /// - Throws: An error if the persistent log store cannot be created.
-  func write(_ records: [LogRecord]) throws {
-    var store = try persistentStoreFactory.makeStore(
-      directory: Self.logDirectory, date: Date(), carName: nil)
-
-    for record in records {
-      if !store.canLogDate(record.timestamp) {
-        store = try persistentStoreFactory.makeStore(
-          directory: Self.logDirectory,
-          date: record.timestamp,
-          carName: nil
-        )
-      }
-      // If a single record fails to write just drop that one record and keep going as this might
-      // be an error specific to this record (e.g. encoding).
-      try? store.writeRecord(record)
+  /// Advance the settled sequence number as far as it is contiguous and mark it in the ring log.
+  private func advanceSettledSequence() {
+    settledSequencesAhead = settledSequencesAhead.filter { $0 > settledSequence }
+    while settledSequencesAhead.remove(settledSequence + 1) != nil {
+      settledSequence += 1
     }
+    ringLog?.markPersisted(through: settledSequence)
   }
 }
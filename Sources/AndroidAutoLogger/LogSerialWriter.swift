@@ -0,0 +1,196 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+import Foundation
+
+/// Serializes the writing of log records to the persistent store.
+///
+/// The store for each segment (the day, and the car the logs are for if any) is held open across
+/// batches so that writing a batch does not reopen the log file. Stale log files are pruned in a
+/// background task whenever a new segment is opened, never inline with writes.
+@available(macOS 10.15, *)
+actor LogSerialWriter {
+  /// When the written records are flushed to stable storage.
+  enum SyncPolicy {
+    /// Leave flushing to the system.
+    case never
+
+    /// Flush after every batch.
+    case everyBatch
+
+    /// Flush after a batch if at least the specified number of seconds have passed since the
+    /// previous flush.
+    case interval(TimeInterval)
+  }
+
+  /// Directory for the log files that are actively being written.
+  static var logDirectory: String {
+    #if os(iOS) || os(watchOS)
+      return NSString.path(withComponents: [
+        NSHomeDirectory(), "Documents", "Logs",
+      ])
+    #elseif os(macOS)
+      return NSString.path(withComponents: [
+        NSHomeDirectory(), "Library", "Logs", ProcessInfo.processInfo.processName,
+      ])
+    #else
+      #error("Unsupported OS for logDirectory.")
+    #endif
+  }
+
+  /// Factory for making the persistent store.
+  private let persistentStoreFactory: PersistentLogStoreFactory
+
+  /// Directory in which the stores are made.
+  private let directory: String
+
+  /// When written records are flushed to stable storage.
+  private let syncPolicy: SyncPolicy
+
+  /// The open store for each car name. Logs which are not for a car use the empty name.
+  private var openStores: [String: PersistentLogStore] = [:]
+
+  /// Names of the open stores which have been written since they were last synchronized.
+  private var unsynchronizedStoreNames: Set<String> = []
+
+  /// When the open stores were last synchronized.
+  private var lastSyncDate = Date()
+
+  /// The pruning task that is currently running, if any.
+  private var pruneTask: Task<Void, Never>?
+
+  /// Initialize using the specified persistence.
+  ///
+  /// - Parameters:
+  ///   - persistentStoreFactory: Factory to use for persistence.
+  ///   - directory: Directory in which to write the logs.
+  ///   - syncPolicy: When written records are flushed to stable storage.
+  init(
+    persistentStoreFactory: PersistentLogStoreFactory,
+    directory: String = LogSerialWriter.logDirectory,
+    syncPolicy: SyncPolicy = .interval(30)
+  ) {
+    self.persistentStoreFactory = persistentStoreFactory
+    self.directory = directory
+    self.syncPolicy = syncPolicy
+  }
+
+  /// Serially write the specified batch of records.
+  ///
+  /// Consecutive records that belong to the same store are written together.
+  ///
+  /// - Parameters:
+  ///   - records: The batch records to write to the persistent storage.
+  ///   - carName: The name of the car that the records are for.
+  /// - Throws: An error if the persistent log store cannot be created.
+  func write(_ records: [LogRecord], carName: String? = nil) throws {
+    let storeName = carName ?? ""
+    var store: PersistentLogStore?
+    var storeRecords: [LogRecord] = []
+
+    for record in records {
+      if let store = store, store.canLogDate(record.timestamp) {
+        storeRecords.append(record)
+        continue
+      }
+      if let store = store {
+        write(storeRecords, to: store, named: storeName)
+      }
+      storeRecords = [record]
+      store = try openStore(named: storeName, carName: carName, date: record.timestamp)
+    }
+    if let store = store {
+      write(storeRecords, to: store, named: storeName)
+    }
+
+    synchronizeIfNeeded()
+  }
+
+  private func write(
+    _ records: [LogRecord],
+    to store: PersistentLogStore,
+    named storeName: String
+  ) {
+    store.writeRecords(records)
+
+    if case .never = syncPolicy { return }
+    unsynchronizedStoreNames.insert(storeName)
+  }
+
+  /// Returns the open store for the specified name and date, making a new one if needed.
+  private func openStore(
+    named storeName: String,
+    carName: String?,
+    date: Date
+  ) throws -> PersistentLogStore {
+    if let store = openStores[storeName] {
+      if store.canLogDate(date) && store.isOpen {
+        return store
+      }
+      closeStore(named: storeName)
+    }
+
+    let store = try persistentStoreFactory.makeStore(
+      directory: directory, date: date, carName: carName)
+    openStores[storeName] = store
+    schedulePruning()
+    return store
+  }
+
+  /// Release the open store for the specified name, synchronizing it first if required.
+  private func closeStore(named storeName: String) {
+    guard let store = openStores.removeValue(forKey: storeName) else { return }
+
+    if unsynchronizedStoreNames.remove(storeName) != nil {
+      store.synchronize()
+    }
+  }
+
+  /// Synchronize the stores which have been written according to the sync policy.
+  private func synchronizeIfNeeded() {
+    guard !unsynchronizedStoreNames.isEmpty else { return }
+
+    let now = Date()
+    switch syncPolicy {
+    case .never:
+      return
+    case .everyBatch:
+      break
+    case .interval(let interval):
+      guard now.timeIntervalSince(lastSyncDate) >= interval else { return }
+    }
+
+    for storeName in unsynchronizedStoreNames {
+      openStores[storeName]?.synchronize()
+    }
+    unsynchronizedStoreNames.removeAll()
+    lastSyncDate = now
+  }
+
+  /// Prune stale stores in a background task unless pruning is already underway.
+  private func schedulePruning() {
+    guard pruneTask == nil else { return }
+
+    let persistentStoreFactory = self.persistentStoreFactory
+    let directory = self.directory
+    pruneTask = Task.detached(priority: .background) {
+      persistentStoreFactory.pruneStores(directory: directory)
+      await self.pruningDidFinish()
+    }
+  }
+
+  private func pruningDidFinish() {
+    pruneTask = nil
+  }
+}
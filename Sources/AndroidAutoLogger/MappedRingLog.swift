@@ -0,0 +1,543 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+import Foundation
+import os.log
+
+/// A fixed-size ring of the most recent log records kept in a memory-mapped file.
+///
+/// Records are held in memory by `LogArchiver` for a short time before they are batched to the
+/// persistent store, so they would be lost if the process crashed in the meantime. Each record is
+/// therefore also encoded into a reusable scratch buffer and copied into a shared file mapping,
+/// which the OS writes back to the file even if the process dies. On the next launch, the records
+/// which were never marked as persisted are recovered so they can be merged into the log store.
+///
+/// When the ring is full the oldest records are overwritten. The ring survives process crashes,
+/// but not necessarily power loss since the mapping is never explicitly flushed.
+///
+/// The file layout is a fixed header followed by the ring of entries. Each entry is a 32-bit
+/// payload length, a 64-bit sequence number and the encoded record, padded to an 8-byte boundary.
+/// An entry which would not fit before the end of the ring is preceded by a wrap marker, and is
+/// written at the start of the ring instead.
+@available(macOS 10.15, *)
+final class MappedRingLog {
+  /// Log for reporting ring log errors.
+  static private let log = OSLog(
+    subsystem: "com.google.ios.aae.trustagentclient",
+    category: "MappedRingLog"
+  )
+
+  /// Default number of bytes available for entries.
+  static let defaultCapacity = 256 * 1_024
+
+  /// Identifies a ring log file ("AARL").
+  static private let magic: UInt32 = 0x4141_524C
+
+  /// Version of the file layout.
+  static private let version: UInt32 = 1
+
+  /// Size of the file header preceding the ring.
+  static private let headerSize = 64
+
+  /// Size of the length and sequence number preceding each payload.
+  static private let entryHeaderSize = 12
+
+  /// Length written in place of an entry to indicate that the ring wraps to its start.
+  static private let wrapMarker = UInt32.max
+
+  /// Byte offsets of the fields in the file header.
+  ///
+  /// `head` and `tail` are logical offsets which only ever increase; their position within the
+  /// ring is the offset modulo the capacity.
+  private enum HeaderField: Int {
+    case magic = 0
+    case version = 4
+    case capacity = 8
+    /// The end of the newest complete entry.
+    case head = 16
+    /// The start of the oldest entry which has not been overwritten.
+    case tail = 24
+    /// The sequence number of the next entry.
+    case nextSequence = 32
+    /// The sequence number through which all entries have been persisted elsewhere.
+    case persistedSequence = 40
+  }
+
+  /// Path of the ring log file in the caches directory.
+  static var defaultPath: String {
+    #if os(iOS) || os(watchOS)
+      return NSString.path(withComponents: [
+        NSHomeDirectory(), "Library", "Caches", "RecentLogs.aaring",
+      ])
+    #elseif os(macOS)
+      return NSString.path(withComponents: [
+        NSHomeDirectory(), "Library", "Caches",
+        "\(ProcessInfo.processInfo.processName)-RecentLogs.aaring",
+      ])
+    #else
+      #error("Unsupported OS for defaultPath.")
+    #endif
+  }
+
+  private let lock = NSLock()
+
+  /// Start of the file mapping.
+  private let mapping: UnsafeMutableRawPointer
+
+  /// Size of the file mapping.
+  private let mappingSize: Int
+
+  /// Number of bytes available for entries.
+  private let capacity: UInt64
+
+  /// Reused buffer into which each record is encoded before being copied into the ring.
+  private var scratch: [UInt8] = []
+
+  /// Start of the ring within the mapping.
+  private var ring: UnsafeMutableRawPointer { mapping + Self.headerSize }
+
+  /// The sequence number through which all records have been persisted elsewhere.
+  var persistedSequence: UInt64 {
+    lock.lock()
+    defer { lock.unlock() }
+    return header(.persistedSequence)
+  }
+
+  /// Open the ring log at the specified path, creating it if needed.
+  ///
+  /// An existing file with a different layout or capacity is reset.
+  ///
+  /// - Parameters:
+  ///   - path: The path of the ring log file.
+  ///   - capacity: The number of bytes available for entries.
+  /// - Returns: `nil` if the file cannot be created or mapped.
+  init?(path: String, capacity: Int = MappedRingLog.defaultCapacity) {
+    let capacity = (capacity + 7) & ~7
+    let mappingSize = Self.headerSize + capacity
+
+    let fileDescriptor = open(path, O_RDWR | O_CREAT, 0o600)
+    guard fileDescriptor >= 0 else {
+      os_log("Unable to open ring log: %d", log: Self.log, type: .error, errno)
+      return nil
+    }
+    // The mapping remains valid after the descriptor is closed.
+    defer { close(fileDescriptor) }
+
+    guard ftruncate(fileDescriptor, off_t(mappingSize)) == 0 else {
+      os_log("Unable to size ring log: %d", log: Self.log, type: .error, errno)
+      return nil
+    }
+
+    let address = mmap(
+      nil, mappingSize, PROT_READ | PROT_WRITE, MAP_SHARED, fileDescriptor, 0)
+    guard let mapping = address, mapping != UnsafeMutableRawPointer(bitPattern: -1) else {
+      os_log("Unable to map ring log: %d", log: Self.log, type: .error, errno)
+      return nil
+    }
+
+    self.mapping = mapping
+    self.mappingSize = mappingSize
+    self.capacity = UInt64(capacity)
+
+    if !hasValidHeader() {
+      reset()
+    }
+  }
+
+  deinit {
+    munmap(mapping, mappingSize)
+  }
+
+  /// Copy the record into the ring.
+  ///
+  /// - Parameter record: The record to append.
+  /// - Returns: The sequence number of the record or `nil` if it is too large for the ring.
+  @discardableResult
+  func append(_ record: LogRecord) -> UInt64? {
+    lock.lock()
+    defer { lock.unlock() }
+
+    scratch.removeAll(keepingCapacity: true)
+    scratch.appendRecord(record)
+
+    let entrySize = Self.entrySize(payloadCount: scratch.count)
+    guard entrySize <= capacity / 2 else { return nil }
+
+    var head = header(.head)
+    let remaining = capacity - head % capacity
+    let padding = entrySize > remaining ? remaining : 0
+    makeRoom(padding + entrySize, head: head)
+
+    if padding > 0 {
+      ring.storeBytes(of: Self.wrapMarker, toByteOffset: Int(head % capacity), as: UInt32.self)
+      head += padding
+    }
+
+    let sequence = header(.nextSequence)
+    let position = Int(head % capacity)
+    ring.storeBytes(of: UInt32(scratch.count), toByteOffset: position, as: UInt32.self)
+    // The sequence number is not 8-byte aligned, so copy rather than store it.
+    withUnsafeBytes(of: sequence) {
+      (ring + position + 4).copyMemory(from: $0.baseAddress!, byteCount: $0.count)
+    }
+    scratch.withUnsafeBytes { payload in
+      (ring + position + Self.entryHeaderSize).copyMemory(
+        from: payload.baseAddress!, byteCount: payload.count)
+    }
+
+    // Publish the entry only once it is completely written.
+    setHeader(.nextSequence, sequence + 1)
+    setHeader(.head, head + entrySize)
+    return sequence
+  }
+
+  /// Record that all records through the specified sequence number have been persisted.
+  ///
+  /// - Parameter sequence: The sequence number through which records have been persisted.
+  func markPersisted(through sequence: UInt64) {
+    lock.lock()
+    defer { lock.unlock() }
+
+    if sequence > header(.persistedSequence) {
+      setHeader(.persistedSequence, sequence)
+    }
+  }
+
+  /// Decode the records which are still in the ring but have not been marked as persisted.
+  ///
+  /// Entries which cannot be decoded are skipped.
+  ///
+  /// - Returns: The records in the order they were appended, and the sequence number of the
+  ///   newest entry in the ring.
+  func unpersistedRecords() -> (records: [LogRecord], lastSequence: UInt64) {
+    lock.lock()
+    defer { lock.unlock() }
+
+    let persistedSequence = header(.persistedSequence)
+    let head = header(.head)
+    var offset = header(.tail)
+    var records: [LogRecord] = []
+
+    while offset < head {
+      let position = Int(offset % capacity)
+      guard let span = entrySpan(atPosition: position) else { break }
+      defer { offset += span }
+
+      let length = ring.load(fromByteOffset: position, as: UInt32.self)
+      guard length != Self.wrapMarker else { continue }
+
+      var sequence: UInt64 = 0
+      withUnsafeMutableBytes(of: &sequence) {
+        $0.copyMemory(from: UnsafeRawBufferPointer(start: ring + position + 4, count: 8))
+      }
+      guard sequence > persistedSequence else { continue }
+
+      let payload = UnsafeRawBufferPointer(
+        start: ring + position + Self.entryHeaderSize, count: Int(length))
+      var reader = RingLogRecordReader(bytes: payload)
+      if let record = try? reader.readRecord() {
+        records.append(record)
+      }
+    }
+
+    return (records, header(.nextSequence) - 1)
+  }
+
+  /// Space taken by an entry with the specified payload size.
+  private static func entrySize(payloadCount: Int) -> UInt64 {
+    UInt64((entryHeaderSize + payloadCount + 7) & ~7)
+  }
+
+  /// Advance the tail past the oldest entries until there is room to write the specified number
+  /// of bytes at the head.
+  private func makeRoom(_ byteCount: UInt64, head: UInt64) {
+    var tail = header(.tail)
+    while head + byteCount - tail > capacity {
+      guard let span = entrySpan(atPosition: Int(tail % capacity)) else {
+        // The ring is corrupt, so drop everything in it.
+        tail = head
+        break
+      }
+      tail += span
+    }
+    setHeader(.tail, tail)
+  }
+
+  /// Space taken by the entry or wrap marker at the specified position, or `nil` if the entry is
+  /// malformed.
+  private func entrySpan(atPosition position: Int) -> UInt64? {
+    let length = ring.load(fromByteOffset: position, as: UInt32.self)
+    if length == Self.wrapMarker {
+      return capacity - UInt64(position)
+    }
+    let span = Self.entrySize(payloadCount: Int(length))
+    guard UInt64(position) + span <= capacity else { return nil }
+    return span
+  }
+
+  private func hasValidHeader() -> Bool {
+    let head = header(.head)
+    let tail = header(.tail)
+    return mapping.load(fromByteOffset: HeaderField.magic.rawValue, as: UInt32.self) == Self.magic
+      && mapping.load(fromByteOffset: HeaderField.version.rawValue, as: UInt32.self)
+        == Self.version
+      && header(.capacity) == capacity
+      && tail <= head && head - tail <= capacity
+      && head % 8 == 0 && tail % 8 == 0
+      && header(.nextSequence) > header(.persistedSequence)
+  }
+
+  /// Clear the header so the ring is empty.
+  private func reset() {
+    memset(mapping, 0, Self.headerSize)
+    mapping.storeBytes(of: Self.magic, toByteOffset: HeaderField.magic.rawValue, as: UInt32.self)
+    mapping.storeBytes(
+      of: Self.version, toByteOffset: HeaderField.version.rawValue, as: UInt32.self)
+    setHeader(.capacity, capacity)
+    setHeader(.nextSequence, 1)
+  }
+
+  private func header(_ field: HeaderField) -> UInt64 {
+    mapping.load(fromByteOffset: field.rawValue, as: UInt64.self)
+  }
+
+  private func setHeader(_ field: HeaderField, _ value: UInt64) {
+    mapping.storeBytes(of: value, toByteOffset: field.rawValue, as: UInt64.self)
+  }
+}
+
+// MARK: - Record encoding
+
+/// Type tags for the metadata values which can be kept in the ring.
+private enum RingLogMetadataTag: UInt8 {
+  case bool, int, double, string, array
+}
+
+/// Length written in place of a count to indicate a missing optional value.
+private let ringLogNilLength = UInt32.max
+
+/// Compact binary encoding of the record fields which are persisted by the log store.
+///
+/// Values are in native byte order since the ring is only ever read on the device that wrote it.
+@available(macOS 10.15, *)
+extension Array where Element == UInt8 {
+  fileprivate mutating func appendRecord(_ record: LogRecord) {
+    append(UInt8(record.level.rawValue))
+    appendInteger(record.timestamp.timeIntervalSinceReferenceDate.bitPattern)
+    appendInteger(Int32(record.timezone.secondsFromGMT(for: record.timestamp)))
+    appendInteger(record.processId)
+    appendInteger(Int64(record.threadId))
+    appendInteger(Int64(record.line))
+    appendString(record.subsystem)
+    appendString(record.category)
+    appendString(record.processName)
+    appendString(record.file)
+    appendString(record.function)
+    appendString(record.message)
+
+    if let backTrace = record.backTrace {
+      appendInteger(UInt32(backTrace.count))
+      backTrace.forEach { appendString($0) }
+    } else {
+      appendInteger(ringLogNilLength)
+    }
+
+    guard let metadata = record.metadata else {
+      appendInteger(ringLogNilLength)
+      return
+    }
+    // Custom metadata types are not kept in the ring.
+    let supportedMetadata = metadata.filter { Self.metadataTag(of: $0.value) != nil }
+    appendInteger(UInt32(supportedMetadata.count))
+    for (key, value) in supportedMetadata {
+      appendString(key)
+      appendMetadataValue(value)
+    }
+  }
+
+  private static func metadataTag(of value: LogMetaData) -> RingLogMetadataTag? {
+    switch value {
+    case is Bool: return .bool
+    case is Int: return .int
+    case is Double: return .double
+    case is String: return .string
+    case is [Bool], is [Int], is [Double], is [String]: return .array
+    default: return nil
+    }
+  }
+
+  private mutating func appendMetadataValue(_ value: LogMetaData) {
+    switch value {
+    case let value as Bool:
+      append(RingLogMetadataTag.bool.rawValue)
+      append(value ? 1 : 0)
+    case let value as Int:
+      append(RingLogMetadataTag.int.rawValue)
+      appendInteger(Int64(value))
+    case let value as Double:
+      append(RingLogMetadataTag.double.rawValue)
+      appendInteger(value.bitPattern)
+    case let value as String:
+      append(RingLogMetadataTag.string.rawValue)
+      appendString(value)
+    case let values as [Bool]:
+      appendMetadataArray(values)
+    case let values as [Int]:
+      appendMetadataArray(values)
+    case let values as [Double]:
+      appendMetadataArray(values)
+    case let values as [String]:
+      appendMetadataArray(values)
+    default:
+      break
+    }
+  }
+
+  private mutating func appendMetadataArray(_ values: [LogMetaData]) {
+    append(RingLogMetadataTag.array.rawValue)
+    appendInteger(UInt32(values.count))
+    values.forEach { appendMetadataValue($0) }
+  }
+
+  private mutating func appendInteger<T: FixedWidthInteger>(_ value: T) {
+    Swift.withUnsafeBytes(of: value) { append(contentsOf: $0) }
+  }
+
+  private mutating func appendString(_ string: String?) {
+    guard var string = string else {
+      appendInteger(ringLogNilLength)
+      return
+    }
+    string.withUTF8 { utf8 in
+      appendInteger(UInt32(utf8.count))
+      append(contentsOf: utf8)
+    }
+  }
+}
+
+/// Decodes records encoded by `appendRecord(_:)`.
+@available(macOS 10.15, *)
+private struct RingLogRecordReader {
+  enum ReadError: Error {
+    case truncated
+    case malformed
+  }
+
+  let bytes: UnsafeRawBufferPointer
+  var offset = 0
+
+  mutating func readRecord() throws -> LogRecord {
+    guard let level = Logger.Level(rawValue: Int(try readInteger(UInt8.self))) else {
+      throw ReadError.malformed
+    }
+    let timestamp = Date(
+      timeIntervalSinceReferenceDate: Double(bitPattern: try readInteger(UInt64.self)))
+    let timezone = TimeZone(secondsFromGMT: Int(try readInteger(Int32.self))) ?? .current
+    let processId = try readInteger(Int32.self)
+    let threadId = Int(try readInteger(Int64.self))
+    let line = Int(try readInteger(Int64.self))
+    let subsystem = try readString()
+    let category = try readString()
+
+    var logger = Logger.default
+    if let subsystem = subsystem, let category = category {
+      logger = Logger(subsystem: subsystem, category: category)
+    }
+
+    return LogRecord(
+      logger: logger.level(level),
+      timestamp: timestamp,
+      timezone: timezone,
+      processId: processId,
+      processName: try readRequiredString(),
+      threadId: threadId,
+      file: try readRequiredString(),
+      line: line,
+      function: try readRequiredString(),
+      backTrace: try readBackTrace(),
+      message: try readRequiredString(),
+      redactableMessage: nil,
+      metadata: try readMetadata()
+    )
+  }
+
+  private mutating func readBackTrace() throws -> [String]? {
+    let count = try readInteger(UInt32.self)
+    guard count != ringLogNilLength else { return nil }
+    return try (0..<count).map { _ in try readRequiredString() }
+  }
+
+  private mutating func readMetadata() throws -> [String: LogMetaData]? {
+    let count = try readInteger(UInt32.self)
+    guard count != ringLogNilLength else { return nil }
+
+    var metadata: [String: LogMetaData] = [:]
+    for _ in 0..<count {
+      let key = try readRequiredString()
+      metadata[key] = try readMetadataValue()
+    }
+    return metadata
+  }
+
+  private mutating func readMetadataValue() throws -> LogMetaData {
+    guard let tag = RingLogMetadataTag(rawValue: try readInteger(UInt8.self)) else {
+      throw ReadError.malformed
+    }
+    switch tag {
+    case .bool:
+      return try readInteger(UInt8.self) != 0
+    case .int:
+      return Int(try readInteger(Int64.self))
+    case .double:
+      return Double(bitPattern: try readInteger(UInt64.self))
+    case .string:
+      return try readRequiredString()
+    case .array:
+      let count = try readInteger(UInt32.self)
+      let values = try (0..<count).map { _ in try readMetadataValue() }
+      if let values = values as? [Bool] { return values }
+      if let values = values as? [Int] { return values }
+      if let values = values as? [Double] { return values }
+      if let values = values as? [String] { return values }
+      throw ReadError.malformed
+    }
+  }
+
+  private mutating func readInteger<T: FixedWidthInteger>(_ type: T.Type) throws -> T {
+    let size = MemoryLayout<T>.size
+    guard offset + size <= bytes.count else { throw ReadError.truncated }
+
+    var value: T = 0
+    withUnsafeMutableBytes(of: &value) {
+      $0.copyMemory(from: UnsafeRawBufferPointer(rebasing: bytes[offset..<offset + size]))
+    }
+    offset += size
+    return value
+  }
+
+  private mutating func readString() throws -> String? {
+    let length = try readInteger(UInt32.self)
+    guard length != ringLogNilLength else { return nil }
+    guard offset + Int(length) <= bytes.count else { throw ReadError.truncated }
+
+    let string = String(decoding: bytes[offset..<offset + Int(length)], as: UTF8.self)
+    offset += Int(length)
+    return string
+  }
+
+  private mutating func readRequiredString() throws -> String {
+    guard let string = try readString() else { throw ReadError.malformed }
+    return string
+  }
+}
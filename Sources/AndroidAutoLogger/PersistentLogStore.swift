@@ -32,6 +32,38 @@ public protocol PersistentLogStore {
   ///
   /// - Parameter data: The data to append.
   func appendData(_ data: Data)
+
+  /// Write the specified records to the log file in order.
+  ///
+  /// A record which cannot be written is dropped without affecting the others.
+  ///
+  /// - Parameter records: The log records to append.
+  func writeRecords(_ records: [LogRecord])
+
+  /// `true` if the store can still write to its backing storage.
+  ///
+  /// A store which is held open across batches may lose its backing storage, for example if the
+  /// log file is deleted, in which case a new store should be made.
+  var isOpen: Bool { get }
+
+  /// Flush the data written so far to stable storage.
+  func synchronize()
+}
+
+@available(macOS 10.15, *)
+extension PersistentLogStore {
+  /// Write the specified records one at a time.
+  public func writeRecords(_ records: [LogRecord]) {
+    for record in records {
+      try? writeRecord(record)
+    }
+  }
+
+  /// Stores are open by default.
+  public var isOpen: Bool { true }
+
+  /// Stores have nothing to synchronize by default.
+  public func synchronize() {}
 }
 
 /// Manage the persistent storage of the log files.
@@ -75,8 +107,14 @@ public class FileLogStore: PersistentLogStore {
   /// File handle to the log file being written.
   private var fileHandle: FileHandle? = nil
 
+  /// Offset of the end of the log file, tracked here to avoid querying the handle per write.
+  private var fileOffset: UInt64 = 0
+
   /// Initialize `FileLogStore`.
   ///
+  /// Stores are meant to be held open for as long as records are written for their day, so this
+  /// does not prune old log files. See `pruneLogFiles(in:)`.
+  ///
   /// - Parameters:
   ///   - directory: The Directory in which to write the logs.
   ///   - date: The time to write the log.
@@ -88,8 +126,6 @@ public class FileLogStore: PersistentLogStore {
     let filePath = logFilePath(for: date, carName: carName)
     let fileManager = FileManager.default
     if !fileManager.fileExists(atPath: filePath) {
-      pruneLogFiles()
-
       let _ = try fileManager.createDirectory(
         atPath: logDirectory,
         withIntermediateDirectories: true,
@@ -105,7 +141,7 @@ public class FileLogStore: PersistentLogStore {
     guard let fileHandle = fileHandle else {
       throw StoreError.noFileHandle(filePath)
     }
-    fileHandle.seekToEndOfFile()
+    fileOffset = fileHandle.seekToEndOfFile()
   }
 
   deinit {
@@ -131,30 +167,70 @@ public class FileLogStore: PersistentLogStore {
   /// - Parameter record: The log record to append.
   /// - Throws: An error if the record cannot be written.
   public func writeRecord(_ record: LogRecord) throws {
-    let encoder = JSONEncoder()
-    encoder.outputFormatting = .prettyPrinted
-    let recordData = try encoder.encode(record)
+    let recordData = try Self.makeEncoder().encode(record)
     appendData(recordData)
   }
 
+  /// Write the specified records to the log file with a single write.
+  ///
+  /// - Parameter records: The log records to append.
+  public func writeRecords(_ records: [LogRecord]) {
+    let encoder = Self.makeEncoder()
+    // If a single record fails to encode just drop that one record and keep going.
+    let recordsData = records.compactMap { try? encoder.encode($0) }
+    appendRecordsData(recordsData)
+  }
+
   /// Append the data to the log file.
   ///
   /// - Parameter data: The data to append.
   public func appendData(_ data: Data) {
-    guard let fileHandle = fileHandle else { return }
+    appendRecordsData([data])
+  }
+
+  /// `true` while the log file is still linked into the log directory.
+  public var isOpen: Bool {
+    guard let fileHandle = fileHandle else { return false }
+
+    var fileStatus = stat()
+    guard fstat(fileHandle.fileDescriptor, &fileStatus) == 0 else { return false }
+    return fileStatus.st_nlink > 0
+  }
+
+  /// Flush the data written so far to stable storage.
+  public func synchronize() {
+    fileHandle?.synchronizeFile()
+  }
+
+  private static func makeEncoder() -> JSONEncoder {
+    let encoder = JSONEncoder()
+    encoder.outputFormatting = .prettyPrinted
+    return encoder
+  }
+
+  /// Append the records, each of which is already encoded, to the log file.
+  private func appendRecordsData(_ recordsData: [Data]) {
+    guard let fileHandle = fileHandle, !recordsData.isEmpty else { return }
 
     var output = Data()
-    if fileHandle.offsetInFile == 0 {
+    if fileOffset == 0 {
       // Empty file -> append the file header.
       output.append(Self.fileHeader)
     } else {
       // Existing records -> overwrite the file footer with the record separator.
-      fileHandle.seek(toFileOffset: fileHandle.offsetInFile - UInt64(Self.fileFooter.count))
+      fileOffset -= UInt64(Self.fileFooter.count)
+      fileHandle.seek(toFileOffset: fileOffset)
       output.append(Self.recordSeparator)
     }
-    output.append(data)
+    for (index, recordData) in recordsData.enumerated() {
+      if index > 0 {
+        output.append(Self.recordSeparator)
+      }
+      output.append(recordData)
+    }
     output.append(Self.fileFooter)
     fileHandle.write(output)
+    fileOffset += UInt64(output.count)
   }
 
   /// Generate the part of the filename that is based on the date.
@@ -178,7 +254,11 @@ public class FileLogStore: PersistentLogStore {
   }
 
   /// Prune the log files that are older than the retention duration.
-  private func pruneLogFiles() {
+  ///
+  /// This enumerates the directory, so it should not be called inline with writes.
+  ///
+  /// - Parameter logDirectory: The directory containing the log files.
+  static func pruneLogFiles(in logDirectory: String) {
     let fileManager = FileManager.default
     guard fileManager.fileExists(atPath: logDirectory) else { return }
 
@@ -193,7 +273,7 @@ public class FileLogStore: PersistentLogStore {
   }
 
   /// Prune the log file if it's older than the retention date.
-  private func pruneLogFileIfNeeded(filePath: String, retentionDate: Date) throws {
+  private static func pruneLogFileIfNeeded(filePath: String, retentionDate: Date) throws {
     let fileManager = FileManager.default
     let attributes = try fileManager.attributesOfItem(atPath: filePath)
     guard let creationDate = attributes[.creationDate] as? Date else { return }
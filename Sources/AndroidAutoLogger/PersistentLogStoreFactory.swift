@@ -29,6 +29,19 @@ public protocol PersistentLogStoreFactory {
   /// - Returns: The log store.
   /// - Throws: If the storage cannot be instantiated.
   func makeStore(directory: String, date: Date, carName: String?) throws -> PersistentLogStore
+
+  /// Remove the stores in the directory which are past their retention duration.
+  ///
+  /// This may be slow, so it is called in the background rather than inline with writes.
+  ///
+  /// - Parameter directory: Directory within which logs are written.
+  func pruneStores(directory: String)
+}
+
+@available(macOS 10.15, *)
+extension PersistentLogStoreFactory {
+  /// Stores are not pruned by default.
+  public func pruneStores(directory: String) {}
 }
 
 /// Factory which persists the logs to a file.
@@ -53,4 +66,11 @@ public struct FileLogStoreFactory: PersistentLogStoreFactory {
   {
     try FileLogStore(directory: directory, date: date, carName: carName)
   }
+
+  /// Remove the log files in the directory which are past their retention duration.
+  ///
+  /// - Parameter directory: Directory within which logs are written.
+  public func pruneStores(directory: String) {
+    FileLogStore.pruneLogFiles(in: directory)
+  }
 }
@@ -49,6 +49,14 @@ public enum BLEMessageStreamFactory {
         messageCompressor: DataCompressorImpl.zlib,
         isCompressionEnabled: isCompressionEnabled
       )
+    case .v3:
+      return BLEMessageStreamV3(
+        peripheral: peripheral,
+        readCharacteristic: readCharacteristic,
+        writeCharacteristic: writeCharacteristic,
+        messageCompressor: DataCompressorImpl.zlib,
+        isCompressionEnabled: allowsCompression
+      )
     }
   }
 }
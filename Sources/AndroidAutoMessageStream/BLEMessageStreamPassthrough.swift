@@ -16,16 +16,57 @@ import AndroidAutoCoreBluetoothProtocols
 import AndroidAutoLogger
 import Foundation
 
+/// Errors that can occur within the passthrough message stream.
+enum BLEMessageStreamPassthroughError: Error {
+  /// The write queue already holds the maximum number of messages waiting to be written.
+  case writeQueueFull
+}
+
+/// An extension of the error that sets a message describing the cause.
+extension BLEMessageStreamPassthroughError: LocalizedError {
+  public var errorDescription: String? {
+    switch self {
+    case .writeQueueFull:
+      return "Too many messages are waiting to be written to the peripheral."
+    }
+  }
+}
+
 /// A message stream that will not actually chunk any messages.
 ///
-/// It will assume that all messages will fit and directly call a write to the peripheral it is
+/// It will assume that all messages will fit and write each of them to the peripheral it is
 /// initialized with. It will also assume all messages from the peripheral are complete messages.
+///
+/// Writes are queued so that only one is outstanding at a time; the next message is written once
+/// the peripheral reports that it is ready to write again.
 class BLEMessageStreamPassthrough: NSObject, BLEMessageStream {
   private static let log = Logger(for: BLEMessageStreamPassthrough.self)
 
   // This force-unwrap is safe as the UUID string is valid and cannot change.
   private static let defaultRecipient = UUID(uuidString: "B75D6A81-635B-4560-BD8D-9CDF83F32AE7")!
 
+  /// The default maximum number of messages that can be waiting to be written.
+  static let defaultMaxPendingWrites = 64
+
+  /// A message waiting to be written along with the recipient to attribute its completion to.
+  private typealias PendingWrite = (message: Data, recipient: UUID)
+
+  /// Messages that should be written to the write characteristic.
+  ///
+  /// The messages are ordered so that the item at the end of the array is the first message that
+  /// should be written. The message at the end remains in the stack while its write is in
+  /// progress and is only removed upon confirmation that the write has completed.
+  private var writeMessageStack: [PendingWrite] = []
+
+  /// Whether a `writeValue` to the remote peripheral is currently in progress.
+  private var isWriteInProgress = false
+
+  /// The maximum number of messages that can be waiting to be written.
+  let maxPendingWrites: Int
+
+  /// The number of messages that are waiting to be written, including any in progress.
+  var pendingWriteCount: Int { writeMessageStack.count }
+
   public let version = MessageStreamVersion.passthrough
 
   public let peripheral: BLEPeripheral
@@ -52,14 +93,17 @@ class BLEMessageStreamPassthrough: NSObject, BLEMessageStream {
   ///   - peripheral: The peripheral to stream messages with.
   ///   - readCharacteristic: The characteristic to listen for new messages on.
   ///   - writeCharacteristic: The characteristic to write messages to.
+  ///   - maxPendingWrites: The maximum number of messages that can be waiting to be written.
   public init(
     peripheral: BLEPeripheral,
     readCharacteristic: BLECharacteristic,
-    writeCharacteristic: BLECharacteristic
+    writeCharacteristic: BLECharacteristic,
+    maxPendingWrites: Int = BLEMessageStreamPassthrough.defaultMaxPendingWrites
   ) {
     self.peripheral = peripheral
     self.readCharacteristic = readCharacteristic
     self.writeCharacteristic = writeCharacteristic
+    self.maxPendingWrites = maxPendingWrites
 
     // "self" can only be used for something other than referencing fields after init() has been
     // called.
@@ -73,8 +117,9 @@ class BLEMessageStreamPassthrough: NSObject, BLEMessageStream {
   /// This implementation is a passthrough, so no message chunking will be performed.
   ///
   /// - Parameter message: The message to write.
-  public func writeMessage(_ message: Data, params: MessageStreamParams) {
-    peripheral.writeValue(message, for: writeCharacteristic)
+  /// - Throws: `writeQueueFull` if too many messages are already waiting to be written.
+  public func writeMessage(_ message: Data, params: MessageStreamParams) throws {
+    try enqueueWrite(message, recipient: params.recipient)
   }
 
   /// Writes the given message to the peripheral associated with this stream.
@@ -82,8 +127,34 @@ class BLEMessageStreamPassthrough: NSObject, BLEMessageStream {
   /// This implementation is a passthrough, so no message chunking or encryption will be performed.
   ///
   /// - Parameter message: The message to write.
+  /// - Throws: `writeQueueFull` if too many messages are already waiting to be written.
   public func writeEncryptedMessage(_ message: Data, params: MessageStreamParams) throws {
-    peripheral.writeValue(message, for: writeCharacteristic)
+    try enqueueWrite(message, recipient: params.recipient)
+  }
+
+  private func enqueueWrite(_ message: Data, recipient: UUID) throws {
+    guard writeMessageStack.count < maxPendingWrites else {
+      Self.log.error(
+        "Unable to queue message for writing. \(writeMessageStack.count) writes already pending.")
+      throw BLEMessageStreamPassthroughError.writeQueueFull
+    }
+
+    // Inserting at the start of the stack is O(n), but `n` is bounded by `maxPendingWrites`.
+    writeMessageStack.insert((message: message, recipient: recipient), at: 0)
+    writeNextMessageInStack()
+  }
+
+  private func writeNextMessageInStack() {
+    guard !isWriteInProgress else {
+      Self.log.debug(
+        "Request to write next message, but a write is currently in progress. Will wait.")
+      return
+    }
+
+    guard let pendingWrite = writeMessageStack.last else { return }
+
+    isWriteInProgress = true
+    peripheral.writeValue(pendingWrite.message, for: writeCharacteristic)
   }
 
   private func logUpdateError(_ error: Error, for characteristic: BLECharacteristic) {
@@ -142,10 +213,20 @@ extension BLEMessageStreamPassthrough: BLEPeripheralDelegate {
   }
 
   public func peripheralIsReadyToWrite(_ peripheral: BLEPeripheral) {
-    delegate?.messageStreamDidWriteMessage(
-      self,
-      to: BLEMessageStreamPassthrough.defaultRecipient
-    )
+    // The peripheral can report readiness without a write of ours in flight (for example, after
+    // another client's write); there is no message to attribute the completion to in that case.
+    guard isWriteInProgress, let completedWrite = writeMessageStack.popLast() else {
+      Self.log.debug("Peripheral ready to write, but no write was in progress.")
+      isWriteInProgress = false
+      writeNextMessageInStack()
+      return
+    }
+
+    isWriteInProgress = false
+    delegate?.messageStreamDidWriteMessage(self, to: completedWrite.recipient)
+
+    // The delegate may have queued another message, which would already be in progress.
+    writeNextMessageInStack()
   }
 
   public func peripheral(_ peripheral: BLEPeripheral, didDiscoverServices error: Error?) {
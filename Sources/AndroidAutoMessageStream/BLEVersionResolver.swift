@@ -29,6 +29,24 @@ public protocol BLEVersionResolverDelegate: AnyObject {
     for peripheral: BLEPeripheral
   )
 
+  /// Called upon a successful version exchange with the channel capabilities of the peripheral.
+  ///
+  /// The default implementation ignores the capabilities.
+  ///
+  /// - Parameters:
+  ///   - bleVersionResolver: The resolver that performed the version exchange.
+  ///   - streamVersion: The BLE messaging stream version that should be used.
+  ///   - securityVersion: The security version that should be used.
+  ///   - channelCapabilities: The raw `SecureChannelCapabilities` listed by the peripheral.
+  ///   - peripheral: The peripheral for which the resolver was acting.
+  func bleVersionResolver(
+    _ bleVersionResolver: BLEVersionResolver,
+    didResolveStreamVersionTo streamVersion: MessageStreamVersion,
+    securityVersionTo securityVersion: MessageSecurityVersion,
+    channelCapabilities: UInt32,
+    for peripheral: BLEPeripheral
+  )
+
   /// Called if there was an error during the version exchange.
   ///
   /// - Parameters:
@@ -42,6 +60,23 @@ public protocol BLEVersionResolverDelegate: AnyObject {
   )
 }
 
+extension BLEVersionResolverDelegate {
+  public func bleVersionResolver(
+    _ bleVersionResolver: BLEVersionResolver,
+    didResolveStreamVersionTo streamVersion: MessageStreamVersion,
+    securityVersionTo securityVersion: MessageSecurityVersion,
+    channelCapabilities: UInt32,
+    for peripheral: BLEPeripheral
+  ) {
+    self.bleVersionResolver(
+      bleVersionResolver,
+      didResolveStreamVersionTo: streamVersion,
+      securityVersionTo: securityVersion,
+      for: peripheral
+    )
+  }
+}
+
 /// Possible errors that can result from the version exchange.
 public enum BLEVersionResolverError: Error {
   case failedToCreateProto
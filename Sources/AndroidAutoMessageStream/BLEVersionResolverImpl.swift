@@ -24,6 +24,9 @@ private typealias CapabilitiesExchange = Com_Google_Companionprotos_Capabilities
 private struct ExchangeResolution {
   let streamVersion: MessageStreamVersion
   let securityVersion: MessageSecurityVersion
+
+  /// The raw secure channel capabilities listed by the peripheral.
+  let channelCapabilities: UInt32
 }
 
 /// Result of a resolver exchange.
@@ -47,6 +50,8 @@ private protocol ResolutionExchangeHandler {
 /// Processes message exchange.
 private protocol MessageExchangeDelegate: AnyObject {
   var allowsCapabilitiesExchange: Bool { get }
+  var channelCapabilities: UInt32 { get }
+  var isCompactFramingAllowed: Bool { get }
 
   func writeMessage(_: Data)
   func process(_: ResolutionExchange)
@@ -63,6 +68,18 @@ public class BLEVersionResolverImpl: NSObject, BLEVersionResolver {
 
   fileprivate var allowsCapabilitiesExchange = false
 
+  /// The raw `SecureChannelCapabilities` listed to the peripheral in the version exchange.
+  ///
+  /// The peripheral lists its own in return. Both sides enable only the capabilities that they
+  /// have in common, so peripherals that list none keep the current behavior.
+  public var channelCapabilities: UInt32 = 0
+
+  /// Whether the compact binary framing of `MessageStreamVersion.v3` may be negotiated.
+  ///
+  /// The framing is offered as messaging version 4, which cars only understand if they implement
+  /// it, so it is opt-in. Otherwise messaging version 3 is the highest that is offered.
+  public var isCompactFramingAllowed = false
+
   public weak var delegate: BLEVersionResolverDelegate?
 
   /// Communicates with the given peripheral and resolves the BLE message stream version to use
@@ -132,13 +149,15 @@ extension BLEVersionResolverImpl: MessageExchangeDelegate {
       Self.log(
         """
         Resolved versions. Stream: \(resolution.streamVersion), \
-        Security: \(resolution.securityVersion)
+        Security: \(resolution.securityVersion), \
+        Channel capabilities: \(resolution.channelCapabilities)
         """
       )
       self.delegate?.bleVersionResolver(
         self,
         didResolveStreamVersionTo: resolution.streamVersion,
         securityVersionTo: resolution.securityVersion,
+        channelCapabilities: resolution.channelCapabilities,
         for: peripheral
       )
     case .failure(let error):
@@ -204,6 +223,9 @@ private struct VersionExchangeHandler: ResolutionExchangeHandler {
   private static let minMessagingVersion: Int32 = 2
   private static let maxMessagingVersion: Int32 = 3
 
+  /// The messaging version that selects the compact binary framing, if it is allowed.
+  private static let compactFramingMessagingVersion: Int32 = 4
+
   private static let minSecurityVersion: Int32 = 1
   private static let maxSecurityVersion: Int32 = 4
 
@@ -213,15 +235,24 @@ private struct VersionExchangeHandler: ResolutionExchangeHandler {
   private let peripheral: BLEPeripheral
   private weak var delegate: MessageExchangeDelegate?
 
+  /// The highest messaging version offered to the peripheral.
+  private let maxOfferedMessagingVersion: Int32
+
   init(peripheral: BLEPeripheral, delegate: MessageExchangeDelegate) {
     self.peripheral = peripheral
     self.delegate = delegate
+    maxOfferedMessagingVersion =
+      delegate.isCompactFramingAllowed
+      ? Self.compactFramingMessagingVersion : Self.maxMessagingVersion
   }
 
   func sendVersionExchangeProto() {
     guard let delegate = self.delegate else { return }
 
-    guard let serializedProto = try? Self.createVersionExchangeProto().serializedData() else {
+    let versionExchange = Self.createVersionExchangeProto(
+      maxMessagingVersion: maxOfferedMessagingVersion,
+      channelCapabilities: delegate.channelCapabilities)
+    guard let serializedProto = try? versionExchange.serializedData() else {
       // This shouldn't fail because nothing dynamic is going into the proto.
       Self.log.error("Could not serialize version exchange proto")
       delegate.process(.failure(.failedToCreateProto))
@@ -251,13 +282,17 @@ private struct VersionExchangeHandler: ResolutionExchangeHandler {
   /// an error during the creation of the proto.
   ///
   /// If there was an error, the delegate is notified.
-  private static func createVersionExchangeProto() -> VersionExchange {
+  private static func createVersionExchangeProto(
+    maxMessagingVersion: Int32,
+    channelCapabilities: UInt32
+  ) -> VersionExchange {
     var versionExchange = VersionExchange()
 
     versionExchange.maxSupportedMessagingVersion = maxMessagingVersion
     versionExchange.minSupportedMessagingVersion = minMessagingVersion
     versionExchange.maxSupportedSecurityVersion = maxSecurityVersion
     versionExchange.minSupportedSecurityVersion = minSecurityVersion
+    versionExchange.supportedChannelCapabilities = channelCapabilities
 
     return versionExchange
   }
@@ -286,7 +321,10 @@ private struct VersionExchangeHandler: ResolutionExchangeHandler {
     }
 
     let resolution = ExchangeResolution(
-      streamVersion: streamVersion, securityVersion: securityVersion)
+      streamVersion: streamVersion,
+      securityVersion: securityVersion,
+      channelCapabilities: versionExchange.supportedChannelCapabilities
+    )
     guard shouldExchangeCapabilities else {
       delegate.process(.resolved(resolution))
       return
@@ -347,7 +385,7 @@ private struct VersionExchangeHandler: ResolutionExchangeHandler {
     from versionExchange: VersionExchange
   ) throws -> MessageStreamVersion {
     let maxVersion = min(
-      Self.maxMessagingVersion,
+      maxOfferedMessagingVersion,
       versionExchange.maxSupportedMessagingVersion
     )
 
@@ -368,8 +406,11 @@ private struct VersionExchangeHandler: ResolutionExchangeHandler {
       throw BLEVersionResolverError.versionNotSupported
     }
 
-    // Use the maximum supported version. Only 2 versions supported in this resolver at this time.
+    // Use the maximum supported version.
     switch maxVersion {
+    case 4:
+      // Version 4 replaces the messaging protos with a compact binary packet header.
+      return .v3
     case 3:
       // Version 3 is version 2 plus support for compression.
       return .v2(true)
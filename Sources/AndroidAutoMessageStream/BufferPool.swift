@@ -0,0 +1,271 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+import Foundation
+
+/// A pool of reusable byte buffers in power of two size classes.
+///
+/// Buffers are handed out as `Data` whose deallocator returns the memory to the pool, so that
+/// steady-state streaming reuses the same few buffers instead of going to the allocator for every
+/// packet, reassembled message and compression result. This class is thread-safe.
+public final class BufferPool {
+  /// Counters describing how the pool has been used.
+  public struct Statistics: Equatable {
+    /// Requests served with an idle pooled buffer.
+    public var hits = 0
+
+    /// Requests that had to allocate a new buffer for their size class.
+    public var misses = 0
+
+    /// Requests larger than the largest size class, which are not pooled.
+    public var oversized = 0
+
+    /// Buffers that were returned and kept for reuse.
+    public var returns = 0
+
+    /// Buffers that were freed when returned because their size class was full.
+    public var discards = 0
+
+    /// Buffers from a size class that are currently in use.
+    public var outstanding = 0
+
+    /// The total size of the idle buffers held by the pool.
+    public var idleBytes = 0
+  }
+
+  /// A buffer handed out by the pool.
+  fileprivate struct Allocation {
+    let pointer: UnsafeMutableRawPointer
+    let capacity: Int
+
+    /// The index of the size class or `nil` if the buffer is not pooled.
+    let sizeClass: Int?
+  }
+
+  /// The pool shared by the message streams, compressors and secure channels.
+  public static let shared = BufferPool()
+
+  /// The size of the smallest size class.
+  static let smallestClassSize = 64
+
+  /// The alignment of every buffer.
+  private static let alignment = 16
+
+  /// The capacity of each size class, in increasing order.
+  let classSizes: [Int]
+
+  /// The most idle buffers kept for each size class.
+  let maxIdleBuffersPerClass: Int
+
+  private let lock = NSLock()
+  private var idleBuffers: [[UnsafeMutableRawPointer]]
+  private var currentStatistics = Statistics()
+
+  /// A snapshot of the pool's counters.
+  public var statistics: Statistics {
+    lock.lock()
+    defer { lock.unlock() }
+    return currentStatistics
+  }
+
+  /// Creates a pool.
+  ///
+  /// - Parameters:
+  ///   - classCount: The number of size classes. The default covers buffers up to 64 KiB.
+  ///   - maxIdleBuffersPerClass: The most idle buffers kept for each size class.
+  init(classCount: Int = 11, maxIdleBuffersPerClass: Int = 16) {
+    classSizes = (0..<classCount).map { Self.smallestClassSize << $0 }
+    self.maxIdleBuffersPerClass = maxIdleBuffersPerClass
+    idleBuffers = Array(repeating: [], count: classCount)
+  }
+
+  deinit {
+    drain()
+  }
+
+  /// Makes `Data` whose bytes are written directly into a pooled buffer.
+  ///
+  /// - Parameters:
+  ///   - capacity: The most bytes that `body` may write.
+  ///   - body: Writes the bytes and returns how many were written.
+  /// - Returns: The written bytes.
+  /// - Throws: Any error thrown by `body`, after the buffer has been returned.
+  public func makeData(
+    capacity: Int,
+    _ body: (UnsafeMutableRawBufferPointer) throws -> Int
+  ) rethrows -> Data {
+    let allocation = acquire(capacity: capacity)
+    let count: Int
+    do {
+      count = try body(UnsafeMutableRawBufferPointer(start: allocation.pointer, count: capacity))
+    } catch {
+      release(allocation)
+      throw error
+    }
+    return makeData(taking: allocation, count: min(count, capacity))
+  }
+
+  /// Makes an empty buffer that can grow by appending.
+  ///
+  /// - Parameter capacity: The number of bytes to reserve.
+  public func makeBuffer(capacity: Int) -> PooledBuffer {
+    return PooledBuffer(pool: self, capacity: capacity)
+  }
+
+  /// Frees all idle buffers, e.g. in response to a memory warning.
+  public func drain() {
+    lock.lock()
+    let buffers = idleBuffers
+    idleBuffers = Array(repeating: [], count: classSizes.count)
+    currentStatistics.idleBytes = 0
+    lock.unlock()
+
+    for buffer in buffers.joined() {
+      buffer.deallocate()
+    }
+  }
+
+  /// Returns a buffer of at least `capacity` bytes, reusing an idle one if possible.
+  fileprivate func acquire(capacity: Int) -> Allocation {
+    guard let sizeClass = classSizes.firstIndex(where: { $0 >= capacity }) else {
+      lock.lock()
+      currentStatistics.oversized += 1
+      lock.unlock()
+      return Allocation(
+        pointer: .allocate(byteCount: capacity, alignment: Self.alignment),
+        capacity: capacity,
+        sizeClass: nil
+      )
+    }
+
+    let classSize = classSizes[sizeClass]
+
+    lock.lock()
+    currentStatistics.outstanding += 1
+    let idleBuffer = idleBuffers[sizeClass].popLast()
+    if idleBuffer != nil {
+      currentStatistics.hits += 1
+      currentStatistics.idleBytes -= classSize
+    } else {
+      currentStatistics.misses += 1
+    }
+    lock.unlock()
+
+    return Allocation(
+      pointer: idleBuffer ?? .allocate(byteCount: classSize, alignment: Self.alignment),
+      capacity: classSize,
+      sizeClass: sizeClass
+    )
+  }
+
+  /// Takes back a buffer, keeping it for reuse if its size class has room.
+  fileprivate func release(_ allocation: Allocation) {
+    guard let sizeClass = allocation.sizeClass else {
+      allocation.pointer.deallocate()
+      return
+    }
+
+    lock.lock()
+    currentStatistics.outstanding -= 1
+    let isKept = idleBuffers[sizeClass].count < maxIdleBuffersPerClass
+    if isKept {
+      idleBuffers[sizeClass].append(allocation.pointer)
+      currentStatistics.returns += 1
+      currentStatistics.idleBytes += allocation.capacity
+    } else {
+      currentStatistics.discards += 1
+    }
+    lock.unlock()
+
+    if !isKept {
+      allocation.pointer.deallocate()
+    }
+  }
+
+  /// Wraps the first `count` bytes of a buffer in `Data` that returns it when released.
+  fileprivate func makeData(taking allocation: Allocation, count: Int) -> Data {
+    guard count > 0 else {
+      release(allocation)
+      return Data()
+    }
+
+    return Data(
+      bytesNoCopy: allocation.pointer,
+      count: count,
+      deallocator: .custom { _, _ in self.release(allocation) }
+    )
+  }
+}
+
+/// A growable byte buffer whose memory comes from a `BufferPool`.
+///
+/// Appending past the capacity moves the bytes to a buffer of the next size class. The bytes are
+/// handed off without copying by `takeData()`.
+public final class PooledBuffer {
+  private let pool: BufferPool
+  private var allocation: BufferPool.Allocation?
+
+  /// The number of bytes appended so far.
+  public private(set) var count = 0
+
+  /// The number of bytes that can be held without moving to a larger buffer.
+  public var capacity: Int { allocation?.capacity ?? 0 }
+
+  fileprivate init(pool: BufferPool, capacity: Int) {
+    self.pool = pool
+    if capacity > 0 {
+      allocation = pool.acquire(capacity: capacity)
+    }
+  }
+
+  deinit {
+    if let allocation = allocation {
+      pool.release(allocation)
+    }
+  }
+
+  /// Appends the given bytes.
+  public func append(_ data: Data) {
+    guard !data.isEmpty else { return }
+
+    reserveCapacity(count + data.count)
+    guard let allocation = allocation else { return }
+
+    data.withUnsafeBytes { bytes in
+      (allocation.pointer + count).copyMemory(from: bytes.baseAddress!, byteCount: bytes.count)
+    }
+    count += data.count
+  }
+
+  /// Returns the appended bytes and leaves this buffer empty.
+  public func takeData() -> Data {
+    guard let allocation = allocation else { return Data() }
+
+    self.allocation = nil
+    defer { count = 0 }
+    return pool.makeData(taking: allocation, count: count)
+  }
+
+  private func reserveCapacity(_ minimumCapacity: Int) {
+    guard minimumCapacity > capacity else { return }
+
+    // Grow geometrically so that repeated appends stay amortized O(1).
+    let newAllocation = pool.acquire(capacity: max(minimumCapacity, capacity * 2))
+    if let allocation = allocation {
+      newAllocation.pointer.copyMemory(from: allocation.pointer, byteCount: count)
+      pool.release(allocation)
+    }
+    allocation = newAllocation
+  }
+}
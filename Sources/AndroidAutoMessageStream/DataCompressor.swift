@@ -32,6 +32,37 @@ protocol DataCompressor {
   /// - Returns: The decompressed data.
   /// - Throws: If the decompression fails.
   func decompress(_ inputData: Data, originalSize: Int) throws -> Data
+
+  /// Makes a decompressor that accepts the compressed data piece by piece.
+  ///
+  /// Default implementation provided.
+  ///
+  /// - Parameter originalSize: The size of the original uncompressed data.
+  /// - Returns: The decompressor or `nil` if this compressor only decompresses whole messages.
+  func makeIncrementalDecompressor(originalSize: Int) -> IncrementalDecompressor?
+}
+
+extension DataCompressor {
+  /// Whole message decompression only.
+  func makeIncrementalDecompressor(originalSize: Int) -> IncrementalDecompressor? {
+    return nil
+  }
+}
+
+/// Decompresses data that arrives in pieces.
+protocol IncrementalDecompressor: AnyObject {
+  /// Decompresses the next piece of compressed data.
+  ///
+  /// - Parameter compressedData: The compressed bytes that follow the previous piece.
+  /// - Returns: The decompressed bytes that have become available.
+  /// - Throws: If the data cannot be decompressed.
+  func decompress(_ compressedData: Data) throws -> Data
+
+  /// Completes decompression once all of the compressed data has been passed.
+  ///
+  /// - Returns: The remaining decompressed bytes.
+  /// - Throws: If the data is incomplete or does not decompress to the original size.
+  func finish() throws -> Data
 }
 
 /// Errors that can be thrown during compressor operations.
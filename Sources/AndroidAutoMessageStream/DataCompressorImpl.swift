@@ -36,13 +36,22 @@ struct DataCompressorImpl: DataCompressor {
   /// Optional annotator for annotating the raw compressed data (e.g. adding a header, checksum).
   private let annotator: DataAnnotator?
 
+  /// The pool that supplies the output buffers.
+  private let bufferPool: BufferPool
+
   /// Initialize with the specified algorithm.
   ///
   /// - Parameter algorithm: Compression algorithm to use.
   /// - Parameter annotator: Optional annotator for annotating the raw compressed data.
-  private init(algorithm: compression_algorithm, annotator: DataAnnotator?) {
+  /// - Parameter bufferPool: The pool that supplies the output buffers.
+  private init(
+    algorithm: compression_algorithm,
+    annotator: DataAnnotator?,
+    bufferPool: BufferPool = .shared
+  ) {
     self.algorithm = algorithm
     self.annotator = annotator
+    self.bufferPool = bufferPool
   }
 
   /// Attempt to compress the input using the ZLIB compression.
@@ -56,25 +65,26 @@ struct DataCompressorImpl: DataCompressor {
       throw DataCompressorError.minDataSize(inputData.count)
     }
 
-    var inputBuffer = [UInt8](inputData)
     // The output size should be strictly less than the input size otherwise we don't want it.
-    let outputBufferSize = inputBuffer.count - 1
-    let outputBuffer = UnsafeMutablePointer<UInt8>.allocate(capacity: outputBufferSize)
-
-    let compressedSize = compression_encode_buffer(
-      outputBuffer,
-      outputBufferSize,
-      &inputBuffer,
-      inputBuffer.count,
-      nil,
-      algorithm
-    )
-
-    if compressedSize == 0 {
+    let outputBufferSize = inputData.count - 1
+
+    var compressedData = bufferPool.makeData(capacity: outputBufferSize) { outputBuffer in
+      inputData.withUnsafeBytes { inputBuffer in
+        compression_encode_buffer(
+          outputBuffer.bindMemory(to: UInt8.self).baseAddress!,
+          outputBufferSize,
+          inputBuffer.bindMemory(to: UInt8.self).baseAddress!,
+          inputBuffer.count,
+          nil,
+          algorithm
+        )
+      }
+    }
+
+    if compressedData.isEmpty {
       throw DataCompressorError.failed
     }
 
-    var compressedData = NSData(bytesNoCopy: outputBuffer, length: compressedSize) as Data
     if let annotator = annotator {
       annotator.annotate(compressed: &compressedData, input: inputData)
     }
@@ -98,27 +108,32 @@ struct DataCompressorImpl: DataCompressor {
       throw DataCompressorError.invalidOriginalSize(originalSize)
     }
 
-    let inputBuffer = [UInt8](rawInput)
-    let outputBuffer = UnsafeMutablePointer<UInt8>.allocate(capacity: originalSize)
+    guard !rawInput.isEmpty else {
+      throw DataCompressorError.failed
+    }
 
-    let outputSize = compression_decode_buffer(
-      outputBuffer,
-      originalSize,
-      inputBuffer,
-      inputBuffer.count,
-      nil,
-      algorithm
-    )
+    let decompressedData = bufferPool.makeData(capacity: originalSize) { outputBuffer in
+      rawInput.withUnsafeBytes { inputBuffer in
+        compression_decode_buffer(
+          outputBuffer.bindMemory(to: UInt8.self).baseAddress!,
+          originalSize,
+          inputBuffer.bindMemory(to: UInt8.self).baseAddress!,
+          inputBuffer.count,
+          nil,
+          algorithm
+        )
+      }
+    }
 
-    guard outputSize > 0 else {
+    guard !decompressedData.isEmpty else {
       throw DataCompressorError.failed
     }
 
-    guard outputSize == originalSize else {
-      throw DataCompressorError.outputSizeMismatch(originalSize, outputSize)
+    guard decompressedData.count == originalSize else {
+      throw DataCompressorError.outputSizeMismatch(originalSize, decompressedData.count)
     }
 
-    return NSData(bytesNoCopy: outputBuffer, length: outputSize) as Data
+    return decompressedData
   }
 }
 
@@ -195,3 +210,13 @@ extension DataCompressorImpl {
     }
   }
 }
+
+// MARK: - Incremental decompression
+
+extension DataCompressorImpl {
+  /// Annotated zlib data can be decompressed as it arrives; other formats only as a whole.
+  func makeIncrementalDecompressor(originalSize: Int) -> IncrementalDecompressor? {
+    guard algorithm == COMPRESSION_ZLIB, annotator is ZlibAnnotator else { return nil }
+    return IncrementalZlibDecompressor(originalSize: originalSize)
+  }
+}
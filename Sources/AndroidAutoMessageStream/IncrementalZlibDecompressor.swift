@@ -0,0 +1,133 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+import Compression
+import Foundation
+
+/// Decompresses annotated zlib data piece by piece with a `compression_stream`.
+///
+/// The two byte zlib header is skipped and the trailing four byte checksum is held back, so that
+/// only the raw deflate bytes reach the stream, matching `DataCompressorImpl.zlib`.
+final class IncrementalZlibDecompressor: IncrementalDecompressor {
+  /// The size of the zlib header that precedes the deflate data.
+  static let headerSize = 2
+
+  /// The size of the Adler-32 checksum that follows the deflate data.
+  static let checksumSize = 4
+
+  /// The size of the buffer into which each call decompresses.
+  private static let outputChunkSize = 4_096
+
+  /// A valid pointer to pass as the source when there is no input.
+  private static let emptyInput = UnsafeMutablePointer<UInt8>.allocate(capacity: 1)
+
+  private let originalSize: Int
+  private let stream = UnsafeMutablePointer<compression_stream>.allocate(capacity: 1)
+  private var isStreamInitialized = false
+
+  /// Header bytes that still need to be skipped.
+  private var headerBytesToSkip = headerSize
+
+  /// The most recent bytes, which may turn out to be the checksum.
+  private var heldBackBytes = Data()
+
+  private var outputCount = 0
+
+  /// Creates a decompressor for data that expands to `originalSize` bytes.
+  ///
+  /// - Returns: `nil` if the compression stream cannot be initialized.
+  init?(originalSize: Int) {
+    guard originalSize > 0 else { return nil }
+
+    self.originalSize = originalSize
+    guard
+      compression_stream_init(stream, COMPRESSION_STREAM_DECODE, COMPRESSION_ZLIB)
+        == COMPRESSION_STATUS_OK
+    else {
+      return nil
+    }
+    isStreamInitialized = true
+  }
+
+  deinit {
+    if isStreamInitialized {
+      compression_stream_destroy(stream)
+    }
+    stream.deallocate()
+  }
+
+  func decompress(_ compressedData: Data) throws -> Data {
+    var input = compressedData
+    if headerBytesToSkip > 0 {
+      let skipped = min(headerBytesToSkip, input.count)
+      input = input.dropFirst(skipped)
+      headerBytesToSkip -= skipped
+    }
+
+    heldBackBytes.append(input)
+    guard heldBackBytes.count > Self.checksumSize else { return Data() }
+
+    let ready = heldBackBytes.prefix(heldBackBytes.count - Self.checksumSize)
+    heldBackBytes = Data(heldBackBytes.suffix(Self.checksumSize))
+    return try process(Data(ready), finalize: false)
+  }
+
+  func finish() throws -> Data {
+    let output = try process(Data(), finalize: true)
+    guard outputCount == originalSize else {
+      throw DataCompressorError.outputSizeMismatch(originalSize, outputCount)
+    }
+    return output
+  }
+
+  private func process(_ input: Data, finalize: Bool) throws -> Data {
+    var output = Data()
+    let flags = finalize ? Int32(COMPRESSION_STREAM_FINALIZE.rawValue) : 0
+    var outputBuffer = [UInt8](repeating: 0, count: Self.outputChunkSize)
+
+    try input.withUnsafeBytes { (inputBuffer: UnsafeRawBufferPointer) in
+      stream.pointee.src_ptr =
+        inputBuffer.bindMemory(to: UInt8.self).baseAddress ?? UnsafePointer(Self.emptyInput)
+      stream.pointee.src_size = inputBuffer.count
+
+      while true {
+        let status = outputBuffer.withUnsafeMutableBufferPointer {
+          (buffer: inout UnsafeMutableBufferPointer<UInt8>) -> compression_status in
+          stream.pointee.dst_ptr = buffer.baseAddress!
+          stream.pointee.dst_size = buffer.count
+          return compression_stream_process(stream, flags)
+        }
+
+        let produced = Self.outputChunkSize - stream.pointee.dst_size
+        output.append(contentsOf: outputBuffer[0..<produced])
+        outputCount += produced
+        guard outputCount <= originalSize else {
+          throw DataCompressorError.outputSizeMismatch(originalSize, outputCount)
+        }
+
+        switch status {
+        case COMPRESSION_STATUS_OK:
+          // Keep going while the output buffer was filled or input remains.
+          if stream.pointee.dst_size > 0, stream.pointee.src_size == 0 { return }
+        case COMPRESSION_STATUS_END:
+          return
+        default:
+          throw DataCompressorError.failed
+        }
+      }
+    }
+
+    return output
+  }
+}
@@ -65,6 +65,24 @@ public protocol MessageStreamDelegate: AnyObject {
   func messageStreamEncounteredUnrecoverableError(_ messageStream: MessageStream)
 }
 
+/// A delegate that is also handed the payload of a message while its packets are still arriving.
+///
+/// Streams that can decode a message incrementally call these methods before
+/// `messageStream(_:didReceiveMessage:params:)`, which is still called with the complete message.
+public protocol StreamingMessageStreamDelegate: MessageStreamDelegate {
+  /// Called with the next decoded piece of a message that is still being received.
+  ///
+  /// - Parameters:
+  ///   - messageStream: The stream that is receiving the message.
+  ///   - payload: The newly decoded bytes, which follow those of the previous call.
+  ///   - params: The contextual metadata for the message being received.
+  func messageStream(
+    _ messageStream: MessageStream,
+    didReceivePartialMessage payload: Data,
+    params: MessageStreamParams
+  )
+}
+
 /// Handles the streaming of BLE messages to a specific peripheral.
 ///
 /// This stream will handle if messages to a particular peripheral need to be split into
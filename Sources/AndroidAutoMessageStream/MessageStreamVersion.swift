@@ -21,6 +21,10 @@ public enum MessageStreamVersion: Equatable {
   /// A message stream that uses version 2 of the messaging protobuf and optionally compression.
   /// Pass `true` if compression is allowed.
   case v2(Bool)
+
+  /// A message stream that frames packets with a compact binary header instead of the messaging
+  /// protobufs of version 2 and supports compression.
+  case v3
 }
 
 /// The supported message security versions.
@@ -0,0 +1,56 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+import Foundation
+
+/// An encryptor that seals each packet of a message independently.
+///
+/// Unlike a `MessageEncryptor`, which can only decrypt a message once all of its packets have
+/// arrived, a packet encryptor lets the receiver open every packet as soon as it is read. Packets
+/// are numbered implicitly, so they must be opened in the order they were sealed.
+public protocol PacketEncryptor: AnyObject {
+  /// The number of bytes that sealing adds to a packet body.
+  var overhead: Int { get }
+
+  /// Seals the body of the next outgoing packet.
+  ///
+  /// - Parameters:
+  ///   - body: The packet body to seal.
+  ///   - header: The packet header, which is authenticated but not encrypted.
+  /// - Returns: The sealed body.
+  /// - Throws: An error if the body cannot be sealed.
+  func seal(_ body: Data, authenticating header: Data) throws -> Data
+
+  /// Opens the body of the next incoming packet.
+  ///
+  /// - Parameters:
+  ///   - sealedBody: The sealed packet body.
+  ///   - header: The packet header the body was sealed with.
+  /// - Returns: The original body.
+  /// - Throws: An error if the body cannot be authenticated.
+  func open(_ sealedBody: Data, authenticating header: Data) throws -> Data
+}
+
+/// A message stream that can encrypt each packet with a `PacketEncryptor`.
+///
+/// Both devices switch to packet encryption before the first encrypted message, so an encryptor
+/// must only be set while `hasExchangedEncryptedMessages` is `false`.
+public protocol PacketEncryptingMessageStream: MessageStream {
+  /// The encryptor for encrypted messages. When set, it is used instead of the
+  /// `messageEncryptor`.
+  var packetEncryptor: PacketEncryptor? { get set }
+
+  /// Whether an encrypted message has been written or started arriving on this stream.
+  var hasExchangedEncryptedMessages: Bool { get }
+}
@@ -27,10 +27,10 @@ private typealias MessagePacket = Com_Google_Companionprotos_Packet
 /// need to be reconstructed for the full message.
 ///
 /// The `payload` is the raw data that has been received so far. New packets are appended to the
-/// end of this `Data` object. `lastPacketNumber` is the packet number of the last message that was
+/// end of this pooled buffer. `lastPacketNumber` is the packet number of the last message that was
 /// appended to `payload`.
 private typealias ReceivedMessage = (
-  payload: Data,
+  payload: PooledBuffer,
   lastPacketNumber: UInt32
 )
 
@@ -85,6 +85,12 @@ class BLEMessageStreamV2: NSObject {
   /// command type and attribute ID and need to be subtracted from the write length.
   static let maxWriteValueLength = 182
 
+  /// The most bytes that will be reserved up front for reassembling a message.
+  ///
+  /// The capacity needed is estimated from the first packet, so this bounds the allocation made
+  /// for a packet that claims an unreasonable number of packets will follow.
+  static let maxReservedMessageCapacity = 1 << 20
+
   /// Messages that should be written to the write characteristic.
   ///
   /// The messages are ordered so that the item at the end of the array is the first message that
@@ -100,6 +106,11 @@ class BLEMessageStreamV2: NSObject {
   /// removed from this map upon a successful write.
   private var pendingMessages: [Int32: UUID] = [:]
 
+  /// Allocates IDs for outgoing messages.
+  ///
+  /// Owned by this stream so that streams for different cars never share a counter.
+  let messageIDGenerator = MessageIDGenerator()
+
   /// Messages that have been received from the read characteristic.
   ///
   /// This dictionary maps `messageID` to messages that the car has sent. This message is a tuple
@@ -119,6 +130,9 @@ class BLEMessageStreamV2: NSObject {
   /// Data compressor for compressing messages.
   let messageCompressor: DataCompressor
 
+  /// Supplies the buffers that messages are reassembled in.
+  let bufferPool: BufferPool
+
   public var version: MessageStreamVersion {
     MessageStreamVersion.v2(true)
   }
@@ -155,13 +169,15 @@ class BLEMessageStreamV2: NSObject {
     readCharacteristic: BLECharacteristic,
     writeCharacteristic: BLECharacteristic,
     messageCompressor: DataCompressor,
-    isCompressionEnabled: Bool
+    isCompressionEnabled: Bool,
+    bufferPool: BufferPool = .shared
   ) {
     self.peripheral = peripheral
     self.readCharacteristic = readCharacteristic
     self.writeCharacteristic = writeCharacteristic
     self.messageCompressor = messageCompressor
     self.isCompressionEnabled = isCompressionEnabled
+    self.bufferPool = bufferPool
 
     // "self" can only be used for something other than referencing fields after init() has been
     // called.
@@ -227,7 +243,9 @@ class BLEMessageStreamV2: NSObject {
       params.operationType == .encryptionHandshake
       ? Data() : withUnsafeBytes(of: params.recipient.uuid) { Data($0) }
 
-    let messageID = MessageIDGenerator.shared.next()
+    // Skip any ID still owned by a message that has not finished writing; this can only happen
+    // once the counter has wrapped.
+    let messageID = messageIDGenerator.next { pendingMessages[$0] != nil }
     var newPackets: [MessagePacket]
     do {
       newPackets = try MessagePacketFactory.makePackets(
@@ -311,10 +329,12 @@ class BLEMessageStreamV2: NSObject {
   private func processReceivedPacket(_ blePacket: MessagePacket) {
     let messageID = blePacket.messageID
 
-    let receivedMessage: ReceivedMessage
-    if let lastReceivedMessage = receivedMessages[messageID] {
-      guard isValid(blePacket, lastReceivedMessage: lastReceivedMessage) else { return }
-      receivedMessage = blePacket.toReceivedMessage(prependingPayloadFrom: lastReceivedMessage)
+    if let lastPacketNumber = receivedMessages[messageID]?.lastPacketNumber {
+      guard isValid(blePacket, lastPacketNumber: lastPacketNumber) else { return }
+
+      // Appended in place so that the reassembled payload is not copied for every packet.
+      receivedMessages[messageID]?.payload.append(blePacket.payload)
+      receivedMessages[messageID]?.lastPacketNumber = blePacket.packetNumber
     } else {
       // The first message must start at 1, but handle receiving the last packet as this could
       // represent a duplicate packet. All other cases will trigger an exception when the packet
@@ -328,32 +348,43 @@ class BLEMessageStreamV2: NSObject {
         )
         return
       }
-      receivedMessage = blePacket.toReceivedMessage()
-    }
 
-    receivedMessages[messageID] = receivedMessage
+      // A message of a single packet needs no reassembly.
+      if blePacket.packetNumber == 1, blePacket.totalPackets == 1 {
+        handleCompletePayload(blePacket.payload, messageID: messageID)
+        return
+      }
+
+      receivedMessages[messageID] = blePacket.toReceivedMessage(
+        bufferPool: bufferPool,
+        maxReservedCapacity: Self.maxReservedMessageCapacity)
+    }
 
     // Only notify delegate if the message is complete.
-    guard blePacket.packetNumber == blePacket.totalPackets else { return }
+    guard blePacket.packetNumber == blePacket.totalPackets,
+      let receivedMessage = receivedMessages.removeValue(forKey: messageID)
+    else {
+      return
+    }
 
-    handleCompletePayload(receivedMessage.payload, messageID: messageID)
+    handleCompletePayload(receivedMessage.payload.takeData(), messageID: messageID)
   }
 
   /// Returns `true` if the given packet is valid based on the specified `lastReceivedMessage`.
-  private func isValid(_ blePacket: MessagePacket, lastReceivedMessage: ReceivedMessage) -> Bool {
-    if lastReceivedMessage.lastPacketNumber + 1 == blePacket.packetNumber {
+  private func isValid(_ blePacket: MessagePacket, lastPacketNumber: UInt32) -> Bool {
+    if lastPacketNumber + 1 == blePacket.packetNumber {
       return true
     }
 
     // A duplicate packet can just be ignored, while an out-of-order packet should notify the
     // delegate that the stream should be closed.
-    if lastReceivedMessage.lastPacketNumber == blePacket.packetNumber {
+    if lastPacketNumber == blePacket.packetNumber {
       Self.log("Received a duplicate packet (\(blePacket.packetNumber)). Ignoring.")
     } else {
       Self.log.error(
         """
         Received out-of-order packet \(blePacket.packetNumber). \
-        Expecting \(lastReceivedMessage.lastPacketNumber + 1).
+        Expecting \(lastPacketNumber + 1).
         """
       )
 
@@ -364,8 +395,6 @@ class BLEMessageStreamV2: NSObject {
   }
 
   private func handleCompletePayload(_ payload: Data, messageID: Int32) {
-    receivedMessages[messageID] = nil
-
     guard let deviceMessage = try? BleDeviceMessage(serializedData: payload) else {
       Self.log.error(
         "Unable to deserialize received message (id: \(messageID)) into a BleDeviceMessage")
@@ -559,6 +588,7 @@ extension BLEMessageStreamV2: BLEPeripheralDelegate {
     )
 
     if blePacket.packetNumber == blePacket.totalPackets {
+      pendingMessages[blePacket.messageID] = nil
       delegate?.messageStreamDidWriteMessage(self, to: recipient)
     }
 
@@ -584,18 +614,22 @@ extension BLEMessageStreamV2: BLEPeripheralDelegate {
 // MARK: - MessagePacket extension.
 
 extension MessagePacket {
-  fileprivate func toReceivedMessage() -> ReceivedMessage {
-    return (payload: payload, lastPacketNumber: packetNumber)
-  }
-
-  /// Returns a `ReceivedMessage` representation of this packet whose payload is a combination
-  /// of the given `ReceivedMessage` and this packet's payload.
+  /// Returns a `ReceivedMessage` representation of this packet with room reserved for the
+  /// payloads of the packets that follow it.
+  ///
+  /// - Parameters:
+  ///   - bufferPool: The pool to take the reassembly buffer from.
+  ///   - maxReservedCapacity: The most bytes to reserve.
   fileprivate func toReceivedMessage(
-    prependingPayloadFrom receivedMessage: ReceivedMessage
+    bufferPool: BufferPool,
+    maxReservedCapacity: Int
   ) -> ReceivedMessage {
-    var newPayload = Data(receivedMessage.payload)
-    newPayload.append(payload)
+    let estimatedSize = payload.count.multipliedReportingOverflow(by: max(Int(totalPackets), 1))
+    let reassembledPayload = bufferPool.makeBuffer(
+      capacity: estimatedSize.overflow
+        ? maxReservedCapacity : min(estimatedSize.partialValue, maxReservedCapacity))
+    reassembledPayload.append(payload)
 
-    return (payload: newPayload, lastPacketNumber: packetNumber)
+    return (payload: reassembledPayload, lastPacketNumber: packetNumber)
   }
 }
@@ -16,31 +16,67 @@ import Foundation
 
 /// A generator of unique IDs for messages.
 ///
-/// This class is not thread-safe.
-class MessageIDGenerator {
-  static let shared = MessageIDGenerator()
+/// Each message stream owns its own generator, so IDs only need to be unique among the messages
+/// of a single stream. Allocation is serialized by a lock, which allows streams for different cars
+/// to be driven from different threads.
+final class MessageIDGenerator {
+  /// The maximum number of IDs that will be skipped over when looking for one that is not in use.
+  ///
+  /// Realistically, only a handful of messages are ever pending at once, so this bound only guards
+  /// against spinning indefinitely if the caller's in-use check is faulty.
+  static let maxCollisionRetries = 1024
+
+  /// Synchronizes access to `rawMessageID`.
+  private let lock = NSLock()
+
+  private var rawMessageID: Int32
 
   /// An ID that can be used to uniquely identify a message.
   ///
   /// This value should always be positive.
   ///
   /// It is exposed for testing purposes. Use `next()` to retrieve the correct value to use.
-  var messageID: Int32 = 0
+  var messageID: Int32 {
+    get {
+      lock.lock()
+      defer { lock.unlock() }
+      return rawMessageID
+    }
+    set {
+      lock.lock()
+      defer { lock.unlock() }
+      rawMessageID = newValue
+    }
+  }
+
+  /// Creates a generator whose first ID will be the given value.
+  ///
+  /// - Parameter initialMessageID: The first ID to return. Must not be negative.
+  init(initialMessageID: Int32 = 0) {
+    precondition(initialMessageID >= 0, "Message IDs cannot be negative.")
+    rawMessageID = initialMessageID
+  }
 
   /// Returns a new, unique ID for identifying messages.
   ///
-  /// This method is not thread-safe.
-  func next() -> Int32 {
-    let currentMessageID = messageID
+  /// IDs increase by one on each call and wrap back to 0 after `Int32.max`. Because a wrap can
+  /// bring the counter back around to a message that has still not finished sending, the caller
+  /// can supply `isInUse` to have such IDs skipped.
+  ///
+  /// - Parameter isInUse: Returns `true` if the given ID still belongs to a pending message.
+  /// - Returns: An ID that is not in use, or the next sequential ID if no free ID was found within
+  ///   `maxCollisionRetries` attempts.
+  func next(skippingIDsWhere isInUse: (Int32) -> Bool = { _ in false }) -> Int32 {
+    lock.lock()
+    defer { lock.unlock() }
 
-    if messageID == Int32.max {
-      // The ID cannot be negative, so reset to 0.
-      messageID = 0
-    } else {
-      messageID += 1
+    var candidate = advance()
+    var retries = 0
+    while isInUse(candidate), retries < Self.maxCollisionRetries {
+      candidate = advance()
+      retries += 1
     }
-
-    return currentMessageID
+    return candidate
   }
 
   /// Resets the message ID back to its default value.
@@ -50,4 +86,18 @@ class MessageIDGenerator {
   func reset() {
     messageID = 0
   }
+
+  /// Returns the current ID and moves the counter forward. Must be called with `lock` held.
+  private func advance() -> Int32 {
+    let currentMessageID = rawMessageID
+
+    if rawMessageID == Int32.max {
+      // The ID cannot be negative, so reset to 0.
+      rawMessageID = 0
+    } else {
+      rawMessageID += 1
+    }
+
+    return currentMessageID
+  }
 }
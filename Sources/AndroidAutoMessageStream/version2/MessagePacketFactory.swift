@@ -131,11 +131,11 @@ enum MessagePacketFactory {
 
     for i in 1...totalPackets {
       // Note: the cast to `Int32` is safe because the size of totalPackets has been verified to
-      // fit.
+      // fit. Each chunk is a slice that shares the storage of `packetPayload` rather than a copy.
       chunks.append(
         makePacket(
           messageID: messageID,
-          payload: packetPayload.subdata(in: start..<end),
+          payload: packetPayload[start..<end],
           packetNumber: UInt32(i),
           totalPackets: Int32(totalPackets)
         ))
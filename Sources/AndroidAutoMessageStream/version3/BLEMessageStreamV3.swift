@@ -0,0 +1,641 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+import AndroidAutoCoreBluetoothProtocols
+import AndroidAutoLogger
+import CoreBluetooth
+import Foundation
+
+/// A message whose packets are still being received.
+private struct ReceivedMessage {
+  /// The header of the first packet, which describes the whole message.
+  let header: CompactPacketHeader
+
+  /// The recipient and original size carried by the first packet.
+  let prefix: CompactMessagePrefix
+
+  /// The parameters reported to the delegate for this message.
+  let params: MessageStreamParams
+
+  /// Whether the payload of each packet is decoded as soon as the packet arrives.
+  ///
+  /// This is not possible when the message was encrypted as a whole, or when it is compressed and
+  /// the compressor can only decompress complete messages.
+  let isDecodedIncrementally: Bool
+
+  /// Decompresses the payload of a compressed message that is decoded incrementally.
+  let decompressor: IncrementalDecompressor?
+
+  /// The payload received so far, already decoded if `isDecodedIncrementally`.
+  var payload: Data
+
+  /// The sequence number of the last packet appended to `payload`.
+  var lastSequence: UInt8
+}
+
+/// Errors that can occur within the version 3 message stream.
+enum BLEMessageStreamV3Error: Error {
+  /// An error occurred while forming the packets of a message for write.
+  case cannotSerializeMessage
+
+  /// No `messageEncryptor` was set on this stream.
+  case noEncryptorSet
+
+  /// There was an error during the encryption of a message.
+  case cannotEncrypt
+
+  /// There was an error during the decryption of a message.
+  case cannotDecrypt
+
+  /// A packet failed authentication.
+  case cannotOpenPacket
+
+  /// Failed to decompress a compressed message.
+  case cannotDecompress
+}
+
+/// An extension of the error that sets a message describing the cause.
+extension BLEMessageStreamV3Error: LocalizedError {
+  public var errorDescription: String? {
+    switch self {
+    case .cannotSerializeMessage:
+      return "Cannot form the packets of the message to be sent to the peripheral."
+    case .noEncryptorSet:
+      return "No messageEncryptor set on this stream."
+    case .cannotEncrypt:
+      return "Message cannot be encrypted for sending"
+    case .cannotDecrypt:
+      return "Cannot decrypt message from remote peripheral."
+    case .cannotOpenPacket:
+      return "Cannot authenticate packet from remote peripheral."
+    case .cannotDecompress:
+      return "Cannot decompress the compressed message from the remote peripheral."
+    }
+  }
+}
+
+/// Version 3 of the message stream.
+///
+/// Behaves like version 2, but frames each packet with the fixed four byte `CompactPacketHeader`
+/// instead of nesting a `Message` proto inside `Packet` protos, so that more of every write carries
+/// payload.
+///
+/// If a `packetEncryptor` has been negotiated, each packet of an encrypted message is sealed on its
+/// own, so that received packets are decrypted and decompressed as they arrive and a
+/// `StreamingMessageStreamDelegate` is handed the payload before the message is complete.
+class BLEMessageStreamV3: NSObject {
+  private static let log = Logger(for: BLEMessageStreamV3.self)
+
+  /// The recipient reported for messages that carry none, such as encryption handshakes.
+  private static let noRecipient = NSUUID(uuidBytes: [UInt8](repeating: 0, count: 16)) as UUID
+
+  /// Packets that should be written to the write characteristic.
+  ///
+  /// The packets are ordered so that the item at the end of the array is the first packet that
+  /// should be written, so that the next packet can be taken with an O(1) `removeLast`.
+  var writeMessageStack: [CompactPacket] = []
+
+  /// Maps the IDs of messages still waiting to be written to their recipients.
+  private var pendingMessages: [UInt16: UUID] = [:]
+
+  /// Allocates IDs for outgoing messages. Only the low 16 bits are sent.
+  let messageIDGenerator = MessageIDGenerator()
+
+  /// Messages whose packets are still being received, keyed by message ID.
+  private var receivedMessages: [UInt16: ReceivedMessage] = [:]
+
+  /// The header of the last packet opened by the `packetEncryptor`, to recognize a repeat of it.
+  private var lastOpenedHeaderBytes: Data?
+
+  /// Whether a `writeValue` to the remote peripheral is currently in progress.
+  private var isWriteInProgress = false
+
+  /// Indicates whether outgoing messages should be compressed.
+  let isCompressionEnabled: Bool
+
+  /// Data compressor for compressing messages.
+  let messageCompressor: DataCompressor
+
+  public let version = MessageStreamVersion.v3
+
+  public let peripheral: BLEPeripheral
+  public let readCharacteristic: BLECharacteristic
+  public let writeCharacteristic: BLECharacteristic
+
+  /// The encryptor responsible for encrypting and decrypting messages.
+  public var messageEncryptor: MessageEncryptor?
+
+  /// The encryptor for the packets of encrypted messages, used instead of `messageEncryptor`.
+  public var packetEncryptor: PacketEncryptor?
+
+  /// Whether an encrypted message has been written or started arriving on this stream.
+  public private(set) var hasExchangedEncryptedMessages = false
+
+  public weak var delegate: MessageStreamDelegate?
+
+  /// Debug description for reading.
+  var readingDebugDescription: String {
+    "Read characteristic with uuid: \(readCharacteristic.uuid.uuidString)"
+  }
+
+  /// Debug description for writing.
+  var writingDebugDescription: String {
+    "Write characteristic with uuid: \(writeCharacteristic.uuid.uuidString)"
+  }
+
+  /// Creates a stream with the given peripheral.
+  ///
+  /// - Parameters
+  ///   - peripheral: The peripheral to stream messages with.
+  ///   - readCharacteristic: The characteristic to listen for new messages on.
+  ///   - writeCharacteristic: The characteristic to write messages to.
+  ///   - messageCompressor: Compresses/decompresses message data.
+  ///   - isCompressionEnabled: Whether outgoing messages should be compressed.
+  public init(
+    peripheral: BLEPeripheral,
+    readCharacteristic: BLECharacteristic,
+    writeCharacteristic: BLECharacteristic,
+    messageCompressor: DataCompressor,
+    isCompressionEnabled: Bool
+  ) {
+    self.peripheral = peripheral
+    self.readCharacteristic = readCharacteristic
+    self.writeCharacteristic = writeCharacteristic
+    self.messageCompressor = messageCompressor
+    self.isCompressionEnabled = isCompressionEnabled
+
+    super.init()
+    peripheral.delegate = self
+    peripheral.setNotifyValue(true, for: readCharacteristic)
+  }
+
+  /// Write the message, compressing and encrypting it as indicated.
+  private func writeMessage(
+    _ message: Data,
+    encrypting: Bool,
+    params: MessageStreamParams
+  ) throws {
+    if encrypting {
+      hasExchangedEncryptedMessages = true
+    }
+
+    var outputMessage = message
+    var originalSize: UInt32 = 0
+    if isCompressionEnabled, let compressedMessage = try? messageCompressor.compress(message) {
+      originalSize = UInt32(message.count)
+      outputMessage = compressedMessage
+    }
+
+    // With a packet encryptor the packets are sealed as they are formed.
+    var sealBody: ((Data, Data) throws -> Data)?
+    var bodyOverhead = 0
+    if encrypting, let packetEncryptor = packetEncryptor {
+      bodyOverhead = packetEncryptor.overhead
+      sealBody = { body, header in
+        guard let sealedBody = try? packetEncryptor.seal(body, authenticating: header) else {
+          throw BLEMessageStreamV3Error.cannotEncrypt
+        }
+        return sealedBody
+      }
+    } else if encrypting {
+      outputMessage = try encryptMessage(outputMessage)
+    }
+
+    let maximumWriteValueLength = min(
+      BLEMessageStreamV2.maxWriteValueLength,
+      peripheral.maximumWriteValueLength
+    )
+
+    // Skip any ID still owned by a message that has not finished writing.
+    let messageID = UInt16(
+      truncatingIfNeeded: messageIDGenerator.next {
+        pendingMessages[UInt16(truncatingIfNeeded: $0)] != nil
+      })
+
+    // Encryption handshake messages have no recipient.
+    let recipient: UUID? =
+      params.operationType == .encryptionHandshake ? nil : params.recipient
+
+    var newPackets: [CompactPacket]
+    do {
+      newPackets = try CompactPacketFactory.makePackets(
+        messageID: messageID,
+        operation: params.operationType.toOperationType(),
+        payload: outputMessage,
+        originalSize: originalSize,
+        isPayloadEncrypted: encrypting,
+        recipient: recipient,
+        maxSize: maximumWriteValueLength,
+        bodyOverhead: bodyOverhead,
+        sealBody: sealBody
+      )
+    } catch {
+      Self.log.error(
+        "Error during attempt to chunk message for sending: \(error.localizedDescription)")
+      throw error as? BLEMessageStreamV3Error ?? .cannotSerializeMessage
+    }
+
+    Self.log.info("Number of chunks for streaming message: \(newPackets.count)")
+
+    newPackets.reverse()
+    writeMessageStack.insert(contentsOf: newPackets, at: 0)
+    pendingMessages[messageID] = params.recipient
+
+    writeNextMessageInStack()
+  }
+
+  private func writeNextMessageInStack() {
+    guard !isWriteInProgress else {
+      Self.log.info(
+        "Request to write next message, but a write is currently in progress. Will wait.")
+      return
+    }
+
+    guard let packet = writeMessageStack.last else {
+      Self.log.error(
+        "Requested to write next message to peripheral, but no remaining messages to be written.")
+      return
+    }
+
+    peripheral.writeValue(packet.data, for: writeCharacteristic)
+    isWriteInProgress = true
+
+    Self.log.info(
+      """
+      Writing packet \(packet.header.sequence) (last: \(packet.header.isLast)). \
+      Message ID: \(packet.header.messageID).
+      """
+    )
+  }
+
+  private func processReceivedPacket(
+    _ header: CompactPacketHeader,
+    headerBytes: Data,
+    body: Data
+  ) {
+    let messageID = header.messageID
+
+    if header.isFirst {
+      if let lastSequence = receivedMessages[messageID]?.lastSequence {
+        if lastSequence == header.sequence {
+          Self.log("Received a duplicate packet (\(header.sequence)). Ignoring.")
+          return
+        }
+        Self.log.error("Received a new message while message \(messageID) is incomplete.")
+        delegate?.messageStreamEncounteredUnrecoverableError(self)
+        return
+      }
+
+      if header.isEncrypted {
+        hasExchangedEncryptedMessages = true
+      }
+
+      // A repeated packet cannot be opened again, so it is dropped before opening.
+      if header.isEncrypted, packetEncryptor != nil, headerBytes == lastOpenedHeaderBytes {
+        Self.log("Received a duplicate first packet of message \(messageID). Ignoring.")
+        return
+      }
+
+      guard let body = openPacketBody(body, header: header, headerBytes: headerBytes) else {
+        return
+      }
+
+      guard let prefix = try? CompactMessagePrefix(header: header, bytes: body) else {
+        Self.log.error("First packet of message \(messageID) is too short for its prefix.")
+        delegate?.messageStreamEncounteredUnrecoverableError(self)
+        return
+      }
+
+      let isWholeMessageEncrypted = header.isEncrypted && packetEncryptor == nil
+      let decompressor =
+        header.isCompressed && !isWholeMessageEncrypted
+        ? messageCompressor.makeIncrementalDecompressor(originalSize: Int(prefix.originalSize))
+        : nil
+      receivedMessages[messageID] = ReceivedMessage(
+        header: header,
+        prefix: prefix,
+        params: MessageStreamParams(
+          recipient: prefix.recipient ?? Self.noRecipient,
+          operationType: header.operation.toStreamOperationType()
+        ),
+        isDecodedIncrementally: !isWholeMessageEncrypted
+          && (!header.isCompressed || decompressor != nil),
+        decompressor: decompressor,
+        payload: Data(),
+        lastSequence: header.sequence
+      )
+      guard appendPayload(body.dropFirst(header.messagePrefixSize), toMessage: messageID) else {
+        return
+      }
+    } else if let lastSequence = receivedMessages[messageID]?.lastSequence {
+      // Duplicates are dropped before opening, since each body can only be opened once.
+      guard isValid(header, lastSequence: lastSequence),
+        let body = openPacketBody(body, header: header, headerBytes: headerBytes)
+      else {
+        return
+      }
+
+      receivedMessages[messageID]?.lastSequence = header.sequence
+      guard appendPayload(body, toMessage: messageID) else { return }
+    } else {
+      // A repeated last packet of a message that has already completed can just be ignored.
+      if header.isLast {
+        Self.log("Received possible duplicate last packet of message \(messageID).")
+      } else {
+        Self.log.error("Received packet \(header.sequence) of unknown message \(messageID).")
+        delegate?.messageStreamEncounteredUnrecoverableError(self)
+      }
+      return
+    }
+
+    guard header.isLast, let receivedMessage = receivedMessages.removeValue(forKey: messageID)
+    else {
+      return
+    }
+
+    handleCompleteMessage(receivedMessage)
+  }
+
+  /// Opens a packet body sealed by the `packetEncryptor`.
+  ///
+  /// - Returns: The opened body, the body itself if it is not sealed, or `nil` if it cannot be
+  ///   opened, in which case the delegate has been notified.
+  private func openPacketBody(
+    _ body: Data,
+    header: CompactPacketHeader,
+    headerBytes: Data
+  ) -> Data? {
+    guard header.isEncrypted, let packetEncryptor = packetEncryptor else { return body }
+
+    do {
+      let openedBody = try packetEncryptor.open(body, authenticating: headerBytes)
+      lastOpenedHeaderBytes = headerBytes
+      return openedBody
+    } catch {
+      Self.log.error(
+        "Unable to open packet \(header.sequence) of message \(header.messageID): \(error)")
+      receivedMessages[header.messageID] = nil
+      delegate?.messageStreamEncounteredUnrecoverableError(self)
+      return nil
+    }
+  }
+
+  /// Appends the payload of a packet to a message being received, decoding it if possible and
+  /// passing the decoded bytes to a streaming delegate.
+  ///
+  /// - Returns: `false` if the payload cannot be decoded, in which case the delegate has been
+  ///   notified.
+  private func appendPayload(_ payload: Data, toMessage messageID: UInt16) -> Bool {
+    // Only copy out the fields needed so the payload buffer is not shared while appending to it.
+    guard let isDecodedIncrementally = receivedMessages[messageID]?.isDecodedIncrementally,
+      let params = receivedMessages[messageID]?.params
+    else {
+      return false
+    }
+
+    guard isDecodedIncrementally else {
+      receivedMessages[messageID]?.payload.append(payload)
+      return true
+    }
+
+    var decoded = Data(payload)
+    if let decompressor = receivedMessages[messageID]?.decompressor {
+      do {
+        decoded = try decompressor.decompress(decoded)
+      } catch {
+        Self.log.error("Unable to decompress packet of message \(messageID): \(error)")
+        receivedMessages[messageID] = nil
+        delegate?.messageStreamEncounteredUnrecoverableError(self)
+        return false
+      }
+    }
+
+    receivedMessages[messageID]?.payload.append(decoded)
+    notifyPartialMessage(decoded, params: params)
+    return true
+  }
+
+  private func notifyPartialMessage(_ payload: Data, params: MessageStreamParams) {
+    guard !payload.isEmpty, let delegate = delegate as? StreamingMessageStreamDelegate else {
+      return
+    }
+    delegate.messageStream(self, didReceivePartialMessage: payload, params: params)
+  }
+
+  /// Returns `true` if the given packet follows the packet with `lastSequence`.
+  private func isValid(_ header: CompactPacketHeader, lastSequence: UInt8) -> Bool {
+    if lastSequence &+ 1 == header.sequence {
+      return true
+    }
+
+    // A duplicate packet can just be ignored, while an out-of-order packet should notify the
+    // delegate that the stream should be closed.
+    if lastSequence == header.sequence {
+      Self.log("Received a duplicate packet (\(header.sequence)). Ignoring.")
+    } else {
+      Self.log.error(
+        "Received out-of-order packet \(header.sequence). Expecting \(lastSequence &+ 1).")
+      delegate?.messageStreamEncounteredUnrecoverableError(self)
+    }
+
+    return false
+  }
+
+  private func handleCompleteMessage(_ message: ReceivedMessage) {
+    let messageID = message.header.messageID
+
+    var payload = message.payload
+    if message.isDecodedIncrementally {
+      if let decompressor = message.decompressor {
+        do {
+          let remainder = try decompressor.finish()
+          payload.append(remainder)
+          notifyPartialMessage(remainder, params: message.params)
+        } catch {
+          Self.log.error("Unable to finish decompressing message for ID: \(messageID)")
+          delegate?.messageStreamEncounteredUnrecoverableError(self)
+          return
+        }
+      }
+      delegate?.messageStream(self, didReceiveMessage: payload, params: message.params)
+      return
+    }
+
+    if message.header.isEncrypted {
+      do {
+        payload = try decryptMessage(payload)
+      } catch {
+        Self.log.error("Unable to decrypt message for ID: \(messageID)")
+        delegate?.messageStreamEncounteredUnrecoverableError(self)
+        return
+      }
+    }
+
+    if message.header.isCompressed {
+      do {
+        payload = try messageCompressor.decompress(
+          payload, originalSize: Int(message.prefix.originalSize))
+      } catch {
+        Self.log.error("Unable to decompress message for ID: \(messageID)")
+        delegate?.messageStreamEncounteredUnrecoverableError(self)
+        return
+      }
+    }
+
+    delegate?.messageStream(self, didReceiveMessage: payload, params: message.params)
+  }
+
+  private func encryptMessage(_ message: Data) throws -> Data {
+    guard let messageEncryptor = messageEncryptor else {
+      throw BLEMessageStreamV3Error.noEncryptorSet
+    }
+
+    guard let encryptedMessage = try? messageEncryptor.encrypt(message) else {
+      throw BLEMessageStreamV3Error.cannotEncrypt
+    }
+
+    return encryptedMessage
+  }
+
+  private func decryptMessage(_ message: Data) throws -> Data {
+    guard let messageEncryptor = messageEncryptor else {
+      throw BLEMessageStreamV3Error.noEncryptorSet
+    }
+
+    guard let decryptedMessage = try? messageEncryptor.decrypt(message) else {
+      throw BLEMessageStreamV3Error.cannotDecrypt
+    }
+
+    return decryptedMessage
+  }
+}
+
+// MARK: - BLEMessageStream
+
+extension BLEMessageStreamV3: BLEMessageStream {
+  /// Writes the given message to the peripheral associated with this stream.
+  ///
+  /// - Parameter message: The message to write.
+  public func writeMessage(_ message: Data, params: MessageStreamParams) throws {
+    try writeMessage(message, encrypting: false, params: params)
+  }
+
+  /// Encrypts and writes the given message to the peripheral associated with this stream.
+  ///
+  /// - Parameter message: The message to write.
+  /// - Throws: An error occurred during the encryption of the message.
+  public func writeEncryptedMessage(_ message: Data, params: MessageStreamParams) throws {
+    try writeMessage(message, encrypting: true, params: params)
+  }
+}
+
+// MARK: - PacketEncryptingMessageStream
+
+extension BLEMessageStreamV3: PacketEncryptingMessageStream {}
+
+// MARK: - BLEPeripheralDelegate
+
+extension BLEMessageStreamV3: BLEPeripheralDelegate {
+  public func peripheral(
+    _ peripheral: BLEPeripheral,
+    didUpdateValueFor characteristic: BLECharacteristic,
+    error: Error?
+  ) {
+    guard error == nil else {
+      Self.log.error("Error on characteristic update: \(error!.localizedDescription)")
+      return
+    }
+
+    // This should never happen because we only call `setNotifyValue` for this characteristic.
+    guard characteristic.uuid == readCharacteristic.uuid else {
+      Self.log.error(
+        """
+        Received a message from an unexpected characteristic \
+        (\(characteristic.uuid.uuidString)). Expected \(readCharacteristic.uuid.uuidString).
+        """
+      )
+      return
+    }
+
+    guard let message = characteristic.value else {
+      Self.log.debug("Received empty message from characteristic \(characteristic.uuid.uuidString)")
+      return
+    }
+
+    guard let header = try? CompactPacketHeader(bytes: message) else {
+      Self.log.error(
+        """
+        Received message for characteristic (\(characteristic.uuid.uuidString)), \
+        but could not parse.
+        """
+      )
+      return
+    }
+
+    Self.log.info(
+      """
+      Received packet \(header.sequence) (last: \(header.isLast)) for readCharacteristic \
+      (\(readCharacteristic.uuid.uuidString)). Message ID: \(header.messageID)
+      """
+    )
+
+    processReceivedPacket(
+      header,
+      headerBytes: message.prefix(CompactPacketHeader.size),
+      body: message.dropFirst(CompactPacketHeader.size)
+    )
+  }
+
+  func peripheralIsReadyToWrite(_ peripheral: BLEPeripheral) {
+    isWriteInProgress = false
+
+    guard let packet = writeMessageStack.last,
+      let recipient = pendingMessages[packet.header.messageID]
+    else {
+      Self.log.error(
+        "Unexpected. Message write successful, but no message in the stack or recipient")
+      return
+    }
+
+    writeMessageStack.removeLast()
+
+    Self.log.info(
+      """
+      Successfully wrote packet \(packet.header.sequence) (last: \(packet.header.isLast)). \
+      Message ID: \(packet.header.messageID). Remaining message: \(writeMessageStack.count)
+      """
+    )
+
+    if packet.header.isLast {
+      pendingMessages[packet.header.messageID] = nil
+      delegate?.messageStreamDidWriteMessage(self, to: recipient)
+    }
+
+    if !writeMessageStack.isEmpty {
+      writeNextMessageInStack()
+    }
+  }
+
+  public func peripheral(_ peripheral: BLEPeripheral, didDiscoverServices error: Error?) {
+    // No-op. Not discovering services in this class.
+  }
+
+  public func peripheral(
+    _ peripheral: BLEPeripheral,
+    didDiscoverCharacteristicsFor service: BLEService,
+    error: Error?
+  ) {
+    // No-op. Not discovering characteristics in this class.
+  }
+}
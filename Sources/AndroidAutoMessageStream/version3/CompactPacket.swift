@@ -0,0 +1,272 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+import Foundation
+import AndroidAutoCompanionProtos
+
+private typealias OperationType = Com_Google_Companionprotos_OperationType
+
+/// Possible errors from encoding or parsing a `CompactPacket`.
+enum CompactPacketError: Error, Equatable {
+  /// The data is too short to hold the packet header or the message prefix.
+  case truncated
+
+  /// The operation cannot be represented in the header bits.
+  case unsupportedOperation(Int)
+
+  /// The maximum packet size cannot hold the header and the message prefix.
+  case maxSizeTooSmall(Int)
+}
+
+/// The fixed binary header of a version 3 packet.
+///
+/// Version 3 replaces the `Packet` and `Message` protos of version 2 with four bytes:
+///
+///     byte 0:    first | last | encrypted | compressed | recipient | operation (3 bits)
+///     bytes 1-2: message ID (big-endian)
+///     byte 3:    sequence number of the packet within its message
+///
+/// The first packet of a message is followed by a prefix holding the 16 byte recipient if the
+/// recipient flag is set and the 4 byte big-endian original size if the compressed flag is set.
+struct CompactPacketHeader: Equatable {
+  /// The size in bytes of the header.
+  static let size = 4
+
+  /// The size in bytes of an encoded recipient.
+  static let recipientSize = 16
+
+  /// The size in bytes of an encoded original size.
+  static let originalSizeSize = 4
+
+  private static let firstFlag: UInt8 = 0x80
+  private static let lastFlag: UInt8 = 0x40
+  private static let encryptedFlag: UInt8 = 0x20
+  private static let compressedFlag: UInt8 = 0x10
+  private static let recipientFlag: UInt8 = 0x08
+  private static let operationMask: UInt8 = 0x07
+
+  var messageID: UInt16
+  var sequence: UInt8
+  var isFirst: Bool
+  var isLast: Bool
+  var isEncrypted: Bool
+  var isCompressed: Bool
+  var hasRecipient: Bool
+  var operation: Com_Google_Companionprotos_OperationType
+
+  /// The size of the prefix that follows this header in the first packet of a message.
+  var messagePrefixSize: Int {
+    guard isFirst else { return 0 }
+    return (hasRecipient ? Self.recipientSize : 0) + (isCompressed ? Self.originalSizeSize : 0)
+  }
+
+  init(
+    messageID: UInt16,
+    sequence: UInt8,
+    isFirst: Bool,
+    isLast: Bool,
+    isEncrypted: Bool,
+    isCompressed: Bool,
+    hasRecipient: Bool,
+    operation: Com_Google_Companionprotos_OperationType
+  ) {
+    self.messageID = messageID
+    self.sequence = sequence
+    self.isFirst = isFirst
+    self.isLast = isLast
+    self.isEncrypted = isEncrypted
+    self.isCompressed = isCompressed
+    self.hasRecipient = hasRecipient
+    self.operation = operation
+  }
+
+  /// Parses the header at the start of the given bytes.
+  ///
+  /// - Throws: `CompactPacketError.truncated` if there are fewer bytes than a header.
+  init<Bytes: Collection>(bytes: Bytes) throws where Bytes.Element == UInt8 {
+    guard bytes.count >= Self.size else { throw CompactPacketError.truncated }
+
+    var index = bytes.startIndex
+    func nextByte() -> UInt8 {
+      defer { index = bytes.index(after: index) }
+      return bytes[index]
+    }
+
+    let flags = nextByte()
+    let messageIDHigh = UInt16(nextByte())
+    let messageIDLow = UInt16(nextByte())
+
+    messageID = messageIDHigh << 8 | messageIDLow
+    sequence = nextByte()
+    isFirst = flags & Self.firstFlag != 0
+    isLast = flags & Self.lastFlag != 0
+    isEncrypted = flags & Self.encryptedFlag != 0
+    isCompressed = flags & Self.compressedFlag != 0
+    hasRecipient = flags & Self.recipientFlag != 0
+    operation = OperationType(rawValue: Int(flags & Self.operationMask)) ?? .unknown
+  }
+
+  /// Appends the encoded header to the given data.
+  ///
+  /// - Throws: `CompactPacketError.unsupportedOperation` if the operation needs more than three
+  ///   bits.
+  func append(to data: inout Data) throws {
+    let operationValue = operation.rawValue
+    guard operationValue >= 0, operationValue <= Int(Self.operationMask) else {
+      throw CompactPacketError.unsupportedOperation(operationValue)
+    }
+
+    var flags = UInt8(operationValue)
+    if isFirst { flags |= Self.firstFlag }
+    if isLast { flags |= Self.lastFlag }
+    if isEncrypted { flags |= Self.encryptedFlag }
+    if isCompressed { flags |= Self.compressedFlag }
+    if hasRecipient { flags |= Self.recipientFlag }
+
+    data.append(contentsOf: [flags, UInt8(messageID >> 8), UInt8(messageID & 0xFF), sequence])
+  }
+}
+
+/// A version 3 packet ready to be written.
+struct CompactPacket {
+  let header: CompactPacketHeader
+
+  /// The encoded packet, including the header.
+  let data: Data
+}
+
+/// The values carried by the prefix of the first packet of a message.
+struct CompactMessagePrefix: Equatable {
+  /// The recipient of the message or `nil` if it has none (e.g. encryption handshake messages).
+  var recipient: UUID?
+
+  /// The size of the payload before compression or `0` if it is not compressed.
+  var originalSize: UInt32
+
+  /// Parses the prefix described by `header` from the start of the given bytes.
+  ///
+  /// - Throws: `CompactPacketError.truncated` if there are fewer bytes than the prefix.
+  init(header: CompactPacketHeader, bytes: Data) throws {
+    guard bytes.count >= header.messagePrefixSize else { throw CompactPacketError.truncated }
+
+    var index = bytes.startIndex
+    if header.hasRecipient {
+      let end = index + CompactPacketHeader.recipientSize
+      recipient = NSUUID(uuidBytes: [UInt8](bytes[index..<end])) as UUID
+      index = end
+    } else {
+      recipient = nil
+    }
+
+    if header.isCompressed {
+      originalSize = bytes[index..<index + CompactPacketHeader.originalSizeSize].reduce(0) {
+        $0 << 8 | UInt32($1)
+      }
+    } else {
+      originalSize = 0
+    }
+  }
+}
+
+/// A creator of `CompactPacket`s.
+enum CompactPacketFactory {
+  /// Splits a message into packets of at most `maxSize` bytes.
+  ///
+  /// - Complexity: O(*n*), where *n* is the length of the payload.
+  /// - Parameters:
+  ///   - messageID: The ID shared by the packets of the message.
+  ///   - operation: The operation this message represents.
+  ///   - payload: The payload to send.
+  ///   - originalSize: The size of the payload before compression or `0` if not compressed.
+  ///   - isPayloadEncrypted: Whether the payload is encrypted.
+  ///   - recipient: The recipient of the message or `nil` if it has none.
+  ///   - maxSize: The most bytes each packet may hold.
+  ///   - bodyOverhead: The bytes that `sealBody` adds to each packet body.
+  ///   - sealBody: Seals the body (prefix and payload) of each packet in turn, given the body and
+  ///     the encoded header to authenticate. `nil` to leave the bodies as they are.
+  /// - Throws: An error if the packets cannot be formed or sealed.
+  static func makePackets(
+    messageID: UInt16,
+    operation: Com_Google_Companionprotos_OperationType,
+    payload: Data,
+    originalSize: UInt32,
+    isPayloadEncrypted: Bool,
+    recipient: UUID?,
+    maxSize: Int,
+    bodyOverhead: Int = 0,
+    sealBody: ((Data, Data) throws -> Data)? = nil
+  ) throws -> [CompactPacket] {
+    var header = CompactPacketHeader(
+      messageID: messageID,
+      sequence: 0,
+      isFirst: true,
+      isLast: false,
+      isEncrypted: isPayloadEncrypted,
+      isCompressed: originalSize > 0,
+      hasRecipient: recipient != nil,
+      operation: operation
+    )
+
+    let firstPacketOverhead = CompactPacketHeader.size + header.messagePrefixSize + bodyOverhead
+    guard maxSize > firstPacketOverhead else {
+      throw CompactPacketError.maxSizeTooSmall(maxSize)
+    }
+
+    var packets: [CompactPacket] = []
+    packets.reserveCapacity(
+      (payload.count + firstPacketOverhead)
+        / (maxSize - CompactPacketHeader.size - bodyOverhead) + 1)
+
+    var start = payload.startIndex
+    repeat {
+      let capacity =
+        maxSize - CompactPacketHeader.size - header.messagePrefixSize - bodyOverhead
+      let end = payload.index(start, offsetBy: capacity, limitedBy: payload.endIndex)
+        ?? payload.endIndex
+      header.isLast = end == payload.endIndex
+
+      var data = Data(capacity: maxSize)
+      try header.append(to: &data)
+      if let sealBody = sealBody {
+        var body = Data(capacity: maxSize - CompactPacketHeader.size)
+        if header.isFirst {
+          appendPrefix(recipient: recipient, originalSize: originalSize, to: &body)
+        }
+        body.append(payload[start..<end])
+        data.append(try sealBody(body, data))
+      } else {
+        if header.isFirst {
+          appendPrefix(recipient: recipient, originalSize: originalSize, to: &data)
+        }
+        data.append(payload[start..<end])
+      }
+      packets.append(CompactPacket(header: header, data: data))
+
+      start = end
+      header.isFirst = false
+      header.sequence &+= 1
+    } while start < payload.endIndex
+
+    return packets
+  }
+
+  private static func appendPrefix(recipient: UUID?, originalSize: UInt32, to data: inout Data) {
+    if let recipient = recipient {
+      withUnsafeBytes(of: recipient.uuid) { data.append(contentsOf: $0) }
+    }
+    if originalSize > 0 {
+      withUnsafeBytes(of: originalSize.bigEndian) { data.append(contentsOf: $0) }
+    }
+  }
+}
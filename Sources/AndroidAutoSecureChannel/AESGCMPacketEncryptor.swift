@@ -0,0 +1,120 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+import AndroidAutoMessageStream
+import AndroidAutoUKey2Wrapper
+import CryptoKit
+import Foundation
+
+/// Errors from sealing or opening packets with an `AESGCMPacketEncryptor`.
+enum AESGCMPacketEncryptorError: Error, Equatable {
+  /// The sealed body is too short to hold the authentication tag.
+  case invalidDataSize(Int)
+
+  /// The packet counter for a direction has been used up.
+  case counterExhausted
+}
+
+/// Seals each packet with AES-256-GCM under a per-direction key.
+///
+/// The nonce of a packet is its number in its direction: four zero bytes followed by the 64 bit
+/// big-endian packet counter. Nonces are never sent, so packets must be opened in the same order
+/// that they were sealed, which the in-order delivery of the message stream guarantees. A packet
+/// that fails to open does not advance the counter.
+final class AESGCMPacketEncryptor: PacketEncryptor {
+  /// The size of the authentication tag appended to each sealed body.
+  static let tagSize = 16
+
+  /// Salt used when deriving the packet keys from the traffic keys of a session.
+  static let keySalt = Data("PACKET".utf8)
+
+  private let sealKey: SymmetricKey
+  private let openKey: SymmetricKey
+
+  /// Guards the counters, since packets may be sealed and opened on different queues.
+  private let lock = NSLock()
+  private var sealCounter: UInt64 = 0
+  private var openCounter: UInt64 = 0
+
+  var overhead: Int { Self.tagSize }
+
+  /// Creates an encryptor with the given keys.
+  ///
+  /// - Parameters:
+  ///   - sealKey: The 32 byte key for outgoing packets.
+  ///   - openKey: The 32 byte key for incoming packets.
+  init(sealKey: Data, openKey: Data) {
+    self.sealKey = SymmetricKey(data: sealKey)
+    self.openKey = SymmetricKey(data: openKey)
+  }
+
+  /// Creates an encryptor with packet keys derived from the traffic keys of a session.
+  ///
+  /// Both devices derive the same keys, so the phone's seal key matches the car's open key.
+  ///
+  /// - Returns: `nil` if the keys cannot be derived.
+  convenience init?(session: UKey2SavedSession) {
+    guard
+      var sealKey = CryptoOps.hkdf(
+        inputKeyMaterial: session.encodeKey, salt: Self.keySalt, info: Data()),
+      var openKey = CryptoOps.hkdf(
+        inputKeyMaterial: session.decodeKey, salt: Self.keySalt, info: Data())
+    else {
+      return nil
+    }
+    // `SymmetricKey` keeps its own copy, so the derived bytes are not needed afterwards.
+    defer {
+      sealKey.zeroize()
+      openKey.zeroize()
+    }
+    self.init(sealKey: sealKey, openKey: openKey)
+  }
+
+  func seal(_ body: Data, authenticating header: Data) throws -> Data {
+    lock.lock()
+    defer { lock.unlock() }
+
+    let nonce = try Self.nonce(for: sealCounter)
+    let sealedBox = try AES.GCM.seal(body, using: sealKey, nonce: nonce, authenticating: header)
+    sealCounter += 1
+    return sealedBox.ciphertext + sealedBox.tag
+  }
+
+  func open(_ sealedBody: Data, authenticating header: Data) throws -> Data {
+    guard sealedBody.count >= Self.tagSize else {
+      throw AESGCMPacketEncryptorError.invalidDataSize(sealedBody.count)
+    }
+
+    lock.lock()
+    defer { lock.unlock() }
+
+    let tagStart = sealedBody.endIndex - Self.tagSize
+    let sealedBox = try AES.GCM.SealedBox(
+      nonce: Self.nonce(for: openCounter),
+      ciphertext: sealedBody[sealedBody.startIndex..<tagStart],
+      tag: sealedBody[tagStart...]
+    )
+    let body = try AES.GCM.open(sealedBox, using: openKey, authenticating: header)
+    openCounter += 1
+    return body
+  }
+
+  private static func nonce(for counter: UInt64) throws -> AES.GCM.Nonce {
+    guard counter < UInt64.max else { throw AESGCMPacketEncryptorError.counterExhausted }
+
+    var nonce = Data(repeating: 0, count: 4)
+    withUnsafeBytes(of: counter.bigEndian) { nonce.append(contentsOf: $0) }
+    return try AES.GCM.Nonce(data: nonce)
+  }
+}
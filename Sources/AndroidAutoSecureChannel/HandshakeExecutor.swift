@@ -0,0 +1,65 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+import Foundation
+
+/// Runs the computationally expensive steps of a key exchange handshake.
+///
+/// Completions must be delivered in the same order in which work was submitted.
+protocol HandshakeExecutor {
+  /// Runs `work` and passes its result to `completion`.
+  ///
+  /// - Parameters:
+  ///   - work: The handshake computation to run.
+  ///   - completion: Receives the result of `work`.
+  func execute<Result>(_ work: @escaping () -> Result, completion: @escaping (Result) -> Void)
+}
+
+/// Runs handshake work on a serial crypto queue and delivers results on a callback queue.
+///
+/// Both queues are serial, so completions arrive in the order in which work was submitted.
+struct DispatchHandshakeExecutor: HandshakeExecutor {
+  /// The queue shared by all channels for elliptic curve computations.
+  static let sharedCryptoQueue = DispatchQueue(
+    label: "com.google.ios.aae.UKey2Channel.crypto", qos: .userInitiated)
+
+  /// The queue on which work is run.
+  let cryptoQueue: DispatchQueue
+
+  /// The queue on which completions are delivered. This should be the queue that delivers the
+  /// message stream's delegate callbacks.
+  let callbackQueue: DispatchQueue
+
+  init(
+    cryptoQueue: DispatchQueue = DispatchHandshakeExecutor.sharedCryptoQueue,
+    callbackQueue: DispatchQueue = .main
+  ) {
+    self.cryptoQueue = cryptoQueue
+    self.callbackQueue = callbackQueue
+  }
+
+  func execute<Result>(_ work: @escaping () -> Result, completion: @escaping (Result) -> Void) {
+    cryptoQueue.async {
+      let result = work()
+      self.callbackQueue.async { completion(result) }
+    }
+  }
+}
+
+/// Runs handshake work synchronously on the calling thread.
+struct InlineHandshakeExecutor: HandshakeExecutor {
+  func execute<Result>(_ work: @escaping () -> Result, completion: @escaping (Result) -> Void) {
+    completion(work())
+  }
+}
@@ -0,0 +1,51 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+import Foundation
+
+/// Key material that is overwritten with zeros as soon as it is no longer referenced.
+///
+/// Secrets such as traffic keys and session keys otherwise linger in freed memory until it is
+/// reused. Holding them in a reference type means the channel never makes value copies of the
+/// bytes while storing them, so the single buffer can be cleared when the last owner goes away.
+final class SecretData {
+  /// The secret bytes. Copies handed out share this buffer and must not outlive the owner.
+  private(set) var data: Data
+
+  /// Takes ownership of the given secret.
+  init(_ data: Data) {
+    self.data = data
+  }
+
+  deinit {
+    data.zeroize()
+  }
+}
+
+extension Data {
+  /// Overwrites every byte with zero in place.
+  ///
+  /// Data is copy-on-write, so only a buffer that this value owns exclusively is cleared. Call this
+  /// on the last copy of a secret.
+  mutating func zeroize() {
+    let count = self.count
+    guard count > 0 else { return }
+
+    withUnsafeMutableBytes { buffer in
+      guard let baseAddress = buffer.baseAddress else { return }
+      // `memset_s` is never elided, unlike a plain store to memory that is about to be freed.
+      _ = memset_s(baseAddress, count, 0, count)
+    }
+  }
+}
@@ -143,4 +143,24 @@ public protocol SecureBLEChannel: AnyObject {
   /// - Returns: A serialized version of this secure session.
   /// - Throws: An error if this session cannot be saved.
   func saveSession() throws -> Data
+
+  /// The optional capabilities that this channel is able to use.
+  var supportedCapabilities: SecureChannelCapabilities { get }
+
+  /// Enables the optional capabilities that both this channel and the remote device support.
+  ///
+  /// The remote device lists its capabilities in the version exchange. This method should be
+  /// called as soon as the channel has been established, before any message is encrypted or
+  /// decrypted, because both devices apply the capabilities from the first encrypted message of the
+  /// session. Capabilities that the remote device does not list are never used.
+  ///
+  /// - Parameter remoteCapabilities: The capabilities that the remote device supports.
+  func negotiateCapabilities(_ remoteCapabilities: SecureChannelCapabilities)
+}
+
+/// Default implementations for channels without optional capabilities.
+extension SecureBLEChannel {
+  public var supportedCapabilities: SecureChannelCapabilities { [] }
+
+  public func negotiateCapabilities(_ remoteCapabilities: SecureChannelCapabilities) {}
 }
@@ -12,8 +12,63 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+import Foundation
+
 /// Creator of different types of secure channels.
 public protocol SecureBLEChannelFactory {
+  /// The optional capabilities that the channels made by this factory are able to use.
+  var supportedCapabilities: SecureChannelCapabilities { get }
+
   /// Creates a new instance of a secure BLE channel.
   func makeChannel() -> SecureBLEChannel
+
+  /// Prepares a channel for the given car ahead of its secure channel being established.
+  ///
+  /// - Parameters:
+  ///   - carId: The identifier of the associated car.
+  ///   - loadSavedSession: Loads the session that will be resumed with the car, if known. It may be
+  ///     called on a background queue, so that a keychain read does not block the caller.
+  func prewarmChannel(
+    for carId: String,
+    loadingSavedSession loadSavedSession: @escaping () -> Data?
+  )
+
+  /// Returns the channel prepared for the given car or a new channel if none is ready.
+  ///
+  /// - Parameter carId: The identifier of the car the channel will be established with.
+  func makeChannel(for carId: String) -> SecureBLEChannel
+
+  /// Discards the channel prepared for the given car, such as when the car is dissociated.
+  ///
+  /// - Parameter carId: The identifier of the car.
+  func evictPrewarmedChannel(for carId: String)
+
+  /// Discards the channels prepared for all cars.
+  func evictAllPrewarmedChannels()
+}
+
+extension SecureBLEChannelFactory {
+  public var supportedCapabilities: SecureChannelCapabilities { [] }
+
+  public func prewarmChannel(
+    for carId: String,
+    loadingSavedSession loadSavedSession: @escaping () -> Data?
+  ) {}
+
+  public func makeChannel(for carId: String) -> SecureBLEChannel {
+    return makeChannel()
+  }
+
+  public func evictPrewarmedChannel(for carId: String) {}
+
+  public func evictAllPrewarmedChannels() {}
+
+  /// Prepares a channel for the given car with a saved session that is already loaded.
+  ///
+  /// - Parameters:
+  ///   - carId: The identifier of the associated car.
+  ///   - savedSession: The session that will be resumed with the car, if known.
+  public func prewarmChannel(for carId: String, savedSession: Data?) {
+    prewarmChannel(for: carId, loadingSavedSession: { savedSession })
+  }
 }
@@ -0,0 +1,62 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+import Foundation
+
+/// Optional features that a secure channel and the remote device can agree to use.
+public struct SecureChannelCapabilities: OptionSet {
+  public let rawValue: UInt32
+
+  public init(rawValue: UInt32) {
+    self.rawValue = rawValue
+  }
+
+  /// Traffic keys can be rotated within an established session.
+  public static let sessionRekey = SecureChannelCapabilities(rawValue: 1 << 0)
+
+  /// Each packet of an encrypted message is sealed on its own, so it can be decrypted on arrival.
+  public static let packetEncryption = SecureChannelCapabilities(rawValue: 1 << 1)
+}
+
+/// Limits on how much a single set of traffic keys can be used before it is rotated.
+///
+/// A rotation is triggered as soon as any one of the limits is reached.
+public struct SessionRekeyPolicy: Equatable {
+  /// The number of messages that can be encrypted under a single key.
+  public var maxMessages: Int
+
+  /// The number of plaintext bytes that can be encrypted under a single key.
+  public var maxBytes: Int
+
+  /// The number of seconds that a single key can remain in use.
+  public var maxKeyAge: TimeInterval
+
+  /// Limits that keep long-lived sessions fresh without rekeying noticeably often.
+  public static let `default` = SessionRekeyPolicy(
+    maxMessages: 10_000,
+    maxBytes: 16 * 1024 * 1024,
+    maxKeyAge: 60 * 60
+  )
+
+  public init(maxMessages: Int, maxBytes: Int, maxKeyAge: TimeInterval) {
+    self.maxMessages = maxMessages
+    self.maxBytes = maxBytes
+    self.maxKeyAge = maxKeyAge
+  }
+
+  /// Returns `true` if a key with the given usage should be rotated.
+  func isExceeded(messages: Int, bytes: Int, keyAge: TimeInterval) -> Bool {
+    return messages >= maxMessages || bytes >= maxBytes || keyAge >= maxKeyAge
+  }
+}
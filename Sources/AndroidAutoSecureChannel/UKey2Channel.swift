@@ -22,6 +22,21 @@ import Foundation
 /// A channel that utilizes UKey2 (go/ukey2) to establish secure communication.
 ///
 /// UKey2 is a Diffie-Hellman based authenticated key exchange protocol.
+///
+/// If the remote device supports `SecureChannelCapabilities.sessionRekey`, the traffic keys of an
+/// established session are rotated according to a `SessionRekeyPolicy`. Every encrypted message
+/// is then prefixed with the low byte of the generation of the key that encrypted it, so the
+/// receiver switches keys exactly when the sender does. The next key in each direction is derived
+/// ahead of time on a background queue, so a rotation is only a swap of the session and never
+/// delays a message.
+///
+/// If the remote device supports `SecureChannelCapabilities.packetEncryption` and the established
+/// stream is a `PacketEncryptingMessageStream`, encrypted messages are instead sealed packet by
+/// packet with an `AESGCMPacketEncryptor` whose keys are derived from the session. The packet keys
+/// are never rotated, so traffic keys are not rekeyed when both devices support packet encryption.
+///
+/// Handshake messages from the remote device are parsed and answered on a `HandshakeExecutor`, so
+/// the elliptic curve work of the key exchange never runs on the message stream's delegate queue.
 class UKey2Channel: SecureBLEChannel {
   /// Token used for verification when establishing a UKey2 channel.
   struct VerificationToken: SecurityVerificationToken {
@@ -52,6 +67,19 @@ class UKey2Channel: SecureBLEChannel {
 
   private static let log = Logger(for: UKey2Channel.self)
 
+  private static let signpostMetrics = SignpostMetrics(category: "UKey2Channel")
+
+  private enum Signposts {
+    /// Time spent computing a handshake step on the handshake executor.
+    static let handshakeComputeDuration = SignpostDuration("Handshake Compute Duration")
+
+    /// Time spent on the delegate queue applying the result of a handshake step.
+    static let handshakeApplyDuration = SignpostDuration("Handshake Apply Duration")
+
+    /// Time from the start to the end of a handshake.
+    static let handshakeDuration = SignpostDuration("Handshake Duration")
+  }
+
   /// An info that is prefixed to an HMAC from this phone to a car.
   private static let clientInfoPrefix = Data("CLIENT".utf8)
 
@@ -66,28 +94,180 @@ class UKey2Channel: SecureBLEChannel {
 
   private static let recipientUUID = UUID(uuidString: "C0667B9C-FB4F-4B88-A5E2-BEB02C939956")!
 
+  /// The result of processing a handshake message from the remote device.
+  private struct HandshakeStep {
+    enum Outcome {
+      /// The handshake is waiting on the next message from the remote device.
+      case awaitingRemote
+
+      /// The handshake requires the given verification data to be confirmed.
+      case verificationNeeded(Data)
+
+      /// The handshake has failed.
+      case failed(SecureBLEChannelError)
+
+      /// The handshake reached a state that should not occur while it is in progress.
+      case unexpectedState(AAEState)
+    }
+
+    /// Messages to send to the remote device, in order.
+    var outgoingMessages: [Data]
+
+    var outcome: Outcome
+
+    /// Seconds spent computing this step.
+    var computeDuration: TimeInterval
+  }
+
+  /// Bookkeeping for the rotation of traffic keys in an established session.
+  private struct RekeyState {
+    /// The generation of the key currently used to encode messages.
+    var encodeGeneration: UInt32 = 0
+
+    /// The generation of the key currently used to decode messages.
+    var decodeGeneration: UInt32 = 0
+
+    /// The pre-derived encode key of generation `encodeGeneration + 1`.
+    var nextEncodeKey: SecretData?
+
+    /// The pre-derived decode key of generation `decodeGeneration + 1`.
+    var nextDecodeKey: SecretData?
+
+    /// The number of messages encoded with the current encode key.
+    var messagesSinceRekey = 0
+
+    /// The number of plaintext bytes encoded with the current encode key.
+    var bytesSinceRekey = 0
+
+    /// When the current encode key was put into use.
+    var encodeKeyStartDate = Date()
+  }
+
+  /// An initiator session whose ephemeral keys and init message were generated ahead of
+  /// `establish(using:)`.
+  private struct PrewarmedHandshake {
+    let ukey2: UKey2Wrapper
+    let initMessage: Data
+  }
+
+  /// A saved session that was parsed ahead of `establish(using:withSavedSession:)`.
+  private struct PrewarmedSavedSession {
+    /// The serialized session that was parsed, used to check that it is still the current one.
+    let serializedSession: Data
+    let uniqueSessionKey: SecretData
+  }
+
   /// The configuration parameters when sending a message over the `BLEMessageStream`.
   private static let streamParams = MessageStreamParams(
     recipient: recipientUUID, operationType: .encryptionHandshake)
 
-  private var ukey2 = UKey2Wrapper(role: .initiator)
+  /// The current session. Replaced with a new one on every establishment, so it is only created
+  /// here if it is accessed beforehand.
+  private lazy var ukey2 = UKey2Wrapper(role: .initiator)
+
+  private var prewarmedHandshake: PrewarmedHandshake?
+  private var prewarmedSavedSession: PrewarmedSavedSession?
+
+  /// Guards `ukey2` and `rekeyState` once the session is established, allowing the session to be
+  /// swapped for a rekeyed one while messages are being encrypted and decrypted.
+  private let sessionLock = NSLock()
+
+  /// Queue on which the next generation of traffic keys is derived.
+  private let rekeyQueue = DispatchQueue(
+    label: "com.google.ios.aae.UKey2Channel.rekey", qos: .utility)
+
+  /// The policy to apply if the remote device supports rekeying.
+  private let configuredRekeyPolicy: SessionRekeyPolicy
+
+  /// The policy that triggers rotation of the encode key or `nil` if rekeying is not in use.
+  private(set) var rekeyPolicy: SessionRekeyPolicy?
+
+  private var rekeyState = RekeyState()
+
+  /// Whether a message has been encrypted or decrypted in the current session. Capabilities change
+  /// the format of encrypted messages, so they can only be negotiated before the first one.
+  private var hasEncryptedTraffic = false
+
+  /// Runs the handshake computations.
+  private let handshakeExecutor: HandshakeExecutor
+
+  /// Handshake messages from the remote device that are waiting to be processed, in order.
+  private var pendingHandshakeMessages: [Data] = []
+
+  /// Whether a handshake message is currently being processed by `handshakeExecutor`.
+  private var isHandshakeStepInFlight = false
+
+  /// Incremented on every establishment so that results for an abandoned handshake are dropped.
+  private var handshakeID = 0
 
   /// A key of a previously saved session. If this value is present, then this indicates that a
   /// reestablishment of a session is occurring.
-  private var savedSessionKey: Data?
+  private var savedSessionKey: SecretData?
 
   /// A session key that combines a previously saved session key with an new one. This value is
   /// used to create HMACs to the phone.
-  private var combinedSessionKey: Data?
+  private var combinedSessionKey: SecretData?
 
   var messageStream: MessageStream?
 
+  /// The stream handed to the delegate once the session was established.
+  private weak var establishedStream: MessageStream?
+
   /// The state of the secure channel.
   private(set) var state: SecureBLEChannelState = .uninitialized
 
+  /// Whether the next establishment can skip generating its ephemeral keys.
+  var isPrewarmed: Bool { prewarmedHandshake != nil }
+
+  /// Whether a saved session was parsed by `prewarm(savedSession:)`.
+  var hasPrewarmedSavedSession: Bool { prewarmedSavedSession != nil }
+
   /// A delegate that will be notified of events within the secure channel.
   weak var delegate: SecureBLEChannelDelegate?
 
+  /// The optional capabilities that every `UKey2Channel` is able to use.
+  static let capabilities: SecureChannelCapabilities = [.sessionRekey, .packetEncryption]
+
+  var supportedCapabilities: SecureChannelCapabilities { Self.capabilities }
+
+  /// Creates a channel.
+  ///
+  /// - Parameters:
+  ///   - rekeyPolicy: When to rotate traffic keys if the remote device supports it.
+  ///   - handshakeExecutor: Runs the handshake computations. Its completions should be delivered
+  ///     on the queue that delivers the message stream's delegate callbacks.
+  init(
+    rekeyPolicy: SessionRekeyPolicy = .default,
+    handshakeExecutor: HandshakeExecutor = DispatchHandshakeExecutor()
+  ) {
+    configuredRekeyPolicy = rekeyPolicy
+    self.handshakeExecutor = handshakeExecutor
+  }
+
+  /// Performs the work of the next establishment that does not depend on the remote device.
+  ///
+  /// The ephemeral keys and init message of a new initiator session are generated, and the given
+  /// saved session is parsed, so that the handshake can start as soon as the message stream is
+  /// ready. This method is not thread-safe and should be called before the channel is handed to
+  /// the code that establishes it.
+  ///
+  /// - Parameter savedSession: The session that the next establishment is expected to resume.
+  func prewarm(savedSession: Data? = nil) {
+    let ukey2 = UKey2Wrapper(role: .initiator)
+    if let initMessage = ukey2.nextHandshakeMessage(), ukey2.handshakeState == .inProgress {
+      prewarmedHandshake = PrewarmedHandshake(ukey2: ukey2, initMessage: initMessage)
+    } else {
+      Self.log.error("Unable to prewarm handshake: \(ukey2.lastHandshakeError)")
+      prewarmedHandshake = nil
+    }
+
+    prewarmedSavedSession = savedSession.flatMap { savedSession in
+      UKey2Wrapper(savedSession: savedSession)?.uniqueSessionKey.map {
+        PrewarmedSavedSession(serializedSession: savedSession, uniqueSessionKey: SecretData($0))
+      }
+    }
+  }
+
   /// Establishes a secure channel using UKey2 with the given peripheral.
   ///
   /// This method will clear any delegates that are set on the given peripheral. The peripheral's
@@ -99,10 +279,23 @@ class UKey2Channel: SecureBLEChannel {
   /// - Parameter messageStream: The stream used to send messages.
   /// - Throws: An generic error or one of type `UKey2ChannelError`.
   func establish(using messageStream: MessageStream) throws {
-    // Always use a new UKey2 session for establishment.
-    ukey2 = UKey2Wrapper(role: .initiator)
-
-    guard let message = ukey2.nextHandshakeMessage(), ukey2.handshakeState == .inProgress else {
+    // Always use a new UKey2 session for establishment, preferring one generated by `prewarm`.
+    let prewarmed = prewarmedHandshake
+    prewarmedHandshake = nil
+    ukey2 = prewarmed?.ukey2 ?? UKey2Wrapper(role: .initiator)
+    rekeyPolicy = nil
+    rekeyState = RekeyState()
+    hasEncryptedTraffic = false
+    establishedStream = nil
+    // Packets of the new session must not be sealed with keys from a previous one.
+    (messageStream as? PacketEncryptingMessageStream)?.packetEncryptor = nil
+    pendingHandshakeMessages = []
+    isHandshakeStepInFlight = false
+    handshakeID += 1
+
+    guard let message = prewarmed?.initMessage ?? ukey2.nextHandshakeMessage(),
+      ukey2.handshakeState == .inProgress
+    else {
       resetInternalState()
       state = .failed
 
@@ -115,6 +308,7 @@ class UKey2Channel: SecureBLEChannel {
     messageStream.delegate = self
 
     Self.log("Writing init handshake message.")
+    Self.signpostMetrics.postIfAvailable(Signposts.handshakeDuration.begin)
 
     state = .inProgress
 
@@ -137,9 +331,19 @@ class UKey2Channel: SecureBLEChannel {
     using messageStream: MessageStream,
     withSavedSession savedSession: Data
   ) throws {
-    guard let restoredSession = UKey2Wrapper(savedSession: savedSession),
-      let uniqueSessionKey = restoredSession.uniqueSessionKey
-    else {
+    let prewarmed = prewarmedSavedSession
+    prewarmedSavedSession = nil
+
+    let restoredSessionKey: SecretData?
+    if let prewarmed = prewarmed, prewarmed.serializedSession == savedSession {
+      restoredSessionKey = prewarmed.uniqueSessionKey
+    } else {
+      restoredSessionKey = UKey2Wrapper(savedSession: savedSession)?.uniqueSessionKey.map {
+        SecretData($0)
+      }
+    }
+
+    guard let uniqueSessionKey = restoredSessionKey else {
       resetInternalState()
       throw SecureBLEChannelError.invalidSavedSession
     }
@@ -180,6 +384,10 @@ class UKey2Channel: SecureBLEChannel {
   ///
   /// This method should only be called after the `state` of this session is `.established`.
   ///
+  /// The current traffic keys are saved. Sessions are saved when they are established, before
+  /// any rotation, so a resumed session derives from the same keys that the remote device saved
+  /// and rekeying does not carry over into it.
+  ///
   /// - Returns: A serialized version of this UKey2 session.
   /// - Throws: An error if the session cannot be saved.
   func saveSession() throws -> Data {
@@ -188,7 +396,11 @@ class UKey2Channel: SecureBLEChannel {
       throw SecureBLEChannelError.saveSessionFailed(errorMessage)
     }
 
-    guard let savedSession = ukey2.saveSession() else {
+    sessionLock.lock()
+    let savedSession = ukey2.saveSession()
+    sessionLock.unlock()
+
+    guard let savedSession = savedSession else {
       let errorMessage = "Could not save the current session"
       throw SecureBLEChannelError.saveSessionFailed(errorMessage)
     }
@@ -196,9 +408,234 @@ class UKey2Channel: SecureBLEChannel {
     return savedSession
   }
 
+  /// Enables packet encryption, or otherwise rekeying, if the remote device supports it.
+  ///
+  /// Both devices learn each other's capabilities in the version exchange and apply them from the
+  /// first encrypted message of the session, so negotiation is refused once a message has been
+  /// encrypted or decrypted. Negotiation starts the derivation of the first rotated keys in the
+  /// background, so they are ready by the time the policy calls for them.
+  func negotiateCapabilities(_ remoteCapabilities: SecureChannelCapabilities) {
+    guard state == .established else {
+      Self.log.error("Cannot negotiate capabilities before the session is established.")
+      return
+    }
+
+    sessionLock.lock()
+    let hasEncryptedTraffic = self.hasEncryptedTraffic
+    sessionLock.unlock()
+
+    guard !hasEncryptedTraffic else {
+      Self.log.error("Cannot negotiate capabilities after encrypted messages have been exchanged.")
+      return
+    }
+
+    let capabilities = supportedCapabilities.intersection(remoteCapabilities)
+    if capabilities.contains(.packetEncryption) {
+      // Packet encryption seals messages with keys that a rotation would not reach, so both
+      // devices leave the traffic keys of the session as they are.
+      enablePacketEncryption()
+      return
+    }
+
+    Self.log("Remote device does not support packet encryption.")
+
+    if capabilities.contains(.sessionRekey) {
+      enableRekeying()
+    } else {
+      Self.log("Remote device does not support session rekeying.")
+    }
+  }
+
+  /// Seals the packets of encrypted messages on the established stream if it supports it.
+  ///
+  /// The packet keys are derived from the traffic keys at the time of negotiation. Rekeying is
+  /// not enabled alongside, since it would not rotate them.
+  private func enablePacketEncryption() {
+    guard let stream = establishedStream as? PacketEncryptingMessageStream else {
+      Self.log("Message stream does not support packet encryption.")
+      return
+    }
+
+    guard stream.packetEncryptor == nil else { return }
+
+    // The remote device applies packet encryption from the first encrypted message, so switching
+    // afterwards would leave the two sides reading different formats.
+    guard !stream.hasExchangedEncryptedMessages else {
+      Self.log.error("Encrypted messages already exchanged. Packet encryption disabled.")
+      return
+    }
+
+    sessionLock.lock()
+    let packetEncryptor = withCurrentSession { AESGCMPacketEncryptor(session: $0) }
+    sessionLock.unlock()
+
+    guard let packetEncryptor = packetEncryptor else {
+      Self.log.error("Cannot derive packet keys. Packet encryption disabled.")
+      return
+    }
+
+    Self.log("Packet encryption enabled.")
+    stream.packetEncryptor = packetEncryptor
+  }
+
+  /// Starts rotating traffic keys according to the configured policy.
+  private func enableRekeying() {
+    sessionLock.lock()
+    defer { sessionLock.unlock() }
+
+    guard rekeyPolicy == nil else { return }
+    guard var serializedSession = ukey2.saveSession() else {
+      Self.log.error("Cannot save session. Session rekeying disabled.")
+      return
+    }
+    defer { serializedSession.zeroize() }
+
+    // The parsed keys are only referenced by the derivations that take ownership of them below.
+    guard let session = UKey2SavedSession(serialized: serializedSession) else {
+      Self.log.error("Cannot read session keys. Session rekeying disabled.")
+      return
+    }
+
+    Self.log("Session rekeying enabled.")
+
+    rekeyPolicy = configuredRekeyPolicy
+    rekeyState = RekeyState()
+    deriveNextKey(for: .encode, from: SecretData(session.encodeKey), generation: 1)
+    deriveNextKey(for: .decode, from: SecretData(session.decodeKey), generation: 1)
+  }
+
+  /// Blocks until all scheduled key derivations have completed.
+  ///
+  /// This method is exposed for testing purposes.
+  func waitForPendingKeyDerivations() {
+    rekeyQueue.sync {}
+  }
+
+  /// Derives the given generation of a traffic key on `rekeyQueue`.
+  ///
+  /// The result is dropped if the key has already moved past the generation that was requested.
+  /// `key` is zeroed once the derivation no longer needs it.
+  private func deriveNextKey(
+    for direction: UKey2SavedSession.Direction,
+    from key: SecretData,
+    generation: UInt32
+  ) {
+    rekeyQueue.async { [weak self] in
+      let nextKey = UKey2SavedSession.nextKey(after: key.data, generation: generation).map {
+        SecretData($0)
+      }
+      guard let self = self else { return }
+
+      self.sessionLock.lock()
+      defer { self.sessionLock.unlock() }
+
+      switch direction {
+      case .encode where self.rekeyState.encodeGeneration + 1 == generation:
+        self.rekeyState.nextEncodeKey = nextKey
+      case .decode where self.rekeyState.decodeGeneration + 1 == generation:
+        self.rekeyState.nextDecodeKey = nextKey
+      default:
+        Self.log.debug("Discarding stale rekey derivation for generation \(generation).")
+      }
+    }
+  }
+
+  /// Returns a copy of the current session with the traffic key for `direction` replaced.
+  ///
+  /// Must be called with `sessionLock` held.
+  private func makeSession(
+    replacingKeyFor direction: UKey2SavedSession.Direction,
+    with key: SecretData
+  ) -> UKey2Wrapper? {
+    return withCurrentSession { session in
+      var serializedSession = session.replacingKey(for: direction, with: key.data).serialized
+      defer { serializedSession.zeroize() }
+      return UKey2Wrapper(savedSession: serializedSession)
+    }
+  }
+
+  /// Calls `body` with the keys of the current session, then zeroes every copy of them that was
+  /// made for it. `body` must not keep the keys.
+  ///
+  /// Must be called with `sessionLock` held.
+  private func withCurrentSession<T>(_ body: (UKey2SavedSession) -> T?) -> T? {
+    guard var serializedSession = ukey2.saveSession() else { return nil }
+    defer { serializedSession.zeroize() }
+
+    guard var session = UKey2SavedSession(serialized: serializedSession) else { return nil }
+    defer { session.zeroize() }
+
+    return body(session)
+  }
+
+  /// Switches to the next encode key if the rekey policy has been exceeded.
+  ///
+  /// If the next key has not finished deriving, the current key remains in use so that the
+  /// message is not delayed. Must be called with `sessionLock` held.
+  private func rotateEncodeKeyIfNeeded() {
+    guard let rekeyPolicy = rekeyPolicy,
+      rekeyPolicy.isExceeded(
+        messages: rekeyState.messagesSinceRekey,
+        bytes: rekeyState.bytesSinceRekey,
+        keyAge: Date().timeIntervalSince(rekeyState.encodeKeyStartDate))
+    else {
+      return
+    }
+
+    guard let nextKey = rekeyState.nextEncodeKey else {
+      Self.log.debug("Rekey due, but next encode key is not ready. Using current key.")
+      return
+    }
+
+    guard let rekeyedSession = makeSession(replacingKeyFor: .encode, with: nextKey) else {
+      Self.log.error("Unable to create rekeyed session. Using current key.")
+      return
+    }
+
+    ukey2 = rekeyedSession
+    rekeyState.encodeGeneration += 1
+    rekeyState.nextEncodeKey = nil
+    rekeyState.messagesSinceRekey = 0
+    rekeyState.bytesSinceRekey = 0
+    rekeyState.encodeKeyStartDate = Date()
+
+    Self.log("Rotated encode key to generation \(rekeyState.encodeGeneration).")
+
+    deriveNextKey(for: .encode, from: nextKey, generation: rekeyState.encodeGeneration + 1)
+  }
+
+  /// Decodes a message whose marker shows it was encoded with the remote device's next key.
+  ///
+  /// The next key is derived on the spot if the background derivation has not finished. On
+  /// success, the next decode key becomes the current one. Must be called with `sessionLock` held.
+  private func decodeWithNextKey(_ message: Data) -> Data? {
+    let generation = rekeyState.decodeGeneration + 1
+    guard
+      let nextKey = rekeyState.nextDecodeKey
+        ?? withCurrentSession({
+          UKey2SavedSession.nextKey(after: $0.decodeKey, generation: generation)
+        }).map({ SecretData($0) }),
+      let rekeyedSession = makeSession(replacingKeyFor: .decode, with: nextKey),
+      let decryptedMessage = rekeyedSession.decode(message)
+    else {
+      return nil
+    }
+
+    ukey2 = rekeyedSession
+    rekeyState.decodeGeneration += 1
+    rekeyState.nextDecodeKey = nil
+
+    Self.log(
+      "Remote device rotated its key. Decode key at generation \(rekeyState.decodeGeneration).")
+
+    deriveNextKey(for: .decode, from: nextKey, generation: rekeyState.decodeGeneration + 1)
+    return decryptedMessage
+  }
+
   private func resetInternalState() {
     messageStream = nil
     savedSessionKey = nil
+    combinedSessionKey = nil
 
     state = .uninitialized
   }
@@ -210,8 +647,10 @@ class UKey2Channel: SecureBLEChannel {
     }
 
     state = .established
+    Self.signpostMetrics.postIfAvailable(Signposts.handshakeDuration.end)
 
     messageStream.messageEncryptor = self
+    establishedStream = messageStream
     delegate?.secureBLEChannel(self, establishedUsing: messageStream)
 
     self.messageStream = nil
@@ -224,62 +663,141 @@ class UKey2Channel: SecureBLEChannel {
     delegate?.secureBLEChannel(self, encounteredError: error)
   }
 
-  /// Performs actions based on the given state of `ukey2`.
-  private func process(_ state: AAEState) {
-    switch state {
-    case .inProgress:
-      sendNextHandshakeMessage()
+  /// Processes the next pending handshake message if no other message is being processed.
+  ///
+  /// Messages are processed strictly one at a time so that each one observes the state left by the
+  /// previous one.
+  private func processNextHandshakeMessage() {
+    guard !isHandshakeStepInFlight, !pendingHandshakeMessages.isEmpty else { return }
 
-    case .verificationNeeded:
-      // Note: UKey2 requires `verificationData` actually be called to advance its internal state.
-      guard
-        let verificationBytes = ukey2.verificationData(
-          withByteLength: UKey2Channel.pairingCodeLength
-        )
-      else {
-        notifyDelegateOfError(
-          SecureBLEChannelError.pairingCodeGenerationFailed(ukey2.lastHandshakeError))
+    let message = pendingHandshakeMessages.removeFirst()
+
+    if state == .resumingSession {
+      verifyServerHMAC(serverMessage: message)
+      processNextHandshakeMessage()
+      return
+    }
+
+    isHandshakeStepInFlight = true
+
+    let ukey2 = self.ukey2
+    let handshakeID = self.handshakeID
+    handshakeExecutor.execute({
+      Self.computeHandshakeStep(ukey2: ukey2, message: message)
+    }) { [weak self] step in
+      guard let self = self, self.handshakeID == handshakeID else {
+        Self.log("Dropping result of a handshake step for an abandoned handshake.")
         return
       }
 
-      processVerificationBytes(verificationBytes)
+      self.isHandshakeStepInFlight = false
+      self.applyHandshakeStep(step)
+      self.processNextHandshakeMessage()
+    }
+  }
 
-    case .error:
-      notifyDelegateOfError(SecureBLEChannelError.handshakeFailed(ukey2.lastHandshakeError))
+  /// Parses the given handshake message and advances `ukey2` as far as it can go without another
+  /// message from the remote device.
+  ///
+  /// This method runs on the handshake executor, so it must not access any state of the channel.
+  private static func computeHandshakeStep(ukey2: UKey2Wrapper, message: Data) -> HandshakeStep {
+    signpostMetrics.postIfAvailable(Signposts.handshakeComputeDuration.begin)
+    let startTime = Date()
+    var outgoingMessages: [Data] = []
+
+    /// Returns the outcome for the given state, sending at most one message while in progress.
+    func resolve(_ state: AAEState, canSend: Bool) -> HandshakeStep.Outcome {
+      switch state {
+      case .inProgress:
+        guard canSend else { return .awaitingRemote }
+        guard let nextMessage = ukey2.nextHandshakeMessage() else {
+          return .failed(.handshakeMessageGenerationFailed(ukey2.lastHandshakeError))
+        }
+        outgoingMessages.append(nextMessage)
+
+        // The handshake state is updated after a call to nextHandshakeMessage(). So, need to
+        // check if we've progressed to a different state.
+        return resolve(ukey2.handshakeState, canSend: false)
+
+      case .verificationNeeded:
+        // Note: UKey2 requires `verificationData` actually be called to advance its internal
+        // state.
+        guard
+          let verificationBytes = ukey2.verificationData(
+            withByteLength: UKey2Channel.pairingCodeLength
+          )
+        else {
+          return .failed(.pairingCodeGenerationFailed(ukey2.lastHandshakeError))
+        }
+        return .verificationNeeded(verificationBytes)
+
+      case .error:
+        return .failed(.handshakeFailed(ukey2.lastHandshakeError))
+
+      default:
+        return .unexpectedState(state)
+      }
+    }
 
-    default:
-      Self.log.error("Invalid handshake state: \(state.rawValue)")
+    let outcome: HandshakeStep.Outcome
+    if ukey2.parseHandshakeMessage(message).isSuccessful {
+      outcome = resolve(ukey2.handshakeState, canSend: true)
+    } else {
+      outcome = .failed(.parseMessageFailed(ukey2.lastHandshakeError))
     }
+    signpostMetrics.postIfAvailable(Signposts.handshakeComputeDuration.end)
+
+    return HandshakeStep(
+      outgoingMessages: outgoingMessages,
+      outcome: outcome,
+      computeDuration: Date().timeIntervalSince(startTime)
+    )
   }
 
-  private func sendNextHandshakeMessage() {
-    // This shouldn't happen because this method is only called after a peripheral and
-    // characteristic has been set.
-    guard let messageStream = messageStream else {
-      Self.log.error("No stream when attempting to process state.")
-      notifyDelegateOfError(SecureBLEChannelError.methodCalledOutOfOrder)
-      return
+  /// Sends the messages produced by a handshake step and acts on its outcome.
+  private func applyHandshakeStep(_ step: HandshakeStep) {
+    Self.signpostMetrics.postIfAvailable(Signposts.handshakeApplyDuration.begin)
+    let startTime = Date()
+    defer {
+      Self.signpostMetrics.postIfAvailable(Signposts.handshakeApplyDuration.end)
+      Self.log.debug(
+        """
+        Handshake step computed off the delegate queue in \(step.computeDuration * 1000) ms; \
+        applied in \(Date().timeIntervalSince(startTime) * 1000) ms.
+        """
+      )
     }
 
-    guard let message = ukey2.nextHandshakeMessage() else {
-      notifyDelegateOfError(
-        SecureBLEChannelError.handshakeMessageGenerationFailed(ukey2.lastHandshakeError))
-      return
-    }
+    for message in step.outgoingMessages {
+      // This shouldn't happen because handshake messages are only processed after a stream has
+      // been set.
+      guard let messageStream = messageStream else {
+        Self.log.error("No stream when attempting to process state.")
+        notifyDelegateOfError(SecureBLEChannelError.methodCalledOutOfOrder)
+        return
+      }
 
-    Self.log("Sending next handshake message.")
+      Self.log("Sending next handshake message.")
 
-    do {
-      try messageStream.writeMessage(message, params: UKey2Channel.streamParams)
-    } catch {
-      Self.log.error("Cannot send next handshake message: \(error.localizedDescription).")
-      notifyDelegateOfError(SecureBLEChannelError.cannotSendMessage)
-      return
+      do {
+        try messageStream.writeMessage(message, params: UKey2Channel.streamParams)
+      } catch {
+        Self.log.error("Cannot send next handshake message: \(error.localizedDescription).")
+        notifyDelegateOfError(SecureBLEChannelError.cannotSendMessage)
+        return
+      }
     }
 
-    // The handshake state is updated after a call to nextHandshakeMessage(). So, need to check
-    // if we've progressed to a different state.
-    process(ukey2.handshakeState)
+    switch step.outcome {
+    case .awaitingRemote:
+      break
+    case .verificationNeeded(let verificationBytes):
+      processVerificationBytes(verificationBytes)
+    case .failed(let error):
+      notifyDelegateOfError(error)
+    case .unexpectedState(let state):
+      Self.log.error("Invalid handshake state: \(state.rawValue)")
+    }
   }
 
   private func processVerificationBytes(_ verificationBytes: Data) {
@@ -322,7 +840,7 @@ class UKey2Channel: SecureBLEChannel {
 
     state = .resumingSession
 
-    guard let newSessionKey = ukey2.uniqueSessionKey,
+    guard var newSessionKey = ukey2.uniqueSessionKey,
       let savedSessionKey = savedSessionKey
     else {
       let errorMessage = "Cannot generate session keys."
@@ -330,9 +848,11 @@ class UKey2Channel: SecureBLEChannel {
       return
     }
 
-    var combinedSessionKey = Data()
-    combinedSessionKey.append(savedSessionKey)
-    combinedSessionKey.append(newSessionKey)
+    var combinedKeyData = Data(capacity: savedSessionKey.data.count + newSessionKey.count)
+    combinedKeyData.append(savedSessionKey.data)
+    combinedKeyData.append(newSessionKey)
+    newSessionKey.zeroize()
+    let combinedSessionKey = SecretData(combinedKeyData)
 
     self.combinedSessionKey = combinedSessionKey
 
@@ -343,7 +863,7 @@ class UKey2Channel: SecureBLEChannel {
     // which will be called when a message is received from the server.
   }
 
-  private func sendResumptionHMAC(withCombinedKey combinedSessionKey: Data) {
+  private func sendResumptionHMAC(withCombinedKey combinedSessionKey: SecretData) {
     // This shouldn't happen because the message stream should have been set during resumption.
     guard let messageStream = messageStream else {
       Self.log.error("No stream when attempting to send resumption HMAC.")
@@ -352,7 +872,7 @@ class UKey2Channel: SecureBLEChannel {
     }
 
     let resumeHMAC = CryptoOps.hkdf(
-      inputKeyMaterial: combinedSessionKey,
+      inputKeyMaterial: combinedSessionKey.data,
       salt: UKey2Channel.resumptionSalt,
       info: UKey2Channel.clientInfoPrefix
     )
@@ -390,8 +910,11 @@ class UKey2Channel: SecureBLEChannel {
       return
     }
 
+    // The combined key is only used for this one exchange.
+    self.combinedSessionKey = nil
+
     let resumeHMAC = CryptoOps.hkdf(
-      inputKeyMaterial: combinedSessionKey,
+      inputKeyMaterial: combinedSessionKey.data,
       salt: UKey2Channel.resumptionSalt,
       info: UKey2Channel.serverInfoPrefix
     )
@@ -431,11 +954,30 @@ extension UKey2Channel: MessageEncryptor {
       throw SecureBLEChannelError.methodCalledOutOfOrder
     }
 
+    sessionLock.lock()
+    defer { sessionLock.unlock() }
+
+    hasEncryptedTraffic = true
+    rotateEncodeKeyIfNeeded()
+
     guard let encryptedMessage = ukey2.encode(message) else {
       throw SecureBLEChannelError.encryptionFailed
     }
 
-    return encryptedMessage
+    guard rekeyPolicy != nil else { return encryptedMessage }
+
+    rekeyState.messagesSinceRekey += 1
+    rekeyState.bytesSinceRekey += message.count
+
+    var markedMessage = Data(capacity: encryptedMessage.count + 1)
+    markedMessage.append(Self.keyMarker(for: rekeyState.encodeGeneration))
+    markedMessage.append(encryptedMessage)
+    return markedMessage
+  }
+
+  /// The marker that prefixes a message encrypted with the key of the given generation.
+  private static func keyMarker(for generation: UInt32) -> UInt8 {
+    return UInt8(truncatingIfNeeded: generation)
   }
 
   /// Decrypts the given message.
@@ -454,7 +996,35 @@ extension UKey2Channel: MessageEncryptor {
       throw SecureBLEChannelError.methodCalledOutOfOrder
     }
 
-    guard let decryptedMessage = ukey2.decode(message) else {
+    sessionLock.lock()
+    defer { sessionLock.unlock() }
+
+    hasEncryptedTraffic = true
+
+    guard rekeyPolicy != nil else {
+      guard let decryptedMessage = ukey2.decode(message) else {
+        throw SecureBLEChannelError.decryptionFailed
+      }
+      return decryptedMessage
+    }
+
+    guard let marker = message.first else {
+      throw SecureBLEChannelError.decryptionFailed
+    }
+
+    let encryptedMessage = Data(message.dropFirst())
+    let decryptedMessage: Data?
+    switch marker {
+    case Self.keyMarker(for: rekeyState.decodeGeneration):
+      decryptedMessage = ukey2.decode(encryptedMessage)
+    case Self.keyMarker(for: rekeyState.decodeGeneration + 1):
+      decryptedMessage = decodeWithNextKey(encryptedMessage)
+    default:
+      Self.log.error("Received message for unknown key generation marker \(marker).")
+      decryptedMessage = nil
+    }
+
+    guard let decryptedMessage = decryptedMessage else {
       throw SecureBLEChannelError.decryptionFailed
     }
 
@@ -488,18 +1058,8 @@ extension UKey2Channel: MessageStreamDelegate {
       }
     }
 
-    if state == .resumingSession {
-      verifyServerHMAC(serverMessage: message)
-      return
-    }
-
-    let response = ukey2.parseHandshakeMessage(message)
-    guard response.isSuccessful else {
-      notifyDelegateOfError(SecureBLEChannelError.parseMessageFailed(ukey2.lastHandshakeError))
-      return
-    }
-
-    process(ukey2.handshakeState)
+    pendingHandshakeMessages.append(message)
+    processNextHandshakeMessage()
   }
 
   func messageStream(
@@ -12,12 +12,149 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+import AndroidAutoLogger
 import Foundation
 
 /// Creator of `UKey2Channel`s.
+///
+/// Channels can be prewarmed per car so that the key generation and saved session parsing of the
+/// handshake happen while the car is still being connected to. A prewarmed channel is replaced when
+/// the car's saved session changes or it grows older than `maxPrewarmAge`, and is evicted when the
+/// car is dissociated.
 public class UKey2ChannelFactory: NSObject, SecureBLEChannelFactory {
+  private static let log = Logger(for: UKey2ChannelFactory.self)
+
+  /// How long a prewarmed channel is kept before its ephemeral keys are considered stale.
+  static let maxPrewarmAge: TimeInterval = 5 * 60
+
+  /// A prewarmed channel and what it was prewarmed with.
+  private struct PrewarmedChannel {
+    let channel: UKey2Channel
+    let savedSession: Data?
+    let creationDate: Date
+
+    var isStale: Bool {
+      Date().timeIntervalSince(creationDate) > UKey2ChannelFactory.maxPrewarmAge
+    }
+  }
+
+  /// Queue on which channels are prewarmed.
+  private let prewarmQueue = DispatchQueue(
+    label: "com.google.ios.aae.UKey2ChannelFactory.prewarm", qos: .userInitiated)
+
+  /// Guards `prewarmedChannels` and `pendingPrewarms`.
+  private let lock = NSLock()
+
+  /// Prewarmed channels keyed by car id. Each channel is handed out at most once.
+  private var prewarmedChannels: [String: PrewarmedChannel] = [:]
+
+  /// The prewarms in flight keyed by car id. A prewarm whose id is no longer listed was evicted and
+  /// its channel is dropped.
+  private var pendingPrewarms: [String: Int] = [:]
+
+  private var nextPrewarmID = 0
+
+  public var supportedCapabilities: SecureChannelCapabilities { UKey2Channel.capabilities }
+
   /// Creates a new instance of a `UKey2Channel`.
   public func makeChannel() -> SecureBLEChannel {
     return UKey2Channel()
   }
+
+  /// Prewarms a `UKey2Channel` for the given car in the background.
+  ///
+  /// The saved session is loaded on the prewarm queue. A channel that is already prewarmed with the
+  /// same saved session and is not stale is kept. Nothing is done while a prewarm for the car is in
+  /// flight.
+  public func prewarmChannel(
+    for carId: String,
+    loadingSavedSession loadSavedSession: @escaping () -> Data?
+  ) {
+    lock.lock()
+    defer { lock.unlock() }
+
+    guard pendingPrewarms[carId] == nil else { return }
+    nextPrewarmID += 1
+    let prewarmID = nextPrewarmID
+    pendingPrewarms[carId] = prewarmID
+
+    prewarmQueue.async { [weak self] in
+      let savedSession = loadSavedSession()
+      guard let self = self,
+        !self.hasCurrentPrewarmedChannel(for: carId, savedSession: savedSession)
+      else {
+        self?.finishPrewarm(prewarmID, for: carId, storing: nil)
+        return
+      }
+
+      let channel = UKey2Channel()
+      channel.prewarm(savedSession: savedSession)
+      let prewarmed = PrewarmedChannel(
+        channel: channel, savedSession: savedSession, creationDate: Date())
+      self.finishPrewarm(prewarmID, for: carId, storing: prewarmed)
+    }
+  }
+
+  /// Returns the channel prewarmed for the given car, or a new `UKey2Channel` if it is not ready.
+  public func makeChannel(for carId: String) -> SecureBLEChannel {
+    lock.lock()
+    defer { lock.unlock() }
+
+    guard let prewarmed = prewarmedChannels.removeValue(forKey: carId), !prewarmed.isStale else {
+      Self.log.debug("No current prewarmed channel for car \(carId). Creating a new one.")
+      return makeChannel()
+    }
+
+    return prewarmed.channel
+  }
+
+  public func evictPrewarmedChannel(for carId: String) {
+    lock.lock()
+    defer { lock.unlock() }
+
+    prewarmedChannels[carId] = nil
+    pendingPrewarms[carId] = nil
+  }
+
+  public func evictAllPrewarmedChannels() {
+    lock.lock()
+    defer { lock.unlock() }
+
+    prewarmedChannels.removeAll()
+    pendingPrewarms.removeAll()
+  }
+
+  /// Blocks until all channels that are currently being prewarmed are ready.
+  func waitForPendingPrewarms() {
+    prewarmQueue.sync {}
+  }
+
+  /// Whether the car has a prewarmed channel for the given saved session that is not stale.
+  private func hasCurrentPrewarmedChannel(for carId: String, savedSession: Data?) -> Bool {
+    lock.lock()
+    defer { lock.unlock() }
+
+    guard let prewarmed = prewarmedChannels[carId] else { return false }
+    return !prewarmed.isStale && prewarmed.savedSession == savedSession
+  }
+
+  /// Ends the given prewarm, storing its channel unless the car was evicted in the meantime.
+  private func finishPrewarm(
+    _ prewarmID: Int,
+    for carId: String,
+    storing prewarmed: PrewarmedChannel?
+  ) {
+    lock.lock()
+    defer { lock.unlock() }
+
+    guard pendingPrewarms[carId] == prewarmID else {
+      Self.log.debug("Dropping channel prewarmed for evicted car \(carId).")
+      return
+    }
+
+    pendingPrewarms[carId] = nil
+    if let prewarmed = prewarmed {
+      prewarmedChannels[carId] = prewarmed
+    }
+  }
 }
@@ -0,0 +1,130 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+import AndroidAutoUKey2Wrapper
+import Foundation
+
+/// The contents of a session returned by `UKey2Wrapper.saveSession()`.
+///
+/// A saved `D2DConnectionContextV1` is laid out as:
+///
+///     protocol version (1 byte) | encode sequence number (4 bytes, big-endian) |
+///     decode sequence number (4 bytes, big-endian) | encode key (32 bytes) | decode key (32 bytes)
+///
+/// Exposing this layout allows the traffic keys of an established session to be rotated without
+/// any changes to the native wrapper.
+struct UKey2SavedSession: Equatable {
+  /// The only protocol version understood by `D2DConnectionContextV1`.
+  static let protocolVersion: UInt8 = 1
+
+  /// The length in bytes of each traffic key.
+  static let keyLength = 32
+
+  /// The total length of a serialized session.
+  static let serializedLength = 1 + 4 + 4 + keyLength + keyLength
+
+  /// Salt used when deriving the next generation of a traffic key.
+  static let rekeySalt = Data("REKEY".utf8)
+
+  /// The two directions of traffic in a session.
+  enum Direction {
+    /// Messages sent from this device to the remote device.
+    case encode
+
+    /// Messages sent from the remote device to this device.
+    case decode
+  }
+
+  var encodeSequenceNumber: UInt32
+  var decodeSequenceNumber: UInt32
+  var encodeKey: Data
+  var decodeKey: Data
+
+  /// Parses the given data from `UKey2Wrapper.saveSession()`.
+  ///
+  /// - Parameter serialized: The saved session.
+  /// - Returns: `nil` if the data is not a saved session of a supported version.
+  init?(serialized: Data) {
+    // The keys are copied straight out of `serialized`, so no other copy of them is left behind.
+    let start = serialized.startIndex
+    guard serialized.count == Self.serializedLength, serialized[start] == Self.protocolVersion
+    else {
+      return nil
+    }
+
+    let encodeKeyStart = start + 9
+    let decodeKeyStart = encodeKeyStart + Self.keyLength
+    encodeSequenceNumber = Self.readUInt32(serialized, at: start + 1)
+    decodeSequenceNumber = Self.readUInt32(serialized, at: start + 5)
+    encodeKey = Data(serialized[encodeKeyStart..<decodeKeyStart])
+    decodeKey = Data(serialized[decodeKeyStart...])
+  }
+
+  /// The serialized form of this session, suitable for `UKey2Wrapper(savedSession:)`.
+  var serialized: Data {
+    var data = Data(capacity: Self.serializedLength)
+    data.append(Self.protocolVersion)
+    Self.appendUInt32(encodeSequenceNumber, to: &data)
+    Self.appendUInt32(decodeSequenceNumber, to: &data)
+    data.append(encodeKey)
+    data.append(decodeKey)
+    return data
+  }
+
+  /// Derives the traffic key that follows `key` in the rekey chain.
+  ///
+  /// Both devices apply the same derivation to their copy of a key, so the phone's next encode key
+  /// always matches the car's next decode key and vice versa.
+  ///
+  /// - Parameters:
+  ///   - key: The current traffic key.
+  ///   - generation: The generation of the key being derived. Must be greater than zero.
+  /// - Returns: The derived key or `nil` if the derivation failed.
+  static func nextKey(after key: Data, generation: UInt32) -> Data? {
+    var info = Data()
+    appendUInt32(generation, to: &info)
+    return CryptoOps.hkdf(inputKeyMaterial: key, salt: rekeySalt, info: info)
+  }
+
+  /// Returns a copy of this session with the key for `direction` replaced by `key`.
+  ///
+  /// The sequence number of the replaced direction restarts at zero, since the remote device will
+  /// see the first message under a new key as the start of a new stream.
+  func replacingKey(for direction: Direction, with key: Data) -> UKey2SavedSession {
+    var session = self
+    switch direction {
+    case .encode:
+      session.encodeKey = key
+      session.encodeSequenceNumber = 0
+    case .decode:
+      session.decodeKey = key
+      session.decodeSequenceNumber = 0
+    }
+    return session
+  }
+
+  /// Overwrites both traffic keys with zeros once the session is no longer needed.
+  mutating func zeroize() {
+    encodeKey.zeroize()
+    decodeKey.zeroize()
+  }
+
+  private static func readUInt32(_ bytes: Data, at offset: Int) -> UInt32 {
+    return bytes[offset..<(offset + 4)].reduce(0) { ($0 << 8) | UInt32($1) }
+  }
+
+  private static func appendUInt32(_ value: UInt32, to data: inout Data) {
+    withUnsafeBytes(of: value.bigEndian) { data.append(contentsOf: $0) }
+  }
+}
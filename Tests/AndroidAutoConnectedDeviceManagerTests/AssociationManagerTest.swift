@@ -16,6 +16,7 @@ import AndroidAutoConnectedDeviceManagerMocks
 import AndroidAutoCoreBluetoothProtocols
 import AndroidAutoCoreBluetoothProtocolsMocks
 import AndroidAutoMessageStream
+import AndroidAutoSecureChannel
 import CoreBluetooth
 import XCTest
 
@@ -56,6 +57,7 @@ class AssociationManagerTest: XCTestCase {
     secureSessionManagerMock.reset()
     secureBLEChannelMock.reset()
     messageHelperFactoryProxy.reset()
+    bleVersionResolverFake.channelCapabilities = 0
 
     // Characteristics have a default value of `nil` for their value.
     clientWriteCharacteristicMock.value = nil
@@ -521,6 +523,23 @@ class AssociationManagerTest: XCTestCase {
     XCTAssertTrue(delegate.requiresDisplayOfPairingCodeCalled)
   }
 
+  func testEncryptionEstablished_negotiatesCapabilitiesFromVersionExchange() {
+    messageHelperFactoryProxy.shouldUseRealFactory = false
+    bleVersionResolverFake.channelCapabilities =
+      SecureChannelCapabilities.packetEncryption.rawValue
+
+    let peripheralMock = PeripheralMock(name: "mock", services: [validService])
+    notifyValidCharacteristicsDiscovered(for: peripheralMock)
+
+    let messageHelperMock =
+      messageHelperFactoryProxy.latestMessageHelper
+      as! AssociationMessageHelperMock
+    messageHelperMock.performEncryptionFlow()
+
+    XCTAssertEqual(secureBLEChannelMock.negotiatedCapabilities, [[.packetEncryption]])
+    XCTAssertTrue(messageHelperMock.onEncryptionEstablishedCalled)
+  }
+
   func testMessageHelperCalls_messageDidSendSuccessfullyCalled() {
     messageHelperFactoryProxy.shouldUseRealFactory = false
 
@@ -0,0 +1,80 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+import XCTest
+
+@testable import AndroidAutoConnectedDeviceManager
+
+/// Unit tests for `ByteRingBuffer`.
+class ByteRingBufferTest: XCTestCase {
+  func testRead_appendsBytesFromStream() {
+    let buffer = ByteRingBuffer(capacity: 8)
+    let stream = openStream(Data([1, 2, 3]))
+
+    XCTAssertEqual(buffer.read(from: stream), 3)
+    XCTAssertEqual(buffer.count, 3)
+    XCTAssertEqual(buffer[0], 1)
+    XCTAssertEqual(buffer[2], 3)
+  }
+
+  func testRead_stopsWhenFull() {
+    let buffer = ByteRingBuffer(capacity: 4)
+    let stream = openStream(Data([1, 2, 3, 4, 5, 6]))
+
+    XCTAssertEqual(buffer.read(from: stream), 4)
+    XCTAssertTrue(buffer.isFull)
+    XCTAssertEqual(buffer.read(from: stream), 0)
+  }
+
+  func testConsume_freesSpaceForWrappedRead() {
+    let buffer = ByteRingBuffer(capacity: 4)
+    let stream = openStream(Data([1, 2, 3, 4, 5, 6]))
+
+    buffer.read(from: stream)
+    buffer.consume(3)
+
+    XCTAssertEqual(buffer.read(from: stream), 2)
+    XCTAssertEqual(buffer.count, 3)
+    XCTAssertEqual((0..<buffer.count).map { buffer[$0] }, [4, 5, 6])
+  }
+
+  func testWithContiguousBytes_rotatesWrappedBytes() {
+    let buffer = ByteRingBuffer(capacity: 4)
+    let stream = openStream(Data([1, 2, 3, 4, 5, 6]))
+
+    buffer.read(from: stream)
+    buffer.consume(3)
+    buffer.read(from: stream)
+
+    let bytes = buffer.withContiguousBytes(count: 3) { Array($0) }
+
+    XCTAssertEqual(bytes, [4, 5, 6])
+    XCTAssertEqual((0..<buffer.count).map { buffer[$0] }, [4, 5, 6])
+  }
+
+  func testRemoveAll_emptiesBuffer() {
+    let buffer = ByteRingBuffer(capacity: 4)
+    buffer.read(from: openStream(Data([1, 2])))
+
+    buffer.removeAll()
+
+    XCTAssertTrue(buffer.isEmpty)
+  }
+
+  private func openStream(_ data: Data) -> InputStream {
+    let stream = InputStream(data: data)
+    stream.open()
+    return stream
+  }
+}
@@ -0,0 +1,82 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+import CoreBluetooth
+import XCTest
+
+@testable import AndroidAutoConnectedDeviceManager
+
+/// Unit tests for `CarAdvertisement`.
+class CarAdvertisementTest: XCTestCase {
+  private var uuidConfig: UUIDConfig!
+
+  override func setUp() {
+    super.setUp()
+
+    uuidConfig = UUIDConfig(plistLoader: PListLoaderFake())
+  }
+
+  func testEmptyAdvertisement_hasNoFields() {
+    let advertisement = CarAdvertisement([:], uuidConfig: uuidConfig)
+
+    XCTAssertNil(advertisement.serviceUUIDs)
+    XCTAssertNil(advertisement.localName)
+    XCTAssertNil(advertisement.associationData)
+    XCTAssertNil(advertisement.reconnectionData)
+    XCTAssertFalse(advertisement.advertisesService(uuidConfig.reconnectionUUID(for: .v1)))
+  }
+
+  func testServiceUUIDs() {
+    let v2UUID = uuidConfig.reconnectionUUID(for: .v2)
+
+    let advertisement = CarAdvertisement(
+      [CBAdvertisementDataServiceUUIDsKey: [v2UUID]], uuidConfig: uuidConfig)
+
+    XCTAssertEqual(advertisement.serviceUUIDs, [v2UUID])
+    XCTAssertTrue(advertisement.advertisesService(v2UUID))
+    XCTAssertFalse(advertisement.advertisesService(uuidConfig.reconnectionUUID(for: .v1)))
+  }
+
+  func testLocalName() {
+    let advertisement = CarAdvertisement(
+      [CBAdvertisementDataLocalNameKey: "name"], uuidConfig: uuidConfig)
+
+    XCTAssertEqual(advertisement.localName, "name")
+  }
+
+  func testServiceData() {
+    let reconnectionData = Data("reconnect".utf8)
+    let advertisementData: [String: Any] = [
+      CBAdvertisementDataServiceDataKey: [uuidConfig.reconnectionDataUUID: reconnectionData]
+    ]
+
+    let advertisement = CarAdvertisement(advertisementData, uuidConfig: uuidConfig)
+
+    XCTAssertEqual(advertisement.reconnectionData, reconnectionData)
+  }
+
+  func testMalformedValues_areIgnored() {
+    let advertisementData: [String: Any] = [
+      CBAdvertisementDataServiceUUIDsKey: "not an array",
+      CBAdvertisementDataLocalNameKey: 42,
+      CBAdvertisementDataServiceDataKey: [uuidConfig.reconnectionDataUUID: "not data"],
+    ]
+
+    let advertisement = CarAdvertisement(advertisementData, uuidConfig: uuidConfig)
+
+    XCTAssertNil(advertisement.serviceUUIDs)
+    XCTAssertNil(advertisement.localName)
+    XCTAssertNil(advertisement.reconnectionData)
+  }
+}
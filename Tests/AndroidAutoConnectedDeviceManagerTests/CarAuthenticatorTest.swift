@@ -133,14 +133,14 @@ class CarAuthenticatorImplTest: XCTestCase {
     // The valid advertisement length is 11.
     let invalidAd = randomData(count: 8)
 
-    XCTAssertThrowsError(try CarAuthenticatorImpl.Advertisement.partition(advertisement: invalidAd))
+    XCTAssertThrowsError(try CarAuthenticatorImpl.Advertisement(invalidAd))
   }
 
   func testAdvertisementPartionDoesntThrowForValidLength() {
     // The valid advertisement length is 11.
     let validAd = randomData(count: 11)
 
-    XCTAssertNoThrow(try CarAuthenticatorImpl.Advertisement.partition(advertisement: validAd))
+    XCTAssertNoThrow(try CarAuthenticatorImpl.Advertisement(validAd))
   }
 
   func testAdvertisementPartition() {
@@ -148,14 +148,16 @@ class CarAuthenticatorImplTest: XCTestCase {
     let advertisement = randomData(count: 11)
 
     do {
-      let partition = try CarAuthenticatorImpl.Advertisement.partition(advertisement: advertisement)
-      XCTAssertEqual(partition.truncatedHMAC.count, 3)
+      let partition = try CarAuthenticatorImpl.Advertisement(advertisement)
+      XCTAssertEqual(partition.truncatedHMACData.count, 3)
 
       // The padded salt is the original 8 bytes from the advertisement padded with 8 more zeros.
-      XCTAssertEqual(partition.paddedSalt.count, 16)
+      let paddedSalt = partition.paddedSaltData
+      XCTAssertEqual(paddedSalt.count, 16)
+      XCTAssertEqual(paddedSalt[8...], Data(repeating: 0, count: 8))
 
       // Regenerate the advertisement from the partition.
-      let regeneratedAd: Data = partition.truncatedHMAC + partition.paddedSalt[0..<8]
+      let regeneratedAd: Data = partition.truncatedHMACData + paddedSalt[0..<8]
       XCTAssertEqual(advertisement, regeneratedAd)
     } catch {
       XCTFail("Partition of valid advertisement failed with error: \(error)")
@@ -169,6 +171,26 @@ class CarAuthenticatorImplTest: XCTestCase {
     XCTAssertEqual(truncatedHMAC.count, 3)
   }
 
+  func testAdvertisementIsTruncationOfHMAC() throws {
+    let hmac = randomData(count: 32)
+    let advertisement = try CarAuthenticatorImpl.Advertisement(hmac[0..<3] + randomData(count: 8))
+
+    XCTAssertTrue(advertisement.isTruncation(of: hmac))
+
+    var otherHMAC = hmac
+    otherHMAC[2] ^= 0x01
+    XCTAssertFalse(advertisement.isTruncation(of: otherHMAC))
+  }
+
+  func testComputeHMACOfBytesMatchesData() {
+    let authenticator = CarAuthenticatorImpl()
+    let data = randomData(count: 16)
+
+    let hmac = data.withUnsafeBytes { authenticator.computeHMAC(bytes: $0) }
+
+    XCTAssertEqual(hmac, authenticator.computeHMAC(data: data))
+  }
+
   func testFindingMatchingCarForAdvertisementData() {
     // Create several cars to associate.
     let aCar = Car(id: "a", name: "hello")
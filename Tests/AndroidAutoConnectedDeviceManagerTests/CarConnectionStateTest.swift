@@ -0,0 +1,239 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+import AndroidAutoCoreBluetoothProtocolsMocks
+import XCTest
+
+@testable import AndroidAutoConnectedDeviceManager
+
+/// Unit tests for CarConnectionState and CarConnectionStateRegistry.
+class CarConnectionStateTest: XCTestCase {
+  private static let retryLimit = 2
+
+  private var registry: CarConnectionStateRegistry!
+
+  override func setUp() {
+    super.setUp()
+
+    // The states are confined to the main queue, which the tests run on.
+    registry = CarConnectionStateRegistry()
+  }
+
+  override func tearDown() {
+    registry = nil
+
+    super.tearDown()
+  }
+
+  // MARK: - Connection
+
+  func testBeginConnecting_retriesUntilLimitThenExhausts() {
+    let state = registry.state(for: UUID())
+    let exhausted = expectation(description: "Retries exhausted")
+    var attempts: [Int] = []
+
+    func handleRetry() {
+      dispatchPrecondition(condition: .onQueue(.main))
+      switch state.retryDecision(limit: Self.retryLimit) {
+      case .retry(let attempt):
+        attempts.append(attempt)
+        state.recordRetry(retryAfter: .milliseconds(5), handler: handleRetry)
+      case .exhausted:
+        state.endConnecting(in: .idle)
+        exhausted.fulfill()
+      case .notConnecting:
+        XCTFail("Retry handler invoked for a car that is not connecting.")
+      }
+    }
+
+    state.beginConnecting(retryAfter: .milliseconds(5), handler: handleRetry)
+    XCTAssertEqual(state.phase, .connecting(attempt: 0))
+
+    wait(for: [exhausted], timeout: 5)
+
+    XCTAssertEqual(attempts, [0, 1])
+    XCTAssertEqual(state.phase, .idle)
+  }
+
+  func testEndConnecting_cancelsPendingRetry() {
+    let state = registry.state(for: UUID())
+    let retried = expectation(description: "Retry handler invoked")
+    retried.isInverted = true
+
+    state.beginConnecting(retryAfter: .milliseconds(20)) { retried.fulfill() }
+    state.endConnecting(in: .connected)
+
+    wait(for: [retried], timeout: 0.2)
+    XCTAssertEqual(state.phase, .connected)
+    XCTAssertEqual(state.retryDecision(limit: Self.retryLimit), .notConnecting)
+  }
+
+  func testBeginConnecting_replacesPendingRetry() {
+    let state = registry.state(for: UUID())
+    let staleRetry = expectation(description: "Stale retry handler invoked")
+    staleRetry.isInverted = true
+    let currentRetry = expectation(description: "Current retry handler invoked")
+
+    state.beginConnecting(retryAfter: .milliseconds(20)) { staleRetry.fulfill() }
+    state.beginConnecting(retryAfter: .milliseconds(40)) { currentRetry.fulfill() }
+
+    wait(for: [staleRetry, currentRetry], timeout: 0.5)
+  }
+
+  // MARK: - Secure channel
+
+  func testBeginSecuring_notifiesOfTimeoutOnce() {
+    let peripheral = PeripheralMock(name: "car", services: nil)
+    let state = registry.state(for: peripheral.identifier)
+    let timedOut = expectation(description: "Timeout handler invoked")
+
+    state.beginSecuring(PendingCar(car: peripheral), timeout: .milliseconds(10)) {
+      timedOut.fulfill()
+    }
+    XCTAssertEqual(state.phase, .securing)
+
+    wait(for: [timedOut], timeout: 1)
+
+    // The timeout has been claimed, so cancelling it afterwards is harmless.
+    state.cancelTimeout()
+    XCTAssert(state.pendingCar?.car === peripheral)
+  }
+
+  func testCancelTimeout_suppressesHandler() {
+    let peripheral = PeripheralMock(name: "car", services: nil)
+    let state = registry.state(for: peripheral.identifier)
+    let timedOut = expectation(description: "Timeout handler invoked")
+    timedOut.isInverted = true
+
+    state.beginSecuring(PendingCar(car: peripheral), timeout: .milliseconds(20)) {
+      timedOut.fulfill()
+    }
+    state.cancelTimeout()
+
+    wait(for: [timedOut], timeout: 0.2)
+  }
+
+  func testEndSecuring_releasesHelperAndCancelsTimeout() {
+    let peripheral = PeripheralMock(name: "car", services: nil)
+    let state = registry.state(for: peripheral.identifier)
+    let timedOut = expectation(description: "Timeout handler invoked")
+    timedOut.isInverted = true
+
+    state.beginSecuring(PendingCar(car: peripheral), timeout: .milliseconds(20)) {
+      timedOut.fulfill()
+    }
+    state.clearPendingCar()
+    state.endSecuring(succeeded: true)
+
+    wait(for: [timedOut], timeout: 0.2)
+    XCTAssertEqual(state.phase, .secured)
+    XCTAssertNil(state.pendingCar)
+    XCTAssertNil(state.reconnectionHelper)
+  }
+
+  // MARK: - Registry
+
+  func testTakeDeviceId_removesDeviceId() {
+    let state = registry.state(for: UUID())
+    state.deviceId = "carId"
+
+    XCTAssertEqual(state.takeDeviceId(), "carId")
+    XCTAssertNil(state.takeDeviceId())
+  }
+
+  func testRegistry_returnsSameStateForIdentifier() {
+    let identifier = UUID()
+
+    XCTAssertNil(registry.existingState(for: identifier))
+    XCTAssert(registry.state(for: identifier) === registry.state(for: identifier))
+    XCTAssert(registry.existingState(for: identifier) === registry.state(for: identifier))
+  }
+
+  func testRemoveStateIfIdle_keepsStatesThatHoldSomething() {
+    let idleID = UUID()
+    let busyID = UUID()
+    registry.state(for: idleID).deviceId = "carId"
+    _ = registry.state(for: idleID).takeDeviceId()
+    registry.state(for: busyID).deviceId = "carId"
+
+    registry.removeStateIfIdle(for: idleID)
+    registry.removeStateIfIdle(for: busyID)
+
+    XCTAssertNil(registry.existingState(for: idleID))
+    XCTAssertNotNil(registry.existingState(for: busyID))
+  }
+
+  // MARK: - Simulation
+
+  /// Drives many cars through their connection phases with their timers interleaved on the main
+  /// queue.
+  ///
+  /// Even cars never connect and exhaust their retries. Odd cars connect on their first retry and
+  /// then time out while securing. Each car's timers and state must stay independent of the others.
+  func testManyCars_withInterleavedTimers_reachExpectedPhases() {
+    let carCount = 200
+    let peripherals = (0..<carCount).map { PeripheralMock(name: "car\($0)", services: nil) }
+    let settled = (0..<carCount).map { expectation(description: "Car \($0) settled") }
+
+    var retryAttempts = [Int](repeating: 0, count: carCount)
+    var timeoutCounts = [Int](repeating: 0, count: carCount)
+
+    for index in 0..<carCount {
+      let peripheral = peripherals[index]
+      let state = registry.state(for: peripheral.identifier)
+      state.deviceId = "car-\(index)"
+
+      func handleRetry() {
+        switch state.retryDecision(limit: Self.retryLimit) {
+        case .retry(let attempt) where index % 2 == 0:
+          retryAttempts[index] = attempt + 1
+          state.recordRetry(retryAfter: .milliseconds(2), handler: handleRetry)
+        case .retry:
+          state.endConnecting(in: .connected)
+          state.beginSecuring(PendingCar(car: peripheral), timeout: .milliseconds(5)) {
+            timeoutCounts[index] += 1
+            settled[index].fulfill()
+          }
+        case .exhausted:
+          state.endConnecting(in: .idle)
+          settled[index].fulfill()
+        case .notConnecting:
+          XCTFail("Retry handler invoked for car \(index) that is not connecting.")
+        }
+      }
+
+      state.beginConnecting(retryAfter: .milliseconds(index % 5), handler: handleRetry)
+    }
+
+    wait(for: settled, timeout: 10)
+
+    XCTAssertEqual(registry.allStates.count, carCount)
+    for (index, peripheral) in peripherals.enumerated() {
+      let state = registry.state(for: peripheral.identifier)
+      XCTAssertEqual(state.deviceId, "car-\(index)")
+
+      if index % 2 == 0 {
+        XCTAssertEqual(state.phase, .idle)
+        XCTAssertEqual(retryAttempts[index], Self.retryLimit)
+        XCTAssertEqual(timeoutCounts[index], 0)
+        XCTAssertNil(state.pendingCar)
+      } else {
+        XCTAssertEqual(state.phase, .securing)
+        XCTAssertEqual(retryAttempts[index], 0)
+        XCTAssertEqual(timeoutCounts[index], 1)
+        XCTAssert(state.pendingCar?.car === peripheral)
+      }
+    }
+  }
+}
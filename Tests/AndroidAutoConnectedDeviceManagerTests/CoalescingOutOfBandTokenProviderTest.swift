@@ -231,6 +231,99 @@ class CoalescingOutOfBandTokenProviderTest: XCTestCase {
     XCTAssertNil(token)
     XCTAssertEqual(tokenCounter, 1)
   }
+
+  func testCancelsPendingProvidersAfterFirstToken() {
+    let child1 = MockOutOfBandTokenProvider()
+    let child2 = MockOutOfBandTokenProvider()
+    let child3 = MockOutOfBandTokenProvider()
+    testTokenProvider = CoalescingOutOfBandTokenProvider(child1, child2, child3)
+
+    var tokenCounter = 0
+    testTokenProvider.requestToken { _ in tokenCounter += 1 }
+
+    child2.postToken(FakeOutOfBandToken())
+
+    XCTAssertEqual(tokenCounter, 1)
+    XCTAssertTrue(child1.cancelPendingRequestsCalled)
+    XCTAssertFalse(child2.cancelPendingRequestsCalled)
+    XCTAssertTrue(child3.cancelPendingRequestsCalled)
+  }
+
+  func testDoesNotRequestRemainingProvidersAfterSynchronousToken() {
+    let child1 = MockOutOfBandTokenProvider()
+    let child2 = MockOutOfBandTokenProvider()
+    child1.postToken(FakeOutOfBandToken())
+    testTokenProvider = CoalescingOutOfBandTokenProvider(child1, child2)
+
+    var token: OutOfBandToken? = nil
+    testTokenProvider.requestToken { token = $0 }
+
+    XCTAssertNotNil(token)
+    XCTAssertEqual(child2.requestCount, 0)
+  }
+
+  func testDeadline_resolvesWithoutTokenAndCancelsProviders() {
+    let child = MockOutOfBandTokenProvider()
+    testTokenProvider = CoalescingOutOfBandTokenProvider(child)
+    testTokenProvider.deadline = .milliseconds(10)
+
+    let completionExpectation = expectation(description: "Completion called.")
+    var tokenCounter = 0
+    testTokenProvider.requestToken { token in
+      XCTAssertNil(token)
+      tokenCounter += 1
+      completionExpectation.fulfill()
+    }
+
+    wait(for: [completionExpectation], timeout: 1)
+
+    XCTAssertTrue(child.cancelPendingRequestsCalled)
+    XCTAssertEqual(testTokenProvider.metrics.timeoutCount, 1)
+
+    // A token arriving after the deadline is ignored.
+    child.postToken(FakeOutOfBandToken())
+    XCTAssertEqual(tokenCounter, 1)
+  }
+
+  func testConcurrentResponses_callCompletionOnce() {
+    let children = (0..<8).map { _ in MockOutOfBandTokenProvider() }
+    testTokenProvider = CoalescingOutOfBandTokenProvider(children)
+
+    let completionExpectation = expectation(description: "Completion called.")
+    completionExpectation.assertForOverFulfill = true
+    testTokenProvider.requestToken { token in
+      XCTAssertNotNil(token)
+      completionExpectation.fulfill()
+    }
+
+    DispatchQueue.concurrentPerform(iterations: children.count) { index in
+      children[index].postToken(FakeOutOfBandToken())
+    }
+
+    wait(for: [completionExpectation], timeout: 1)
+  }
+
+  func testMetrics_recordTimeToTokenPerProviderKind() {
+    let child1 = MockOutOfBandTokenProvider()
+    let child2 = MockOutOfBandTokenProvider()
+    testTokenProvider = CoalescingOutOfBandTokenProvider(child1, child2)
+
+    testTokenProvider.requestToken { _ in }
+    child1.postToken(FakeOutOfBandToken())
+
+    let metrics = testTokenProvider.metrics.metrics(forProviderNamed: child1.providerName)
+    XCTAssertEqual(metrics.requestCount, 2)
+    XCTAssertEqual(metrics.tokenCount, 1)
+    XCTAssertEqual(metrics.winCount, 1)
+    XCTAssertEqual(metrics.cancelledCount, 1)
+    XCTAssertNotNil(metrics.lastTimeToToken)
+  }
+
+  func testProviderName_ofTypeErasedProvider_isSourceName() {
+    let source = MockOutOfBandTokenProvider()
+
+    XCTAssertEqual(AnyOutOfBandTokenProvider(source: source).providerName, source.providerName)
+  }
 }
 
 /// Fake Out of Band token with minimal implementation.
@@ -255,6 +348,11 @@ class MockOutOfBandTokenProvider: OutOfBandTokenProvider {
   var prepareForRequestsCalled = false
   var closeForRequestsCalled = false
   var resetCalled = false
+  var cancelPendingRequestsCalled = false
+  var requestCount = 0
+
+  /// Guards `completion` and `token`, which may be posted from several threads.
+  private let lock = NSLock()
 
   func prepareForRequests() {
     prepareForRequestsCalled = true
@@ -265,6 +363,7 @@ class MockOutOfBandTokenProvider: OutOfBandTokenProvider {
   }
 
   func requestToken(completion: @escaping (OutOfBandToken?) -> Void) {
+    requestCount += 1
     if let token = token {
       completion(token)
     } else {
@@ -272,6 +371,15 @@ class MockOutOfBandTokenProvider: OutOfBandTokenProvider {
     }
   }
 
+  func cancelPendingRequests() {
+    cancelPendingRequestsCalled = true
+    lock.lock()
+    let completion = self.completion
+    self.completion = nil
+    lock.unlock()
+    completion?(nil)
+  }
+
   func reset() {
     resetCalled = true
     token = nil
@@ -280,9 +388,12 @@ class MockOutOfBandTokenProvider: OutOfBandTokenProvider {
   }
 
   func postToken(_ token: OutOfBandToken?) {
+    lock.lock()
     self.token = token
+    let completion = self.completion
+    self.completion = nil
+    lock.unlock()
     completion?(token)
-    completion = nil
   }
 
   init() {}
@@ -27,6 +27,7 @@ class CommunicationManagerDelegateFake: CommunicationManagerDelegate {
   var establishingPeripheral: BLEPeripheral?
 
   var didEstablishSecureChannelCalled = false
+  var establishedSecureChannelCount = 0
   var securedCarChannel: SecuredCarChannel?
 
   var errorExpectation: XCTestExpectation?
@@ -49,6 +50,7 @@ class CommunicationManagerDelegateFake: CommunicationManagerDelegate {
     didEstablishSecureChannel securedCarChannel: SecuredConnectedDeviceChannel
   ) {
     didEstablishSecureChannelCalled = true
+    establishedSecureChannelCount += 1
     self.securedCarChannel = securedCarChannel
   }
 
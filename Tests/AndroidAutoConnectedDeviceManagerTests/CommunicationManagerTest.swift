@@ -46,11 +46,32 @@ class CommunicationManagerTest: XCTestCase {
   private var communicationManager: CommunicationManager!
   private var reconnectionHelpers: [UUID: ReconnectionHelperMock]!
   private var uuidConfig: UUIDConfig!
+  private var userRoleCache: UserRoleCacheFake!
+
+  /// Car ids passed to `prewarmChannel(for:loadingSavedSession:)`, in order.
+  private var prewarmedCarIds: [String] = []
+
+  /// The saved session loaders passed to `prewarmChannel(for:loadingSavedSession:)`, in order.
+  private var savedSessionLoaders: [() -> Data?] = []
+
+  /// Car ids passed to `evictPrewarmedChannel(for:)`, in order.
+  private var evictedCarIds: [String] = []
+
+  /// The number of calls to `evictAllPrewarmedChannels()`.
+  private var evictAllCount = 0
+
+  /// Car ids passed to `makeChannel(for:)`, in order.
+  private var channelCarIds: [String] = []
 
   override func setUp() {
     super.setUp()
 
     reconnectionHelpers = [:]
+    prewarmedCarIds = []
+    savedSessionLoaders = []
+    evictedCarIds = []
+    evictAllCount = 0
+    channelCarIds = []
 
     writeCharacteristicMock = CharacteristicMock(
       uuid: ioCharactersticsUUIDs.writeUUID,
@@ -87,6 +108,7 @@ class CommunicationManagerTest: XCTestCase {
 
     bleVersionResolver = BLEVersionResolverFake()
     connectionHandle = ConnectionHandleFake()
+    userRoleCache = UserRoleCacheFake()
     communicationManager = CommunicationManager(
       overlay: Overlay(),
       connectionHandle: connectionHandle,
@@ -95,7 +117,8 @@ class CommunicationManagerTest: XCTestCase {
       secureSessionManager: secureSessionManagerMock,
       secureBLEChannelFactory: self,
       bleVersionResolver: bleVersionResolver,
-      reconnectionHandlerFactory: reconnectionHandlerFactory)
+      reconnectionHandlerFactory: reconnectionHandlerFactory,
+      userRoleCache: userRoleCache)
 
     delegate = CommunicationManagerDelegateFake()
     communicationManager.delegate = delegate
@@ -195,6 +218,92 @@ class CommunicationManagerTest: XCTestCase {
     XCTAssert(car.serviceUUIDs!.contains(uuidConfig.reconnectionUUID(for: .v1)))
   }
 
+  func testSetUpSecureChannel_withId_prewarmsChannel() {
+    let id = "id"
+    let car = PeripheralMock(name: "name")
+
+    setUpAssociatedCar(id: id, car: car)
+
+    XCTAssertNoThrow(try communicationManager.setUpSecureChannel(with: car, id: id))
+
+    XCTAssertEqual(prewarmedCarIds, [id])
+  }
+
+  func testSetUpSecureChannel_withIdFromAdvertisement_reusesPrewarmedChannel() {
+    let id = "id"
+    let car = PeripheralMock(name: "name")
+
+    setUpAssociatedCar(id: id, car: car)
+
+    let helper = ReconnectionHelperMock(peripheral: car, pendingCarId: id)
+    helper.carId = id
+    communicationManager.addReconnectionHelper(helper)
+    XCTAssertEqual(prewarmedCarIds, [id])
+
+    XCTAssertNoThrow(try communicationManager.setUpSecureChannel(with: car, id: id))
+
+    XCTAssertEqual(prewarmedCarIds, [id])
+    XCTAssertNil(communicationManager.pendingCars.first?.secureSession)
+  }
+
+  func testSetUpSecureChannel_unassociatedId_throwsNotAssociated() {
+    let car = PeripheralMock(name: "name")
+    communicationManager.addReconnectionHelper(
+      ReconnectionHelperMock(peripheral: car, pendingCarId: "id"))
+
+    XCTAssertThrowsError(try communicationManager.setUpSecureChannel(with: car, id: "id")) {
+      error in
+      XCTAssertEqual(error as? CommunicationManagerError, .notAssociated)
+    }
+    XCTAssertTrue(prewarmedCarIds.isEmpty)
+  }
+
+  func testAddReconnectionHelper_withKnownCarId_prewarmsChannel() {
+    let id = "id"
+    let car = PeripheralMock(name: "name")
+
+    setUpAssociatedCar(id: id, car: car)
+    XCTAssertTrue(prewarmedCarIds.isEmpty)
+
+    let helper = ReconnectionHelperMock(peripheral: car, pendingCarId: id)
+    helper.carId = id
+    communicationManager.addReconnectionHelper(helper)
+
+    XCTAssertEqual(prewarmedCarIds, [id])
+  }
+
+  func testAddReconnectionHelper_defersSavedSessionReadToFactory() {
+    let id = "id"
+    let car = PeripheralMock(name: "name")
+    setUpAssociatedCar(id: id, car: car)
+    secureSessionManagerMock.secureSessions[id] = Data("updated".utf8)
+
+    let helper = ReconnectionHelperMock(peripheral: car, pendingCarId: id)
+    helper.carId = id
+    communicationManager.addReconnectionHelper(helper)
+
+    // The session is only read when the factory calls the loader.
+    XCTAssertEqual(savedSessionLoaders.last?(), Data("updated".utf8))
+  }
+
+  func testEvictPrewarmedChannel_forwardsToFactory() {
+    communicationManager.evictPrewarmedChannel(for: "id")
+    communicationManager.evictAllPrewarmedChannels()
+
+    XCTAssertEqual(evictedCarIds, ["id"])
+    XCTAssertEqual(evictAllCount, 1)
+  }
+
+  func testAddReconnectionHelper_unassociatedCar_doesNotPrewarmChannel() {
+    let car = PeripheralMock(name: "name")
+
+    let helper = ReconnectionHelperMock(peripheral: car, pendingCarId: "id")
+    helper.carId = "id"
+    communicationManager.addReconnectionHelper(helper)
+
+    XCTAssertTrue(prewarmedCarIds.isEmpty)
+  }
+
   func testEstablishEncryption_happyPath() {
     // Car ID messsage should be a valid UUID.
     let message = Data("0123456789ABCDEF".utf8)
@@ -227,6 +336,7 @@ class CommunicationManagerTest: XCTestCase {
     )
 
     XCTAssertFalse(delegate.didEncounterErrorCalled)
+    XCTAssertEqual(channelCarIds, [carID])
   }
 
   func testEstablishEncryption_noSavedEncryption_notifiesDelegate() {
@@ -706,6 +816,94 @@ class CommunicationManagerTest: XCTestCase {
     XCTAssert(reconnectionHandler.delegate === communicationManager)
   }
 
+  func testEstablishEncryption_passesCapabilitiesFromVersionExchange() {
+    let id = makeRandomUUID()
+    let car = PeripheralMock(name: "name", services: [validService])
+    bleVersionResolver.channelCapabilities = SecureChannelCapabilities.sessionRekey.rawValue
+
+    setUpAssociatedCar(id: id.uuidString, car: car)
+    XCTAssertNoThrow(try communicationManager.setUpSecureChannel(with: car, id: nil))
+
+    communicationManager.peripheral(
+      car,
+      didDiscoverCharacteristicsFor: validService,
+      error: nil
+    )
+
+    let pendingCar = communicationManager.pendingCars.first(where: { $0.car === car })!
+    communicationManager.messageStream(
+      pendingCar.messageStream!,
+      didReceiveMessage: Data("Test".utf8),
+      params: MessageStreamParams(
+        recipient: Config.defaultRecipientUUID,
+        operationType: .encryptionHandshake
+      )
+    )
+
+    XCTAssertEqual(reconnectionHandlerFactory.channelCapabilities, [[.sessionRekey]])
+  }
+
+  func testEstablishEncryption_passesPacketEncryptionFromVersionExchange() {
+    let id = makeRandomUUID()
+    let car = PeripheralMock(name: "name", services: [validService])
+    let capabilities: SecureChannelCapabilities = [.sessionRekey, .packetEncryption]
+    bleVersionResolver.channelCapabilities = capabilities.rawValue
+
+    setUpAssociatedCar(id: id.uuidString, car: car)
+    XCTAssertNoThrow(try communicationManager.setUpSecureChannel(with: car, id: nil))
+
+    communicationManager.peripheral(
+      car,
+      didDiscoverCharacteristicsFor: validService,
+      error: nil
+    )
+
+    let pendingCar = communicationManager.pendingCars.first(where: { $0.car === car })!
+
+    // Handshake messages are not encrypted, so the switch point has not been passed yet.
+    communicationManager.messageStream(
+      pendingCar.messageStream!,
+      didReceiveMessage: Data("Test".utf8),
+      params: MessageStreamParams(
+        recipient: Config.defaultRecipientUUID,
+        operationType: .encryptionHandshake
+      )
+    )
+
+    XCTAssertEqual(reconnectionHandlerFactory.channelCapabilities, [capabilities])
+    let reconnectionHandler =
+      communicationManager.reconnectingHandlers.first(
+        where: { $0.car.id == id.uuidString }
+      ) as! ReconnectionHandlerFake
+    XCTAssertTrue(reconnectionHandler.establishEncryptionCalled)
+  }
+
+  func testEstablishEncryption_carWithoutCapabilities_passesNone() {
+    let id = makeRandomUUID()
+    let car = PeripheralMock(name: "name", services: [validService])
+
+    setUpAssociatedCar(id: id.uuidString, car: car)
+    XCTAssertNoThrow(try communicationManager.setUpSecureChannel(with: car, id: nil))
+
+    communicationManager.peripheral(
+      car,
+      didDiscoverCharacteristicsFor: validService,
+      error: nil
+    )
+
+    let pendingCar = communicationManager.pendingCars.first(where: { $0.car === car })!
+    communicationManager.messageStream(
+      pendingCar.messageStream!,
+      didReceiveMessage: Data("Test".utf8),
+      params: MessageStreamParams(
+        recipient: Config.defaultRecipientUUID,
+        operationType: .encryptionHandshake
+      )
+    )
+
+    XCTAssertEqual(reconnectionHandlerFactory.channelCapabilities, [[]])
+  }
+
   func testHandshakeCompletes_CallsEstablishEncryption() {
     let id = makeRandomUUID()
     let name = "name"
@@ -848,6 +1046,98 @@ class CommunicationManagerTest: XCTestCase {
     waitForExpectations(timeout: communicationManager.timeoutDuration.toSeconds())
   }
 
+  // MARK: - Speculative unlock tests
+
+  func testEncryptionSetUp_speculative_notifiesDelegateBeforeConfiguration() {
+    makeSpeculativeCommunicationManager()
+
+    let id = makeRandomUUID()
+    let car = PeripheralMock(name: "name", services: [validService])
+    setUpAssociatedCar(id: id.uuidString, car: car)
+    userRoleCache.storeUserRole(.driver, for: id.uuidString)
+
+    let helper = reconnectionHelpers[car.identifier]!
+    helper.defersConfiguration = true
+
+    XCTAssertNoThrow(try communicationManager.setUpSecureChannel(with: car, id: nil))
+    establishSecureChannel(for: car, id: id)
+
+    XCTAssertEqual(delegate.establishedSecureChannelCount, 1)
+    XCTAssertNotNil(helper.configuredChannel)
+    XCTAssertEqual(delegate.securedCarChannel?.userRole, .driver)
+
+    helper.completeConfiguration()
+
+    // The delegate must not be notified a second time.
+    XCTAssertEqual(delegate.establishedSecureChannelCount, 1)
+    XCTAssertFalse(delegate.didEncounterErrorCalled)
+  }
+
+  func testEncryptionSetUp_speculative_configurationFailureNotifiesDelegate() {
+    makeSpeculativeCommunicationManager()
+
+    let id = makeRandomUUID()
+    let car = PeripheralMock(name: "name", services: [validService])
+    setUpAssociatedCar(id: id.uuidString, car: car)
+    userRoleCache.storeUserRole(.driver, for: id.uuidString)
+
+    let helper = reconnectionHelpers[car.identifier]!
+    helper.defersConfiguration = true
+    helper.configureSecureChannelShouldSucceed = false
+
+    XCTAssertNoThrow(try communicationManager.setUpSecureChannel(with: car, id: nil))
+    establishSecureChannel(for: car, id: id)
+    helper.completeConfiguration()
+
+    XCTAssertTrue(delegate.didEncounterErrorCalled)
+    XCTAssertEqual(delegate.error, .configureSecureChannelFailed)
+    XCTAssertEqual(delegate.peripheralWithError?.identifier, car.identifier)
+    XCTAssertEqual(userRoleCache.clearedCarIds, [id.uuidString])
+    XCTAssertNil(userRoleCache.userRole(for: id.uuidString))
+    XCTAssertTrue(communicationManager.reconnectingHandlers.isEmpty)
+  }
+
+  func testEncryptionSetUp_speculativeWithoutKnownRole_waitsForConfiguration() {
+    makeSpeculativeCommunicationManager()
+
+    let id = makeRandomUUID()
+    let car = PeripheralMock(name: "name", services: [validService])
+    setUpAssociatedCar(id: id.uuidString, car: car)
+
+    let helper = reconnectionHelpers[car.identifier]!
+    helper.defersConfiguration = true
+
+    XCTAssertNoThrow(try communicationManager.setUpSecureChannel(with: car, id: nil))
+    establishSecureChannel(for: car, id: id)
+
+    XCTAssertFalse(delegate.didEstablishSecureChannelCalled)
+
+    (helper.configuredChannel as? SecuredCarChannelMock)?.userRole = .driver
+    helper.completeConfiguration()
+
+    XCTAssertEqual(delegate.establishedSecureChannelCount, 1)
+  }
+
+  func testEncryptionSetUp_notSpeculativeByDefault() {
+    let id = makeRandomUUID()
+    let car = PeripheralMock(name: "name", services: [validService])
+    setUpAssociatedCar(id: id.uuidString, car: car)
+    userRoleCache.storeUserRole(.driver, for: id.uuidString)
+
+    let helper = reconnectionHelpers[car.identifier]!
+    helper.defersConfiguration = true
+
+    XCTAssertNoThrow(try communicationManager.setUpSecureChannel(with: car, id: nil))
+    establishSecureChannel(for: car, id: id)
+
+    XCTAssertFalse(communicationManager.isSpeculativeUnlockAllowed)
+    XCTAssertFalse(delegate.didEstablishSecureChannelCalled)
+
+    helper.completeConfiguration()
+
+    XCTAssertTrue(delegate.didEstablishSecureChannelCalled)
+  }
+
   func testMessageCompressionAllowedFalseInOverlay() {
     communicationManager = CommunicationManager(
       overlay: Overlay([CommunicationManager.messageCompressionAllowedKey: false]),
@@ -857,7 +1147,8 @@ class CommunicationManagerTest: XCTestCase {
       secureSessionManager: secureSessionManagerMock,
       secureBLEChannelFactory: self,
       bleVersionResolver: bleVersionResolver,
-      reconnectionHandlerFactory: reconnectionHandlerFactory)
+      reconnectionHandlerFactory: reconnectionHandlerFactory,
+      userRoleCache: userRoleCache)
 
     XCTAssertFalse(communicationManager.isMessageCompressionAllowed)
   }
@@ -871,7 +1162,8 @@ class CommunicationManagerTest: XCTestCase {
       secureSessionManager: secureSessionManagerMock,
       secureBLEChannelFactory: self,
       bleVersionResolver: bleVersionResolver,
-      reconnectionHandlerFactory: reconnectionHandlerFactory)
+      reconnectionHandlerFactory: reconnectionHandlerFactory,
+      userRoleCache: userRoleCache)
 
     XCTAssertTrue(communicationManager.isMessageCompressionAllowed)
   }
@@ -885,7 +1177,8 @@ class CommunicationManagerTest: XCTestCase {
       secureSessionManager: secureSessionManagerMock,
       secureBLEChannelFactory: self,
       bleVersionResolver: bleVersionResolver,
-      reconnectionHandlerFactory: reconnectionHandlerFactory)
+      reconnectionHandlerFactory: reconnectionHandlerFactory,
+      userRoleCache: userRoleCache)
 
     XCTAssertTrue(communicationManager.isMessageCompressionAllowed)
   }
@@ -980,6 +1273,21 @@ class CommunicationManagerTest: XCTestCase {
     return CBUUID(string: UUID().uuidString)
   }
 
+  /// Replaces `communicationManager` with one that allows speculative unlock.
+  private func makeSpeculativeCommunicationManager() {
+    communicationManager = CommunicationManager(
+      overlay: Overlay([CommunicationManager.speculativeUnlockAllowedKey: true]),
+      connectionHandle: connectionHandle,
+      uuidConfig: uuidConfig,
+      associatedCarsManager: associatedCarsManagerMock,
+      secureSessionManager: secureSessionManagerMock,
+      secureBLEChannelFactory: self,
+      bleVersionResolver: bleVersionResolver,
+      reconnectionHandlerFactory: reconnectionHandlerFactory,
+      userRoleCache: userRoleCache)
+    communicationManager.delegate = delegate
+  }
+
   private func establishSecureChannel(for car: PeripheralMock, id: CBUUID) {
     communicationManager.peripheral(car, didDiscoverServices: nil)
     communicationManager.peripheral(
@@ -1021,4 +1329,25 @@ extension CommunicationManagerTest: SecureBLEChannelFactory {
   func makeChannel() -> SecureBLEChannel {
     return SecureBLEChannelMock()
   }
+
+  func prewarmChannel(
+    for carId: String,
+    loadingSavedSession loadSavedSession: @escaping () -> Data?
+  ) {
+    prewarmedCarIds.append(carId)
+    savedSessionLoaders.append(loadSavedSession)
+  }
+
+  func evictPrewarmedChannel(for carId: String) {
+    evictedCarIds.append(carId)
+  }
+
+  func evictAllPrewarmedChannels() {
+    evictAllCount += 1
+  }
+
+  func makeChannel(for carId: String) -> SecureBLEChannel {
+    channelCarIds.append(carId)
+    return makeChannel()
+  }
 }
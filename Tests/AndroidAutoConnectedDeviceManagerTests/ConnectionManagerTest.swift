@@ -914,7 +914,8 @@ class ConnectionManagerTest: XCTestCase {
       secureSessionManager: SecureSessionManagerMock(),
       secureBLEChannelFactory: self,
       bleVersionResolver: BLEVersionResolverFake(),
-      reconnectionHandlerFactory: ReconnectionHandlerFactoryFake()
+      reconnectionHandlerFactory: ReconnectionHandlerFactoryFake(),
+      userRoleCache: UserRoleCacheFake()
     )
   }
 }
@@ -53,4 +53,192 @@ class DataExtensionsTest: XCTestCase {
     XCTAssertEqual(Data(hex: "A1B2C")!.hex, "0A1B2C")
     XCTAssertEqual(Data(hex: "A1B2C3")!.hex, "A1B2C3")
   }
+
+  func testEmptyHexString_nil() {
+    XCTAssertNil(Data(hex: ""))
+  }
+
+  func testHexStringWithNonHexCharacters_nil() {
+    XCTAssertNil(Data(hex: "1G"))
+    XCTAssertNil(Data(hex: "A1 B2"))
+    XCTAssertNil(Data(hex: "Ａ1"))
+  }
+
+  func testEmptyData_emptyHex() {
+    XCTAssertEqual(Data().hex, "")
+  }
+
+  func testHexRoundTrip_randomData() {
+    var generator = SplitMix64(seed: 0x5EED)
+    for _ in 0..<500 {
+      let data = generator.nextData()
+      let hex = data.hex
+
+      XCTAssertEqual(hex, referenceHex(data))
+      XCTAssertEqual(Data(hex: hex.lowercased()), data.isEmpty ? nil : data)
+    }
+  }
+
+  func testBase64URLEncoding_knownVectors() {
+    // Test vectors from RFC 4648 section 10.
+    let vectors = ["": "", "f": "Zg", "fo": "Zm8", "foo": "Zm9v", "foob": "Zm9vYg"]
+    for (plain, encoded) in vectors {
+      XCTAssertEqual(Data(plain.utf8).base64URLEncodedString(), encoded)
+      XCTAssertEqual(Data(base64URLEncoded: encoded), Data(plain.utf8))
+    }
+    XCTAssertEqual(Data("fooba".utf8).base64URLEncodedString(padded: true), "Zm9vYmE=")
+    XCTAssertEqual(Data([0xFB, 0xFF]).base64URLEncodedString(), "-_8")
+  }
+
+  func testBase64URLDecoding_acceptsBothAlphabetsPaddingAndWhitespace() {
+    let data = Data([0xFB, 0xFF, 0xBF])
+
+    XCTAssertEqual(Data(base64URLEncoded: "-_-_"), data)
+    XCTAssertEqual(Data(base64URLEncoded: "+/+/"), data)
+    XCTAssertEqual(Data(base64URLEncoded: "Zm8="), Data("fo".utf8))
+    XCTAssertEqual(Data(base64URLEncoded: "Zm9v\nYg=="), Data("foob".utf8))
+  }
+
+  func testBase64URLDecoding_rejectsInvalidInput() {
+    XCTAssertNil(Data(base64URLEncoded: "Zm9v!"))
+    XCTAssertNil(Data(base64URLEncoded: "Z"))
+    XCTAssertNil(Data(base64URLEncoded: "Zm9vY"))
+    XCTAssertNil(Data(base64URLEncoded: "Zg==Zg"))
+    XCTAssertNil(Data(base64URLEncoded: "Zm%39v"))
+  }
+
+  func testBase64URLRoundTrip_randomData() {
+    var generator = SplitMix64(seed: 0xBA5E64)
+    for _ in 0..<500 {
+      let data = generator.nextData()
+      let padded = data.base64URLEncodedString(padded: true)
+      let unpadded = data.base64URLEncodedString()
+
+      XCTAssertEqual(padded, referenceBase64URL(data))
+      XCTAssertEqual(unpadded, padded.trimmingCharacters(in: CharacterSet(charactersIn: "=")))
+      XCTAssertEqual(Data(base64URLEncoded: padded), data)
+      XCTAssertEqual(Data(base64URLEncoded: unpadded), data)
+      XCTAssertEqual(Data(base64URLEncoded: data.base64EncodedString()), data)
+    }
+  }
+
+  // MARK: - Benchmarks
+
+  func testHexEncodingPerformance_legacy() {
+    let data = benchmarkData()
+    measure {
+      for _ in 0..<100 {
+        _ = referenceHex(data)
+      }
+    }
+  }
+
+  func testHexEncodingPerformance() {
+    let data = benchmarkData()
+    measure {
+      for _ in 0..<100 {
+        _ = data.hex
+      }
+    }
+  }
+
+  func testHexDecodingPerformance_legacy() {
+    let hex = benchmarkData().hex
+    measure {
+      for _ in 0..<100 {
+        _ = referenceData(hex: hex)
+      }
+    }
+  }
+
+  func testHexDecodingPerformance() {
+    let hex = benchmarkData().hex
+    measure {
+      for _ in 0..<100 {
+        _ = Data(hex: hex)
+      }
+    }
+  }
+
+  func testBase64URLDecodingPerformance_legacy() {
+    let base64 = benchmarkData().base64URLEncodedString(padded: true)
+    measure {
+      for _ in 0..<100 {
+        let standardBase64 = base64.removingPercentEncoding!
+          .replacingOccurrences(of: "_", with: "/")
+          .replacingOccurrences(of: "-", with: "+")
+        _ = Data(base64Encoded: standardBase64, options: .ignoreUnknownCharacters)
+      }
+    }
+  }
+
+  func testBase64URLDecodingPerformance() {
+    let base64 = benchmarkData().base64URLEncodedString(padded: true)
+    measure {
+      for _ in 0..<100 {
+        _ = Data(base64URLEncoded: base64)
+      }
+    }
+  }
+
+  // MARK: - Helpers
+
+  private func benchmarkData() -> Data {
+    var generator = SplitMix64(seed: 0xBE7C)
+    return Data((0..<4_096).map { _ in UInt8(truncatingIfNeeded: generator.next()) })
+  }
+
+  /// The previous per-byte `String(_:radix:)` hex encoding.
+  private func referenceHex(_ data: Data) -> String {
+    data.map {
+      var digitPair = String($0, radix: 16, uppercase: true)
+      if digitPair.count == 1 {
+        digitPair = "0" + digitPair
+      }
+      return digitPair
+    }.joined()
+  }
+
+  /// The previous index-walking hex decoding, for even digit counts.
+  private func referenceData(hex: String) -> Data? {
+    var data = Data(capacity: hex.count / 2)
+    var currentIndex = hex.startIndex
+    while currentIndex != hex.endIndex {
+      let nextIndex = hex.index(currentIndex, offsetBy: 2)
+      guard let byte = UInt8(hex[currentIndex..<nextIndex], radix: 16) else { return nil }
+      data.append(byte)
+      currentIndex = nextIndex
+    }
+    return data
+  }
+
+  /// Foundation's base64 encoding mapped to the URL-safe alphabet.
+  private func referenceBase64URL(_ data: Data) -> String {
+    data.base64EncodedString()
+      .replacingOccurrences(of: "+", with: "-")
+      .replacingOccurrences(of: "/", with: "_")
+  }
+}
+
+/// Deterministic pseudo-random generator so that property tests are reproducible.
+private struct SplitMix64: RandomNumberGenerator {
+  private var state: UInt64
+
+  init(seed: UInt64) {
+    state = seed
+  }
+
+  mutating func next() -> UInt64 {
+    state &+= 0x9E37_79B9_7F4A_7C15
+    var z = state
+    z = (z ^ (z >> 30)) &* 0xBF58_476D_1CE4_E5B9
+    z = (z ^ (z >> 27)) &* 0x94D0_49BB_1331_11EB
+    return z ^ (z >> 31)
+  }
+
+  /// Random data of up to 64 bytes.
+  mutating func nextData() -> Data {
+    let count = Int.random(in: 0...64, using: &self)
+    return Data((0..<count).map { _ in UInt8.random(in: .min ... .max, using: &self) })
+  }
 }
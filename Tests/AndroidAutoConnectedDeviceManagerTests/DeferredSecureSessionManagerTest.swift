@@ -0,0 +1,215 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+import AndroidAutoConnectedDeviceManagerMocks
+import XCTest
+
+@testable import AndroidAutoConnectedDeviceManager
+
+#if canImport(UIKit)
+  import UIKit
+#endif
+
+/// Unit tests for DeferredSecureSessionManager.
+class DeferredSecureSessionManagerTest: XCTestCase {
+  private let carId = "carId"
+  private let session = Data("session".utf8)
+
+  private var storage: SecureSessionManagerMock!
+  private var queue: DispatchQueue!
+  private var notificationCenter: NotificationCenter!
+  private var manager: DeferredSecureSessionManager!
+
+  override func setUp() {
+    super.setUp()
+
+    storage = SecureSessionManagerMock()
+    queue = DispatchQueue(label: "DeferredSecureSessionManagerTest")
+    notificationCenter = NotificationCenter()
+    manager = DeferredSecureSessionManager(
+      storage: storage, queue: queue, notificationCenter: notificationCenter)
+  }
+
+  override func tearDown() {
+    manager = nil
+    notificationCenter = nil
+    queue = nil
+    storage = nil
+
+    super.tearDown()
+  }
+
+  func testRefresh_returnsBeforePersisting() {
+    queue.suspend()
+
+    XCTAssertTrue(manager.refreshSecureSession(session, for: carId))
+
+    XCTAssertEqual(storage.storeSecureSessionCallCount, 0)
+    XCTAssertEqual(manager.secureSession(for: carId), session)
+    XCTAssertTrue(manager.hasPendingWrites)
+
+    queue.resume()
+    manager.flush()
+
+    XCTAssertEqual(storage.secureSessions[carId], session)
+    XCTAssertFalse(manager.hasPendingWrites)
+  }
+
+  func testRepeatedRefreshes_areCoalesced() {
+    queue.suspend()
+
+    let latestSession = Data("latest".utf8)
+    _ = manager.refreshSecureSession(Data("first".utf8), for: carId)
+    _ = manager.refreshSecureSession(Data("second".utf8), for: carId)
+    _ = manager.refreshSecureSession(latestSession, for: carId)
+
+    queue.resume()
+    manager.flush()
+
+    XCTAssertEqual(storage.storeSecureSessionCallCount, 1)
+    XCTAssertEqual(storage.secureSessions[carId], latestSession)
+    XCTAssertEqual(manager.statistics.requestedWrites, 3)
+    XCTAssertEqual(manager.statistics.coalescedWrites, 2)
+    XCTAssertEqual(manager.statistics.completedWrites, 1)
+  }
+
+  func testRefreshesForDifferentCars_areNotCoalesced() {
+    queue.suspend()
+
+    _ = manager.refreshSecureSession(session, for: "car1")
+    _ = manager.refreshSecureSession(session, for: "car2")
+
+    queue.resume()
+    manager.flush()
+
+    XCTAssertEqual(storage.storeSecureSessionCallCount, 2)
+    XCTAssertEqual(storage.secureSessions["car1"], session)
+    XCTAssertEqual(storage.secureSessions["car2"], session)
+    XCTAssertEqual(manager.statistics.coalescedWrites, 0)
+  }
+
+  func testStore_persistsBeforeReturning() {
+    XCTAssertTrue(manager.storeSecureSession(session, for: carId))
+
+    XCTAssertEqual(storage.secureSessions[carId], session)
+    XCTAssertFalse(manager.hasPendingWrites)
+    XCTAssertEqual(manager.statistics.completedWrites, 1)
+  }
+
+  func testStore_reportsStorageFailure() {
+    storage.storeSecureSessionSucceeds = false
+
+    XCTAssertFalse(manager.storeSecureSession(session, for: carId))
+
+    XCTAssertNil(manager.secureSession(for: carId))
+    XCTAssertFalse(manager.hasPendingWrites)
+    XCTAssertEqual(manager.statistics.failedWrites, 1)
+  }
+
+  func testStore_supersedesFailedRefresh() {
+    storage.storeSecureSessionSucceeds = false
+    _ = manager.refreshSecureSession(Data("refreshed".utf8), for: carId)
+    queue.sync {}
+    XCTAssertTrue(manager.hasPendingWrites)
+
+    storage.storeSecureSessionSucceeds = true
+    XCTAssertTrue(manager.storeSecureSession(session, for: carId))
+    manager.flush()
+
+    XCTAssertFalse(manager.hasPendingWrites)
+    XCTAssertEqual(storage.secureSessions[carId], session)
+    XCTAssertEqual(manager.secureSession(for: carId), session)
+  }
+
+  func testSecureSession_readsThroughToStorageWhenNothingPending() {
+    storage.secureSessions[carId] = session
+
+    XCTAssertEqual(manager.secureSession(for: carId), session)
+  }
+
+  func testClear_supersedesPendingRefresh() {
+    storage.secureSessions[carId] = Data("old".utf8)
+    queue.suspend()
+
+    _ = manager.refreshSecureSession(session, for: carId)
+    manager.clearSecureSession(for: carId)
+
+    XCTAssertNil(manager.secureSession(for: carId))
+
+    queue.resume()
+    manager.flush()
+
+    XCTAssertEqual(storage.storeSecureSessionCallCount, 0)
+    XCTAssertNil(storage.secureSessions[carId])
+  }
+
+  func testFailedWrite_isServedFromMemoryAndRetriedOnFlush() {
+    storage.storeSecureSessionSucceeds = false
+
+    _ = manager.refreshSecureSession(session, for: carId)
+    manager.flush()
+
+    XCTAssertNil(storage.secureSessions[carId])
+    XCTAssertEqual(manager.secureSession(for: carId), session)
+    XCTAssertEqual(manager.statistics.failedWrites, 2)
+
+    storage.storeSecureSessionSucceeds = true
+    manager.flush()
+
+    XCTAssertEqual(storage.secureSessions[carId], session)
+    XCTAssertFalse(manager.hasPendingWrites)
+  }
+
+  func testFailedWrite_isRetriedWithoutFlush() {
+    manager = DeferredSecureSessionManager(
+      storage: storage, queue: queue, notificationCenter: notificationCenter,
+      initialRetryDelay: 0.01)
+    storage.storeSecureSessionSucceeds = false
+
+    _ = manager.refreshSecureSession(session, for: carId)
+    queue.sync {
+      XCTAssertEqual(manager.statistics.failedWrites, 1)
+      storage.storeSecureSessionSucceeds = true
+    }
+
+    let persisted = expectation(
+      for: NSPredicate { [unowned self] _, _ in !self.manager.hasPendingWrites },
+      evaluatedWith: nil)
+    wait(for: [persisted], timeout: 1)
+
+    XCTAssertEqual(queue.sync { storage.secureSessions[carId] }, session)
+    XCTAssertEqual(manager.statistics.completedWrites, 1)
+  }
+
+  func testRetryDelay_doublesUpToMaximum() {
+    XCTAssertEqual(manager.retryDelay(afterFailures: 1), 1)
+    XCTAssertEqual(manager.retryDelay(afterFailures: 2), 2)
+    XCTAssertEqual(manager.retryDelay(afterFailures: 4), 8)
+    XCTAssertEqual(
+      manager.retryDelay(afterFailures: 20), DeferredSecureSessionManager.maxRetryDelay)
+  }
+
+  #if os(iOS)
+    func testWillTerminate_flushesPendingWrites() {
+      queue.suspend()
+      _ = manager.refreshSecureSession(session, for: carId)
+      queue.resume()
+
+      notificationCenter.post(name: UIApplication.willTerminateNotification, object: nil)
+
+      XCTAssertEqual(storage.secureSessions[carId], session)
+      XCTAssertFalse(manager.hasPendingWrites)
+    }
+  #endif
+}
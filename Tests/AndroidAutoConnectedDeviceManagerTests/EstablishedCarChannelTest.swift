@@ -57,6 +57,41 @@ class EstablishedCarChannelTest: XCTestCase {
     XCTAssert(connectionHandle.disconnectedStream === messageStream)
   }
 
+  // MARK: - User role tests.
+
+  func testUpdateUserRole_setsRoleWithoutNotifying() {
+    var notifiedRoles: [UserRole] = []
+    _ = channel.observeUserRoleChange { _, userRole in notifiedRoles.append(userRole) }
+
+    channel.updateUserRole(.driver)
+
+    XCTAssertEqual(channel.userRole, .driver)
+    XCTAssertTrue(notifiedRoles.isEmpty)
+  }
+
+  func testUpdateUserRole_differentRoleNotifiesObservers() {
+    var notifiedRoles: [UserRole] = []
+    _ = channel.observeUserRoleChange { _, userRole in notifiedRoles.append(userRole) }
+
+    channel.updateUserRole(.driver)
+    channel.updateUserRole(.driver)
+    channel.updateUserRole(.passenger)
+
+    XCTAssertEqual(channel.userRole, .passenger)
+    XCTAssertEqual(notifiedRoles, [.passenger])
+  }
+
+  func testUpdateUserRole_cancelledObservationIsNotNotified() {
+    var notifiedRoles: [UserRole] = []
+    let handle = channel.observeUserRoleChange { _, userRole in notifiedRoles.append(userRole) }
+    handle.cancel()
+
+    channel.updateUserRole(.driver)
+    channel.updateUserRole(.passenger)
+
+    XCTAssertTrue(notifiedRoles.isEmpty)
+  }
+
   // MARK: - Write messages tests.
 
   func testWriteMessage_writesToStream() {
@@ -134,6 +169,37 @@ class EstablishedCarChannelTest: XCTestCase {
     }
   }
 
+  func testWriteMessage_succeeds_recordsSendStatistics() {
+    let recipient = UUID()
+    let message = Data("message".utf8)
+    try! channel.writeEncryptedMessage(message, to: recipient, completion: nil)
+
+    XCTAssertEqual(channel.sendStatistics(for: recipient).pendingMessageCount, 1)
+
+    channel.messageStreamDidWriteMessage(messageStream, to: recipient)
+
+    let statistics = channel.sendStatistics(for: recipient)
+    XCTAssertEqual(statistics.messageCount, 1)
+    XCTAssertEqual(statistics.byteCount, message.count)
+    XCTAssertEqual(statistics.pendingMessageCount, 0)
+  }
+
+  func testHandleDisconnection_failsPendingWrites() {
+    let recipient = UUID()
+    var results: [Bool] = []
+
+    for _ in 0..<3 {
+      try! channel.writeEncryptedMessage(Data("message".utf8), to: recipient) { success in
+        results.append(success)
+      }
+    }
+
+    channel.handleDisconnection()
+
+    XCTAssertEqual(results, [false, false, false])
+    XCTAssertEqual(channel.sendStatistics(for: recipient).pendingMessageCount, 0)
+  }
+
   // MARK: - Received message tests.
 
   func testReceivedMessage_ignoresUnknownOperationType() {
@@ -219,6 +285,33 @@ class EstablishedCarChannelTest: XCTestCase {
     }
   }
 
+  func testObserveReceivedMessage_withSpilledMessages_deliversInOrder() {
+    let recipient = UUID()
+    let params = MessageStreamParams(recipient: recipient, operationType: .clientMessage)
+
+    // Enough messages that some are spilled to disk.
+    let missedMessages = (0..<20).map { Data("missed\($0)".utf8) }
+    for message in missedMessages {
+      messageStream.triggerMessageReceived(message, params: params)
+    }
+
+    let allDelivered = expectation(description: "All messages delivered.")
+    let newMessage = Data("new".utf8)
+    var receivedMessages: [Data] = []
+    let _ = try! channel.observeMessageReceived(from: recipient) { _, message in
+      receivedMessages.append(message)
+      if receivedMessages.count == missedMessages.count + 1 {
+        allDelivered.fulfill()
+      }
+    }
+
+    // Received while the spilled messages are still being read.
+    messageStream.triggerMessageReceived(newMessage, params: params)
+
+    wait(for: [allDelivered], timeout: 1)
+    XCTAssertEqual(receivedMessages, missedMessages + [newMessage])
+  }
+
   func testObserveReceivedMessage_deliversMissedMessages_onlyOnce() {
     let receivedMessage = Data("Received message".utf8)
     let handlerNotCalledExpectation = expectation(description: "Completion handler called.")
@@ -385,6 +478,36 @@ class EstablishedCarChannelTest: XCTestCase {
     }
   }
 
+  func testQueryResponse_afterFailedQueryWrite_doesNotNotifyCompletionHandler() {
+    let handlerCalledExpectation = expectation(description: "Completion handler called.")
+    handlerCalledExpectation.isInverted = true
+
+    let queryID: Int32 = 4
+    channel.queryID = queryID
+
+    let recipient = UUID()
+    let query = Query(request: Data("request".utf8), parameters: nil)
+
+    try! channel.sendQuery(query, to: recipient) { _ in
+      handlerCalledExpectation.fulfill()
+    }
+
+    // Failing the write should remove the response handler for the query.
+    channel.handleDisconnection()
+
+    messageStream.triggerMessageReceived(
+      try! QueryResponse(id: queryID, isSuccessful: true, response: Data()).toProtoData(),
+      params: MessageStreamParams(recipient: recipient, operationType: .queryResponse)
+    )
+
+    // Waiting for 1 second because the message should notify immediately.
+    waitForExpectations(timeout: 1) { error in
+      if let error = error {
+        XCTFail("waitForExpectationsWithTimeout encountered error: \(error)")
+      }
+    }
+  }
+
   // MARK: - Query observations
 
   func testQueryObservation_throwsErrorIfMultipleObserversRegistered() {
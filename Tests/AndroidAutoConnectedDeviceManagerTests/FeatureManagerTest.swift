@@ -69,6 +69,28 @@ class FeatureManagerTest: XCTestCase {
     XCTAssertEqual(featureManager.carsWithSecuredChannels[0], car)
   }
 
+  func testSecureChannelEstablished_appliesSendPolicy() {
+    let car = Car(id: "id", name: "name")
+    let channel = SecuredCarChannelMock(car: car)
+
+    connectedCarManagerMock.triggerSecureChannelSetUp(with: channel)
+
+    XCTAssertEqual(channel.sendPolicies[Constants.featureID], .default)
+  }
+
+  func testSendStatistics_returnsStatisticsOfChannel() {
+    let car = Car(id: "id", name: "name")
+    let channel = SecuredCarChannelMock(car: car)
+    var statistics = FeatureSendStatistics()
+    statistics.messageCount = 3
+    channel.sendStatisticsByRecipient[Constants.featureID] = statistics
+
+    connectedCarManagerMock.triggerSecureChannelSetUp(with: channel)
+
+    XCTAssertEqual(featureManager.sendStatistics(for: car), statistics)
+    XCTAssertNil(featureManager.sendStatistics(for: Car(id: "other", name: "other")))
+  }
+
   func testCarDisassociated_invokesOnCarDisassociated() {
     let car = Car(id: "id", name: "name")
     connectedCarManagerMock.triggerDissociation(for: car)
@@ -77,6 +99,28 @@ class FeatureManagerTest: XCTestCase {
     XCTAssertEqual(featureManager.disassociatedCars[0], car)
   }
 
+  func testUserRoleChanged_invokesOnUserRoleChanged() {
+    let car = Car(id: "id", name: "name")
+    let channel = SecuredCarChannelMock(car: car)
+
+    connectedCarManagerMock.triggerSecureChannelSetUp(with: channel)
+    channel.triggerUserRoleChange(to: .passenger)
+
+    XCTAssertEqual(featureManager.changedUserRoles, [.passenger])
+    XCTAssertEqual(featureManager.carsWithChangedUserRoles, [car])
+  }
+
+  func testUserRoleChanged_afterDisconnection_doesNotInvokeCallback() {
+    let car = Car(id: "id", name: "name")
+    let channel = SecuredCarChannelMock(car: car)
+
+    connectedCarManagerMock.triggerSecureChannelSetUp(with: channel)
+    connectedCarManagerMock.triggerDisconnection(for: car)
+    channel.triggerUserRoleChange(to: .passenger)
+
+    XCTAssertTrue(featureManager.changedUserRoles.isEmpty)
+  }
+
   // MARK: - Message received tests.
 
   func testOnMessageReceived_invokesCallback() {
@@ -337,6 +381,204 @@ class FeatureManagerTest: XCTestCase {
     XCTAssertEqual(channel.writtenQueryResponses[0].queryResponse, expectedQueryResponse)
     XCTAssertEqual(channel.writtenQueryResponses[0].recipient, Constants.senderId)
   }
+
+  // MARK: - Execution context tests.
+
+  func testInlineContext_deliversMessagesSynchronously() {
+    let car = Car(id: "id", name: "name")
+    let channel = SecuredCarChannelMock(car: car)
+
+    connectedCarManagerMock.triggerSecureChannelSetUp(with: channel)
+    channel.triggerMessageReceived(Data("message".utf8), from: Constants.featureID)
+
+    XCTAssertEqual(featureManager.receivedMessages.count, 1)
+    XCTAssertEqual(featureManager.inboxMetrics.deliveredEventCount, 2)
+    XCTAssertEqual(featureManager.inboxMetrics.pendingEventCount, 0)
+  }
+
+  func testSerialQueueContext_deliversMessagesInOrderOffMainThread() {
+    let queuedFeatureManager = QueuedFeatureManager(connectedCarManager: connectedCarManagerMock)
+    let car = Car(id: "id", name: "name")
+    let channel = SecuredCarChannelMock(car: car)
+
+    connectedCarManagerMock.triggerSecureChannelSetUp(with: channel)
+    queuedFeatureManager.waitForPendingEvents()
+
+    let messages = [Data("first".utf8), Data("second".utf8)]
+    for message in messages {
+      channel.triggerMessageReceived(message, from: Constants.featureID)
+    }
+    queuedFeatureManager.waitForPendingEvents()
+
+    XCTAssertEqual(queuedFeatureManager.onSecureChannelEstablishedCalledCount, 1)
+    XCTAssertEqual(queuedFeatureManager.receivedMessages, messages)
+    XCTAssertEqual(queuedFeatureManager.messagesReceivedOnMainThread, [false, false])
+    XCTAssertEqual(queuedFeatureManager.inboxMetrics.deliveredEventCount, 3)
+    XCTAssertEqual(queuedFeatureManager.inboxMetrics.pendingEventCount, 0)
+  }
+
+  func testSerialQueueContext_dropsMessagesWhenInboxIsFull() {
+    let queuedFeatureManager = QueuedFeatureManager(connectedCarManager: connectedCarManagerMock)
+    let gate = DispatchSemaphore(value: 0)
+    queuedFeatureManager.messageGate = gate
+
+    let car = Car(id: "id", name: "name")
+    let channel = SecuredCarChannelMock(car: car)
+
+    connectedCarManagerMock.triggerSecureChannelSetUp(with: channel)
+    queuedFeatureManager.waitForPendingEvents()
+
+    // The first message occupies the feature until the gate is opened.
+    let messages = (1...4).map { Data("message\($0)".utf8) }
+    channel.triggerMessageReceived(messages[0], from: Constants.featureID)
+    queuedFeatureManager.messageStarted.wait()
+
+    for message in messages[1...] {
+      channel.triggerMessageReceived(message, from: Constants.featureID)
+    }
+
+    XCTAssertEqual(queuedFeatureManager.inboxMetrics.pendingEventCount, 2)
+
+    for _ in 0..<3 {
+      gate.signal()
+    }
+    queuedFeatureManager.waitForPendingEvents()
+
+    let metrics = queuedFeatureManager.inboxMetrics
+    XCTAssertEqual(queuedFeatureManager.receivedMessages, Array(messages[0...2]))
+    XCTAssertEqual(metrics.droppedEventCount, 1)
+    XCTAssertEqual(metrics.maxPendingEventCount, 2)
+    XCTAssertEqual(metrics.pendingEventCount, 0)
+    XCTAssertGreaterThan(metrics.maxDispatchLag, 0)
+  }
+
+  func testSerialQueueContext_rejectsQueriesWhenInboxIsFull() {
+    let queuedFeatureManager = QueuedFeatureManager(connectedCarManager: connectedCarManagerMock)
+    let gate = DispatchSemaphore(value: 0)
+    queuedFeatureManager.messageGate = gate
+
+    let car = Car(id: "id", name: "name")
+    let channel = SecuredCarChannelMock(car: car)
+
+    connectedCarManagerMock.triggerSecureChannelSetUp(with: channel)
+    queuedFeatureManager.waitForPendingEvents()
+
+    // The first message occupies the feature while two more fill its inbox.
+    channel.triggerMessageReceived(Data("first".utf8), from: Constants.featureID)
+    queuedFeatureManager.messageStarted.wait()
+    channel.triggerMessageReceived(Data("second".utf8), from: Constants.featureID)
+    channel.triggerMessageReceived(Data("third".utf8), from: Constants.featureID)
+
+    let queryID: Int32 = 7
+    channel.triggerQuery(
+      Query(request: Data("request".utf8), parameters: nil),
+      queryID: queryID,
+      sender: Constants.senderId,
+      recipient: Constants.featureID
+    )
+
+    XCTAssertEqual(channel.writtenQueryResponses.count, 1)
+    XCTAssertEqual(
+      channel.writtenQueryResponses[0].queryResponse,
+      QueryResponse(id: queryID, isSuccessful: false, response: Data()))
+    XCTAssertEqual(channel.writtenQueryResponses[0].recipient, Constants.senderId)
+
+    for _ in 0..<3 {
+      gate.signal()
+    }
+    queuedFeatureManager.waitForPendingEvents()
+
+    XCTAssertTrue(queuedFeatureManager.receivedQueries.isEmpty)
+    XCTAssertEqual(queuedFeatureManager.inboxMetrics.droppedEventCount, 1)
+  }
+
+  func testSerialQueueContext_sendMessageFromCallback_writesToSecureChannel() {
+    let queuedFeatureManager = QueuedFeatureManager(connectedCarManager: connectedCarManagerMock)
+    let car = Car(id: "id", name: "name")
+    let channel = SecuredCarChannelMock(car: car)
+
+    connectedCarManagerMock.triggerSecureChannelSetUp(with: channel)
+
+    let reply = Data("reply".utf8)
+    let expectation = XCTestExpectation(description: "Reply sent")
+    var completedOnMainThread = [Bool]()
+    queuedFeatureManager.messageHandler = { [unowned queuedFeatureManager] _, car in
+      XCTAssertNoThrow(
+        try queuedFeatureManager.sendMessage(reply, to: car) { success in
+          XCTAssertTrue(success)
+          completedOnMainThread.append(Thread.isMainThread)
+          expectation.fulfill()
+        })
+    }
+
+    channel.triggerMessageReceived(Data("message".utf8), from: Constants.featureID)
+
+    // The main thread blocks on the feature's queue while the reply is being sent.
+    queuedFeatureManager.waitForPendingEvents()
+    wait(for: [expectation], timeout: 1)
+
+    XCTAssertEqual(channel.writtenMessages, [reply])
+    XCTAssertEqual(completedOnMainThread, [false])
+  }
+
+  func testSerialQueueContext_sendMessageToNotSecuredCar_completesWithFailure() {
+    let queuedFeatureManager = QueuedFeatureManager(connectedCarManager: connectedCarManagerMock)
+    let car = Car(id: "id", name: "name")
+    let channel = SecuredCarChannelMock(car: car)
+    let notSecuredCar = Car(id: "otherId", name: "other")
+
+    connectedCarManagerMock.triggerSecureChannelSetUp(with: channel)
+
+    let expectation = XCTestExpectation(description: "Completion called")
+    var results = [Bool]()
+    queuedFeatureManager.messageHandler = { [unowned queuedFeatureManager] _, _ in
+      XCTAssertNoThrow(
+        try queuedFeatureManager.sendMessage(Data("reply".utf8), to: notSecuredCar) { success in
+          results.append(success)
+          expectation.fulfill()
+        })
+    }
+
+    channel.triggerMessageReceived(Data("message".utf8), from: Constants.featureID)
+    wait(for: [expectation], timeout: 1)
+    queuedFeatureManager.waitForPendingEvents()
+
+    XCTAssertEqual(results, [false])
+    XCTAssertTrue(channel.writtenMessages.isEmpty)
+  }
+
+  func testSerialQueueContext_queryResponse_isDeliveredOnFeatureQueue() {
+    let queuedFeatureManager = QueuedFeatureManager(connectedCarManager: connectedCarManagerMock)
+    let car = Car(id: "id", name: "name")
+    let channel = SecuredCarChannelMock(car: car)
+    channel.queryID = 5
+
+    connectedCarManagerMock.triggerSecureChannelSetUp(with: channel)
+
+    let querySent = XCTestExpectation(description: "Query sent")
+    let responseReceived = XCTestExpectation(description: "Response received")
+    var respondedOnMainThread = [Bool]()
+    queuedFeatureManager.messageHandler = { [unowned queuedFeatureManager] _, car in
+      XCTAssertNoThrow(
+        try queuedFeatureManager.sendQuery(
+          Query(request: Data("request".utf8), parameters: nil), to: car
+        ) { _ in
+          respondedOnMainThread.append(Thread.isMainThread)
+          responseReceived.fulfill()
+        })
+      // The query is written on the main thread, ahead of this block.
+      DispatchQueue.main.async { querySent.fulfill() }
+    }
+
+    channel.triggerMessageReceived(Data("message".utf8), from: Constants.featureID)
+    wait(for: [querySent], timeout: 1)
+
+    XCTAssertEqual(channel.writtenQueries.count, 1)
+    channel.triggerQueryResponse(QueryResponse(id: 5, isSuccessful: true, response: Data()))
+    wait(for: [responseReceived], timeout: 1)
+
+    XCTAssertEqual(respondedOnMainThread, [false])
+  }
 }
 
 /// A `FeatureManager` implementation that allows for assertions on its event methods.
@@ -358,6 +600,9 @@ private class ObservableFeatureManager: FeatureManager {
   var onCarDisassociatedCalledCount = 0
   var disassociatedCars = [Car]()
 
+  var changedUserRoles = [UserRole]()
+  var carsWithChangedUserRoles = [Car]()
+
   var receivedMessages = [Data]()
   var carsWithReceivedMessages = [Car]()
 
@@ -385,6 +630,11 @@ private class ObservableFeatureManager: FeatureManager {
     disassociatedCars.append(car)
   }
 
+  override func onUserRoleChanged(to userRole: UserRole, for car: Car) {
+    changedUserRoles.append(userRole)
+    carsWithChangedUserRoles.append(car)
+  }
+
   override func onMessageReceived(_ message: Data, from car: Car) {
     receivedMessages.append(message)
     carsWithReceivedMessages.append(car)
@@ -400,3 +650,31 @@ private class ObservableFeatureManager: FeatureManager {
     queryResponseHandlers.append(responseHandle)
   }
 }
+
+/// An `ObservableFeatureManager` that handles its events on a serial queue.
+@available(watchOS 6.0, *)
+private class QueuedFeatureManager: ObservableFeatureManager {
+  override var executionContext: FeatureExecutionContext {
+    return .serialQueue(maxPendingMessages: 2)
+  }
+
+  /// If set, each message waits for this semaphore to be signaled before it is recorded.
+  var messageGate: DispatchSemaphore?
+
+  /// Signaled each time the handling of a message starts.
+  let messageStarted = DispatchSemaphore(value: 0)
+
+  /// Invoked after each message has been recorded.
+  var messageHandler: ((Data, Car) -> Void)?
+
+  var messagesReceivedOnMainThread = [Bool]()
+
+  override func onMessageReceived(_ message: Data, from car: Car) {
+    messagesReceivedOnMainThread.append(Thread.isMainThread)
+    messageStarted.signal()
+    messageGate?.wait()
+
+    super.onMessageReceived(message, from: car)
+    messageHandler?(message, car)
+  }
+}
@@ -0,0 +1,267 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+import XCTest
+
+@testable import AndroidAutoConnectedDeviceManager
+
+/// Unit tests for `FeatureMessageMultiplexer`.
+class FeatureMessageMultiplexerTest: XCTestCase {
+  private let interactiveRecipient = UUID(uuidString: "c2337f28-18ba-4b04-a1f0-a1fb3ab2a0c0")!
+  private let bulkRecipient = UUID(uuidString: "7e796761-2422-4552-bb0d-97bb3fc1bcfa")!
+
+  private var currentTime: TimeInterval = 0
+  private var scheduledRetries: [(delay: TimeInterval, work: () -> Void)] = []
+  private var writtenMessages: [String] = []
+  private var multiplexer: FeatureMessageMultiplexer!
+
+  override func setUp() {
+    super.setUp()
+    continueAfterFailure = false
+
+    currentTime = 0
+    scheduledRetries = []
+    writtenMessages = []
+    multiplexer = makeMultiplexer(maxInFlightWrites: 1)
+  }
+
+  func testEnqueue_writesImmediatelyWhenIdle() throws {
+    try enqueue("first", to: interactiveRecipient)
+
+    XCTAssertEqual(writtenMessages, ["first"])
+  }
+
+  func testEnqueue_holdsWritesBeyondInFlightLimit() throws {
+    try enqueue("first", to: interactiveRecipient)
+    try enqueue("second", to: interactiveRecipient)
+
+    XCTAssertEqual(writtenMessages, ["first"])
+
+    multiplexer.completeWrite(isSuccessful: true)
+
+    XCTAssertEqual(writtenMessages, ["first", "second"])
+  }
+
+  func testCompleteWrite_notifiesCompletionsInOrder() throws {
+    multiplexer = makeMultiplexer(maxInFlightWrites: 2)
+    var completions: [String] = []
+
+    try enqueue("first", to: interactiveRecipient) { completions.append("first: \($0)") }
+    try enqueue("second", to: bulkRecipient) { completions.append("second: \($0)") }
+
+    multiplexer.completeWrite(isSuccessful: true)
+    multiplexer.completeWrite(isSuccessful: false)
+
+    XCTAssertEqual(completions, ["first: true", "second: false"])
+  }
+
+  func testBacklog_doesNotStarveOtherRecipients() throws {
+    try enqueue("bulk0", to: bulkRecipient)
+    for index in 1...5 {
+      try enqueue("bulk\(index)", to: bulkRecipient)
+    }
+    try enqueue("tap", to: interactiveRecipient)
+
+    completeAllWrites()
+
+    // The interactive message is written right after the one in flight instead of after the rest
+    // of the backlog.
+    XCTAssertEqual(writtenMessages.firstIndex(of: "tap"), 1)
+  }
+
+  func testWeights_shareBandwidthProportionally() throws {
+    multiplexer.setPolicy(FeatureSendPolicy(weight: 3), for: interactiveRecipient)
+
+    // Block the stream so that both backlogs are queued before scheduling starts.
+    try enqueue("blocker", to: UUID())
+    for index in 0..<8 {
+      try enqueue("bulk\(index)", to: bulkRecipient)
+      try enqueue("fast\(index)", to: interactiveRecipient)
+    }
+
+    completeAllWrites()
+
+    let firstEight = writtenMessages.dropFirst().prefix(8)
+    XCTAssertEqual(firstEight.filter { $0.hasPrefix("fast") }.count, 6)
+    XCTAssertEqual(firstEight.filter { $0.hasPrefix("bulk") }.count, 2)
+  }
+
+  func testRateLimit_throttlesUntilTokensRefill() throws {
+    multiplexer = makeMultiplexer(maxInFlightWrites: 4)
+    multiplexer.setPolicy(
+      FeatureSendPolicy(maxBytesPerSecond: 10, burstBytes: 10), for: bulkRecipient)
+
+    try enqueue("0123456789", to: bulkRecipient)
+    try enqueue("0123456789", to: bulkRecipient)
+
+    XCTAssertEqual(writtenMessages.count, 1)
+    XCTAssertEqual(scheduledRetries.count, 1)
+    XCTAssertEqual(scheduledRetries[0].delay, 1, accuracy: 0.001)
+    XCTAssertEqual(multiplexer.statistics(for: bulkRecipient).throttledMessageCount, 1)
+
+    currentTime = 1
+    scheduledRetries.removeFirst().work()
+
+    XCTAssertEqual(writtenMessages.count, 2)
+  }
+
+  func testRateLimit_countsEachThrottledMessageOnce() throws {
+    multiplexer = makeMultiplexer(maxInFlightWrites: 4)
+    multiplexer.setPolicy(
+      FeatureSendPolicy(maxBytesPerSecond: 10, burstBytes: 10), for: bulkRecipient)
+
+    try enqueue("0123456789", to: bulkRecipient)
+    try enqueue("0123456789", to: bulkRecipient)
+
+    // Further scheduling passes while the same message waits do not count it again.
+    try enqueue("tap", to: interactiveRecipient)
+    currentTime = 0.5
+    scheduledRetries.removeFirst().work()
+    multiplexer.completeWrite(isSuccessful: true)
+
+    XCTAssertEqual(multiplexer.statistics(for: bulkRecipient).throttledMessageCount, 1)
+
+    currentTime = 1
+    scheduledRetries.removeFirst().work()
+    try enqueue("0123456789", to: bulkRecipient)
+
+    XCTAssertEqual(writtenMessages.filter { $0 == "0123456789" }.count, 2)
+    XCTAssertEqual(multiplexer.statistics(for: bulkRecipient).throttledMessageCount, 2)
+  }
+
+  func testRateLimit_doesNotDelayOtherRecipients() throws {
+    multiplexer = makeMultiplexer(maxInFlightWrites: 4)
+    multiplexer.setPolicy(
+      FeatureSendPolicy(maxBytesPerSecond: 10, burstBytes: 10), for: bulkRecipient)
+
+    try enqueue("0123456789", to: bulkRecipient)
+    try enqueue("0123456789", to: bulkRecipient)
+    try enqueue("tap", to: interactiveRecipient)
+
+    XCTAssertEqual(writtenMessages, ["0123456789", "tap"])
+  }
+
+  func testEnqueue_immediateWriteError_isRethrown() {
+    var completionCalled = false
+
+    XCTAssertThrowsError(
+      try multiplexer.enqueue(
+        byteCount: 1,
+        to: interactiveRecipient,
+        write: { throw FakeError.writeFailed },
+        completion: { _ in completionCalled = true })
+    )
+
+    XCTAssertFalse(completionCalled)
+    XCTAssertEqual(multiplexer.statistics(for: interactiveRecipient).pendingMessageCount, 0)
+  }
+
+  func testQueuedWriteError_notifiesCompletion() throws {
+    var result: Bool?
+
+    try enqueue("first", to: interactiveRecipient)
+    try multiplexer.enqueue(
+      byteCount: 1,
+      to: bulkRecipient,
+      write: { throw FakeError.writeFailed },
+      completion: { result = $0 })
+
+    multiplexer.completeWrite(isSuccessful: true)
+
+    XCTAssertEqual(result, false)
+    XCTAssertEqual(multiplexer.statistics(for: bulkRecipient).failedMessageCount, 1)
+  }
+
+  func testCancelAll_failsQueuedAndInFlightWritesInOrder() throws {
+    var completions: [String] = []
+
+    try enqueue("first", to: interactiveRecipient) { completions.append("first: \($0)") }
+    try enqueue("second", to: bulkRecipient) { completions.append("second: \($0)") }
+    try enqueue("third", to: interactiveRecipient) { completions.append("third: \($0)") }
+
+    multiplexer.cancelAll()
+
+    XCTAssertEqual(completions, ["first: false", "second: false", "third: false"])
+    XCTAssertEqual(writtenMessages, ["first"])
+
+    let statistics = multiplexer.statistics(for: interactiveRecipient)
+    XCTAssertEqual(statistics.pendingMessageCount, 0)
+    XCTAssertEqual(statistics.failedMessageCount, 2)
+  }
+
+  func testCancelAll_allowsNewWrites() throws {
+    try enqueue("first", to: interactiveRecipient)
+    multiplexer.cancelAll()
+
+    try enqueue("second", to: interactiveRecipient)
+
+    XCTAssertEqual(writtenMessages, ["first", "second"])
+  }
+
+  func testStatistics_recordBytesAndLatency() throws {
+    try enqueue("first", to: interactiveRecipient)
+    try enqueue("second", to: interactiveRecipient)
+
+    XCTAssertEqual(multiplexer.statistics(for: interactiveRecipient).pendingMessageCount, 2)
+
+    currentTime = 0.5
+    multiplexer.completeWrite(isSuccessful: true)
+    currentTime = 1.5
+    multiplexer.completeWrite(isSuccessful: true)
+
+    let statistics = multiplexer.statistics(for: interactiveRecipient)
+    XCTAssertEqual(statistics.messageCount, 2)
+    XCTAssertEqual(statistics.byteCount, 11)
+    XCTAssertEqual(statistics.pendingMessageCount, 0)
+    XCTAssertEqual(statistics.lastLatency, 1.5, accuracy: 0.001)
+    XCTAssertEqual(statistics.maxLatency, 1.5, accuracy: 0.001)
+    XCTAssertEqual(statistics.averageLatency, 1, accuracy: 0.001)
+  }
+
+  // MARK: - Helpers
+
+  private enum FakeError: Error {
+    case writeFailed
+  }
+
+  private func makeMultiplexer(maxInFlightWrites: Int) -> FeatureMessageMultiplexer {
+    return FeatureMessageMultiplexer(
+      maxInFlightWrites: maxInFlightWrites,
+      now: { [unowned self] in self.currentTime },
+      scheduleRetry: { [unowned self] delay, work in
+        self.scheduledRetries.append((delay, work))
+      }
+    )
+  }
+
+  private func enqueue(
+    _ message: String,
+    to recipient: UUID,
+    completion: @escaping (Bool) -> Void = { _ in }
+  ) throws {
+    try multiplexer.enqueue(
+      byteCount: message.utf8.count,
+      to: recipient,
+      write: { [unowned self] in self.writtenMessages.append(message) },
+      completion: completion)
+  }
+
+  private func completeAllWrites() {
+    var previousCount = -1
+    while writtenMessages.count != previousCount {
+      previousCount = writtenMessages.count
+      multiplexer.completeWrite(isSuccessful: true)
+    }
+  }
+}
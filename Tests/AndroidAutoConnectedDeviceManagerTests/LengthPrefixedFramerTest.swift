@@ -0,0 +1,151 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+import XCTest
+
+@testable import AndroidAutoConnectedDeviceManager
+
+/// Unit tests for `LengthPrefixedFramer`.
+class LengthPrefixedFramerTest: XCTestCase {
+  func testRead_parsesSingleFrame() throws {
+    let framer = LengthPrefixedFramer<UInt32>()
+    let stream = ChunkedInputStream()
+    stream.deliver(frame(Data("token".utf8), prefix: UInt32.self))
+
+    let frames = try readFrames(with: framer, from: stream)
+
+    XCTAssertEqual(frames, [Data("token".utf8)])
+    XCTAssertEqual(framer.bufferedByteCount, 0)
+  }
+
+  func testRead_parsesMultipleFramesFromOneRead() throws {
+    let framer = LengthPrefixedFramer<UInt32>()
+    let stream = ChunkedInputStream()
+    stream.deliver(
+      frame(Data("first".utf8), prefix: UInt32.self) + frame(Data(), prefix: UInt32.self)
+        + frame(Data("third".utf8), prefix: UInt32.self))
+
+    let frames = try readFrames(with: framer, from: stream)
+
+    XCTAssertEqual(frames, [Data("first".utf8), Data(), Data("third".utf8)])
+  }
+
+  func testRead_waitsForRestOfSplitFrame() throws {
+    let framer = LengthPrefixedFramer<Int32>()
+    let stream = ChunkedInputStream()
+    let bytes = frame(Data("split token".utf8), prefix: Int32.self)
+
+    stream.deliver(bytes.prefix(2))
+    XCTAssertTrue(try readFrames(with: framer, from: stream).isEmpty)
+
+    stream.deliver(bytes.dropFirst(2).prefix(5))
+    XCTAssertTrue(try readFrames(with: framer, from: stream).isEmpty)
+
+    stream.deliver(bytes.dropFirst(7))
+    XCTAssertEqual(try readFrames(with: framer, from: stream), [Data("split token".utf8)])
+  }
+
+  func testRead_framesWrappingAroundBuffer() throws {
+    // Each frame is five bytes, so frames straddle the end of the eight byte buffer.
+    let framer = LengthPrefixedFramer<UInt16>(capacity: 8)
+    let stream = ChunkedInputStream()
+    let payloads = (0..<10).map { Data([$0, $0 &+ 1, $0 &+ 2]) }
+
+    var frames: [Data] = []
+    for payload in payloads {
+      stream.deliver(frame(payload, prefix: UInt16.self))
+      frames += try readFrames(with: framer, from: stream)
+    }
+
+    XCTAssertEqual(frames, payloads)
+  }
+
+  func testRead_negativeSize_throwsError() {
+    let framer = LengthPrefixedFramer<Int32>()
+    let stream = ChunkedInputStream()
+    stream.deliver(Data([0xFF, 0xFF, 0xFF, 0xFE]))
+
+    XCTAssertThrowsError(try readFrames(with: framer, from: stream)) { error in
+      XCTAssertEqual(error as? LengthPrefixedFramerError, .invalidFrameSize(-2))
+    }
+    XCTAssertEqual(framer.bufferedByteCount, 0)
+  }
+
+  func testRead_frameLargerThanBuffer_throwsError() {
+    let framer = LengthPrefixedFramer<UInt16>(capacity: 16)
+    let stream = ChunkedInputStream()
+    stream.deliver(Data([0x00, 0x20]))
+
+    XCTAssertThrowsError(try readFrames(with: framer, from: stream)) { error in
+      XCTAssertEqual(error as? LengthPrefixedFramerError, .frameTooLarge(32))
+    }
+  }
+
+  func testRead_fromPipe() throws {
+    let pipe = Pipe()
+    let payloads = [Data("first".utf8), Data("second".utf8)]
+    let bytes = payloads.map { frame($0, prefix: UInt32.self) }.reduce(Data(), +)
+    pipe.fileHandleForWriting.write(bytes)
+    pipe.fileHandleForWriting.closeFile()
+
+    let path = "/dev/fd/\(pipe.fileHandleForReading.fileDescriptor)"
+    let stream = try XCTUnwrap(InputStream(fileAtPath: path))
+    stream.open()
+    defer { stream.close() }
+
+    let frames = try readFrames(with: LengthPrefixedFramer<UInt32>(), from: stream)
+
+    XCTAssertEqual(frames, payloads)
+  }
+
+  // MARK: - Helpers
+
+  private func frame<SizeType: FixedWidthInteger>(_ payload: Data, prefix: SizeType.Type) -> Data {
+    var size = SizeType(payload.count).bigEndian
+    return Data(bytes: &size, count: MemoryLayout<SizeType>.size) + payload
+  }
+
+  private func readFrames<SizeType>(
+    with framer: LengthPrefixedFramer<SizeType>,
+    from stream: InputStream
+  ) throws -> [Data] {
+    var frames: [Data] = []
+    try framer.read(from: stream) { frames.append(Data($0)) }
+    return frames
+  }
+}
+
+/// An input stream whose bytes are delivered by the test.
+private final class ChunkedInputStream: InputStream {
+  private var available = Data()
+
+  init() {
+    super.init(data: Data())
+  }
+
+  func deliver<Bytes: Sequence>(_ bytes: Bytes) where Bytes.Element == UInt8 {
+    available.append(contentsOf: bytes)
+  }
+
+  override var hasBytesAvailable: Bool {
+    return !available.isEmpty
+  }
+
+  override func read(_ buffer: UnsafeMutablePointer<UInt8>, maxLength length: Int) -> Int {
+    let count = min(length, available.count)
+    available.copyBytes(to: buffer, count: count)
+    available.removeFirst(count)
+    return count
+  }
+}
@@ -0,0 +1,269 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+import XCTest
+
+@testable import AndroidAutoConnectedDeviceManager
+
+/// Unit tests for `MissedMessageBuffer`.
+class MissedMessageBufferTest: XCTestCase {
+  private let recipient = UUID(uuidString: "c2337f28-18ba-4b04-a1f0-a1fb3ab2a0c0")!
+  private let otherRecipient = UUID(uuidString: "7e796761-2422-4552-bb0d-97bb3fc1bcfa")!
+
+  private var directory: URL!
+  private var currentDate = Date(timeIntervalSinceReferenceDate: 0)
+  private var buffer: MissedMessageBuffer<Data>!
+
+  override func setUp() {
+    super.setUp()
+    continueAfterFailure = false
+
+    directory = FileManager.default.temporaryDirectory
+      .appendingPathComponent("MissedMessageBufferTest", isDirectory: true)
+      .appendingPathComponent(UUID().uuidString, isDirectory: true)
+    buffer = makeBuffer()
+  }
+
+  override func tearDown() {
+    buffer = nil
+    try? FileManager.default.removeItem(at: directory)
+
+    super.tearDown()
+  }
+
+  func testRemoveAll_returnsMessagesInOrder() {
+    let messages = makeMessages(count: 2)
+    messages.forEach { buffer.append($0, for: recipient) }
+
+    XCTAssertEqual(removeAll(for: recipient, from: buffer), messages)
+    XCTAssertEqual(buffer.metrics.inMemoryCount, 0)
+    XCTAssertEqual(buffer.metrics.deliveredCount, 2)
+  }
+
+  func testRemoveAll_onlyReturnsMessagesOnce() {
+    buffer.append(Data("message".utf8), for: recipient)
+
+    _ = removeAll(for: recipient, from: buffer)
+
+    XCTAssertTrue(removeAll(for: recipient, from: buffer).isEmpty)
+  }
+
+  func testRemoveAll_onlyReturnsMessagesForRecipient() {
+    buffer.append(Data("message".utf8), for: recipient)
+    buffer.append(Data("other".utf8), for: otherRecipient)
+
+    XCTAssertEqual(removeAll(for: recipient, from: buffer), [Data("message".utf8)])
+    XCTAssertEqual(buffer.metrics.inMemoryCount, 1)
+  }
+
+  func testAppend_beyondRecipientThreshold_spillsToDisk() {
+    let messages = makeMessages(count: 5)
+    messages.forEach { buffer.append($0, for: recipient) }
+
+    XCTAssertEqual(buffer.metrics.inMemoryCount, 2)
+    XCTAssertEqual(buffer.metrics.spilledCount, 3)
+    MissedMessageStorage.waitUntilIdle()
+    XCTAssertTrue(FileManager.default.fileExists(atPath: directory.path))
+
+    XCTAssertEqual(removeAll(for: recipient, from: buffer), messages)
+    XCTAssertEqual(buffer.metrics.spilledCount, 0)
+    XCTAssertEqual(buffer.metrics.totalSpilledCount, 3)
+  }
+
+  func testAppend_beyondTotalThreshold_spillsToDisk() {
+    buffer.append(Data("first".utf8), for: recipient)
+    buffer.append(Data("second".utf8), for: otherRecipient)
+    buffer.append(Data("third".utf8), for: UUID())
+
+    XCTAssertEqual(buffer.metrics.inMemoryCount, 2)
+    XCTAssertEqual(buffer.metrics.spilledCount, 1)
+  }
+
+  func testSpilledMessages_areEncrypted() throws {
+    let message = Data("a distinctive plaintext message".utf8)
+    for _ in 0..<3 {
+      buffer.append(message, for: recipient)
+    }
+
+    let recordURL = directory.appendingPathComponent(recipient.uuidString)
+      .appendingPathComponent("0")
+    MissedMessageStorage.waitUntilIdle()
+    let record = try Data(contentsOf: recordURL)
+
+    XCTAssertNil(record.range(of: message))
+  }
+
+  func testAppend_beyondSpillLimit_dropsMessages() {
+    makeMessages(count: 7).forEach { buffer.append($0, for: recipient) }
+
+    XCTAssertEqual(buffer.metrics.spilledCount, 4)
+    XCTAssertEqual(buffer.metrics.droppedCount, 1)
+    XCTAssertEqual(removeAll(for: recipient, from: buffer).count, 6)
+  }
+
+  func testExpiredMessages_areNotDelivered() {
+    makeMessages(count: 4).forEach { buffer.append($0, for: recipient) }
+
+    currentDate.addTimeInterval(61)
+
+    XCTAssertTrue(removeAll(for: recipient, from: buffer).isEmpty)
+    XCTAssertEqual(buffer.metrics.expiredCount, 4)
+  }
+
+  func testAppend_removesExpiredMessagesOfOtherRecipients() {
+    makeMessages(count: 4).forEach { buffer.append($0, for: otherRecipient) }
+
+    currentDate.addTimeInterval(61)
+    buffer.append(Data("message".utf8), for: recipient)
+
+    XCTAssertEqual(buffer.metrics.expiredCount, 4)
+    XCTAssertEqual(buffer.metrics.inMemoryCount, 1)
+    XCTAssertEqual(buffer.metrics.spilledCount, 0)
+    MissedMessageStorage.waitUntilIdle()
+    XCTAssertFalse(
+      FileManager.default.fileExists(
+        atPath: directory.appendingPathComponent(otherRecipient.uuidString).path))
+  }
+
+  func testQueries_roundTripThroughDisk() throws {
+    let sender = UUID(uuidString: "0497aec5-cd44-4f31-ae92-5d3356159aea")!
+    let queryBuffer = MissedMessageBuffer<(Int32, UUID, Query)>(
+      maxInMemoryCountPerRecipient: 0,
+      directory: directory,
+      encode: { id, sender, query in try query.toProtoData(queryID: id, sender: sender) },
+      decode: { data in
+        ReceivedQuery(serializedData: data).map { ($0.id, $0.sender, $0.query) }
+      }
+    )
+    let query = Query(request: Data("request".utf8), parameters: Data("parameters".utf8))
+
+    queryBuffer.append((7, sender, query), for: recipient)
+    let queries = removeAll(for: recipient, from: queryBuffer)
+
+    XCTAssertEqual(queryBuffer.metrics.totalSpilledCount, 1)
+    XCTAssertEqual(queries.count, 1)
+    XCTAssertEqual(queries[0].0, 7)
+    XCTAssertEqual(queries[0].1, sender)
+    XCTAssertEqual(queries[0].2, query)
+  }
+
+  func testDeinit_removesSpilledMessages() {
+    makeMessages(count: 3).forEach { buffer.append($0, for: recipient) }
+
+    buffer = nil
+    MissedMessageStorage.waitUntilIdle()
+
+    XCTAssertFalse(FileManager.default.fileExists(atPath: directory.path))
+  }
+
+  func testDeinit_afterDrainingRecipient_removesDirectory() {
+    makeMessages(count: 3).forEach { buffer.append($0, for: recipient) }
+    _ = removeAll(for: recipient, from: buffer)
+    MissedMessageStorage.waitUntilIdle()
+    XCTAssertTrue(FileManager.default.fileExists(atPath: directory.path))
+
+    buffer = nil
+    MissedMessageStorage.waitUntilIdle()
+
+    XCTAssertFalse(FileManager.default.fileExists(atPath: directory.path))
+  }
+
+  func testAppend_doesNotWaitForDisk() {
+    let gate = DispatchSemaphore(value: 0)
+    MissedMessageStorage.queue.async { gate.wait() }
+
+    makeMessages(count: 3).forEach { buffer.append($0, for: recipient) }
+    XCTAssertEqual(buffer.metrics.spilledCount, 1)
+    XCTAssertFalse(FileManager.default.fileExists(atPath: directory.path))
+
+    gate.signal()
+    XCTAssertEqual(removeAll(for: recipient, from: buffer), makeMessages(count: 3))
+  }
+
+  func testRemoveAll_withSpilledMessages_doesNotWaitForDisk() {
+    let messages = makeMessages(count: 3)
+    messages.forEach { buffer.append($0, for: recipient) }
+
+    let gate = DispatchSemaphore(value: 0)
+    MissedMessageStorage.queue.async { gate.wait() }
+
+    let removed = expectation(description: "Messages removed")
+    var removedMessages: [Data] = []
+    buffer.removeAll(for: recipient) { messages in
+      removedMessages = messages
+      removed.fulfill()
+    }
+    XCTAssertTrue(removedMessages.isEmpty)
+
+    // A message appended while the others are read is kept for the next removal.
+    buffer.append(Data("late".utf8), for: recipient)
+    XCTAssertTrue(buffer.containsMessages(for: recipient))
+
+    gate.signal()
+    wait(for: [removed], timeout: 1)
+
+    XCTAssertEqual(removedMessages, messages)
+    XCTAssertEqual(removeAll(for: recipient, from: buffer), [Data("late".utf8)])
+    XCTAssertFalse(buffer.containsMessages(for: recipient))
+  }
+
+  func testRemoveStaleDirectories_removesDirectoriesOfPreviousBuffers() throws {
+    let staleDirectory = directory.appendingPathComponent(UUID().uuidString)
+    try FileManager.default.createDirectory(
+      at: staleDirectory, withIntermediateDirectories: true)
+
+    MissedMessageStorage.queue.sync {
+      MissedMessageStorage.removeStaleDirectories(in: directory)
+    }
+
+    XCTAssertFalse(FileManager.default.fileExists(atPath: staleDirectory.path))
+    XCTAssertTrue(FileManager.default.fileExists(atPath: directory.path))
+  }
+
+  // MARK: - Helpers
+
+  private func makeBuffer() -> MissedMessageBuffer<Data> {
+    let buffer = MissedMessageBuffer<Data>(
+      maxInMemoryCountPerRecipient: 2,
+      maxInMemoryCount: 2,
+      maxSpilledCountPerRecipient: 4,
+      timeToLive: 60,
+      directory: directory,
+      encode: { $0 },
+      decode: { $0 }
+    )
+    buffer.now = { [unowned self] in self.currentDate }
+    return buffer
+  }
+
+  /// Removes the messages of the given recipient, waiting for any spilled ones to be read.
+  private func removeAll<Element>(
+    for recipient: UUID,
+    from buffer: MissedMessageBuffer<Element>
+  ) -> [Element] {
+    let removed = expectation(description: "Messages removed")
+    var elements: [Element] = []
+    buffer.removeAll(for: recipient) {
+      elements = $0
+      removed.fulfill()
+    }
+
+    wait(for: [removed], timeout: 1)
+    return elements
+  }
+
+  private func makeMessages(count: Int) -> [Data] {
+    return (0..<count).map { Data("message\($0)".utf8) }
+  }
+}
@@ -58,4 +58,21 @@ class OutOfBandAssociationDataSourceTest: XCTestCase {
     XCTAssertTrue(dataSource.token is OutOfBandAssociationToken)
     XCTAssertEqual(dataSource.token as! OutOfBandAssociationToken, token)
   }
+
+  func testExtractsOutOfBandDataFromUnpaddedURLSafeBase64() throws {
+    var outOfBandData = OutOfBandAssociationData()
+    outOfBandData.deviceIdentifier = Data(hex: "A1B2C3")!
+
+    let querySafeBase64 = try outOfBandData.serializedData().base64URLEncodedString()
+    let url = URL(string: "http://companion/associate?oobData=\(querySafeBase64)")
+
+    let dataSource = try OutOfBandAssociationDataSource(url!)
+
+    XCTAssertEqual(dataSource.deviceID.hex, "A1B2C3")
+  }
+
+  func testURLInvalidBase64Throws() {
+    let url = URL(string: "http://companion/associate?oobData=A")
+    XCTAssertThrowsError(try OutOfBandAssociationDataSource(url!))
+  }
 }
@@ -0,0 +1,182 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+import XCTest
+
+@testable import AndroidAutoConnectedDeviceManager
+
+/// Unit tests for PrefetchingOutOfBandTokenProvider.
+@available(watchOS 6.0, *)
+class PrefetchingOutOfBandTokenProviderTest: XCTestCase {
+  private var child: MockOutOfBandTokenProvider!
+  private var testTokenProvider: PrefetchingOutOfBandTokenProvider<MockOutOfBandTokenProvider>!
+
+  override func setUp() {
+    super.setUp()
+
+    child = MockOutOfBandTokenProvider()
+    testTokenProvider = PrefetchingOutOfBandTokenProvider(child)
+  }
+
+  override func tearDown() {
+    testTokenProvider = nil
+    child = nil
+
+    super.tearDown()
+  }
+
+  func testPrefetch_preparesAndRequestsToken() {
+    testTokenProvider.prefetchToken(for: nil)
+
+    XCTAssertTrue(child.prepareForRequestsCalled)
+    XCTAssertEqual(child.requestCount, 1)
+  }
+
+  func testRequestAfterPrefetchResolved_usesCachedToken() {
+    testTokenProvider.prefetchToken(for: nil)
+    child.postToken(FakeToken())
+
+    var token: OutOfBandToken?
+    testTokenProvider.requestToken { token = $0 }
+
+    XCTAssertNotNil(token)
+    XCTAssertEqual(child.requestCount, 1)
+    XCTAssertEqual(testTokenProvider.metrics.hitCount, 1)
+    XCTAssertEqual(testTokenProvider.metrics.lastWaitTime, 0)
+    XCTAssertNotNil(testTokenProvider.metrics.lastSavedTime)
+  }
+
+  func testRequestDuringPrefetch_waitsForPrefetchedToken() {
+    testTokenProvider.prefetchToken(for: nil)
+
+    var tokenCounter = 0
+    var token: OutOfBandToken?
+    testTokenProvider.requestToken {
+      token = $0
+      tokenCounter += 1
+    }
+    XCTAssertEqual(tokenCounter, 0)
+
+    child.postToken(FakeToken())
+
+    XCTAssertNotNil(token)
+    XCTAssertEqual(tokenCounter, 1)
+    XCTAssertEqual(child.requestCount, 1)
+    XCTAssertEqual(testTokenProvider.metrics.inFlightCount, 1)
+  }
+
+  func testRequestWithoutPrefetch_isForwarded() {
+    var token: OutOfBandToken?
+    testTokenProvider.requestToken { token = $0 }
+    child.postToken(FakeToken())
+
+    XCTAssertNotNil(token)
+    XCTAssertEqual(testTokenProvider.metrics.missCount, 1)
+  }
+
+  func testPrefetchWithoutToken_forwardsLaterRequest() {
+    testTokenProvider.prefetchToken(for: nil)
+    child.postToken(nil)
+
+    testTokenProvider.requestToken { _ in }
+
+    XCTAssertEqual(child.requestCount, 2)
+    XCTAssertEqual(testTokenProvider.metrics.missCount, 1)
+  }
+
+  func testPrefetchForSameSource_reusesToken() {
+    let source = NSObject()
+    testTokenProvider.prefetchToken(for: source)
+    child.postToken(FakeToken())
+
+    testTokenProvider.prefetchToken(for: source)
+
+    XCTAssertEqual(child.requestCount, 1)
+  }
+
+  func testPrefetchForDifferentSource_fetchesAgain() {
+    testTokenProvider.prefetchToken(for: NSObject())
+    child.postToken(FakeToken())
+
+    testTokenProvider.prefetchToken(for: NSObject())
+
+    XCTAssertEqual(child.requestCount, 2)
+  }
+
+  func testReset_resolvesWaitersAndDiscardsToken() {
+    testTokenProvider.prefetchToken(for: nil)
+
+    var tokenCounter = 0
+    testTokenProvider.requestToken { token in
+      XCTAssertNil(token)
+      tokenCounter += 1
+    }
+    testTokenProvider.reset()
+
+    XCTAssertEqual(tokenCounter, 1)
+    XCTAssertTrue(child.resetCalled)
+
+    testTokenProvider.requestToken { _ in }
+    XCTAssertEqual(testTokenProvider.metrics.missCount, 1)
+  }
+
+  func testCloseForRequests_discardsPrefetchedToken() {
+    testTokenProvider.prefetchToken(for: nil)
+    child.postToken(FakeToken())
+    testTokenProvider.requestToken { _ in }
+
+    testTokenProvider.closeForRequests()
+
+    XCTAssertTrue(child.closeForRequestsCalled)
+    testTokenProvider.requestToken { _ in }
+    XCTAssertEqual(child.requestCount, 2)
+    XCTAssertEqual(testTokenProvider.metrics.missCount, 1)
+  }
+
+  func testCloseForRequests_resolvesWaiters() {
+    testTokenProvider.prefetchToken(for: nil)
+
+    var tokenCounter = 0
+    testTokenProvider.requestToken { token in
+      XCTAssertNil(token)
+      tokenCounter += 1
+    }
+    testTokenProvider.closeForRequests()
+
+    XCTAssertEqual(tokenCounter, 1)
+  }
+
+  func testTwoAssociationsInARow_eachFetchesItsOwnToken() {
+    let source = NSObject()
+
+    for _ in 1...2 {
+      // Scan, then request at verification and close once the association completes.
+      testTokenProvider.prefetchToken(for: source)
+      child.postToken(FakeToken())
+      var token: OutOfBandToken?
+      testTokenProvider.requestToken { token = $0 }
+      XCTAssertNotNil(token)
+      testTokenProvider.closeForRequests()
+    }
+
+    XCTAssertEqual(child.requestCount, 2)
+    XCTAssertEqual(testTokenProvider.metrics.hitCount, 2)
+  }
+}
+
+/// Fake Out of Band token which returns messages unchanged.
+private struct FakeToken: OutOfBandToken {
+  func encrypt(_ message: Data) throws -> Data { message }
+  func decrypt(_ message: Data) throws -> Data { message }
+}
@@ -0,0 +1,79 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+import XCTest
+
+@testable import AndroidAutoConnectedDeviceManager
+
+/// Unit tests for `Query` and `ReceivedQuery`.
+@available(watchOS 6.0, *)
+class QueryTest: XCTestCase {
+  private let sender = UUID(uuidString: "0497aec5-cd44-4f31-ae92-5d3356159aea")!
+
+  // MARK: - ReceivedQuery tests.
+
+  func testReceivedQuery_parsesSerializedQuery() throws {
+    let query = Query(request: Data("request".utf8), parameters: Data("parameters".utf8))
+    let data = try query.toProtoData(queryID: 13, sender: sender)
+
+    let receivedQuery = try XCTUnwrap(ReceivedQuery(serializedData: data))
+
+    XCTAssertEqual(receivedQuery.id, 13)
+    XCTAssertEqual(receivedQuery.sender, sender)
+    XCTAssertEqual(receivedQuery.query, query)
+  }
+
+  func testReceivedQuery_withoutParameters_hasEmptyParameters() throws {
+    let query = Query(request: Data("request".utf8), parameters: nil)
+    let data = try query.toProtoData(queryID: 1, sender: sender)
+
+    let receivedQuery = try XCTUnwrap(ReceivedQuery(serializedData: data))
+
+    XCTAssertEqual(receivedQuery.query.request, Data("request".utf8))
+    XCTAssertEqual(receivedQuery.query.parameters, Data())
+  }
+
+  func testReceivedQuery_negativeID_isParsed() throws {
+    let query = Query(request: Data("request".utf8), parameters: nil)
+    let data = try query.toProtoData(queryID: -2, sender: sender)
+
+    XCTAssertEqual(ReceivedQuery(serializedData: data)?.id, -2)
+  }
+
+  func testReceivedQuery_skipsUnknownFields() throws {
+    let query = Query(request: Data("request".utf8), parameters: nil)
+    var data = try query.toProtoData(queryID: 1, sender: sender)
+
+    // Field 9 as a varint, field 10 as a fixed32 and field 11 as a length-delimited value.
+    data.append(contentsOf: [0x48, 0x96, 0x01])
+    data.append(contentsOf: [0x55, 0x01, 0x02, 0x03, 0x04])
+    data.append(contentsOf: [0x5A, 0x02, 0xAB, 0xCD])
+
+    let receivedQuery = try XCTUnwrap(ReceivedQuery(serializedData: data))
+
+    XCTAssertEqual(receivedQuery.query.request, Data("request".utf8))
+  }
+
+  func testReceivedQuery_truncatedData_returnsNil() throws {
+    let query = Query(request: Data("request".utf8), parameters: Data("parameters".utf8))
+    let data = try query.toProtoData(queryID: 1, sender: sender)
+
+    XCTAssertNil(ReceivedQuery(serializedData: data.dropLast()))
+  }
+
+  func testReceivedQuery_invalidWireType_returnsNil() {
+    // Field 1 with the deprecated start group wire type.
+    XCTAssertNil(ReceivedQuery(serializedData: Data([0x0B])))
+  }
+}
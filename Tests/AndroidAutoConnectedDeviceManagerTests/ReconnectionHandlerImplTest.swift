@@ -66,6 +66,7 @@ class ReconnectionHandlerImplTest: XCTestCase {
       secureSession: savedSession,
       messageStream: messageStream,
       secureBLEChannel: secureBLEChannelMock,
+      channelCapabilities: [.sessionRekey],
       secureSessionManager: secureSessionManagerMock
     )
   }
@@ -127,6 +128,18 @@ class ReconnectionHandlerImplTest: XCTestCase {
     XCTAssertEqual(delegate.establishedChannel!.car, expectedCar)
   }
 
+  func testEncryptionEstablished_negotiatesCapabilitiesBeforeNotifyingDelegate() {
+    let delegate = ReconnectionHandlerDelegateMock()
+    reconnectionHandler.delegate = delegate
+    secureBLEChannelMock.savedSessionShouldInstantlyNotify = true
+    secureSessionManagerMock.storeSecureSessionSucceeds = true
+
+    XCTAssertNoThrow(try reconnectionHandler.establishEncryption())
+
+    XCTAssertEqual(secureBLEChannelMock.negotiatedCapabilities, [[.sessionRekey]])
+    XCTAssertTrue(delegate.didEstablishSecureChannelCalled)
+  }
+
   func testEncryptionEstablished_encounteredError_notifiesDelegate() {
     let delegate = ReconnectionHandlerDelegateMock()
     reconnectionHandler.delegate = delegate
@@ -22,6 +22,10 @@ class TrustAgentConfigTest: XCTestCase {
   private let storage = UserDefaultsStorage.shared
   private let testCar = Car(id: "carId", name: "carName")
 
+  private var carConfigKey: String {
+    TrustAgentConfigUserDefaults.trustedDeviceConfigurationKeyPrefix + testCar.id
+  }
+
   override func setUp() {
     super.setUp()
     continueAfterFailure = false
@@ -60,27 +64,73 @@ class TrustAgentConfigTest: XCTestCase {
     config.setDeviceUnlockRequired(false, for: testCar)
     XCTAssertFalse(config.isDeviceUnlockRequired(for: testCar))
 
-    let savedConfig1 = storage.data(
-      forKey: TrustAgentConfigUserDefaults.trustedDeviceConfigurationKeyPrefix + testCar.id)
+    let savedConfig1 = storage.data(forKey: carConfigKey)
     XCTAssertNotNil(savedConfig1)
-    if let loadedConfig1 = try? JSONDecoder().decode(IndividualCarConfig.self, from: savedConfig1!)
-    {
-      let _ = TrustAgentConfigUserDefaults(plistLoader: PListLoaderFake())
-      XCTAssertFalse(loadedConfig1.isDeviceUnlockRequired)
-    }
+    XCTAssertEqual(IndividualCarConfig(serialized: savedConfig1!)?.isDeviceUnlockRequired, false)
 
     config.setDeviceUnlockRequired(true, for: testCar)
     XCTAssertTrue(config.isDeviceUnlockRequired(for: testCar))
-    let savedConfig2 = storage.data(
-      forKey: TrustAgentConfigUserDefaults.trustedDeviceConfigurationKeyPrefix + testCar.id)
+
+    let savedConfig2 = storage.data(forKey: carConfigKey)
     XCTAssertNotNil(savedConfig2)
-    if let loadedConfig2 = try? JSONDecoder().decode(IndividualCarConfig.self, from: savedConfig2!)
-    {
-      let _ = TrustAgentConfigUserDefaults(plistLoader: PListLoaderFake())
-      XCTAssertTrue(loadedConfig2.isDeviceUnlockRequired)
+    XCTAssertEqual(IndividualCarConfig(serialized: savedConfig2!)?.isDeviceUnlockRequired, true)
+  }
+
+  func testSetDeviceUnlockRequired_persistsAcrossInstances() {
+    TrustAgentConfigUserDefaults(plistLoader: PListLoaderFake())
+      .setDeviceUnlockRequired(false, for: testCar)
+
+    let config = TrustAgentConfigUserDefaults(plistLoader: PListLoaderFake())
+    XCTAssertFalse(config.isDeviceUnlockRequired(for: testCar))
+  }
+
+  func testIsDeviceUnlockRequired_migratesJSONConfig() {
+    var legacyConfig = IndividualCarConfig()
+    legacyConfig.isDeviceUnlockRequired = false
+    storage.set(try! JSONEncoder().encode(legacyConfig), forKey: carConfigKey)
+
+    let config = TrustAgentConfigUserDefaults(plistLoader: PListLoaderFake())
+    XCTAssertFalse(config.isDeviceUnlockRequired(for: testCar))
+
+    // The stored value should have been rewritten in the compact encoding.
+    let savedConfig = storage.data(forKey: carConfigKey)!
+    XCTAssertEqual(IndividualCarConfig(serialized: savedConfig)?.isDeviceUnlockRequired, false)
+  }
+
+  func testIsDeviceUnlockRequired_readsStorageOnce() {
+    let config = TrustAgentConfigUserDefaults(plistLoader: PListLoaderFake())
+    XCTAssertTrue(config.isDeviceUnlockRequired(for: testCar))
+
+    // Changes made outside of this instance are not seen once the value is cached.
+    var otherConfig = IndividualCarConfig()
+    otherConfig.isDeviceUnlockRequired = false
+    storage.set(otherConfig.serialized, forKey: carConfigKey)
+
+    XCTAssertTrue(config.isDeviceUnlockRequired(for: testCar))
+  }
+
+  func testIsDeviceUnlockRequired_invalidStoredValueReturnsDefault() {
+    storage.set(Data([0xFF]), forKey: carConfigKey)
+
+    let config = TrustAgentConfigUserDefaults(plistLoader: PListLoaderFake())
+    XCTAssertTrue(config.isDeviceUnlockRequired(for: testCar))
+  }
+
+  func testIndividualCarConfig_serializationRoundTrips() {
+    for isDeviceUnlockRequired in [true, false] {
+      var carConfig = IndividualCarConfig()
+      carConfig.isDeviceUnlockRequired = isDeviceUnlockRequired
+
+      let decoded = IndividualCarConfig(serialized: carConfig.serialized)
+      XCTAssertEqual(decoded?.isDeviceUnlockRequired, isDeviceUnlockRequired)
     }
   }
 
+  func testIndividualCarConfig_rejectsUnknownVersion() {
+    XCTAssertNil(IndividualCarConfig(serialized: Data([2, 0])))
+    XCTAssertNil(IndividualCarConfig(serialized: Data()))
+  }
+
   func testRemove_clearConfigurationForCar() {
     let config = TrustAgentConfigUserDefaults(plistLoader: PListLoaderFake())
     config.setDeviceUnlockRequired(true, for: testCar)
@@ -91,6 +141,16 @@ class TrustAgentConfigTest: XCTestCase {
     XCTAssertTrue(config.isDeviceUnlockRequired(for: testCar))
   }
 
+  func testClearConfig_resetsCachedValue() {
+    let config = TrustAgentConfigUserDefaults(plistLoader: PListLoaderFake())
+    config.setDeviceUnlockRequired(false, for: testCar)
+
+    config.clearConfig(for: testCar)
+
+    XCTAssertTrue(config.isDeviceUnlockRequired(for: testCar))
+    XCTAssertNil(storage.data(forKey: carConfigKey))
+  }
+
   func testUnlockHistoryEnabled_defaultIsTrue() {
     let config = TrustAgentConfigUserDefaults(plistLoader: PListLoaderFake())
     XCTAssertTrue(config.isUnlockHistoryEnabled)
@@ -0,0 +1,108 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+import XCTest
+
+@testable import AndroidAutoConnectedDeviceManager
+
+/// Unit tests for `UserDefaultsUserRoleCache`.
+class UserDefaultsUserRoleCacheTest: XCTestCase {
+  private static let suiteName = "UserDefaultsUserRoleCacheTest"
+
+  private let timeToLive: TimeInterval = 60
+
+  private var userDefaults: UserDefaults!
+  private var cache: UserDefaultsUserRoleCache!
+
+  override func setUp() {
+    super.setUp()
+    continueAfterFailure = false
+
+    userDefaults = UserDefaults(suiteName: Self.suiteName)
+    userDefaults.removePersistentDomain(forName: Self.suiteName)
+    cache = UserDefaultsUserRoleCache(userDefaults: userDefaults, timeToLive: timeToLive)
+  }
+
+  override func tearDown() {
+    userDefaults.removePersistentDomain(forName: Self.suiteName)
+    super.tearDown()
+  }
+
+  func testUserRole_noStoredRoleReturnsNil() {
+    XCTAssertNil(cache.userRole(for: "carId"))
+  }
+
+  func testStoreUserRole_roundTrips() {
+    cache.storeUserRole(.driver, for: "driverCar")
+    cache.storeUserRole(.passenger, for: "passengerCar")
+
+    XCTAssertEqual(cache.userRole(for: "driverCar"), .driver)
+    XCTAssertEqual(cache.userRole(for: "passengerCar"), .passenger)
+  }
+
+  func testStoreUserRole_persistsAcrossInstances() {
+    cache.storeUserRole(.passenger, for: "carId")
+
+    let otherCache = UserDefaultsUserRoleCache(userDefaults: userDefaults, timeToLive: timeToLive)
+    XCTAssertEqual(otherCache.userRole(for: "carId"), .passenger)
+  }
+
+  func testUserRole_expiresAfterTimeToLive() {
+    let storedDate = Date()
+    cache.now = { storedDate }
+    cache.storeUserRole(.driver, for: "carId")
+
+    cache.now = { storedDate + self.timeToLive - 1 }
+    XCTAssertEqual(cache.userRole(for: "carId"), .driver)
+
+    cache.now = { storedDate + self.timeToLive }
+    XCTAssertNil(cache.userRole(for: "carId"))
+
+    // The expired entry should have been removed.
+    cache.now = { storedDate }
+    XCTAssertNil(cache.userRole(for: "carId"))
+  }
+
+  func testStoreUserRole_refreshesTimeToLive() {
+    let storedDate = Date()
+    cache.now = { storedDate }
+    cache.storeUserRole(.driver, for: "carId")
+
+    cache.now = { storedDate + self.timeToLive - 1 }
+    cache.storeUserRole(.driver, for: "carId")
+
+    cache.now = { storedDate + self.timeToLive + 1 }
+    XCTAssertEqual(cache.userRole(for: "carId"), .driver)
+  }
+
+  func testClearUserRole_onlyClearsGivenCar() {
+    cache.storeUserRole(.driver, for: "carId")
+    cache.storeUserRole(.driver, for: "otherCarId")
+
+    cache.clearUserRole(for: "carId")
+
+    XCTAssertNil(cache.userRole(for: "carId"))
+    XCTAssertEqual(cache.userRole(for: "otherCarId"), .driver)
+  }
+
+  func testClearAllUserRoles() {
+    cache.storeUserRole(.driver, for: "carId")
+    cache.storeUserRole(.passenger, for: "otherCarId")
+
+    cache.clearAllUserRoles()
+
+    XCTAssertNil(cache.userRole(for: "carId"))
+    XCTAssertNil(cache.userRole(for: "otherCarId"))
+  }
+}
@@ -0,0 +1,41 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+import Foundation
+
+@testable import AndroidAutoConnectedDeviceManager
+
+/// An in-memory implementation of `UserRoleCache` that allows for verification of its contents.
+class UserRoleCacheFake: UserRoleCache {
+  var userRoles: [String: UserRole] = [:]
+  var clearedCarIds: [String] = []
+
+  func userRole(for carId: String) -> UserRole? {
+    return userRoles[carId]
+  }
+
+  func storeUserRole(_ userRole: UserRole, for carId: String) {
+    userRoles[carId] = userRole
+  }
+
+  func clearUserRole(for carId: String) {
+    clearedCarIds.append(carId)
+    userRoles.removeValue(forKey: carId)
+  }
+
+  func clearAllUserRoles() {
+    clearedCarIds.append(contentsOf: userRoles.keys)
+    userRoles.removeAll()
+  }
+}
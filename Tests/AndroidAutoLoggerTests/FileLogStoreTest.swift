@@ -0,0 +1,139 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+import XCTest
+
+@testable import AndroidAutoLogger
+
+/// Unit tests for `FileLogStore`.
+class FileLogStoreTest: XCTestCase {
+  /// Number of batches written by each benchmark iteration.
+  private static let benchmarkBatchCount = 50
+
+  /// Number of records in each benchmark batch.
+  private static let benchmarkBatchSize = 20
+
+  private let logger = Logger(for: FileLogStoreTest.self)
+
+  private var directory: String!
+
+  override func setUp() {
+    super.setUp()
+
+    directory = NSString.path(withComponents: [
+      NSTemporaryDirectory(), "FileLogStoreTest-\(UUID().uuidString)",
+    ])
+  }
+
+  override func tearDown() {
+    try? FileManager.default.removeItem(atPath: directory)
+
+    super.tearDown()
+  }
+
+  func testWriteRecords_producesJSONArray() throws {
+    let date = Date()
+    let store = try FileLogStore(directory: directory, date: date)
+
+    store.writeRecords(makeRecords(count: 3, date: date))
+    store.writeRecords(makeRecords(count: 2, date: date))
+
+    XCTAssertEqual(try readLogFile().count, 5)
+  }
+
+  func testWriteRecords_appendsToExistingFile() throws {
+    let date = Date()
+    let store = try FileLogStore(directory: directory, date: date)
+    store.writeRecords(makeRecords(count: 2, date: date))
+
+    let reopenedStore = try FileLogStore(directory: directory, date: date)
+    try reopenedStore.writeRecord(LoggingMockUtils.makeLogRecord(logger: logger, date: date))
+
+    XCTAssertEqual(try readLogFile().count, 3)
+  }
+
+  func testIsOpen_falseAfterFileIsDeleted() throws {
+    let store = try FileLogStore(directory: directory, date: Date())
+    XCTAssertTrue(store.isOpen)
+
+    try FileManager.default.removeItem(atPath: logFilePath())
+
+    XCTAssertFalse(store.isOpen)
+  }
+
+  func testPruneLogFiles_keepsRecentFiles() throws {
+    _ = try FileLogStore(directory: directory, date: Date())
+
+    FileLogStore.pruneLogFiles(in: directory)
+
+    XCTAssertTrue(FileManager.default.fileExists(atPath: try logFilePath()))
+  }
+
+  /// Benchmark of the previous write path, which made a store for every batch.
+  func testBatchWriteLatency_storePerBatch() {
+    let date = Date()
+    let batch = makeRecords(count: Self.benchmarkBatchSize, date: date)
+    let factory = FileLogStoreFactory()
+
+    measure {
+      for _ in 0..<Self.benchmarkBatchCount {
+        guard let store = try? factory.makeStore(directory: directory, date: date, carName: nil)
+        else {
+          XCTFail("Unable to make store.")
+          return
+        }
+        for record in batch {
+          try? store.writeRecord(record)
+        }
+      }
+    }
+  }
+
+  /// Benchmark of the current write path, which holds the store open across batches.
+  func testBatchWriteLatency_reusedStore() {
+    let date = Date()
+    let batch = makeRecords(count: Self.benchmarkBatchSize, date: date)
+    let writer = LogSerialWriter(
+      persistentStoreFactory: FileLogStoreFactory(),
+      directory: directory,
+      syncPolicy: .never
+    )
+
+    measure {
+      let writesExpectation = XCTestExpectation(description: "Batches Written")
+      Task {
+        for _ in 0..<Self.benchmarkBatchCount {
+          try? await writer.write(batch)
+        }
+        writesExpectation.fulfill()
+      }
+      wait(for: [writesExpectation], timeout: 10)
+    }
+  }
+
+  private func logFilePath() throws -> String {
+    let fileNames = try FileManager.default.contentsOfDirectory(atPath: directory)
+    XCTAssertEqual(fileNames.count, 1)
+    return NSString.path(withComponents: [directory, fileNames.first ?? ""])
+  }
+
+  private func readLogFile() throws -> [Any] {
+    let data = try Data(contentsOf: URL(fileURLWithPath: try logFilePath()))
+    return try XCTUnwrap(JSONSerialization.jsonObject(with: data) as? [Any])
+  }
+
+  private func makeRecords(count: Int, date: Date) -> [LogRecord] {
+    return (0..<count).map { _ in LoggingMockUtils.makeLogRecord(logger: logger, date: date) }
+  }
+}
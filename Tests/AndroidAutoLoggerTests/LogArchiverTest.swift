@@ -98,6 +98,49 @@ class LogArchiverTest: XCTestCase {
     )
   }
 
+  func testRecordsLeftInRingLog_areRestored() throws {
+    let path = NSString.path(withComponents: [
+      NSTemporaryDirectory(), "LogArchiverTest-\(UUID().uuidString).aaring",
+    ])
+    defer { try? FileManager.default.removeItem(atPath: path) }
+
+    let date = Date()
+    var ringLog = MappedRingLog(path: path)
+    ringLog?.append(makeLogRecord(logger: logger, date: date))
+    ringLog = nil
+
+    let writeRecordExpectation = XCTestExpectation(description: "Write Restored Record")
+    storeFactory.setWriteRecordExpectation(writeRecordExpectation, for: date)
+
+    let restoringRingLog = try XCTUnwrap(MappedRingLog(path: path))
+    archiver = LogArchiver(persistentStoreFactory: storeFactory, ringLog: restoringRingLog)
+
+    wait(for: [writeRecordExpectation], timeout: 2)
+  }
+
+  func testPersistedRecords_areMarkedInRingLog() throws {
+    let path = NSString.path(withComponents: [
+      NSTemporaryDirectory(), "LogArchiverTest-\(UUID().uuidString).aaring",
+    ])
+    defer { try? FileManager.default.removeItem(atPath: path) }
+
+    let ringLog = try XCTUnwrap(MappedRingLog(path: path))
+    archiver = LogArchiver(persistentStoreFactory: storeFactory, ringLog: ringLog)
+
+    let writeRecordExpectation = XCTestExpectation(description: "Write Record")
+    let date = Date()
+    storeFactory.setWriteRecordExpectation(writeRecordExpectation, for: date)
+
+    archiver.loggerDidRecordMessage(makeLogRecord(logger: logger, date: date))
+    XCTAssertEqual(ringLog.unpersistedRecords().records.count, 1)
+
+    wait(for: [writeRecordExpectation], timeout: 2)
+
+    let settledPredicate = NSPredicate { _, _ in ringLog.persistedSequence == 1 }
+    wait(for: [expectation(for: settledPredicate, evaluatedWith: nil)], timeout: 2)
+    XCTAssertTrue(ringLog.unpersistedRecords().records.isEmpty)
+  }
+
   /// Helper function to make a log record.
   private func makeLogRecord(logger: Logger, date: Date) -> LogRecord {
     return LogRecord(
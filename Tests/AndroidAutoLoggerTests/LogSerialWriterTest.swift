@@ -0,0 +1,128 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+import XCTest
+
+@testable import AndroidAutoLogger
+
+/// Unit tests for `LogSerialWriter`.
+class LogSerialWriterTest: XCTestCase {
+  private let logger = Logger(for: LogSerialWriterTest.self)
+
+  private var storeFactory: MockLogStoreFactory!
+
+  override func setUp() {
+    super.setUp()
+
+    storeFactory = MockLogStoreFactory()
+  }
+
+  func testBatchesForSameDay_reuseStore() async throws {
+    let writer = makeWriter(syncPolicy: .never)
+    let date = Date()
+
+    try await writer.write(makeRecords(count: 3, date: date))
+    try await writer.write(makeRecords(count: 4, date: date))
+
+    XCTAssertEqual(storeFactory.makeStoreCount, 1)
+    XCTAssertEqual(storeFactory.storeForDate(date)?.writtenRecordCount, 7)
+  }
+
+  func testBatchForNewDay_makesNewStore() async throws {
+    let writer = makeWriter(syncPolicy: .never)
+    let today = Date()
+    let tomorrow = today.addingTimeInterval(24 * 3_600)
+
+    let records = makeRecords(count: 2, date: today) + makeRecords(count: 3, date: tomorrow)
+    try await writer.write(records)
+
+    XCTAssertEqual(storeFactory.makeStoreCount, 2)
+    XCTAssertEqual(storeFactory.storeForDate(today)?.writtenRecordCount, 2)
+    XCTAssertEqual(storeFactory.storeForDate(tomorrow)?.writtenRecordCount, 3)
+  }
+
+  func testClosedStore_isReplaced() async throws {
+    let writer = makeWriter(syncPolicy: .never)
+    let date = Date()
+
+    try await writer.write(makeRecords(count: 1, date: date))
+    storeFactory.storeForDate(date)?.isOpen = false
+    try await writer.write(makeRecords(count: 1, date: date))
+
+    XCTAssertEqual(storeFactory.makeStoreCount, 2)
+    XCTAssertEqual(storeFactory.storeForDate(date)?.isOpen, true)
+  }
+
+  func testNewStore_schedulesPruning() async throws {
+    let pruneStoresExpectation = XCTestExpectation(description: "Prune Stores")
+    storeFactory.pruneStoresExpectation = pruneStoresExpectation
+    let writer = makeWriter(syncPolicy: .never)
+
+    try await writer.write(makeRecords(count: 1, date: Date()))
+
+    wait(for: [pruneStoresExpectation], timeout: 2)
+  }
+
+  func testSyncPolicyNever_doesNotSynchronize() async throws {
+    let writer = makeWriter(syncPolicy: .never)
+    let date = Date()
+
+    try await writer.write(makeRecords(count: 2, date: date))
+
+    XCTAssertEqual(storeFactory.storeForDate(date)?.synchronizeCount, 0)
+  }
+
+  func testSyncPolicyEveryBatch_synchronizesEachBatch() async throws {
+    let writer = makeWriter(syncPolicy: .everyBatch)
+    let date = Date()
+
+    try await writer.write(makeRecords(count: 2, date: date))
+    try await writer.write(makeRecords(count: 2, date: date))
+
+    XCTAssertEqual(storeFactory.storeForDate(date)?.synchronizeCount, 2)
+  }
+
+  func testSyncPolicyInterval_waitsForInterval() async throws {
+    let writer = makeWriter(syncPolicy: .interval(3_600))
+    let date = Date()
+
+    try await writer.write(makeRecords(count: 2, date: date))
+
+    XCTAssertEqual(storeFactory.storeForDate(date)?.synchronizeCount, 0)
+  }
+
+  func testReplacedStore_isSynchronizedBeforeRelease() async throws {
+    let writer = makeWriter(syncPolicy: .interval(3_600))
+    let today = Date()
+    let tomorrow = today.addingTimeInterval(24 * 3_600)
+
+    try await writer.write(makeRecords(count: 1, date: today))
+    try await writer.write(makeRecords(count: 1, date: tomorrow))
+
+    XCTAssertEqual(storeFactory.storeForDate(today)?.synchronizeCount, 1)
+    XCTAssertEqual(storeFactory.storeForDate(tomorrow)?.synchronizeCount, 0)
+  }
+
+  private func makeWriter(syncPolicy: LogSerialWriter.SyncPolicy) -> LogSerialWriter {
+    return LogSerialWriter(
+      persistentStoreFactory: storeFactory,
+      directory: NSTemporaryDirectory(),
+      syncPolicy: syncPolicy
+    )
+  }
+
+  private func makeRecords(count: Int, date: Date) -> [LogRecord] {
+    return (0..<count).map { _ in LoggingMockUtils.makeLogRecord(logger: logger, date: date) }
+  }
+}
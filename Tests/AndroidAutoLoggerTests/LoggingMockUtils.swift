@@ -14,6 +14,8 @@
 
 import Foundation
 
+@testable import AndroidAutoLogger
+
 /// Utils for logging mock.
 enum LoggingMockUtils {
   /// Get the date components for the given date which correspond to a day.
@@ -21,4 +23,23 @@ enum LoggingMockUtils {
     let calendar = Calendar(identifier: .gregorian)
     return calendar.dateComponents([.year, .month, .day], from: date)
   }
+
+  /// Make a log record with the specified date.
+  static func makeLogRecord(logger: Logger, date: Date, message: String = "Test") -> LogRecord {
+    return LogRecord(
+      logger: logger,
+      timestamp: date,
+      timezone: TimeZone.current,
+      processId: 0,
+      processName: "Test",
+      threadId: 0,
+      file: "Test",
+      line: 0,
+      function: "",
+      backTrace: nil,
+      message: message,
+      redactableMessage: nil,
+      metadata: nil
+    )
+  }
 }
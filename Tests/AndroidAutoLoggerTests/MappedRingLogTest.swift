@@ -0,0 +1,181 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+import XCTest
+
+@testable import AndroidAutoLogger
+
+/// Unit tests for `MappedRingLog`.
+class MappedRingLogTest: XCTestCase {
+  private let logger = Logger(for: MappedRingLogTest.self)
+
+  private var path: String!
+
+  override func setUp() {
+    super.setUp()
+
+    path = NSString.path(withComponents: [
+      NSTemporaryDirectory(), "MappedRingLogTest-\(UUID().uuidString).aaring",
+    ])
+  }
+
+  override func tearDown() {
+    try? FileManager.default.removeItem(atPath: path)
+
+    super.tearDown()
+  }
+
+  func testAppend_assignsIncreasingSequenceNumbers() throws {
+    let ringLog = try XCTUnwrap(MappedRingLog(path: path))
+
+    let first = ringLog.append(makeRecord(message: "first"))
+    let second = ringLog.append(makeRecord(message: "second"))
+
+    XCTAssertEqual(first, 1)
+    XCTAssertEqual(second, 2)
+  }
+
+  func testUnpersistedRecords_survivesReopening() throws {
+    var ringLog = MappedRingLog(path: path)
+    ringLog?.append(makeRecord(message: "first"))
+    ringLog?.append(makeRecord(message: "second"))
+    ringLog = nil
+
+    let reopenedRingLog = try XCTUnwrap(MappedRingLog(path: path))
+    let (records, lastSequence) = reopenedRingLog.unpersistedRecords()
+
+    XCTAssertEqual(records.map { $0.message }, ["first", "second"])
+    XCTAssertEqual(lastSequence, 2)
+  }
+
+  func testUnpersistedRecords_preservesFields() throws {
+    let ringLog = try XCTUnwrap(MappedRingLog(path: path))
+    let date = Date(timeIntervalSinceReferenceDate: 1_234.5)
+    let record = LogRecord(
+      logger: logger.error,
+      timestamp: date,
+      timezone: TimeZone(secondsFromGMT: -7 * 3_600)!,
+      processId: 42,
+      processName: "Process",
+      threadId: 7,
+      file: "File.swift",
+      line: 99,
+      function: "function()",
+      backTrace: ["frame0", "frame1"],
+      message: "Message",
+      redactableMessage: "Secret",
+      metadata: ["car": "Car", "count": 3, "unlocked": true, "ratio": 0.5, "ids": [1, 2]]
+    )
+
+    ringLog.append(record)
+    let restored = try XCTUnwrap(ringLog.unpersistedRecords().records.first)
+
+    XCTAssertEqual(restored.timestamp, date)
+    XCTAssertEqual(restored.timezone.secondsFromGMT(for: date), -7 * 3_600)
+    XCTAssertEqual(restored.level, .error)
+    XCTAssertEqual(restored.subsystem, logger.subsystem)
+    XCTAssertEqual(restored.category, logger.category)
+    XCTAssertEqual(restored.processId, 42)
+    XCTAssertEqual(restored.processName, "Process")
+    XCTAssertEqual(restored.threadId, 7)
+    XCTAssertEqual(restored.file, "File.swift")
+    XCTAssertEqual(restored.line, 99)
+    XCTAssertEqual(restored.function, "function()")
+    XCTAssertEqual(restored.backTrace, ["frame0", "frame1"])
+    XCTAssertEqual(restored.message, "Message")
+    XCTAssertNil(restored.redactableMessage)
+    XCTAssertEqual(restored.metadata?["car"] as? String, "Car")
+    XCTAssertEqual(restored.metadata?["count"] as? Int, 3)
+    XCTAssertEqual(restored.metadata?["unlocked"] as? Bool, true)
+    XCTAssertEqual(restored.metadata?["ratio"] as? Double, 0.5)
+    XCTAssertEqual(restored.metadata?["ids"] as? [Int], [1, 2])
+  }
+
+  func testMarkPersisted_excludesPersistedRecords() throws {
+    let ringLog = try XCTUnwrap(MappedRingLog(path: path))
+    ringLog.append(makeRecord(message: "first"))
+    let second = try XCTUnwrap(ringLog.append(makeRecord(message: "second")))
+    ringLog.append(makeRecord(message: "third"))
+
+    ringLog.markPersisted(through: second)
+
+    XCTAssertEqual(ringLog.unpersistedRecords().records.map { $0.message }, ["third"])
+    XCTAssertEqual(ringLog.persistedSequence, second)
+  }
+
+  func testMarkPersisted_neverMovesBackwards() throws {
+    let ringLog = try XCTUnwrap(MappedRingLog(path: path))
+    ringLog.append(makeRecord(message: "first"))
+    ringLog.append(makeRecord(message: "second"))
+
+    ringLog.markPersisted(through: 2)
+    ringLog.markPersisted(through: 1)
+
+    XCTAssertEqual(ringLog.persistedSequence, 2)
+  }
+
+  func testFullRing_overwritesOldestRecords() throws {
+    let ringLog = try XCTUnwrap(MappedRingLog(path: path, capacity: 1_024))
+
+    for index in 0..<100 {
+      ringLog.append(makeRecord(message: "\(index)"))
+    }
+    let messages = ringLog.unpersistedRecords().records.map { $0.message }
+
+    XCTAssertFalse(messages.isEmpty)
+    XCTAssertLessThan(messages.count, 100)
+    XCTAssertEqual(messages.last, "99")
+    // The surviving records are the newest ones, in order.
+    let expectedMessages = (100 - messages.count..<100).map { "\($0)" }
+    XCTAssertEqual(messages, expectedMessages)
+  }
+
+  func testOversizedRecord_isNotAppended() throws {
+    let ringLog = try XCTUnwrap(MappedRingLog(path: path, capacity: 256))
+
+    let sequence = ringLog.append(makeRecord(message: String(repeating: "x", count: 512)))
+
+    XCTAssertNil(sequence)
+    XCTAssertTrue(ringLog.unpersistedRecords().records.isEmpty)
+  }
+
+  func testDifferentCapacity_resetsRing() throws {
+    var ringLog = MappedRingLog(path: path, capacity: 1_024)
+    ringLog?.append(makeRecord(message: "first"))
+    ringLog = nil
+
+    let resizedRingLog = try XCTUnwrap(MappedRingLog(path: path, capacity: 2_048))
+
+    XCTAssertTrue(resizedRingLog.unpersistedRecords().records.isEmpty)
+  }
+
+  func testCorruptHeader_resetsRing() throws {
+    var ringLog = MappedRingLog(path: path)
+    ringLog?.append(makeRecord(message: "first"))
+    ringLog = nil
+
+    let fileHandle = try XCTUnwrap(FileHandle(forWritingAtPath: path))
+    fileHandle.write(Data(repeating: 0xFF, count: 64))
+    fileHandle.closeFile()
+
+    let reopenedRingLog = try XCTUnwrap(MappedRingLog(path: path))
+
+    XCTAssertTrue(reopenedRingLog.unpersistedRecords().records.isEmpty)
+    XCTAssertEqual(reopenedRingLog.append(makeRecord(message: "second")), 1)
+  }
+
+  private func makeRecord(message: String) -> LogRecord {
+    return LoggingMockUtils.makeLogRecord(logger: logger, date: Date(), message: message)
+  }
+}
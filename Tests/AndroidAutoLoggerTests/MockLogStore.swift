@@ -22,6 +22,15 @@ public class MockLogStore: PersistentLogStore {
 
   public let date: Date
 
+  /// Whether the store reports that it can still write to its backing storage.
+  public var isOpen = true
+
+  /// The number of records written to this store.
+  public var writtenRecordCount = 0
+
+  /// The number of times this store has been synchronized.
+  public var synchronizeCount = 0
+
   public init(date: Date) {
     self.date = date
   }
@@ -39,6 +48,7 @@ public class MockLogStore: PersistentLogStore {
   ///
   /// - Parameter record: The log record to append.
   public func writeRecord(_ record: LogRecord) {
+    writtenRecordCount += 1
     writeRecordExpectation?.fulfill()
   }
 
@@ -48,4 +58,9 @@ public class MockLogStore: PersistentLogStore {
   public func appendData(_ data: Data) {
     appendDataExpectation?.fulfill()
   }
+
+  /// Record that the store was synchronized.
+  public func synchronize() {
+    synchronizeCount += 1
+  }
 }
@@ -18,6 +18,10 @@ import XCTest
 /// Mock `PersistentLogStoreFactory`
 public class MockLogStoreFactory: PersistentLogStoreFactory {
   public var makeStoreExpectation: XCTestExpectation?
+  public var pruneStoresExpectation: XCTestExpectation?
+
+  /// The number of stores that have been made.
+  public var makeStoreCount = 0
 
   public var appendDataStore: MockLogStore?
   public var appendDataExpectation: XCTestExpectation?
@@ -45,11 +49,16 @@ public class MockLogStoreFactory: PersistentLogStoreFactory {
       }
     }
 
+    makeStoreCount += 1
     makeStoreExpectation?.fulfill()
 
     return store
   }
 
+  public func pruneStores(directory: String) {
+    pruneStoresExpectation?.fulfill()
+  }
+
   public func storeForDate(_ date: Date) -> MockLogStore? {
     let dayComponents = LoggingMockUtils.dayComponentsForDate(date)
     return stores[dayComponents]
@@ -0,0 +1,118 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+import AndroidAutoCoreBluetoothProtocols
+import AndroidAutoCoreBluetoothProtocolsMocks
+import CoreBluetooth
+import XCTest
+
+@testable import AndroidAutoMessageStream
+
+/// Unit tests for `BLEMessageStreamPassthrough`.
+class BLEMessageStreamPassthroughTest: XCTestCase {
+  private let peripheralMock = PeripheralMock(name: "fake")
+  private let readCharacteristic = CharacteristicMock(uuid: CBUUID(string: "bad1"), value: nil)
+  private let writeCharacteristic = CharacteristicMock(uuid: CBUUID(string: "bad2"), value: nil)
+
+  private var delegate: MessageStreamDelegateMock!
+  private var messageStream: BLEMessageStreamPassthrough!
+
+  override func setUp() {
+    super.setUp()
+    continueAfterFailure = false
+
+    peripheralMock.reset()
+
+    messageStream = BLEMessageStreamPassthrough(
+      peripheral: peripheralMock,
+      readCharacteristic: readCharacteristic,
+      writeCharacteristic: writeCharacteristic,
+      maxPendingWrites: 3
+    )
+
+    delegate = MessageStreamDelegateMock()
+    messageStream.delegate = delegate
+  }
+
+  func testWriteMessage_writesImmediatelyWhenIdle() throws {
+    let message = Data("message".utf8)
+
+    try messageStream.writeMessage(message, params: makeParams())
+
+    XCTAssertEqual(peripheralMock.writeValueCalledCount, 1)
+    XCTAssertEqual(peripheralMock.writtenData, [message])
+    XCTAssert(peripheralMock.characteristicWrittenTo[0] === writeCharacteristic)
+  }
+
+  func testWriteMessage_waitsForReadyToWriteBeforeNextWrite() throws {
+    let first = Data("first".utf8)
+    let second = Data("second".utf8)
+
+    try messageStream.writeMessage(first, params: makeParams())
+    try messageStream.writeMessage(second, params: makeParams())
+
+    XCTAssertEqual(peripheralMock.writtenData, [first])
+    XCTAssertEqual(messageStream.pendingWriteCount, 2)
+
+    messageStream.peripheralIsReadyToWrite(peripheralMock)
+
+    XCTAssertEqual(peripheralMock.writtenData, [first, second])
+    XCTAssertEqual(messageStream.pendingWriteCount, 1)
+  }
+
+  func testReadyToWrite_attributesCompletionToRecipientOfWrite() throws {
+    let firstRecipient = UUID()
+    let secondRecipient = UUID()
+
+    try messageStream.writeMessage(
+      Data("first".utf8), params: makeParams(recipient: firstRecipient))
+    try messageStream.writeEncryptedMessage(
+      Data("second".utf8), params: makeParams(recipient: secondRecipient))
+
+    messageStream.peripheralIsReadyToWrite(peripheralMock)
+    messageStream.peripheralIsReadyToWrite(peripheralMock)
+
+    XCTAssertEqual(delegate.writtenMessageRecipients, [firstRecipient, secondRecipient])
+    XCTAssertEqual(messageStream.pendingWriteCount, 0)
+  }
+
+  func testReadyToWrite_withoutPendingWriteDoesNotNotifyDelegate() {
+    messageStream.peripheralIsReadyToWrite(peripheralMock)
+
+    XCTAssertEqual(delegate.didWriteMessageCalledCount, 0)
+  }
+
+  func testWriteMessage_throwsWhenQueueFull() throws {
+    for _ in 0..<messageStream.maxPendingWrites {
+      try messageStream.writeMessage(Data("message".utf8), params: makeParams())
+    }
+
+    XCTAssertThrowsError(
+      try messageStream.writeMessage(Data("overflow".utf8), params: makeParams())
+    ) { error in
+      XCTAssertEqual(
+        error as? BLEMessageStreamPassthroughError, BLEMessageStreamPassthroughError.writeQueueFull)
+    }
+
+    // Draining a write frees up space in the queue.
+    messageStream.peripheralIsReadyToWrite(peripheralMock)
+    XCTAssertNoThrow(try messageStream.writeMessage(Data("message".utf8), params: makeParams()))
+  }
+
+  // MARK: - Helper functions
+
+  private func makeParams(recipient: UUID = UUID()) -> MessageStreamParams {
+    return MessageStreamParams(recipient: recipient, operationType: .clientMessage)
+  }
+}
@@ -95,6 +95,74 @@ class BLEVersionResolverImplTest: XCTestCase {
     XCTAssertEqual(versionProto.minSupportedMessagingVersion, 2)
     XCTAssertEqual(versionProto.maxSupportedSecurityVersion, 4)
     XCTAssertEqual(versionProto.minSupportedSecurityVersion, 1)
+    XCTAssertEqual(versionProto.supportedChannelCapabilities, 0)
+  }
+
+  func testVersionResolver_compactFramingAllowed_offersMessagingVersionFour() {
+    bleVersionResolver.isCompactFramingAllowed = true
+
+    bleVersionResolver.resolveVersion(
+      with: peripheralMock,
+      readCharacteristic: readCharacteristic,
+      writeCharacteristic: writeCharacteristic,
+      allowsCapabilitiesExchange: false
+    )
+
+    let versionProto = try! VersionExchange(serializedData: peripheralMock.writtenData[0])
+    XCTAssertEqual(versionProto.maxSupportedMessagingVersion, 4)
+  }
+
+  func testVersionResolver_listsChannelCapabilities() {
+    bleVersionResolver.channelCapabilities = 0b11
+
+    bleVersionResolver.resolveVersion(
+      with: peripheralMock,
+      readCharacteristic: readCharacteristic,
+      writeCharacteristic: writeCharacteristic,
+      allowsCapabilitiesExchange: false
+    )
+
+    let versionProto = try! VersionExchange(serializedData: peripheralMock.writtenData[0])
+    XCTAssertEqual(versionProto.supportedChannelCapabilities, 0b11)
+  }
+
+  func testResolveVersion_reportsChannelCapabilitiesOfCar() {
+    bleVersionResolver.channelCapabilities = 0b11
+    bleVersionResolver.isCompactFramingAllowed = true
+
+    bleVersionResolver.resolveVersion(
+      with: peripheralMock,
+      readCharacteristic: readCharacteristic,
+      writeCharacteristic: writeCharacteristic,
+      allowsCapabilitiesExchange: false
+    )
+
+    var versionExchange = VersionExchange()
+    versionExchange.maxSupportedMessagingVersion = 4
+    versionExchange.minSupportedMessagingVersion = 2
+    versionExchange.maxSupportedSecurityVersion = 4
+    versionExchange.minSupportedSecurityVersion = 4
+    versionExchange.supportedChannelCapabilities = 0b01
+    notify(from: peripheralMock, withValue: try! versionExchange.serializedData())
+
+    XCTAssertEqual(delegateMock.resolvedStreamVersion, .v3)
+    XCTAssertEqual(delegateMock.resolvedChannelCapabilities, 0b01)
+  }
+
+  func testResolveVersion_carWithoutCapabilitiesReportsNone() {
+    bleVersionResolver.channelCapabilities = 0b11
+
+    bleVersionResolver.resolveVersion(
+      with: peripheralMock,
+      readCharacteristic: readCharacteristic,
+      writeCharacteristic: writeCharacteristic,
+      allowsCapabilitiesExchange: false
+    )
+
+    let versionExchangeProto = makeVersionExchangeProto(messagingVersion: 2, securityVersion: 1)
+    notify(from: peripheralMock, withValue: versionExchangeProto)
+
+    XCTAssertEqual(delegateMock.resolvedChannelCapabilities, 0)
   }
 
   // MARK: - Valid version resolution tests.
@@ -142,6 +210,53 @@ class BLEVersionResolverImplTest: XCTestCase {
     XCTAssertNil(delegateMock.encounteredError)
   }
 
+  func testResolveVersion_correctlyResolvesStreamVersionToThree() {
+    bleVersionResolver.isCompactFramingAllowed = true
+
+    bleVersionResolver.resolveVersion(
+      with: peripheralMock,
+      readCharacteristic: readCharacteristic,
+      writeCharacteristic: writeCharacteristic,
+      allowsCapabilitiesExchange: false
+    )
+
+    let versionExchangeProto = makeVersionExchangeProto(
+      maxSupportedMessagingVersion: 4,
+      minSupportedMessagingVersion: 2,
+      maxSupportedSecurityVersion: 1,
+      minSupportedSecurityVersion: 1
+    )
+
+    notify(from: peripheralMock, withValue: versionExchangeProto)
+
+    XCTAssertEqual(delegateMock.resolvedStreamVersion, .v3)
+    XCTAssertEqual(delegateMock.resolvedSecurityVersion, .v1)
+    XCTAssert(delegateMock.resolvedPeripheral === peripheralMock)
+
+    XCTAssertNil(delegateMock.encounteredError)
+  }
+
+  func testResolveVersion_compactFramingNotAllowed_resolvesToVersionTwoWithCompression() {
+    bleVersionResolver.resolveVersion(
+      with: peripheralMock,
+      readCharacteristic: readCharacteristic,
+      writeCharacteristic: writeCharacteristic,
+      allowsCapabilitiesExchange: false
+    )
+
+    let versionExchangeProto = makeVersionExchangeProto(
+      maxSupportedMessagingVersion: 4,
+      minSupportedMessagingVersion: 2,
+      maxSupportedSecurityVersion: 1,
+      minSupportedSecurityVersion: 1
+    )
+
+    notify(from: peripheralMock, withValue: versionExchangeProto)
+
+    XCTAssertEqual(delegateMock.resolvedStreamVersion, .v2(true))
+    XCTAssertNil(delegateMock.encounteredError)
+  }
+
   func testResolveVersion_correctlyResolvesSecurityVersionToTwo() {
     bleVersionResolver.resolveVersion(
       with: peripheralMock,
@@ -442,9 +557,26 @@ private class BLEVersionResolverDelegateMock: BLEVersionResolverDelegate {
   var resolvedStreamVersion: MessageStreamVersion?
   var resolvedSecurityVersion: MessageSecurityVersion?
   var resolvedPeripheral: BLEPeripheral?
+  var resolvedChannelCapabilities: UInt32?
 
   var encounteredError: BLEVersionResolverError?
 
+  func bleVersionResolver(
+    _ bleVersionResolver: BLEVersionResolver,
+    didResolveStreamVersionTo streamVersion: MessageStreamVersion,
+    securityVersionTo securityVersion: MessageSecurityVersion,
+    channelCapabilities: UInt32,
+    for peripheral: BLEPeripheral
+  ) {
+    resolvedChannelCapabilities = channelCapabilities
+    self.bleVersionResolver(
+      bleVersionResolver,
+      didResolveStreamVersionTo: streamVersion,
+      securityVersionTo: securityVersion,
+      for: peripheral
+    )
+  }
+
   func bleVersionResolver(
     _ bleVersionResolver: BLEVersionResolver,
     didResolveStreamVersionTo streamVersion: MessageStreamVersion,
@@ -468,6 +600,7 @@ private class BLEVersionResolverDelegateMock: BLEVersionResolverDelegate {
     resolvedStreamVersion = nil
     resolvedSecurityVersion = nil
     resolvedPeripheral = nil
+    resolvedChannelCapabilities = nil
     encounteredError = nil
   }
 }
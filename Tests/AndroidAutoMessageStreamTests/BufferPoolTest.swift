@@ -0,0 +1,149 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+import XCTest
+
+@testable import AndroidAutoMessageStream
+
+/// Unit tests for `BufferPool`.
+class BufferPoolTest: XCTestCase {
+  private var pool: BufferPool!
+
+  override func setUp() {
+    super.setUp()
+    pool = BufferPool(classCount: 4, maxIdleBuffersPerClass: 2)
+  }
+
+  func testClassSizes_arePowersOfTwo() {
+    XCTAssertEqual(pool.classSizes, [64, 128, 256, 512])
+  }
+
+  func testMakeData_containsWrittenBytes() {
+    let data = pool.makeData(capacity: 10) { buffer in
+      for i in 0..<5 { buffer[i] = UInt8(i) }
+      return 5
+    }
+
+    XCTAssertEqual(data, Data([0, 1, 2, 3, 4]))
+  }
+
+  func testMakeData_reusesReleasedBuffer() {
+    autoreleasepool {
+      _ = pool.makeData(capacity: 100) { _ in 100 }
+    }
+    _ = pool.makeData(capacity: 128) { _ in 128 }
+
+    let statistics = pool.statistics
+    XCTAssertEqual(statistics.misses, 1)
+    XCTAssertEqual(statistics.hits, 1)
+    XCTAssertEqual(statistics.returns, 2)
+    XCTAssertEqual(statistics.outstanding, 0)
+    XCTAssertEqual(statistics.idleBytes, 128)
+  }
+
+  func testMakeData_tracksOutstandingBuffers() {
+    let first = pool.makeData(capacity: 10) { _ in 10 }
+    let second = pool.makeData(capacity: 10) { _ in 10 }
+
+    XCTAssertEqual(pool.statistics.outstanding, 2)
+    XCTAssertEqual(first.count + second.count, 20)
+  }
+
+  func testMakeData_emptyResultReturnsBuffer() {
+    let data = pool.makeData(capacity: 10) { _ in 0 }
+
+    XCTAssertTrue(data.isEmpty)
+    XCTAssertEqual(pool.statistics.outstanding, 0)
+    XCTAssertEqual(pool.statistics.returns, 1)
+  }
+
+  func testMakeData_throwingBodyReturnsBuffer() {
+    struct FakeError: Error {}
+
+    XCTAssertThrowsError(try pool.makeData(capacity: 10) { _ in throw FakeError() })
+    XCTAssertEqual(pool.statistics.outstanding, 0)
+  }
+
+  func testMakeData_oversizedRequestIsNotPooled() {
+    let data = pool.makeData(capacity: 1_000) { _ in 1_000 }
+
+    XCTAssertEqual(data.count, 1_000)
+    XCTAssertEqual(pool.statistics.oversized, 1)
+    XCTAssertEqual(pool.statistics.outstanding, 0)
+  }
+
+  func testRelease_discardsBuffersBeyondLimit() {
+    autoreleasepool {
+      let buffers = (0..<3).map { _ in pool.makeData(capacity: 10) { _ in 10 } }
+      XCTAssertEqual(buffers.count, 3)
+    }
+
+    XCTAssertEqual(pool.statistics.returns, 2)
+    XCTAssertEqual(pool.statistics.discards, 1)
+    XCTAssertEqual(pool.statistics.idleBytes, 128)
+  }
+
+  func testDrain_freesIdleBuffers() {
+    _ = pool.makeData(capacity: 10) { _ in 10 }
+
+    pool.drain()
+
+    XCTAssertEqual(pool.statistics.idleBytes, 0)
+    _ = pool.makeData(capacity: 10) { _ in 10 }
+    XCTAssertEqual(pool.statistics.hits, 0)
+  }
+
+  // MARK: - PooledBuffer
+
+  func testPooledBuffer_appendsAndTakesData() {
+    let buffer = pool.makeBuffer(capacity: 8)
+
+    buffer.append(Data([1, 2, 3]))
+    buffer.append(Data([4, 5]))
+
+    XCTAssertEqual(buffer.count, 5)
+    XCTAssertEqual(buffer.takeData(), Data([1, 2, 3, 4, 5]))
+    XCTAssertEqual(buffer.count, 0)
+  }
+
+  func testPooledBuffer_growsIntoLargerClass() {
+    let buffer = pool.makeBuffer(capacity: 64)
+    let bytes = Data((0..<200).map { UInt8($0) })
+
+    buffer.append(bytes.prefix(60))
+    buffer.append(bytes.dropFirst(60))
+
+    XCTAssertGreaterThanOrEqual(buffer.capacity, 200)
+    XCTAssertEqual(buffer.takeData(), bytes)
+    XCTAssertEqual(pool.statistics.outstanding, 0)
+  }
+
+  func testPooledBuffer_appendsSlices() {
+    let buffer = pool.makeBuffer(capacity: 8)
+    let bytes = Data([9, 8, 7, 6])
+
+    buffer.append(bytes[2..<4])
+
+    XCTAssertEqual(buffer.takeData(), Data([7, 6]))
+  }
+
+  func testPooledBuffer_releasedWithoutTakingReturnsBuffer() {
+    autoreleasepool {
+      let buffer = pool.makeBuffer(capacity: 8)
+      buffer.append(Data([1]))
+    }
+
+    XCTAssertEqual(pool.statistics.outstanding, 0)
+  }
+}
@@ -99,6 +99,53 @@ class DataCompressorImplTest: XCTestCase {
     XCTAssertEqual(decompressedData, rawData)
   }
 
+  // MARK: - Incremental decompression
+
+  func testRawZlib_HasNoIncrementalDecompressor() {
+    XCTAssertNil(DataCompressorImpl.zlibRaw.makeIncrementalDecompressor(originalSize: 1000))
+  }
+
+  func testAnnotatedZlib_IncrementalDecompressRecoversOriginal() throws {
+    let rawData = mixedData(count: 10_000)
+    let compressedData = try DataCompressorImpl.zlib.compress(rawData)
+    let decompressor = try XCTUnwrap(
+      DataCompressorImpl.zlib.makeIncrementalDecompressor(originalSize: rawData.count))
+
+    var decompressedData = Data()
+    var start = compressedData.startIndex
+    while start < compressedData.endIndex {
+      let end = min(start + 7, compressedData.endIndex)
+      decompressedData += try decompressor.decompress(compressedData[start..<end])
+      start = end
+    }
+    decompressedData += try decompressor.finish()
+
+    XCTAssertEqual(decompressedData, rawData)
+  }
+
+  func testAnnotatedZlib_IncrementalDecompressProducesOutputBeforeFinish() throws {
+    let rawData = mixedData(count: 10_000)
+    let compressedData = try DataCompressorImpl.zlib.compress(rawData)
+    let decompressor = try XCTUnwrap(
+      DataCompressorImpl.zlib.makeIncrementalDecompressor(originalSize: rawData.count))
+
+    let firstHalf = try decompressor.decompress(compressedData.prefix(compressedData.count / 2))
+
+    XCTAssertGreaterThan(firstHalf.count, 0)
+    XCTAssertEqual(firstHalf, rawData.prefix(firstHalf.count))
+  }
+
+  func testAnnotatedZlib_IncrementalDecompressThrowsForTruncatedData() throws {
+    let rawData = mixedData(count: 10_000)
+    let compressedData = try DataCompressorImpl.zlib.compress(rawData)
+    let decompressor = try XCTUnwrap(
+      DataCompressorImpl.zlib.makeIncrementalDecompressor(originalSize: rawData.count))
+
+    _ = try decompressor.decompress(compressedData.prefix(compressedData.count / 2))
+
+    XCTAssertThrowsError(try decompressor.finish())
+  }
+
   // MARK: - Utilities
 
   /// Generate repeating data which should compress very well.
@@ -106,4 +153,10 @@ class DataCompressorImplTest: XCTestCase {
     let array = [UInt8](repeating: 12, count: count)
     return Data(array)
   }
+
+  /// Generate data that compresses but not into just a few bytes.
+  private func mixedData(count: Int) -> Data {
+    let lines = (0..<count).lazy.map { "line \($0)\n" }.joined()
+    return Data(lines.utf8.prefix(count))
+  }
 }
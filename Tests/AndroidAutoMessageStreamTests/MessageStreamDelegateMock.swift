@@ -18,14 +18,18 @@ import Foundation
 @testable import AndroidAutoMessageStream
 
 /// Allows for verification of method invocations within a `MessageStreamDelegate`.
-class MessageStreamDelegateMock: NSObject, MessageStreamDelegate {
+class MessageStreamDelegateMock: NSObject, StreamingMessageStreamDelegate {
   var didUpdateValueCalledCount = 0
   var updatedMessage: Data?
   var receivedMessageParams: MessageStreamParams?
 
+  /// The pieces passed to `messageStream(_:didReceivePartialMessage:params:)`, in order.
+  var partialMessages: [Data] = []
+
   var didEncounterWriteErrorCount = 0
 
   var didWriteMessageCalledCount = 0
+  var writtenMessageRecipients: [UUID] = []
 
   var encounteredUnrecoverableErrorCalled = false
 
@@ -39,6 +43,14 @@ class MessageStreamDelegateMock: NSObject, MessageStreamDelegate {
     receivedMessageParams = params
   }
 
+  func messageStream(
+    _ messageStream: MessageStream,
+    didReceivePartialMessage payload: Data,
+    params: MessageStreamParams
+  ) {
+    partialMessages.append(payload)
+  }
+
   func messageStream(
     _ messageStream: MessageStream,
     didEncounterWriteError error: Error,
@@ -49,6 +61,7 @@ class MessageStreamDelegateMock: NSObject, MessageStreamDelegate {
 
   func messageStreamDidWriteMessage(_ messageStream: MessageStream, to recipient: UUID) {
     didWriteMessageCalledCount += 1
+    writtenMessageRecipients.append(recipient)
   }
 
   func messageStreamEncounteredUnrecoverableError(_ messageStream: MessageStream) {
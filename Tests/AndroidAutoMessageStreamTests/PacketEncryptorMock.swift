@@ -0,0 +1,59 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+import AndroidAutoMessageStream
+import Foundation
+
+/// A mock of the `PacketEncryptor` that numbers packets like a real one.
+///
+/// Bodies are masked with the packet number and followed by a tag of the header and packet number,
+/// so opening fails for a changed header or a packet opened out of order.
+class PacketEncryptorMock: PacketEncryptor {
+  let overhead = 16
+
+  var sealCalledCount = 0
+  var openCalledCount = 0
+
+  private var sealCounter: UInt64 = 0
+  private var openCounter: UInt64 = 0
+
+  func seal(_ body: Data, authenticating header: Data) throws -> Data {
+    sealCalledCount += 1
+    defer { sealCounter += 1 }
+    return mask(body, counter: sealCounter) + tag(header: header, counter: sealCounter)
+  }
+
+  func open(_ sealedBody: Data, authenticating header: Data) throws -> Data {
+    openCalledCount += 1
+    guard sealedBody.count >= overhead,
+      sealedBody.suffix(overhead) == tag(header: header, counter: openCounter)
+    else {
+      throw NSError(domain: "", code: 0, userInfo: nil)
+    }
+
+    defer { openCounter += 1 }
+    return mask(sealedBody.dropLast(overhead), counter: openCounter)
+  }
+
+  private func mask(_ body: Data, counter: UInt64) -> Data {
+    return Data(body.map { $0 ^ UInt8(truncatingIfNeeded: counter) ^ 0x5A })
+  }
+
+  private func tag(header: Data, counter: UInt64) -> Data {
+    var tag = Data(header)
+    withUnsafeBytes(of: counter.bigEndian) { tag.append(contentsOf: $0) }
+    tag.append(Data(repeating: 0, count: overhead - tag.count))
+    return tag
+  }
+}
@@ -46,7 +46,6 @@ class BLEMessageStreamV2Test: XCTestCase {
     super.setUp()
     continueAfterFailure = false
 
-    MessageIDGenerator.shared.reset()
     peripheralMock.reset()
     readCharacteristic.value = nil
     writeCharacteristic.value = nil
@@ -149,6 +148,42 @@ class BLEMessageStreamV2Test: XCTestCase {
     XCTAssertEqual(messageEncryptor.decryptCalledCount, 1)
   }
 
+  func testUpdateValue_reassemblyBufferIsReused() {
+    let bufferPool = BufferPool()
+    messageStreamV2 = BLEMessageStreamV2(
+      peripheral: peripheralMock,
+      readCharacteristic: readCharacteristic,
+      writeCharacteristic: writeCharacteristic,
+      messageCompressor: DataCompressorMock(),
+      isCompressionEnabled: false,
+      bufferPool: bufferPool
+    )
+    messageStreamV2.delegate = delegate
+    messageStreamV2.messageEncryptor = messageEncryptor
+
+    for messageID: Int32 in 1...3 {
+      let packets = try! MessagePacketFactory.makePackets(
+        messageID: messageID,
+        operation: .clientMessage,
+        payload: makeMessage(length: 1000),
+        originalSize: 0,
+        isPayloadEncrypted: false,
+        recipient: Data("id".utf8),
+        maxSize: 80
+      )
+      XCTAssertGreaterThan(packets.count, 1)
+
+      for packet in packets {
+        simulateMessageReceived(try! packet.serializedData(), from: peripheralMock)
+      }
+    }
+
+    XCTAssertEqual(delegate.didUpdateValueCalledCount, 3)
+    XCTAssertEqual(bufferPool.statistics.misses, 1)
+    XCTAssertEqual(bufferPool.statistics.hits, 2)
+    XCTAssertEqual(bufferPool.statistics.outstanding, 0)
+  }
+
   func testUpdateValue_correctlyPassesParams() {
     let operation = OperationType.clientMessage
     let recipientUUID = UUID()
@@ -289,6 +324,36 @@ class BLEMessageStreamV2Test: XCTestCase {
     assertWriteMessage_requiresChunkingCorrectlySplitsPayload(isEncryptedWrite: false)
   }
 
+  func testWriteMessage_skipsMessageIDStillPendingAfterWrap() {
+    peripheralMock.maximumWriteValueLength = BLEMessageStreamV2.maxWriteValueLength
+
+    // The first message is never acknowledged, so its ID stays pending.
+    messageStreamV2.messageIDGenerator.messageID = 0
+    writeMessage(makeMessage(length: 50), isEncryptedWrite: false)
+
+    // Simulate the counter wrapping back around to the pending ID.
+    messageStreamV2.messageIDGenerator.messageID = 0
+    writeMessage(makeMessage(length: 50), isEncryptedWrite: false)
+
+    // The newest message is inserted at the start of the stack.
+    XCTAssertEqual(messageStreamV2.writeMessageStack.count, 2)
+    XCTAssertEqual(messageStreamV2.writeMessageStack.last?.messageID, 0)
+    XCTAssertEqual(messageStreamV2.writeMessageStack.first?.messageID, 1)
+  }
+
+  func testWriteMessage_reusesMessageIDOnceWritten() {
+    peripheralMock.maximumWriteValueLength = BLEMessageStreamV2.maxWriteValueLength
+
+    messageStreamV2.messageIDGenerator.messageID = 0
+    writeMessage(makeMessage(length: 50), isEncryptedWrite: false)
+    notifyReadyToWrite(forCount: 1)
+
+    messageStreamV2.messageIDGenerator.messageID = 0
+    writeMessage(makeMessage(length: 50), isEncryptedWrite: false)
+
+    XCTAssertEqual(messageStreamV2.writeMessageStack.last?.messageID, 0)
+  }
+
   // MARK: - writeEncryptedMessage() tests.
 
   func testWriteEncryptedMessage_fitsWithoutChunkingNotifiesDelegate() {
@@ -395,7 +460,7 @@ class BLEMessageStreamV2Test: XCTestCase {
   ) {
     // Set a message ID to make testing easier.
     let messageID: Int32 = 5
-    MessageIDGenerator.shared.messageID = messageID
+    messageStreamV2.messageIDGenerator.messageID = messageID
 
     // Ensure the message does not fit in 1 message.
     peripheralMock.maximumWriteValueLength = 182
@@ -420,7 +485,7 @@ class BLEMessageStreamV2Test: XCTestCase {
   ) {
     // Set a message ID to make testing easier.
     let messageID: Int32 = 5
-    MessageIDGenerator.shared.messageID = messageID
+    messageStreamV2.messageIDGenerator.messageID = messageID
 
     // Ensure the message does not fit in 1 message.
     peripheralMock.maximumWriteValueLength = 182
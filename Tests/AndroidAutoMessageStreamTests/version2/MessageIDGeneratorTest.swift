@@ -19,14 +19,14 @@ import XCTest
 /// Unit tests for `MessageIDGenerator`.
 class MessageIDGeneratorTest: XCTestCase {
   func testNextMessageID_correctlyIncrements() {
-    let messageIDGenerator = MessageIDGenerator.shared
+    let messageIDGenerator = MessageIDGenerator()
     let initialMessageID = messageIDGenerator.next()
 
     XCTAssertEqual(messageIDGenerator.next(), initialMessageID + 1)
   }
 
   func testNextMessageID_correctlyWrapsBackToZero() {
-    let messageIDGenerator = MessageIDGenerator.shared
+    let messageIDGenerator = MessageIDGenerator()
     messageIDGenerator.messageID = Int32.max
 
     XCTAssertEqual(messageIDGenerator.next(), Int32.max)
@@ -34,4 +34,47 @@ class MessageIDGeneratorTest: XCTestCase {
     // This next ID should have been wrapped back to 0.
     XCTAssertEqual(messageIDGenerator.next(), 0)
   }
+
+  func testNextMessageID_generatorsAreIndependent() {
+    let firstGenerator = MessageIDGenerator()
+    let secondGenerator = MessageIDGenerator()
+
+    _ = firstGenerator.next()
+    _ = firstGenerator.next()
+
+    XCTAssertEqual(secondGenerator.next(), 0)
+  }
+
+  func testNextMessageID_skipsIDsInUse() {
+    let messageIDGenerator = MessageIDGenerator(initialMessageID: Int32.max)
+    let pendingIDs: Set<Int32> = [Int32.max, 0, 1]
+
+    XCTAssertEqual(messageIDGenerator.next { pendingIDs.contains($0) }, 2)
+    XCTAssertEqual(messageIDGenerator.next(), 3)
+  }
+
+  func testNextMessageID_givesUpAfterMaxRetries() {
+    let messageIDGenerator = MessageIDGenerator()
+
+    let messageID = messageIDGenerator.next { _ in true }
+
+    XCTAssertEqual(messageID, Int32(MessageIDGenerator.maxCollisionRetries))
+  }
+
+  func testNextMessageID_uniqueAcrossConcurrentCallers() {
+    let messageIDGenerator = MessageIDGenerator()
+    let iterations = 1000
+    let lock = NSLock()
+    var allocatedIDs = Set<Int32>()
+
+    DispatchQueue.concurrentPerform(iterations: iterations) { _ in
+      let messageID = messageIDGenerator.next()
+      lock.lock()
+      allocatedIDs.insert(messageID)
+      lock.unlock()
+    }
+
+    XCTAssertEqual(allocatedIDs.count, iterations)
+    XCTAssertEqual(messageIDGenerator.messageID, Int32(iterations))
+  }
 }
@@ -0,0 +1,390 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+import AndroidAutoCoreBluetoothProtocols
+import AndroidAutoCoreBluetoothProtocolsMocks
+import CoreBluetooth
+import XCTest
+
+@testable import AndroidAutoMessageStream
+
+/// Unit tests for `BLEMessageStreamV3`.
+class BLEMessageStreamV3Test: XCTestCase {
+  private let recipientUUID = UUID(uuidString: "B75D6A81-635B-4560-BD8D-9CDF83F32AE7")!
+
+  private let peripheralMock = PeripheralMock(name: "fake")
+
+  private let readCharacteristic = CharacteristicMock(uuid: CBUUID(string: "bad1"), value: nil)
+
+  private let writeCharacteristic = CharacteristicMock(uuid: CBUUID(string: "bad2"), value: nil)
+
+  private var params: MessageStreamParams!
+  private var delegate: MessageStreamDelegateMock!
+  private var messageEncryptor: MessageEncryptorMock!
+  private var messageStream: BLEMessageStreamV3!
+
+  override func setUp() {
+    super.setUp()
+    continueAfterFailure = false
+
+    peripheralMock.reset()
+    peripheralMock.maximumWriteValueLength = BLEMessageStreamV2.maxWriteValueLength
+    readCharacteristic.value = nil
+    writeCharacteristic.value = nil
+
+    params = MessageStreamParams(recipient: recipientUUID, operationType: .clientMessage)
+    messageStream = makeStream(isCompressionEnabled: false)
+  }
+
+  // MARK: - Initialization tests.
+
+  func testInit_setsItselfAsPeripheralDelegate() {
+    XCTAssert(peripheralMock.delegate === messageStream)
+    XCTAssertTrue(peripheralMock.notifyValueCalled)
+    XCTAssertEqual(messageStream.version, .v3)
+  }
+
+  // MARK: - Write tests.
+
+  func testWriteMessage_fitsWithoutChunkingNotifiesDelegate() throws {
+    let message = makeMessage(length: 50)
+
+    try messageStream.writeMessage(message, params: params)
+    notifyReadyToWrite(forCount: 1)
+
+    XCTAssertEqual(peripheralMock.writtenData.count, 1)
+    XCTAssertEqual(peripheralMock.writtenData[0].count, CompactPacketHeader.size + 16 + 50)
+    XCTAssertEqual(delegate.didWriteMessageCalledCount, 1)
+  }
+
+  func testWriteMessage_requiresChunkingOnlyNotifiesAfterCompleteMessageSent() throws {
+    try messageStream.writeMessage(makeMessage(length: 1_000), params: params)
+
+    let requiredWrites = messageStream.writeMessageStack.count
+    XCTAssertGreaterThan(requiredWrites, 1)
+
+    notifyReadyToWrite(forCount: requiredWrites - 1)
+    XCTAssertEqual(delegate.didWriteMessageCalledCount, 0)
+
+    notifyReadyToWrite(forCount: 1)
+    XCTAssertEqual(peripheralMock.writtenData.count, requiredWrites)
+    XCTAssertEqual(delegate.didWriteMessageCalledCount, 1)
+  }
+
+  func testWriteMessage_waitsIfSendInProgress() throws {
+    try messageStream.writeMessage(makeMessage(length: 1_000), params: params)
+    try messageStream.writeMessage(makeMessage(length: 10), params: params)
+
+    XCTAssertEqual(peripheralMock.writeValueCalledCount, 1)
+
+    notifyReadyToWrite(forCount: 1)
+    XCTAssertEqual(peripheralMock.writeValueCalledCount, 2)
+  }
+
+  func testWriteMessage_skipsMessageIDStillPendingAfterWrap() throws {
+    messageStream.messageIDGenerator.messageID = 0
+    try messageStream.writeMessage(makeMessage(length: 50), params: params)
+
+    // Only the low 16 bits are sent, so 0x10000 collides with the pending message 0.
+    messageStream.messageIDGenerator.messageID = 0x10000
+    try messageStream.writeMessage(makeMessage(length: 50), params: params)
+
+    XCTAssertEqual(messageStream.writeMessageStack.last?.header.messageID, 0)
+    XCTAssertEqual(messageStream.writeMessageStack.first?.header.messageID, 1)
+  }
+
+  func testWriteEncryptedMessage_throwsErrorIfNoMessageEncryptor() {
+    messageStream.messageEncryptor = nil
+
+    XCTAssertThrowsError(
+      try messageStream.writeEncryptedMessage(Data("message".utf8), params: params)
+    ) { error in
+      XCTAssertEqual(error as? BLEMessageStreamV3Error, .noEncryptorSet)
+    }
+  }
+
+  // MARK: - Round trip tests.
+
+  func testRoundTrip_deliversMessageAndParams() throws {
+    try assertRoundTrip(length: 1_000, encrypted: false)
+  }
+
+  func testRoundTrip_encryptedMessage() throws {
+    try assertRoundTrip(length: 1_000, encrypted: true)
+    XCTAssertEqual(messageEncryptor.decryptCalledCount, 1)
+  }
+
+  func testRoundTrip_compressedMessage() throws {
+    messageStream = makeStream(isCompressionEnabled: true)
+
+    try assertRoundTrip(length: 1_000, encrypted: true)
+  }
+
+  func testRoundTrip_handshakeMessageHasNoRecipient() throws {
+    params = MessageStreamParams(recipient: recipientUUID, operationType: .encryptionHandshake)
+    let message = makeMessage(length: 50)
+
+    try messageStream.writeMessage(message, params: params)
+    XCTAssertEqual(peripheralMock.writtenData[0].count, CompactPacketHeader.size + 50)
+
+    simulateMessageReceived(peripheralMock.writtenData[0])
+
+    XCTAssertEqual(delegate.updatedMessage, message)
+    XCTAssertEqual(delegate.receivedMessageParams?.operationType, .encryptionHandshake)
+  }
+
+  // MARK: - Packet encryption tests.
+
+  func testPacketEncryption_roundTripOpensEveryPacket() throws {
+    let packetEncryptor = PacketEncryptorMock()
+    messageStream.packetEncryptor = packetEncryptor
+
+    try assertRoundTrip(length: 1_000, encrypted: true)
+
+    XCTAssertEqual(messageEncryptor.encryptCalledCount, 0)
+    XCTAssertEqual(messageEncryptor.decryptCalledCount, 0)
+    XCTAssertGreaterThan(peripheralMock.writtenData.count, 1)
+    XCTAssertEqual(packetEncryptor.sealCalledCount, peripheralMock.writtenData.count)
+    XCTAssertEqual(packetEncryptor.openCalledCount, peripheralMock.writtenData.count)
+  }
+
+  func testPacketEncryption_packetsFitMaximumWriteLength() throws {
+    messageStream.packetEncryptor = PacketEncryptorMock()
+
+    try messageStream.writeEncryptedMessage(makeMessage(length: 1_000), params: params)
+
+    for packet in messageStream.writeMessageStack {
+      XCTAssertLessThanOrEqual(packet.data.count, BLEMessageStreamV2.maxWriteValueLength)
+    }
+  }
+
+  func testPacketEncryption_unencryptedMessageIsNotSealed() throws {
+    let packetEncryptor = PacketEncryptorMock()
+    messageStream.packetEncryptor = packetEncryptor
+
+    try assertRoundTrip(length: 1_000, encrypted: false)
+
+    XCTAssertEqual(packetEncryptor.sealCalledCount, 0)
+    XCTAssertEqual(packetEncryptor.openCalledCount, 0)
+  }
+
+  func testPacketEncryption_deliversPayloadBeforeLastPacket() throws {
+    messageStream.packetEncryptor = PacketEncryptorMock()
+    let message = makeMessage(length: 1_000)
+
+    try messageStream.writeEncryptedMessage(message, params: params)
+    notifyReadyToWrite(forCount: messageStream.writeMessageStack.count)
+
+    let packets = peripheralMock.writtenData
+    for packet in packets.dropLast() {
+      simulateMessageReceived(packet)
+    }
+
+    XCTAssertEqual(delegate.didUpdateValueCalledCount, 0)
+    let partialPayload = delegate.partialMessages.reduce(Data(), +)
+    XCTAssertGreaterThan(partialPayload.count, 0)
+    XCTAssertEqual(partialPayload, message.prefix(partialPayload.count))
+
+    simulateMessageReceived(packets.last!)
+
+    XCTAssertEqual(delegate.partialMessages.reduce(Data(), +), message)
+    XCTAssertEqual(delegate.updatedMessage, message)
+  }
+
+  func testPacketEncryption_decompressesIncrementally() throws {
+    messageStream = makeStream(isCompressionEnabled: true, compressor: DataCompressorImpl.zlib)
+    messageStream.packetEncryptor = PacketEncryptorMock()
+    // Random words compress well but still span several packets.
+    let words = ["alpha", "bravo", "charlie", "delta", "echo", "foxtrot", "golf", "hotel"]
+    let message = Data((0..<4_000).map { _ in words.randomElement()! }.joined(separator: " ").utf8)
+
+    try messageStream.writeEncryptedMessage(message, params: params)
+    notifyReadyToWrite(forCount: messageStream.writeMessageStack.count)
+
+    XCTAssertEqual(messageStream.writeMessageStack.count, 0)
+    XCTAssertGreaterThan(peripheralMock.writtenData.count, 1)
+    for packet in peripheralMock.writtenData {
+      simulateMessageReceived(packet)
+    }
+
+    XCTAssertGreaterThan(delegate.partialMessages.count, 1)
+    XCTAssertEqual(delegate.partialMessages.reduce(Data(), +), message)
+    XCTAssertEqual(delegate.updatedMessage, message)
+  }
+
+  func testPacketEncryption_tamperedHeaderNotifiesDelegateOfError() throws {
+    messageStream.packetEncryptor = PacketEncryptorMock()
+
+    try messageStream.writeEncryptedMessage(makeMessage(length: 50), params: params)
+
+    var packet = peripheralMock.writtenData[0]
+    packet[packet.startIndex + 3] ^= 0x01
+    simulateMessageReceived(packet)
+
+    XCTAssertEqual(delegate.didUpdateValueCalledCount, 0)
+    XCTAssertTrue(delegate.encounteredUnrecoverableErrorCalled)
+  }
+
+  func testPacketEncryption_duplicatePacketsAreIgnored() throws {
+    messageStream.packetEncryptor = PacketEncryptorMock()
+    let message = makeMessage(length: 1_000)
+
+    try messageStream.writeEncryptedMessage(message, params: params)
+    notifyReadyToWrite(forCount: messageStream.writeMessageStack.count)
+
+    for packet in peripheralMock.writtenData {
+      simulateMessageReceived(packet)
+      simulateMessageReceived(packet)
+    }
+
+    XCTAssertEqual(delegate.didUpdateValueCalledCount, 1)
+    XCTAssertEqual(delegate.updatedMessage, message)
+    XCTAssertFalse(delegate.encounteredUnrecoverableErrorCalled)
+  }
+
+  func testHasExchangedEncryptedMessages_falseForUnencryptedMessages() throws {
+    try assertRoundTrip(length: 1_000, encrypted: false)
+
+    XCTAssertFalse(messageStream.hasExchangedEncryptedMessages)
+  }
+
+  func testHasExchangedEncryptedMessages_trueAfterWritingEncryptedMessage() throws {
+    try messageStream.writeEncryptedMessage(makeMessage(length: 50), params: params)
+
+    XCTAssertTrue(messageStream.hasExchangedEncryptedMessages)
+  }
+
+  func testHasExchangedEncryptedMessages_trueAfterReceivingEncryptedPacket() throws {
+    let packets = try CompactPacketFactory.makePackets(
+      messageID: 1,
+      operation: .clientMessage,
+      payload: makeMessage(length: 1_000),
+      originalSize: 0,
+      isPayloadEncrypted: true,
+      recipient: recipientUUID,
+      maxSize: BLEMessageStreamV2.maxWriteValueLength
+    ).map { $0.data }
+
+    simulateMessageReceived(packets[0])
+
+    XCTAssertTrue(messageStream.hasExchangedEncryptedMessages)
+  }
+
+  // MARK: - Receive error tests.
+
+  func testDuplicatePacketIsIgnored() throws {
+    let packets = try makePackets(length: 1_000)
+    XCTAssertGreaterThan(packets.count, 1)
+
+    for packet in packets {
+      simulateMessageReceived(packet)
+      simulateMessageReceived(packet)
+    }
+
+    XCTAssertEqual(delegate.didUpdateValueCalledCount, 1)
+    XCTAssertFalse(delegate.encounteredUnrecoverableErrorCalled)
+  }
+
+  func testOutOfOrderPacket_notifiesDelegateOfError() throws {
+    let packets = try makePackets(length: 1_000)
+    XCTAssertGreaterThan(packets.count, 2)
+
+    simulateMessageReceived(packets.first!)
+    simulateMessageReceived(packets.last!)
+
+    XCTAssertEqual(delegate.didUpdateValueCalledCount, 0)
+    XCTAssertTrue(delegate.encounteredUnrecoverableErrorCalled)
+  }
+
+  func testPacketOfUnknownMessage_notifiesDelegateOfError() throws {
+    let packets = try makePackets(length: 1_000)
+
+    simulateMessageReceived(packets[1])
+
+    XCTAssertTrue(delegate.encounteredUnrecoverableErrorCalled)
+  }
+
+  // MARK: - Helper functions
+
+  private func makeStream(
+    isCompressionEnabled: Bool,
+    compressor: DataCompressor = DataCompressorMock()
+  ) -> BLEMessageStreamV3 {
+    let stream = BLEMessageStreamV3(
+      peripheral: peripheralMock,
+      readCharacteristic: readCharacteristic,
+      writeCharacteristic: writeCharacteristic,
+      messageCompressor: compressor,
+      isCompressionEnabled: isCompressionEnabled
+    )
+
+    delegate = MessageStreamDelegateMock()
+    stream.delegate = delegate
+
+    messageEncryptor = MessageEncryptorMock()
+    stream.messageEncryptor = messageEncryptor
+    return stream
+  }
+
+  /// Writes a message and feeds the written packets back to the stream as received packets.
+  private func assertRoundTrip(length: Int, encrypted: Bool) throws {
+    let message = makeMessage(length: length)
+    params = MessageStreamParams(recipient: recipientUUID, operationType: .query)
+
+    if encrypted {
+      try messageStream.writeEncryptedMessage(message, params: params)
+    } else {
+      try messageStream.writeMessage(message, params: params)
+    }
+    notifyReadyToWrite(forCount: messageStream.writeMessageStack.count)
+
+    for packet in peripheralMock.writtenData {
+      simulateMessageReceived(packet)
+    }
+
+    XCTAssertEqual(delegate.didUpdateValueCalledCount, 1)
+    XCTAssertEqual(delegate.updatedMessage, message)
+    XCTAssertEqual(delegate.receivedMessageParams?.recipient, recipientUUID)
+    XCTAssertEqual(delegate.receivedMessageParams?.operationType, .query)
+  }
+
+  private func makePackets(length: Int) throws -> [Data] {
+    return try CompactPacketFactory.makePackets(
+      messageID: 1,
+      operation: .clientMessage,
+      payload: makeMessage(length: length),
+      originalSize: 0,
+      isPayloadEncrypted: false,
+      recipient: recipientUUID,
+      maxSize: BLEMessageStreamV2.maxWriteValueLength
+    ).map { $0.data }
+  }
+
+  private func simulateMessageReceived(_ message: Data) {
+    readCharacteristic.value = message
+    messageStream.peripheral(peripheralMock, didUpdateValueFor: readCharacteristic, error: nil)
+  }
+
+  /// Notifies that the current peripheral is ready to send another message.
+  private func notifyReadyToWrite(forCount count: Int) {
+    guard count > 0 else { return }
+    for _ in 1...count {
+      messageStream.peripheralIsReadyToWrite(peripheralMock)
+    }
+  }
+
+  private func makeMessage(length: Int) -> Data {
+    return Data((0..<length).map { _ in UInt8.random(in: 0...UInt8.max) })
+  }
+}
@@ -0,0 +1,202 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+import XCTest
+import AndroidAutoCompanionProtos
+
+@testable import AndroidAutoMessageStream
+
+private typealias OperationType = Com_Google_Companionprotos_OperationType
+
+/// Unit tests for `CompactPacketHeader` and `CompactPacketFactory`.
+class CompactPacketTest: XCTestCase {
+  private let recipient = UUID(uuidString: "B75D6A81-635B-4560-BD8D-9CDF83F32AE7")!
+
+  // MARK: - Header tests.
+
+  func testHeader_roundTrips() throws {
+    let header = CompactPacketHeader(
+      messageID: 0xABCD,
+      sequence: 7,
+      isFirst: true,
+      isLast: false,
+      isEncrypted: true,
+      isCompressed: false,
+      hasRecipient: true,
+      operation: .queryResponse
+    )
+
+    var data = Data()
+    try header.append(to: &data)
+
+    XCTAssertEqual(data.count, CompactPacketHeader.size)
+    XCTAssertEqual(data, Data([0xAE, 0xAB, 0xCD, 0x07]))
+    XCTAssertEqual(try CompactPacketHeader(bytes: data), header)
+  }
+
+  func testHeader_truncatedData_throwsError() {
+    XCTAssertThrowsError(try CompactPacketHeader(bytes: Data([0x80, 0x00]))) { error in
+      XCTAssertEqual(error as? CompactPacketError, .truncated)
+    }
+  }
+
+  func testHeader_operationOutOfRange_throwsError() {
+    let header = CompactPacketHeader(
+      messageID: 1,
+      sequence: 0,
+      isFirst: true,
+      isLast: true,
+      isEncrypted: false,
+      isCompressed: false,
+      hasRecipient: false,
+      operation: .UNRECOGNIZED(9)
+    )
+
+    var data = Data()
+    XCTAssertThrowsError(try header.append(to: &data)) { error in
+      XCTAssertEqual(error as? CompactPacketError, .unsupportedOperation(9))
+    }
+  }
+
+  // MARK: - Factory tests.
+
+  func testMakePackets_singlePacketCarriesPrefix() throws {
+    let payload = Data("payload".utf8)
+
+    let packets = try CompactPacketFactory.makePackets(
+      messageID: 3,
+      operation: .clientMessage,
+      payload: payload,
+      originalSize: 42,
+      isPayloadEncrypted: false,
+      recipient: recipient,
+      maxSize: 182
+    )
+
+    XCTAssertEqual(packets.count, 1)
+    let header = packets[0].header
+    XCTAssertTrue(header.isFirst)
+    XCTAssertTrue(header.isLast)
+    XCTAssertTrue(header.isCompressed)
+
+    let body = packets[0].data.dropFirst(CompactPacketHeader.size)
+    let prefix = try CompactMessagePrefix(header: header, bytes: Data(body))
+    XCTAssertEqual(prefix.recipient, recipient)
+    XCTAssertEqual(prefix.originalSize, 42)
+    XCTAssertEqual(body.dropFirst(header.messagePrefixSize), payload)
+  }
+
+  func testMakePackets_splitsPayloadWithSequentialHeaders() throws {
+    let payload = Data((0..<1_000).map { UInt8(truncatingIfNeeded: $0) })
+
+    let packets = try CompactPacketFactory.makePackets(
+      messageID: 9,
+      operation: .clientMessage,
+      payload: payload,
+      originalSize: 0,
+      isPayloadEncrypted: true,
+      recipient: recipient,
+      maxSize: 182
+    )
+
+    // 16 bytes of recipient in the first packet and 178 bytes of payload in every packet.
+    XCTAssertEqual(packets.count, 6)
+
+    var reassembled = Data()
+    for (index, packet) in packets.enumerated() {
+      XCTAssertLessThanOrEqual(packet.data.count, 182)
+      XCTAssertEqual(packet.header.sequence, UInt8(index))
+      XCTAssertEqual(packet.header.messageID, 9)
+      XCTAssertEqual(packet.header.isFirst, index == 0)
+      XCTAssertEqual(packet.header.isLast, index == packets.count - 1)
+      XCTAssertTrue(packet.header.isEncrypted)
+
+      let skip = CompactPacketHeader.size + packet.header.messagePrefixSize
+      reassembled.append(packet.data.dropFirst(skip))
+    }
+    XCTAssertEqual(reassembled, payload)
+  }
+
+  func testMakePackets_emptyPayload_makesOnePacket() throws {
+    let packets = try CompactPacketFactory.makePackets(
+      messageID: 1,
+      operation: .encryptionHandshake,
+      payload: Data(),
+      originalSize: 0,
+      isPayloadEncrypted: false,
+      recipient: nil,
+      maxSize: 182
+    )
+
+    XCTAssertEqual(packets.count, 1)
+    XCTAssertEqual(packets[0].data.count, CompactPacketHeader.size)
+    XCTAssertTrue(packets[0].header.isLast)
+  }
+
+  func testMakePackets_maxSizeTooSmallForPrefix_throwsError() {
+    XCTAssertThrowsError(
+      try CompactPacketFactory.makePackets(
+        messageID: 1,
+        operation: .clientMessage,
+        payload: Data([1]),
+        originalSize: 0,
+        isPayloadEncrypted: false,
+        recipient: recipient,
+        maxSize: 20
+      )
+    ) { error in
+      XCTAssertEqual(error as? CompactPacketError, .maxSizeTooSmall(20))
+    }
+  }
+
+  // MARK: - Goodput comparison with version 2.
+
+  /// Compares the bytes written by version 2 and version 3 for typical message sizes.
+  ///
+  /// Goodput is the fraction of written bytes that are payload. With 182 byte writes, version 2
+  /// spends about 13 bytes of every packet on the `Packet` proto and about 26 bytes of every
+  /// message on the `Message` proto, while version 3 spends 4 bytes per packet and 16 per message.
+  func testGoodput_exceedsVersion2() throws {
+    let maxSize = 182
+    let recipientBytes = withUnsafeBytes(of: recipient.uuid) { Data($0) }
+
+    for size in [20, 100, 500, 1_000, 10_000, 100_000] {
+      let payload = Data(repeating: 0x5A, count: size)
+
+      let v2Packets = try MessagePacketFactory.makePackets(
+        messageID: 1_000,
+        operation: .clientMessage,
+        payload: payload,
+        originalSize: 0,
+        isPayloadEncrypted: true,
+        recipient: recipientBytes,
+        maxSize: maxSize
+      )
+      let v2Bytes = try v2Packets.reduce(0) { $0 + (try $1.serializedData().count) }
+
+      let v3Packets = try CompactPacketFactory.makePackets(
+        messageID: 1_000,
+        operation: .clientMessage,
+        payload: payload,
+        originalSize: 0,
+        isPayloadEncrypted: true,
+        recipient: recipient,
+        maxSize: maxSize
+      )
+      let v3Bytes = v3Packets.reduce(0) { $0 + $1.data.count }
+      XCTAssertLessThanOrEqual(v3Packets.count, v2Packets.count)
+      XCTAssertLessThan(v3Bytes, v2Bytes)
+    }
+  }
+}
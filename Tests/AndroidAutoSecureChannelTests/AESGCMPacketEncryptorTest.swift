@@ -0,0 +1,89 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+import XCTest
+
+@testable import AndroidAutoSecureChannel
+
+/// Unit tests for `AESGCMPacketEncryptor`.
+class AESGCMPacketEncryptorTest: XCTestCase {
+  private let phoneKey = Data(repeating: 1, count: 32)
+  private let carKey = Data(repeating: 2, count: 32)
+  private let header = Data([0x80, 0x00, 0x01, 0x00])
+
+  private var phone: AESGCMPacketEncryptor!
+  private var car: AESGCMPacketEncryptor!
+
+  override func setUp() {
+    super.setUp()
+
+    phone = AESGCMPacketEncryptor(sealKey: phoneKey, openKey: carKey)
+    car = AESGCMPacketEncryptor(sealKey: carKey, openKey: phoneKey)
+  }
+
+  func testSeal_addsOverhead() throws {
+    let body = Data("Hello World".utf8)
+
+    let sealedBody = try phone.seal(body, authenticating: header)
+
+    XCTAssertEqual(sealedBody.count, body.count + phone.overhead)
+    XCTAssertNotEqual(sealedBody.prefix(body.count), body)
+  }
+
+  func testOpen_recoversPacketsInOrder() throws {
+    let bodies = (0..<3).map { Data("Packet \($0)".utf8) }
+    let sealedBodies = try bodies.map { try phone.seal($0, authenticating: header) }
+
+    for (body, sealedBody) in zip(bodies, sealedBodies) {
+      XCTAssertEqual(try car.open(sealedBody, authenticating: header), body)
+    }
+  }
+
+  func testSeal_sameBodyDiffersPerPacket() throws {
+    let body = Data("Hello World".utf8)
+
+    XCTAssertNotEqual(
+      try phone.seal(body, authenticating: header), try phone.seal(body, authenticating: header))
+  }
+
+  func testOpen_rejectsChangedHeader() throws {
+    let sealedBody = try phone.seal(Data("Hello World".utf8), authenticating: header)
+
+    XCTAssertThrowsError(try car.open(sealedBody, authenticating: Data([0x80, 0x00, 0x02, 0x00])))
+  }
+
+  func testOpen_rejectsPacketOutOfOrder() throws {
+    _ = try phone.seal(Data("First".utf8), authenticating: header)
+    let second = try phone.seal(Data("Second".utf8), authenticating: header)
+
+    XCTAssertThrowsError(try car.open(second, authenticating: header))
+  }
+
+  func testOpen_failureDoesNotAdvanceCounter() throws {
+    let body = Data("Hello World".utf8)
+    let sealedBody = try phone.seal(body, authenticating: header)
+
+    var tampered = sealedBody
+    tampered[tampered.startIndex] ^= 0x01
+    XCTAssertThrowsError(try car.open(tampered, authenticating: header))
+
+    XCTAssertEqual(try car.open(sealedBody, authenticating: header), body)
+  }
+
+  func testOpen_rejectsShortData() {
+    XCTAssertThrowsError(try car.open(Data([1, 2, 3]), authenticating: header)) { error in
+      XCTAssertEqual(error as? AESGCMPacketEncryptorError, .invalidDataSize(3))
+    }
+  }
+}
@@ -21,7 +21,7 @@ import Foundation
 /// A message stream that stores any messages to be written in a local list for assertion.
 ///
 /// This stream also exposes methods to toggle if writing messages should succeed or not.
-class FakeMessageStream: NSObject, MessageStream {
+class FakeMessageStream: NSObject, PacketEncryptingMessageStream {
   private static let log = Logger(for: FakeMessageStream.self)
 
   // This force-unwrap is safe as the UUID string is valid and cannot change.
@@ -35,6 +35,10 @@ class FakeMessageStream: NSObject, MessageStream {
 
   public var messageEncryptor: MessageEncryptor? = nil
 
+  public var packetEncryptor: PacketEncryptor? = nil
+
+  public var hasExchangedEncryptedMessages = false
+
   /// Messages that have been delivered through a call to `writeMessage(_:params:)` or
   /// `writeEncryptedMessage(_:params:)`.
   public var writtenData: [Data] = []
@@ -57,6 +61,7 @@ class FakeMessageStream: NSObject, MessageStream {
   }
 
   public func writeEncryptedMessage(_ message: Data, params: MessageStreamParams) throws {
+    hasExchangedEncryptedMessages = true
     try writeMessageInternal(message, params: params)
   }
 
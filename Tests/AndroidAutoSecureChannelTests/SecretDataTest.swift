@@ -0,0 +1,66 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+import XCTest
+
+@testable import AndroidAutoSecureChannel
+
+/// Unit tests for `SecretData` and `Data.zeroize()`.
+class SecretDataTest: XCTestCase {
+  func testZeroize_clearsEveryByte() {
+    var data = Data((1...64).map { UInt8($0) })
+
+    data.zeroize()
+
+    XCTAssertEqual(data, Data(repeating: 0, count: 64))
+  }
+
+  func testZeroize_clearsOnlyTheSlice() {
+    var data = Data(repeating: 7, count: 64)
+    var slice = data[16..<48]
+
+    slice.zeroize()
+    data.replaceSubrange(16..<48, with: slice)
+
+    XCTAssertEqual(slice, Data(repeating: 0, count: 32))
+    XCTAssertEqual(data.prefix(16), Data(repeating: 7, count: 16))
+    XCTAssertEqual(data.suffix(16), Data(repeating: 7, count: 16))
+  }
+
+  func testZeroize_emptyDataIsUnchanged() {
+    var data = Data()
+
+    data.zeroize()
+
+    XCTAssertTrue(data.isEmpty)
+  }
+
+  func testZeroize_doesNotClearOtherCopies() {
+    let original = Data(repeating: 9, count: 64)
+    var copy = original
+
+    copy.zeroize()
+
+    XCTAssertEqual(original, Data(repeating: 9, count: 64))
+    XCTAssertEqual(copy, Data(repeating: 0, count: 64))
+  }
+
+  func testSecretData_exposesBytes() {
+    let bytes = Data(repeating: 5, count: 32)
+
+    let secret = SecretData(bytes)
+
+    XCTAssertEqual(secret.data, bytes)
+  }
+}
@@ -0,0 +1,170 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+import AndroidAutoUKey2Wrapper
+import XCTest
+
+@testable import AndroidAutoSecureChannel
+
+/// Unit tests for `UKey2ChannelFactory`.
+class UKey2ChannelFactoryTest: XCTestCase {
+  private var factory: UKey2ChannelFactory!
+
+  override func setUp() {
+    super.setUp()
+    continueAfterFailure = false
+
+    factory = UKey2ChannelFactory()
+  }
+
+  func testMakeChannel_withoutPrewarm_returnsNewChannel() {
+    let channel = factory.makeChannel(for: "car") as? UKey2Channel
+
+    XCTAssertNotNil(channel)
+    XCTAssertFalse(channel!.isPrewarmed)
+  }
+
+  func testMakeChannel_afterPrewarm_returnsPrewarmedChannel() {
+    factory.prewarmChannel(for: "car", savedSession: nil)
+    factory.waitForPendingPrewarms()
+
+    let channel = factory.makeChannel(for: "car") as? UKey2Channel
+
+    XCTAssertNotNil(channel)
+    XCTAssertTrue(channel!.isPrewarmed)
+  }
+
+  func testMakeChannel_prewarmedChannelIsHandedOutOnce() {
+    factory.prewarmChannel(for: "car", savedSession: nil)
+    factory.waitForPendingPrewarms()
+
+    let first = factory.makeChannel(for: "car") as! UKey2Channel
+    let second = factory.makeChannel(for: "car") as! UKey2Channel
+
+    XCTAssertFalse(first === second)
+    XCTAssertFalse(second.isPrewarmed)
+  }
+
+  func testMakeChannel_prewarmIsPerCar() {
+    factory.prewarmChannel(for: "car", savedSession: nil)
+    factory.waitForPendingPrewarms()
+
+    let channel = factory.makeChannel(for: "otherCar") as! UKey2Channel
+
+    XCTAssertFalse(channel.isPrewarmed)
+    XCTAssertTrue((factory.makeChannel(for: "car") as! UKey2Channel).isPrewarmed)
+  }
+
+  func testPrewarm_loadsSavedSessionOffCallingThread() {
+    var loadedOnMainThread: Bool?
+    factory.prewarmChannel(for: "car") {
+      loadedOnMainThread = Thread.isMainThread
+      return nil
+    }
+    factory.waitForPendingPrewarms()
+
+    XCTAssertEqual(loadedOnMainThread, false)
+  }
+
+  func testPrewarm_sameSavedSessionKeepsPrewarmedChannel() {
+    var loadCount = 0
+    let loadSession: () -> Data? = {
+      loadCount += 1
+      return nil
+    }
+    factory.prewarmChannel(for: "car", loadingSavedSession: loadSession)
+    factory.waitForPendingPrewarms()
+    factory.prewarmChannel(for: "car", loadingSavedSession: loadSession)
+    factory.waitForPendingPrewarms()
+
+    XCTAssertEqual(loadCount, 2)
+    XCTAssertTrue((factory.makeChannel(for: "car") as! UKey2Channel).isPrewarmed)
+    XCTAssertFalse((factory.makeChannel(for: "car") as! UKey2Channel).isPrewarmed)
+  }
+
+  func testPrewarm_changedSavedSessionReplacesPrewarmedChannel() {
+    factory.prewarmChannel(for: "car", savedSession: nil)
+    factory.waitForPendingPrewarms()
+
+    factory.prewarmChannel(for: "car", savedSession: makeSavedSession())
+    factory.waitForPendingPrewarms()
+
+    let channel = factory.makeChannel(for: "car") as! UKey2Channel
+    XCTAssertTrue(channel.isPrewarmed)
+    XCTAssertTrue(channel.hasPrewarmedSavedSession)
+  }
+
+  func testEvictPrewarmedChannel_discardsChannelForCar() {
+    factory.prewarmChannel(for: "car", savedSession: nil)
+    factory.prewarmChannel(for: "otherCar", savedSession: nil)
+    factory.waitForPendingPrewarms()
+
+    factory.evictPrewarmedChannel(for: "car")
+
+    XCTAssertFalse((factory.makeChannel(for: "car") as! UKey2Channel).isPrewarmed)
+    XCTAssertTrue((factory.makeChannel(for: "otherCar") as! UKey2Channel).isPrewarmed)
+  }
+
+  func testEvictPrewarmedChannel_dropsPrewarmInFlight() {
+    let loadStarted = DispatchSemaphore(value: 0)
+    let finishLoad = DispatchSemaphore(value: 0)
+    factory.prewarmChannel(for: "car") {
+      loadStarted.signal()
+      finishLoad.wait()
+      return nil
+    }
+    loadStarted.wait()
+
+    factory.evictPrewarmedChannel(for: "car")
+    finishLoad.signal()
+    factory.waitForPendingPrewarms()
+
+    XCTAssertFalse((factory.makeChannel(for: "car") as! UKey2Channel).isPrewarmed)
+
+    // A fresh prewarm is not blocked by the evicted one.
+    factory.prewarmChannel(for: "car", savedSession: nil)
+    factory.waitForPendingPrewarms()
+    XCTAssertTrue((factory.makeChannel(for: "car") as! UKey2Channel).isPrewarmed)
+  }
+
+  func testEvictAllPrewarmedChannels_discardsEveryChannel() {
+    factory.prewarmChannel(for: "car", savedSession: nil)
+    factory.prewarmChannel(for: "otherCar", savedSession: nil)
+    factory.waitForPendingPrewarms()
+
+    factory.evictAllPrewarmedChannels()
+
+    XCTAssertFalse((factory.makeChannel(for: "car") as! UKey2Channel).isPrewarmed)
+    XCTAssertFalse((factory.makeChannel(for: "otherCar") as! UKey2Channel).isPrewarmed)
+  }
+
+  // MARK: - Helper functions.
+
+  /// Runs a full handshake between an initiator and a responder and saves the initiator's session.
+  private func makeSavedSession() -> Data {
+    let initiator = UKey2Wrapper(role: .initiator)
+    let responder = UKey2Wrapper(role: .responder)
+
+    responder.parseHandshakeMessage(initiator.nextHandshakeMessage()!)
+    initiator.parseHandshakeMessage(responder.nextHandshakeMessage()!)
+    responder.parseHandshakeMessage(initiator.nextHandshakeMessage()!)
+
+    initiator.verificationData(withByteLength: 32)
+    responder.verificationData(withByteLength: 32)
+    initiator.verifyHandshake()
+    responder.verifyHandshake()
+
+    return initiator.saveSession()!
+  }
+}
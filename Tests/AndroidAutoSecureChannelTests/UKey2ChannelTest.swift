@@ -32,7 +32,7 @@ class UKey2ChannelTest: XCTestCase {
     continueAfterFailure = false
 
     messageStream = FakeMessageStream(peripheral: FakePeripheral())
-    ukey2Channel = UKey2Channel()
+    ukey2Channel = UKey2Channel(handshakeExecutor: InlineHandshakeExecutor())
   }
 
   // MARK: - establish(with:readCharacteristic:) tests.
@@ -66,6 +66,40 @@ class UKey2ChannelTest: XCTestCase {
     XCTAssertThrowsError(try ukey2Channel.establish(using: messageStream))
   }
 
+  func testEstablish_prewarmedChannelSendsInitMessage() {
+    ukey2Channel.prewarm()
+    XCTAssertTrue(ukey2Channel.isPrewarmed)
+
+    XCTAssertNoThrow(try ukey2Channel.establish(using: messageStream))
+    XCTAssertFalse(ukey2Channel.isPrewarmed)
+    XCTAssertEqual(messageStream.writtenData.count, 1)
+
+    let car = UKey2Wrapper(role: .responder)
+    XCTAssertTrue(car.parseHandshakeMessage(messageStream.writtenData[0]).isSuccessful)
+  }
+
+  func testEstablish_prewarmedChannelCompletesHandshake() {
+    ukey2Channel.prewarm()
+
+    let car = setUpHandshake(phoneChannel: ukey2Channel)
+    XCTAssertEqual(ukey2Channel.state, .verificationNeeded)
+
+    XCTAssertNoThrow(try ukey2Channel.notifyPairingCodeAccepted())
+    XCTAssertTrue(car.verifyHandshake())
+    XCTAssertEqual(ukey2Channel.state, .established)
+  }
+
+  func testEstablish_prewarmIsUsedOnlyOnce() {
+    ukey2Channel.prewarm()
+
+    XCTAssertNoThrow(try ukey2Channel.establish(using: messageStream))
+    XCTAssertNoThrow(try ukey2Channel.establish(using: messageStream))
+
+    // Each establishment must use its own ephemeral keys.
+    XCTAssertEqual(messageStream.writtenData.count, 2)
+    XCTAssertNotEqual(messageStream.writtenData[0], messageStream.writtenData[1])
+  }
+
   // MARK: - Continue handshake tests.
 
   func testHandshakeFlow_leadsToVerificationNeeded() {
@@ -118,6 +152,66 @@ class UKey2ChannelTest: XCTestCase {
     XCTAssertTrue(delegateMock.encounteredErrorCalled)
   }
 
+  // MARK: - Handshake executor tests.
+
+  func testHandshakeFlow_computesOnExecutorBeforeResponding() {
+    let executor = ManualHandshakeExecutor()
+    ukey2Channel = UKey2Channel(handshakeExecutor: executor)
+
+    XCTAssertNoThrow(try ukey2Channel.establish(using: messageStream))
+
+    let car = UKey2Wrapper(role: .responder)
+    car.parseHandshakeMessage(messageStream.writtenData[0])
+    simulateMessageFromCar(car.nextHandshakeMessage()!)
+
+    // Nothing is sent until the executor has run the handshake computation.
+    XCTAssertEqual(messageStream.writtenData.count, 1)
+    XCTAssertEqual(executor.pendingWorkCount, 1)
+
+    executor.runNext()
+
+    XCTAssertEqual(messageStream.writtenData.count, 2)
+    XCTAssertEqual(ukey2Channel.state, .verificationNeeded)
+  }
+
+  func testHandshakeFlow_processesQueuedMessagesInOrder() {
+    let delegateMock = SecureBLEChannelDelegateMock()
+    let executor = ManualHandshakeExecutor()
+    ukey2Channel = UKey2Channel(handshakeExecutor: executor)
+    ukey2Channel.delegate = delegateMock
+
+    XCTAssertNoThrow(try ukey2Channel.establish(using: messageStream))
+
+    let car = UKey2Wrapper(role: .responder)
+    car.parseHandshakeMessage(messageStream.writtenData[0])
+    simulateMessageFromCar(car.nextHandshakeMessage()!)
+
+    // A second message arriving while the first is in flight waits for it to complete.
+    simulateMessageFromCar(Data("unexpected".utf8))
+    XCTAssertEqual(executor.pendingWorkCount, 1)
+
+    executor.runNext()
+    XCTAssertEqual(ukey2Channel.state, .verificationNeeded)
+    XCTAssertEqual(executor.pendingWorkCount, 1)
+
+    executor.runNext()
+    XCTAssertTrue(delegateMock.encounteredErrorCalled)
+  }
+
+  func testHandshakeFlow_dispatchExecutorDeliversOnCallbackQueue() {
+    let callbackQueue = DispatchQueue(label: "UKey2ChannelTest.callback")
+    let executor = DispatchHandshakeExecutor(callbackQueue: callbackQueue)
+    let completed = expectation(description: "Handshake step completed")
+
+    executor.execute({ 42 }) { result in
+      dispatchPrecondition(condition: .onQueue(callbackQueue))
+      XCTAssertEqual(result, 42)
+      completed.fulfill()
+    }
+
+    wait(for: [completed], timeout: 1)
+  }
+
   // MARK: - Verification code tests.
 
   func testHandshakeFlow_notifiesDelegateThatVerificationIsNeeded() {
@@ -255,6 +349,194 @@ class UKey2ChannelTest: XCTestCase {
     XCTAssertEqual(try? ukey2Channel.decrypt(encryptedMessage), message)
   }
 
+  // MARK: - Rekey tests.
+
+  func testRekey_notUsedWithoutNegotiation() throws {
+    ukey2Channel = UKey2Channel(
+      rekeyPolicy: makeRekeyPolicy(maxMessages: 1), handshakeExecutor: InlineHandshakeExecutor())
+    let car = setUpHandshake(phoneChannel: ukey2Channel)
+    XCTAssertNoThrow(try ukey2Channel.notifyPairingCodeAccepted())
+    car.verifyHandshake()
+
+    let message = Data("Hello World".utf8)
+    for _ in 1...3 {
+      XCTAssertEqual(car.decode(try ukey2Channel.encrypt(message)), message)
+    }
+    XCTAssertNil(ukey2Channel.rekeyPolicy)
+  }
+
+  func testRekey_carCanDecryptAfterPhoneRotatesKey() throws {
+    ukey2Channel = UKey2Channel(
+      rekeyPolicy: makeRekeyPolicy(maxMessages: 2), handshakeExecutor: InlineHandshakeExecutor())
+    let car = setUpHandshake(phoneChannel: ukey2Channel)
+    XCTAssertNoThrow(try ukey2Channel.notifyPairingCodeAccepted())
+    car.verifyHandshake()
+
+    ukey2Channel.negotiateCapabilities([.sessionRekey])
+    ukey2Channel.waitForPendingKeyDerivations()
+
+    let message = Data("Hello World".utf8)
+    for _ in 1...2 {
+      let encrypted = try ukey2Channel.encrypt(message)
+      XCTAssertEqual(encrypted.first, 0)
+      XCTAssertEqual(car.decode(Data(encrypted.dropFirst())), message)
+    }
+
+    // The policy has been reached, so this message is sent under the next key.
+    let markedMessage = try ukey2Channel.encrypt(message)
+    XCTAssertEqual(markedMessage.first, 1)
+    let rotatedMessage = Data(markedMessage.dropFirst())
+    XCTAssertNil(car.decode(rotatedMessage))
+
+    let carSession = UKey2SavedSession(serialized: car.saveSession()!)!
+    let nextKey = UKey2SavedSession.nextKey(after: carSession.decodeKey, generation: 1)!
+    let rekeyedCar = UKey2Wrapper(
+      savedSession: carSession.replacingKey(for: .decode, with: nextKey).serialized)!
+
+    XCTAssertEqual(rekeyedCar.decode(rotatedMessage), message)
+  }
+
+  func testRekey_phoneCanDecryptAfterCarRotatesKey() throws {
+    let car = setUpHandshake(phoneChannel: ukey2Channel)
+    XCTAssertNoThrow(try ukey2Channel.notifyPairingCodeAccepted())
+    car.verifyHandshake()
+
+    ukey2Channel.negotiateCapabilities([.sessionRekey])
+    ukey2Channel.waitForPendingKeyDerivations()
+
+    let carSession = UKey2SavedSession(serialized: car.saveSession()!)!
+    let nextKey = UKey2SavedSession.nextKey(after: carSession.encodeKey, generation: 1)!
+    let rekeyedCar = UKey2Wrapper(
+      savedSession: carSession.replacingKey(for: .encode, with: nextKey).serialized)!
+
+    let message = Data("Hello World".utf8)
+    XCTAssertEqual(try ukey2Channel.decrypt(Data([1]) + rekeyedCar.encode(message)!), message)
+
+    // Later messages continue under the rotated key.
+    XCTAssertEqual(try ukey2Channel.decrypt(Data([1]) + rekeyedCar.encode(message)!), message)
+  }
+
+  func testRekey_doesNotTryRotatedKeyWithoutMarker() throws {
+    let car = setUpHandshake(phoneChannel: ukey2Channel)
+    XCTAssertNoThrow(try ukey2Channel.notifyPairingCodeAccepted())
+    car.verifyHandshake()
+
+    ukey2Channel.negotiateCapabilities([.sessionRekey])
+    ukey2Channel.waitForPendingKeyDerivations()
+
+    let carSession = UKey2SavedSession(serialized: car.saveSession()!)!
+    let nextKey = UKey2SavedSession.nextKey(after: carSession.encodeKey, generation: 1)!
+    let rekeyedCar = UKey2Wrapper(
+      savedSession: carSession.replacingKey(for: .encode, with: nextKey).serialized)!
+
+    // A message under the rotated key that claims the current generation is rejected.
+    XCTAssertThrowsError(
+      try ukey2Channel.decrypt(Data([0]) + rekeyedCar.encode(Data("Hello".utf8))!))
+  }
+
+  func testNegotiateCapabilities_refusedAfterEncryptedTraffic() throws {
+    let car = setUpHandshake(phoneChannel: ukey2Channel)
+    XCTAssertNoThrow(try ukey2Channel.notifyPairingCodeAccepted())
+    car.verifyHandshake()
+
+    let message = Data("Hello World".utf8)
+    XCTAssertEqual(car.decode(try ukey2Channel.encrypt(message)), message)
+
+    ukey2Channel.negotiateCapabilities([.sessionRekey])
+
+    XCTAssertNil(ukey2Channel.rekeyPolicy)
+    XCTAssertEqual(car.decode(try ukey2Channel.encrypt(message)), message)
+  }
+
+  func testRekey_rejectsMessagesFromUnknownKey() throws {
+    let car = setUpHandshake(phoneChannel: ukey2Channel)
+    XCTAssertNoThrow(try ukey2Channel.notifyPairingCodeAccepted())
+    car.verifyHandshake()
+
+    ukey2Channel.negotiateCapabilities([.sessionRekey])
+    ukey2Channel.waitForPendingKeyDerivations()
+
+    // Skipping a generation is not allowed.
+    let carSession = UKey2SavedSession(serialized: car.saveSession()!)!
+    let firstKey = UKey2SavedSession.nextKey(after: carSession.encodeKey, generation: 1)!
+    let secondKey = UKey2SavedSession.nextKey(after: firstKey, generation: 2)!
+    let rekeyedCar = UKey2Wrapper(
+      savedSession: carSession.replacingKey(for: .encode, with: secondKey).serialized)!
+
+    XCTAssertThrowsError(
+      try ukey2Channel.decrypt(Data([2]) + rekeyedCar.encode(Data("Hello".utf8))!))
+  }
+
+  // MARK: - Packet encryption tests.
+
+  func testPacketEncryption_notUsedWithoutNegotiation() {
+    let car = setUpHandshake(phoneChannel: ukey2Channel)
+    XCTAssertNoThrow(try ukey2Channel.notifyPairingCodeAccepted())
+    car.verifyHandshake()
+
+    ukey2Channel.negotiateCapabilities([.sessionRekey])
+
+    XCTAssertNil(messageStream.packetEncryptor)
+  }
+
+  func testPacketEncryption_carCanOpenPhonePackets() throws {
+    let car = setUpHandshake(phoneChannel: ukey2Channel)
+    XCTAssertNoThrow(try ukey2Channel.notifyPairingCodeAccepted())
+    car.verifyHandshake()
+
+    ukey2Channel.negotiateCapabilities([.packetEncryption])
+
+    let phoneEncryptor = try XCTUnwrap(messageStream.packetEncryptor)
+    let carSession = UKey2SavedSession(serialized: car.saveSession()!)!
+    let carEncryptor = try XCTUnwrap(AESGCMPacketEncryptor(session: carSession))
+
+    let header = Data([0x80, 0, 1, 0])
+    let body = Data("Hello World".utf8)
+    let phonePacket = try phoneEncryptor.seal(body, authenticating: header)
+    XCTAssertEqual(try carEncryptor.open(phonePacket, authenticating: header), body)
+
+    let carPacket = try carEncryptor.seal(body, authenticating: header)
+    XCTAssertEqual(try phoneEncryptor.open(carPacket, authenticating: header), body)
+  }
+
+  func testPacketEncryption_takesPrecedenceOverRekeying() throws {
+    let car = setUpHandshake(phoneChannel: ukey2Channel)
+    XCTAssertNoThrow(try ukey2Channel.notifyPairingCodeAccepted())
+    car.verifyHandshake()
+
+    ukey2Channel.negotiateCapabilities([.sessionRekey, .packetEncryption])
+
+    XCTAssertNotNil(messageStream.packetEncryptor)
+    XCTAssertNil(ukey2Channel.rekeyPolicy)
+
+    // Messages are encrypted under the original traffic keys without a generation marker.
+    let message = Data("Hello World".utf8)
+    XCTAssertEqual(car.decode(try ukey2Channel.encrypt(message)), message)
+  }
+
+  func testPacketEncryption_notEnabledAfterEncryptedMessages() throws {
+    let car = setUpHandshake(phoneChannel: ukey2Channel)
+    XCTAssertNoThrow(try ukey2Channel.notifyPairingCodeAccepted())
+    car.verifyHandshake()
+    messageStream.hasExchangedEncryptedMessages = true
+
+    ukey2Channel.negotiateCapabilities([.packetEncryption])
+
+    XCTAssertNil(messageStream.packetEncryptor)
+  }
+
+  func testPacketEncryption_clearedOnReestablishment() {
+    let car = setUpHandshake(phoneChannel: ukey2Channel)
+    XCTAssertNoThrow(try ukey2Channel.notifyPairingCodeAccepted())
+    car.verifyHandshake()
+    ukey2Channel.negotiateCapabilities([.packetEncryption])
+    XCTAssertNotNil(messageStream.packetEncryptor)
+
+    XCTAssertNoThrow(try ukey2Channel.establish(using: messageStream))
+
+    XCTAssertNil(messageStream.packetEncryptor)
+  }
+
   // MARK - Operation type check tests.
 
   func testOperationType_respectedForV2Stream() {
@@ -355,6 +637,36 @@ class UKey2ChannelTest: XCTestCase {
     }
   }
 
+  func testReconnection_withPrewarmedSavedSession() {
+    let car = setUpHandshake(phoneChannel: ukey2Channel)
+    XCTAssertNoThrow(try ukey2Channel.notifyPairingCodeAccepted())
+    car.verifyHandshake()
+
+    let phoneSession = try! ukey2Channel.saveSession()
+    messageStream.writtenData = []
+
+    ukey2Channel.prewarm(savedSession: phoneSession)
+    XCTAssertNoThrow(
+      try ukey2Channel.establish(using: messageStream, withSavedSession: phoneSession))
+
+    XCTAssertEqual(ukey2Channel.state, .inProgress)
+    XCTAssertEqual(messageStream.writtenData.count, 1)
+  }
+
+  func testReconnection_prewarmedWithStaleSession_parsesGivenSession() {
+    let car = setUpHandshake(phoneChannel: ukey2Channel)
+    XCTAssertNoThrow(try ukey2Channel.notifyPairingCodeAccepted())
+    car.verifyHandshake()
+
+    let phoneSession = try! ukey2Channel.saveSession()
+    messageStream.writtenData = []
+
+    // The prewarmed session no longer matches, so the invalid one given must still be rejected.
+    ukey2Channel.prewarm(savedSession: phoneSession)
+    XCTAssertThrowsError(
+      try ukey2Channel.establish(using: messageStream, withSavedSession: Data("invalid".utf8)))
+  }
+
   func testReconnectionError_notifiesDelegate() {
     let delegateMock = SecureBLEChannelDelegateMock()
     ukey2Channel.delegate = delegateMock
@@ -411,6 +723,15 @@ class UKey2ChannelTest: XCTestCase {
     )
   }
 
+  /// Returns a rekey policy that is only triggered by the number of messages.
+  private func makeRekeyPolicy(maxMessages: Int) -> SessionRekeyPolicy {
+    return SessionRekeyPolicy(
+      maxMessages: maxMessages,
+      maxBytes: Int.max,
+      maxKeyAge: .greatestFiniteMagnitude
+    )
+  }
+
   /// Runs through the encryption flow and ensures a secure channel is set up between the given
   /// phone and a car.
   ///
@@ -441,6 +762,23 @@ class UKey2ChannelTest: XCTestCase {
 
 // MARK: - Mocks.
 
+/// A handshake executor that holds on to work until the test explicitly runs it.
+class ManualHandshakeExecutor: HandshakeExecutor {
+  private var pendingWork: [() -> Void] = []
+
+  var pendingWorkCount: Int { pendingWork.count }
+
+  func execute<Result>(_ work: @escaping () -> Result, completion: @escaping (Result) -> Void) {
+    pendingWork.append { completion(work()) }
+  }
+
+  /// Runs the oldest pending work item and delivers its completion.
+  func runNext() {
+    guard !pendingWork.isEmpty else { return }
+    pendingWork.removeFirst()()
+  }
+}
+
 /// A mock of `SecureBLEChannelDelegate` that allows for verification that its callback methods
 /// have been called.
 class SecureBLEChannelDelegateMock: SecureBLEChannelDelegate {
@@ -0,0 +1,110 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+import AndroidAutoUKey2Wrapper
+import XCTest
+
+@testable import AndroidAutoSecureChannel
+
+/// Unit tests for `UKey2SavedSession`.
+class UKey2SavedSessionTest: XCTestCase {
+  func testParse_roundTripsSavedSession() {
+    let savedSession = makeEstablishedSession().saveSession()!
+
+    let session = UKey2SavedSession(serialized: savedSession)
+
+    XCTAssertNotNil(session)
+    XCTAssertEqual(session?.serialized, savedSession)
+    XCTAssertEqual(session?.encodeKey.count, UKey2SavedSession.keyLength)
+    XCTAssertEqual(session?.decodeKey.count, UKey2SavedSession.keyLength)
+  }
+
+  func testParse_rejectsInvalidLength() {
+    XCTAssertNil(UKey2SavedSession(serialized: Data(repeating: 1, count: 10)))
+  }
+
+  func testParse_rejectsUnknownVersion() {
+    var savedSession = makeEstablishedSession().saveSession()!
+    savedSession[0] = 2
+
+    XCTAssertNil(UKey2SavedSession(serialized: savedSession))
+  }
+
+  func testParse_acceptsSlice() {
+    let savedSession = makeEstablishedSession().saveSession()!
+    let framed = Data([0xFF]) + savedSession
+
+    let session = UKey2SavedSession(serialized: framed.dropFirst())
+
+    XCTAssertEqual(session?.serialized, savedSession)
+  }
+
+  func testZeroize_clearsKeys() {
+    var session = UKey2SavedSession(serialized: makeEstablishedSession().saveSession()!)!
+
+    session.zeroize()
+
+    let zeroKey = Data(repeating: 0, count: UKey2SavedSession.keyLength)
+    XCTAssertEqual(session.encodeKey, zeroKey)
+    XCTAssertEqual(session.decodeKey, zeroKey)
+  }
+
+  func testNextKey_isDeterministicPerGeneration() {
+    let key = Data(repeating: 7, count: UKey2SavedSession.keyLength)
+
+    let first = UKey2SavedSession.nextKey(after: key, generation: 1)
+    let firstAgain = UKey2SavedSession.nextKey(after: key, generation: 1)
+    let second = UKey2SavedSession.nextKey(after: key, generation: 2)
+
+    XCTAssertEqual(first, firstAgain)
+    XCTAssertNotEqual(first, second)
+    XCTAssertNotEqual(first, key)
+    XCTAssertEqual(first?.count, UKey2SavedSession.keyLength)
+  }
+
+  func testReplacingKey_resetsSequenceNumberOfReplacedDirection() {
+    let wrapper = makeEstablishedSession()
+    _ = wrapper.encode(Data("message".utf8))
+    let session = UKey2SavedSession(serialized: wrapper.saveSession()!)!
+    XCTAssertGreaterThan(session.encodeSequenceNumber, 0)
+
+    let newKey = Data(repeating: 3, count: UKey2SavedSession.keyLength)
+    let rekeyed = session.replacingKey(for: .encode, with: newKey)
+
+    XCTAssertEqual(rekeyed.encodeKey, newKey)
+    XCTAssertEqual(rekeyed.encodeSequenceNumber, 0)
+    XCTAssertEqual(rekeyed.decodeKey, session.decodeKey)
+    XCTAssertEqual(rekeyed.decodeSequenceNumber, session.decodeSequenceNumber)
+    XCTAssertNotNil(UKey2Wrapper(savedSession: rekeyed.serialized))
+  }
+
+  // MARK: - Helper functions.
+
+  /// Runs a full handshake between an initiator and a responder and returns the initiator.
+  private func makeEstablishedSession() -> UKey2Wrapper {
+    let initiator = UKey2Wrapper(role: .initiator)
+    let responder = UKey2Wrapper(role: .responder)
+
+    responder.parseHandshakeMessage(initiator.nextHandshakeMessage()!)
+    initiator.parseHandshakeMessage(responder.nextHandshakeMessage()!)
+    responder.parseHandshakeMessage(initiator.nextHandshakeMessage()!)
+
+    initiator.verificationData(withByteLength: 32)
+    responder.verificationData(withByteLength: 32)
+    initiator.verifyHandshake()
+    responder.verifyHandshake()
+
+    return initiator
+  }
+}